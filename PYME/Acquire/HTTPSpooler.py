@@ -34,6 +34,7 @@ import PYME.Acquire.Spooler as sp
 #from PYME.ParallelTasks.relativeFiles import getRelFilename
 
 import threading
+import multiprocessing
 
 try:
     # noinspection PyCompatibility
@@ -44,12 +45,14 @@ except ImportError:
 
 from PYME.IO import clusterIO
 from PYME.IO import PZFFormat
+from PYME.IO import EventLogFormat
 
 import numpy as np
 import random
 from PYME import config
 
 import json
+import socket
 
 import logging
 logger = logging.getLogger(__name__)
@@ -60,6 +63,7 @@ class EventLogger:
         #self.scope = scope
           
         self._events = []
+        self._n_streamed = 0
         self._event_lock = threading.Lock()
     
     def logEvent(self, eventName, eventDescr = '', timestamp=None):
@@ -74,6 +78,14 @@ class EventLogger:
         
     def to_JSON(self):
         return json.dumps(self._events)
+    
+    def new_events(self):
+        """The events logged since the last call (used to stream the event log)"""
+        with self._event_lock:
+            events = self._events[self._n_streamed:]
+            self._n_streamed = len(self._events)
+            
+        return events
           
 
 def genSequenceID(filename=''):
@@ -100,6 +112,54 @@ def exists(seriesName):
 NUM_POLL_THREADS = 10
 QUEUE_MAX_SIZE = 200 # ~10k frames
 
+# Compression runs in its own pool of threads, separate from the upload threads, so that slow uploads don't hold up
+# compression and vice versa. The huffman coding in pymecompress releases the GIL, so these compress in parallel.
+NUM_COMPRESSION_THREADS = max(min(multiprocessing.cpu_count() // 2, 8), 1)
+
+class SpoolingStats(object):
+    """
+    Throughput and latency counters for the compression and upload stages of the spooler. Used to see when spooling is
+    about to fall behind the camera.
+    """
+    # upper edges of the upload latency histogram bins [s]. The last bin catches everything longer.
+    LATENCY_BINS = [.005, .01, .02, .05, .1, .2, .5, 1., 2., 5.]
+    
+    def __init__(self):
+        self._lock = threading.Lock()
+        
+        self.n_frames_compressed = 0
+        self.raw_bytes = 0
+        self.compressed_bytes = 0
+        self.compression_time = 0
+        
+        self.n_uploads = 0
+        self.upload_time = 0
+        self.upload_latency_hist = [0]*(len(self.LATENCY_BINS) + 1)
+        
+    def record_compression(self, n_frames, raw_bytes, compressed_bytes, dt):
+        with self._lock:
+            self.n_frames_compressed += n_frames
+            self.raw_bytes += raw_bytes
+            self.compressed_bytes += compressed_bytes
+            self.compression_time += dt
+            
+    def record_upload(self, dt):
+        with self._lock:
+            self.n_uploads += 1
+            self.upload_time += dt
+            self.upload_latency_hist[int(np.searchsorted(self.LATENCY_BINS, dt))] += 1
+            
+    def to_dict(self):
+        with self._lock:
+            return {'frames_compressed' : self.n_frames_compressed,
+                    # throughput of a single compression thread
+                    'compression_MBps' : 1e-6*self.raw_bytes/max(self.compression_time, 1e-9),
+                    'compression_ratio' : float(self.raw_bytes)/max(self.compressed_bytes, 1),
+                    'n_uploads' : self.n_uploads,
+                    'mean_upload_latency' : self.upload_time/max(self.n_uploads, 1),
+                    'upload_latency_bins' : list(self.LATENCY_BINS),
+                    'upload_latency_hist' : list(self.upload_latency_hist)}
+
 defaultCompSettings = {
     'compression' : PZFFormat.DATA_COMP_HUFFCODE,
     'quantization' : PZFFormat.DATA_QUANT_NONE,
@@ -125,23 +185,53 @@ class Spooler(sp.Spooler):
                                         config.get('dataserver-filter', ''))
         self._buffer = []
         
+        # frames from the frameWrangler's frame ring are compressed in place, rather than copied. We register as a
+        # consumer of the ring so that we can tell the producer which frames we are still using, and keep track of
+        # which frames are waiting to be compressed.
+        self._ring_consumer = None
+        self._ring_outstanding = set()
+        self._ring_next = 0
+        self._ring_lock = threading.Lock()
+        self._ring_released = threading.Condition(self._ring_lock)
+        self._n_lost_frames = 0
+        
+        # By default, the camera thread waits (as it would on a full queue) if it is about to overwrite a frame we are
+        # still compressing. Setting `httpspooler-lossy-ring` lets the camera run on regardless, at the cost of
+        # dropping those frames (counted in `HTTPSpooler.LostFrames`).
+        self._lossy_ring = config.get('httpspooler-lossy-ring', False)
+        
         self.buflen = config.get('httpspooler-chunksize', 50)
         
+        # chunks of frames wait in _postQueue to be compressed, and are then passed to _uploadQueue
         self._postQueue = Queue.Queue(QUEUE_MAX_SIZE)
+        self._uploadQueue = Queue.Queue(QUEUE_MAX_SIZE)
+        
+        # events are streamed to a binary log (see PYME.IO.EventLogFormat) during acquisition, so that they are
+        # available (and safe) before the series finishes. A json copy is still saved at the end for older readers.
+        # When aggregating into a .h5 file, events are saved in the .h5 instead.
+        self._stream_events = (not self._aggregate_h5) and config.get('httpspooler-binary-events', True)
+        self._events_url = None
+        self._eventQueue = Queue.Queue()
         self._dPoll = True
         self._stopping = False
         self._lock = threading.Lock()
         
         self._last_thread_exception = None
-
-        self._numThreadsProcessing = 0
+        
+        self.stats = SpoolingStats()
+        self._last_backlog_warning = 0
+        
+        n_compression_threads = config.get('httpspooler-compression-threads', NUM_COMPRESSION_THREADS)
+        self._n_compression_running = n_compression_threads
+        self._n_upload_running = NUM_POLL_THREADS
         
         self._pollThreads = []
-        for i in range(NUM_POLL_THREADS):
-            pt = threading.Thread(target=self._queuePoll)
-            pt.daemon = False
-            pt.start()
-            self._pollThreads.append(pt)
+        for target, n_threads in [(self._compressPoll, n_compression_threads), (self._uploadPoll, NUM_POLL_THREADS)]:
+            for i in range(n_threads):
+                pt = threading.Thread(target=target)
+                pt.daemon = False
+                pt.start()
+                self._pollThreads.append(pt)
         
         self.md = MetaDataHandler.NestedClassMDHandler()
         self.evtLogger = EventLogger(self)
@@ -172,44 +262,128 @@ class Spooler(sp.Spooler):
             assert(scale >=.001)
             assert(scale <= 100)
             
-    def _queuePoll(self):
-        while self._dPoll:
-            try:
-                data = self._postQueue.get_nowait()
-
-                with self._lock:
-                    self._numThreadsProcessing += 1
-
+    def _compressPoll(self):
+        try:
+            while self._dPoll:
                 try:
+                    data = self._postQueue.get(timeout=.01)
+                except Queue.Empty:
+                    if self._stopping:
+                        break
+                    else:
+                        continue
+                
+                try:
+                    t0 = time.time()
+                    raw_bytes = 0
+                    compressed_bytes = 0
+                    
+                    with self._ring_lock:
+                        # claim the frames, so that OnFrame doesn't try to copy them out of the ring under us
+                        for entry in data:
+                            entry[4] = True
+                        data = [tuple(entry) for entry in data]
+                        
                     files = []
-                    for imNum, frame in data:
+                    ring_frames = []
+                    for imNum, frame, ring, frameNum, claimed in data:
                         if self._aggregate_h5:
                             fn = '/'.join(['__aggregate_h5', self.seriesName, 'frame%05d.pzf' % imNum])
                         else:
                             fn = '/'.join([self.seriesName, 'frame%05d.pzf' % imNum])
                             
                         pzf = PZFFormat.dumps(frame, sequenceID=self.sequenceID, frameNum = imNum, **self.compSettings)
+                        raw_bytes += frame.nbytes
+                        compressed_bytes += len(pzf)
+                        
+                        if ring is not None:
+                            ring_frames.append((ring, frameNum))
+                            if not ring.is_valid(frameNum):
+                                # the producer lapped us whilst we were compressing - the data is no longer good
+                                logger.error('Frame %d was overwritten in the frame ring before it could be saved' % imNum)
+                                with self._lock:
+                                    self._n_lost_frames += 1
+                                continue
 
                         files.append((fn, pzf))
+                        
+                    self._release_ring_frames(ring_frames)
+                    self.stats.record_compression(len(data), raw_bytes, compressed_bytes, time.time() - t0)
 
                     if len(files) > 0:
-                        clusterIO.put_files(files, serverfilter=self.clusterFilter)
+                        self._queue_upload(files)
                         
                 except Exception as e:
                     self._last_thread_exception = e
-                    logging.exception('Exception whilst putting files')
+                    logging.exception('Exception whilst compressing files')
                     raise
-                finally:
+        finally:
+            with self._lock:
+                self._n_compression_running -= 1
+                
+    def _queue_upload(self, files):
+        """Pass a chunk of compressed frames to the upload threads, without blocking forever if they have gone away"""
+        while True:
+            try:
+                self._uploadQueue.put(files, timeout=.1)
+                return
+            except Queue.Full:
+                if not self._dPoll:
+                    # we've been cleaned up (e.g. acquisition aborted) - nobody is going to upload this chunk
+                    logger.error('Spooler shut down before frames could be queued for upload')
                     with self._lock:
-                        self._numThreadsProcessing -= 1
-
-                time.sleep(.01)
-                #print 't', len(data)
-            except Queue.Empty:
-                if self._stopping:
-                    self._dPoll = False
-                else:
-                    time.sleep(.01)
+                        self._n_lost_frames += len(files)
+                    return
+                
+                if self._n_upload_running == 0:
+                    raise RuntimeError('Upload threads are no longer running - cannot queue frames for upload')
+                
+    def _put_events(self, chunk):
+        s = clusterIO._getSession(self._events_url)
+        r = s.put(self._events_url, data=chunk, timeout=5)
+        if not r.status_code == 200:
+            raise RuntimeError('Put of events failed with %d: %s' % (r.status_code, r.content))
+        
+    def _flush_events(self):
+        """Queue any new events to be appended to the binary event log"""
+        if self._events_url is not None:
+            events = self.evtLogger.new_events()
+            if len(events) > 0:
+                self._eventQueue.put(EventLogFormat.dumps(events))
+    
+    def _uploadPoll(self):
+        try:
+            while self._dPoll:
+                try:
+                    chunk = self._eventQueue.get_nowait()
+                    self._put_events(chunk)
+                except Queue.Empty:
+                    pass
+                except Exception as e:
+                    self._last_thread_exception = e
+                    logging.exception('Exception whilst putting events')
+                    raise
+                
+                try:
+                    files = self._uploadQueue.get(timeout=.01)
+                except Queue.Empty:
+                    # only stop once all the compression threads are done
+                    if self._stopping and (self._n_compression_running == 0):
+                        break
+                    else:
+                        continue
+                    
+                try:
+                    t0 = time.time()
+                    clusterIO.put_files(files, serverfilter=self.clusterFilter)
+                    self.stats.record_upload(time.time() - t0)
+                except Exception as e:
+                    self._last_thread_exception = e
+                    logging.exception('Exception whilst putting files')
+                    raise
+        finally:
+            with self._lock:
+                self._n_upload_running -= 1
                 
     def finished(self):
         if not self._last_thread_exception is None:
@@ -217,7 +391,20 @@ class Spooler(sp.Spooler):
             logging.error('An exception occurred in one of the spooling threads')
             raise RuntimeError('An exception occurred in one of the spooling threads')
         else:
-            return (not self._dPoll) and self._postQueue.empty() and (self._numThreadsProcessing == 0)
+            finished = (self._n_compression_running == 0) and (self._n_upload_running == 0)
+            if finished:
+                self._close_ring_consumer()
+                
+            return finished
+        
+    def status(self):
+        status = sp.Spooler.status(self)
+        status.update(self.stats.to_dict())
+        status.update({'compression_queue' : self._postQueue.qsize(),
+                       'upload_queue' : self._uploadQueue.qsize(),
+                       'max_queue_size' : QUEUE_MAX_SIZE,
+                       'lost_frames' : self._n_lost_frames})
+        return status
 
         
     def getURL(self):
@@ -230,11 +417,17 @@ class Spooler(sp.Spooler):
         logger.debug('Starting spooling: %s' %self.seriesName)
         
         if self._aggregate_h5:
-            #NOTE: allow a longer timeout than normal here as __aggregate with metadata waits for a lock on the server side before
-            # actually adding (and is therefore susceptible to longer latencies than most operations). FIXME - remove server side lock.
-            clusterIO.put_file('__aggregate_h5/' + self.seriesName + '/metadata.json', self.md.to_JSON().encode(), serverfilter=self.clusterFilter, timeout=3)
+            # NOTE: the server queues metadata (and frames) for its .h5 writer thread, so this doesn't wait on the
+            # server side pytables lock.
+            clusterIO.put_file('__aggregate_h5/' + self.seriesName + '/metadata.json', self.md.to_JSON().encode(), serverfilter=self.clusterFilter)
         else:
             clusterIO.put_file(self.seriesName + '/metadata.json', self.md.to_JSON().encode(), serverfilter=self.clusterFilter)
+            
+            if self._stream_events:
+                # pick a server for the event log up front, so that all the chunks get appended to the same file
+                name, info = clusterIO._chooseServer(self.clusterFilter)
+                self._events_url = 'http://%s:%d/__aggregate_txt/%s/events.pev' % (socket.inet_ntoa(info.address),
+                                                                                  info.port, self.seriesName)
     
     def finalise(self):
         # wait until our input queue is empty rather than immediately stopping saving.
@@ -252,16 +445,33 @@ class Spooler(sp.Spooler):
             # TODO - is there actually a performance impact that justifies this config option, or is it purely theoretical
             for pt in self._pollThreads:
                 pt.join()
+                
+            self._close_ring_consumer()
 
         # remove our reference to the threads which hold back-references preventing garbage collection
         del(self._pollThreads)
         
+        if self._n_lost_frames > 0:
+            logger.error('%d frames were lost as spooling could not keep up with the camera' % self._n_lost_frames)
+            self.md['HTTPSpooler.LostFrames'] = self._n_lost_frames
+        
         # save events and final metadata
-        # TODO - use a binary format for saving events - they can be quite
-        # numerous, and can trip the standard 1 s clusterIO.put_file timeout.
-        # Use long timeouts as a temporary hack because failing these can ruin
-        # a dataset
-        if self._aggregate_h5:
+        # Use long timeouts for the json events as they can be quite numerous, and can trip the standard 1 s
+        # clusterIO.put_file timeout. Failing these can ruin a dataset.
+        if self._events_url is not None:
+            # the events have been streamed to the binary event log as we went - just send what's left. events.json
+            # is still written in the usual (list) format, as it marks the series as complete, and is what
+            # readers which don't know about the binary log use.
+            self._flush_events()
+            while not self._eventQueue.empty():
+                self._put_events(self._eventQueue.get_nowait())
+                
+            clusterIO.put_file(self.seriesName + '/final_metadata.json',
+                               self.md.to_JSON().encode(), self.clusterFilter)
+            clusterIO.put_file(self.seriesName + '/events.json',
+                               self.evtLogger.to_JSON().encode(),
+                               self.clusterFilter, timeout=10)
+        elif self._aggregate_h5:
             clusterIO.put_file('__aggregate_h5/' + self.seriesName + '/final_metadata.json', 
                                self.md.to_JSON().encode(), self.clusterFilter)
             clusterIO.put_file('__aggregate_h5/' + self.seriesName + '/events.json', 
@@ -275,12 +485,127 @@ class Spooler(sp.Spooler):
                                self.clusterFilter, timeout=10)
         
         
-    def OnFrame(self, sender, frameData, **kwargs):
-        # NOTE: copy is now performed in frameWrangler, so we don't need to worry about it here
+    def _get_ring_consumer(self, ring):
+        if (self._ring_consumer is None) or not (self._ring_consumer.ring is ring):
+            # new ring (the frameWrangler re-allocates it if the frame size changes). Frames still waiting in the
+            # old ring are safe as nothing else will be written to it.
+            self._close_ring_consumer()
+            try:
+                self._ring_consumer = ring.register_consumer()
+            except RuntimeError:
+                logger.exception('Could not register with frame ring, copying frames instead')
+                return None
+            
+        return self._ring_consumer
+    
+    def _close_ring_consumer(self):
+        with self._ring_lock:
+            if self._ring_consumer is not None:
+                self._ring_consumer.close()
+                self._ring_consumer = None
+                self._ring_outstanding.clear()
+    
+    def _release_ring(self):
+        # NB - must be called with self._ring_lock held
+        if len(self._ring_outstanding) > 0:
+            self._ring_consumer.release(min(self._ring_outstanding))
+        else:
+            self._ring_consumer.release(self._ring_next)
+        
+        self._ring_released.notify_all()
+    
+    def _release_ring_frames(self, ring_frames):
+        """Let the frame ring know that we are finished with a set of frames"""
+        with self._ring_lock:
+            consumer = self._ring_consumer
+            if consumer is None:
+                return
+            
+            for ring, frameNum in ring_frames:
+                if ring is consumer.ring:
+                    self._ring_outstanding.discard(frameNum)
+            
+            self._release_ring()
+            
+    def _spill_ring_frames(self):
+        """
+        Copy any frames which are waiting to be compressed out of the frame ring so that the camera can't overwrite
+        them. Called when we are falling behind.
+        """
+        with self._postQueue.mutex:
+            chunks = list(self._postQueue.queue)
+            
+        with self._ring_lock:
+            for chunk in chunks + [self._buffer]:
+                for entry in chunk:
+                    imNum, frame, ring, frameNum, claimed = entry
+                    if (ring is not None) and not claimed:
+                        frame = frame.copy()
+                        if ring.is_valid(frameNum):
+                            entry[1] = frame
+                            entry[2] = None
+                            self._ring_outstanding.discard(frameNum)
+            
+            self._release_ring()
+    
+    def _wait_for_ring(self, consumer, ring):
+        """
+        Block the camera thread until the next frame written to the ring will not overwrite a frame we are still
+        compressing (any frames not yet claimed for compression have already been copied out by _spill_ring_frames()).
+        This gives us the same backpressure as blocking on a full _postQueue.
+        """
+        with self._ring_lock:
+            t0 = None
+            while (self._ring_consumer is consumer) and self._dPoll and (self._n_compression_running > 0):
+                write, read, overflows = consumer.state
+                if (write - read) < ring.n_slots:
+                    break
+                
+                if t0 is None:
+                    t0 = time.time()
+                    logger.debug('Frame ring full, waiting for compression to catch up')
+                    
+                self._ring_released.wait(.1)
+                
+            if t0 is not None:
+                logger.debug('Camera thread blocked for %3.3f s waiting for compression' % (time.time() - t0))
+        
+    def OnFrame(self, sender, frameData, frameNum=-1, frameRing=None, **kwargs):
+        ring = None
+        if (frameRing is not None) and (frameNum >= 0):
+            consumer = self._get_ring_consumer(frameRing)
+            if consumer is not None:
+                write, read, overflows = consumer.state
+                if (write - read) >= frameRing.n_slots // 2:
+                    # we are falling behind - copy frames out of the ring rather than let the camera overwrite
+                    # frames we haven't saved yet.
+                    logger.debug('Spooling falling behind camera, copying frames out of frame ring')
+                    self._spill_ring_frames()
+                    write, read, overflows = consumer.state
+                    
+                # Use the frame in place if the ring is still holding it for us.
+                use_ring = (frameNum >= read) and ((write - read) < frameRing.n_slots // 2)
+                with self._ring_lock:
+                    self._ring_next = frameNum + 1
+                    if use_ring:
+                        ring = frameRing
+                        self._ring_outstanding.add(frameNum)
+                    else:
+                        self._release_ring()
+                
+                if not self._lossy_ring:
+                    self._wait_for_ring(consumer, frameRing)
+        
+            if ring is None:
+                # not using the frame in place, take a copy as the ring is free to re-use the memory
+                frameData = frameData.copy()
+        
+        # NB - buffer entries are lists as _spill_ring_frames() can replace the frame with a copy
         if frameData.shape[0] == 1:
-            self._buffer.append((self.imNum, frameData))
+            self._buffer.append([self.imNum, frameData, ring, frameNum, False])
         else:
-            self._buffer.append((self.imNum, frameData.reshape(1, frameData.shape[0], frameData.shape[1])))
+            self._buffer.append([self.imNum, frameData.reshape(1, frameData.shape[0], frameData.shape[1]), ring,
+                                 frameNum, False])
 
         #print len(self.buffer)
         t = time.time()
@@ -294,10 +619,20 @@ class Spooler(sp.Spooler):
         
     def cleanup(self):
         self._dPoll = False
+        self._close_ring_consumer()
       
     def FlushBuffer(self):
       self._postQueue.put(self._buffer)
       self._buffer = []
+      self._flush_events()
+      
+      backlog = max(self._postQueue.qsize(), self._uploadQueue.qsize())
+      t = time.time()
+      if (backlog > 0.8*QUEUE_MAX_SIZE) and (t > (self._last_backlog_warning + 5)):
+          # we are about to start blocking the camera thread
+          self._last_backlog_warning = t
+          logger.warning('Spooling is falling behind: %d chunks waiting for compression, %d for upload (max %d). Stats: %s'
+                         % (self._postQueue.qsize(), self._uploadQueue.qsize(), QUEUE_MAX_SIZE, self.stats.to_dict()))
      
 
 
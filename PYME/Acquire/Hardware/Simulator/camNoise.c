@@ -0,0 +1,385 @@
+/*
+##################
+# camNoise.c
+#
+# Copyright David Baddeley, 2019
+# d.baddeley@auckland.ac.nz
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+##################
+ */
+
+/*
+Camera noise model for the simulator (see fakeCam.NoiseMaker.noisify).
+
+Each pixel gets Gaussian read noise (with an optional per-pixel offset and read noise map for sCMOS cameras) and,
+if the shutter is open, scaled Poisson shot noise with the EMCCD excess noise factor folded in.
+
+Random numbers come from a Philox4x32-10 counter based generator. The counter is (pixel, draw, frame index), so that
+every pixel has its own independent stream, and the noise for a given seed and frame index is the same no matter how
+the frame is split between threads.
+*/
+
+#include "Python.h"
+#include <math.h>
+#include "numpy/arrayobject.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define MIN(a, b) ((a<b) ? a : b)
+#define MAX(a, b) ((a>b) ? a : b)
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define PHILOX_M0 0xD2511F53U
+#define PHILOX_M1 0xCD9E8D57U
+#define PHILOX_W0 0x9E3779B9U
+#define PHILOX_W1 0xBB67AE85U
+
+/* switch from inversion to transformed rejection for Poisson means above this */
+#define POISSON_PTRS_LAMBDA 10.0
+
+typedef struct {
+    uint32_t key[2];
+    uint32_t ctr[4];
+    uint32_t out[4];
+    int idx;
+} philox_stream_t;
+
+static void philox4x32_10(const uint32_t *ctr_in, const uint32_t *key_in, uint32_t *out)
+{
+    uint32_t c0 = ctr_in[0], c1 = ctr_in[1], c2 = ctr_in[2], c3 = ctr_in[3];
+    uint32_t k0 = key_in[0], k1 = key_in[1];
+    uint64_t p0, p1;
+    int r;
+
+    for (r = 0; r < 10; r++)
+    {
+        if (r > 0)
+        {
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+
+        p0 = (uint64_t) PHILOX_M0 * c0;
+        p1 = (uint64_t) PHILOX_M1 * c2;
+
+        c0 = ((uint32_t) (p1 >> 32)) ^ c1 ^ k0;
+        c2 = ((uint32_t) (p0 >> 32)) ^ c3 ^ k1;
+        c1 = (uint32_t) p1;
+        c3 = (uint32_t) p0;
+    }
+
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+#define PHILOX_ROUND(k0, k1) {\
+        p0 = (uint64_t) PHILOX_M0 * c0;\
+        p1 = (uint64_t) PHILOX_M1 * c2;\
+        c0 = ((uint32_t) (p1 >> 32)) ^ c1 ^ (k0);\
+        c2 = ((uint32_t) (p0 >> 32)) ^ c3 ^ (k1);\
+        c1 = (uint32_t) p1;\
+        c3 = (uint32_t) p0;\
+        }
+
+/*
+The first block of the streams of n consecutive pixels, as structure of arrays. This is the bulk of the random numbers
+we need, and the straight line code lets the compiler vectorise it.
+*/
+static void philox_first_blocks(uint32_t pixel0, int n, uint64_t seed, uint64_t frame,
+                                uint32_t *o0, uint32_t *o1, uint32_t *o2, uint32_t *o3)
+{
+    uint32_t k0 = (uint32_t) seed, k1 = (uint32_t) (seed >> 32);
+    uint32_t f0 = (uint32_t) frame, f1 = (uint32_t) (frame >> 32);
+    uint32_t c0, c1, c2, c3;
+    uint64_t p0, p1;
+    int j;
+
+    for (j = 0; j < n; j++)
+    {
+        c0 = pixel0 + (uint32_t) j;
+        c1 = 0;
+        c2 = f0;
+        c3 = f1;
+
+        PHILOX_ROUND(k0, k1)
+        PHILOX_ROUND(k0 + 1*PHILOX_W0, k1 + 1*PHILOX_W1)
+        PHILOX_ROUND(k0 + 2*PHILOX_W0, k1 + 2*PHILOX_W1)
+        PHILOX_ROUND(k0 + 3*PHILOX_W0, k1 + 3*PHILOX_W1)
+        PHILOX_ROUND(k0 + 4*PHILOX_W0, k1 + 4*PHILOX_W1)
+        PHILOX_ROUND(k0 + 5*PHILOX_W0, k1 + 5*PHILOX_W1)
+        PHILOX_ROUND(k0 + 6*PHILOX_W0, k1 + 6*PHILOX_W1)
+        PHILOX_ROUND(k0 + 7*PHILOX_W0, k1 + 7*PHILOX_W1)
+        PHILOX_ROUND(k0 + 8*PHILOX_W0, k1 + 8*PHILOX_W1)
+        PHILOX_ROUND(k0 + 9*PHILOX_W0, k1 + 9*PHILOX_W1)
+
+        o0[j] = c0;
+        o1[j] = c1;
+        o2[j] = c2;
+        o3[j] = c3;
+    }
+}
+
+/* stream for a pixel, the first block of which has already been generated (see philox_first_blocks) */
+static void stream_init(philox_stream_t *s, uint64_t seed, uint64_t frame, uint32_t pixel, const uint32_t *first)
+{
+    s->key[0] = (uint32_t) seed;
+    s->key[1] = (uint32_t) (seed >> 32);
+    s->ctr[0] = pixel;
+    s->ctr[1] = 1;
+    s->ctr[2] = (uint32_t) frame;
+    s->ctr[3] = (uint32_t) (frame >> 32);
+    s->out[0] = first[0];
+    s->out[1] = first[1];
+    s->out[2] = first[2];
+    s->out[3] = first[3];
+    s->idx = 0;
+}
+
+#define TO_UNIFORM(x) (((x) + 0.5)*(1.0/4294967296.0))
+
+/* uniform on (0, 1) */
+static double stream_uniform(philox_stream_t *s)
+{
+    if (s->idx >= 4)
+    {
+        philox4x32_10(s->ctr, s->key, s->out);
+        s->ctr[1]++;
+        s->idx = 0;
+    }
+
+    return TO_UNIFORM(s->out[s->idx++]);
+}
+
+/* Box-Muller, from the first two words of each pixel's first block */
+static void normals_from_blocks(int n, const uint32_t *o0, const uint32_t *o1, double *normals)
+{
+    int j;
+
+    for (j = 0; j < n; j++)
+        normals[j] = sqrt(-2.0*log(TO_UNIFORM(o0[j])))*cos(2*M_PI*TO_UNIFORM(o1[j]));
+}
+
+/*
+Poisson deviate. Small means use inversion (a single uniform), larger means use the transformed rejection method
+(PTRS) of Hormann, 1993 - the same as numpy.
+*/
+static double stream_poisson(philox_stream_t *s, double lam)
+{
+    double u, p, cdf, k;
+    double slam, loglam, a, b, invalpha, vr, us, v;
+
+    if (lam <= 0) return 0;
+
+    if (lam < POISSON_PTRS_LAMBDA)
+    {
+        u = stream_uniform(s);
+        p = exp(-lam);
+        cdf = p;
+        k = 0;
+
+        //the cap guards against rounding leaving cdf just short of u
+        while ((u > cdf) && (k < 1000))
+        {
+            k++;
+            p *= lam/k;
+            cdf += p;
+        }
+
+        return k;
+    }
+
+    slam = sqrt(lam);
+    b = 0.931 + 2.53*slam;
+    a = -0.059 + 0.02483*b;
+    vr = 0.9277 - 3.6224/(b - 2);
+
+    while (1)
+    {
+        u = stream_uniform(s) - 0.5;
+        v = stream_uniform(s);
+        us = 0.5 - fabs(u);
+        k = floor((2*a/us + b)*u + lam + 0.43);
+
+        //most samples are accepted here, so leave the more expensive constants until we need them
+        if ((us >= 0.07) && (v <= vr)) return k;
+        if ((k < 0) || ((us < 0.013) && (v > us))) continue;
+
+        loglam = log(lam);
+        invalpha = 1.1239 + 1.1328/(b - 3.4);
+        if ((log(v) + log(invalpha) - log(a/(us*us) + b)) <= (-lam + k*loglam - lgamma(k + 1))) return k;
+    }
+}
+
+static PyObject * noisify(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oIm=0, *oOut=0, *oOffset=0, *oReadNoise=0;
+    PyArrayObject *aIm=0, *aOut=0, *aOffset=0, *aReadNoise=0;
+    float *im;
+    double *out, *offset, *readNoise;
+    double electronsPerCount = 1, photonScale = 1, countScale = 1, background = 0;
+    unsigned long long seed = 0, frame = 0;
+    int shutterOpen = 1, startRow = 0, endRow = -1;
+    int nRows, nCols, offsetStride, readStride, i, j;
+    npy_intp p;
+    philox_stream_t s;
+    uint32_t first[4], *rowBuf = NULL;
+    double *normals = NULL;
+
+    static char *kwlist[] = {"im", "out", "offset", "readNoise", "electronsPerCount", "photonScale", "countScale",
+                             "background", "shutterOpen", "seed", "frame", "startRow", "endRow", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOOOdddd|iKKii", kwlist, &oIm, &oOut, &oOffset, &oReadNoise,
+         &electronsPerCount, &photonScale, &countScale, &background, &shutterOpen, &seed, &frame, &startRow, &endRow))
+        return NULL;
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_noisify;\
+        }
+
+    aIm = (PyArrayObject *) PyArray_ContiguousFromObject(oIm, NPY_FLOAT, 2, 2);
+    if (aIm == NULL) ABORT("Bad image - expecting a 2D float32 array")
+    nRows = (int) PyArray_DIM(aIm, 0);
+    nCols = (int) PyArray_DIM(aIm, 1);
+
+    if ((npy_intp) nRows*nCols > 0xFFFFFFFFLL) ABORT("Image too large")
+
+    //out is an output array and must be written in place
+    if (!PyArray_Check(oOut)) ABORT("out must be an array")
+    aOut = (PyArrayObject *) oOut;
+    if ((PyArray_TYPE(aOut) != NPY_DOUBLE) || !PyArray_ISCARRAY(aOut) || (PyArray_SIZE(aOut) != PyArray_SIZE(aIm)))
+        ABORT("out must be a contiguous float64 array the same size as im")
+
+    //offset and read noise can either be scalars or per pixel maps
+    aOffset = (PyArrayObject *) PyArray_ContiguousFromObject(oOffset, NPY_DOUBLE, 0, 2);
+    if ((aOffset == NULL) || ((PyArray_SIZE(aOffset) != 1) && (PyArray_SIZE(aOffset) != PyArray_SIZE(aIm))))
+        ABORT("Bad offset - expecting a scalar or a map the same size as the image")
+    offsetStride = (PyArray_SIZE(aOffset) == 1) ? 0 : 1;
+
+    aReadNoise = (PyArrayObject *) PyArray_ContiguousFromObject(oReadNoise, NPY_DOUBLE, 0, 2);
+    if ((aReadNoise == NULL) || ((PyArray_SIZE(aReadNoise) != 1) && (PyArray_SIZE(aReadNoise) != PyArray_SIZE(aIm))))
+        ABORT("Bad readNoise - expecting a scalar or a map the same size as the image")
+    readStride = (PyArray_SIZE(aReadNoise) == 1) ? 0 : 1;
+
+    im = (float *) PyArray_DATA(aIm);
+    out = (double *) PyArray_DATA(aOut);
+    offset = (double *) PyArray_DATA(aOffset);
+    readNoise = (double *) PyArray_DATA(aReadNoise);
+
+    if (endRow < 0) endRow = nRows;
+    startRow = MAX(startRow, 0);
+    endRow = MIN(endRow, nRows);
+
+    //row buffers for the first block of each pixel's stream, and the read noise
+    rowBuf = (uint32_t *) malloc(4*(size_t) nCols*sizeof(uint32_t));
+    normals = (double *) malloc((size_t) nCols*sizeof(double));
+    if ((rowBuf == NULL) || (normals == NULL)) ABORT("Error allocating memory")
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (i = startRow; i < endRow; i++)
+    {
+        p = (npy_intp) i*nCols;
+        philox_first_blocks((uint32_t) p, nCols, seed, frame, rowBuf, rowBuf + nCols, rowBuf + 2*nCols,
+                            rowBuf + 3*nCols);
+        normals_from_blocks(nCols, rowBuf, rowBuf + nCols, normals);
+
+        for (j = 0; j < nCols; j++, p++)
+        {
+            out[p] = offset[p*offsetStride] + (readNoise[p*readStride]/electronsPerCount)*normals[j];
+
+            if (shutterOpen)
+            {
+                first[0] = rowBuf[j];
+                first[1] = rowBuf[nCols + j];
+                first[2] = rowBuf[2*nCols + j];
+                first[3] = rowBuf[3*nCols + j];
+
+                //the first two words went on the read noise
+                stream_init(&s, seed, frame, (uint32_t) p, first);
+                s.idx = 2;
+
+                out[p] += countScale*stream_poisson(&s, photonScale*(im[p] + background));
+            }
+        }
+    }
+    Py_END_ALLOW_THREADS;
+
+    free(rowBuf);
+    free(normals);
+
+    Py_XDECREF(aIm);
+    Py_XDECREF(aOffset);
+    Py_XDECREF(aReadNoise);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+
+FINALIZE_noisify:
+    #undef ABORT
+
+    if (rowBuf) free(rowBuf);
+    if (normals) free(normals);
+
+    Py_XDECREF(aIm);
+    Py_XDECREF(aOffset);
+    Py_XDECREF(aReadNoise);
+
+    return NULL;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+static PyMethodDef camNoiseMethods[] = {
+    {"noisify",  noisify, METH_VARARGS | METH_KEYWORDS,
+    "Simulate camera noise for rows [startRow, endRow) of an image, writing the result (in ADUs) into `out`. Each pixel "
+    "is offset + readNoise/electronsPerCount*N(0,1) + countScale*Poisson(photonScale*(im + background)), the Poisson "
+    "term only being included if shutterOpen.\n Arguments are: 'im' (float32 [N, M], photons), 'out' (float64 [N, M]), "
+    "'offset', 'readNoise' (scalars or [N, M] maps), 'electronsPerCount', 'photonScale', 'countScale', 'background', "
+    "'shutterOpen'=1, 'seed'=0, 'frame'=0, 'startRow'=0, 'endRow'=N"},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+#pragma GCC diagnostic pop
+
+#if PY_MAJOR_VERSION>=3
+static struct PyModuleDef moduledef = {
+        PyModuleDef_HEAD_INIT,
+        "camNoise",     /* m_name */
+        "simulated camera noise",  /* m_doc */
+        -1,                  /* m_size */
+        camNoiseMethods,    /* m_methods */
+        NULL,                /* m_reload */
+        NULL,                /* m_traverse */
+        NULL,                /* m_clear */
+        NULL,                /* m_free */
+    };
+
+PyMODINIT_FUNC PyInit_camNoise(void)
+{
+	PyObject *m;
+    m = PyModule_Create(&moduledef);
+    import_array()
+    return m;
+}
+
+#else
+PyMODINIT_FUNC initcamNoise(void)
+{
+    PyObject *m;
+
+    m = Py_InitModule("camNoise", camNoiseMethods);
+    import_array()
+}
+#endif
@@ -30,6 +30,8 @@ from PYME.Acquire import eventLog
 import numpy as np
 
 import threading
+import multiprocessing
+from PYME.util.threaded import run_threaded
 #import processing
 import time
 
@@ -87,7 +89,15 @@ def generate_camera_maps(size_x = 1024, size_y = 1024, seed=100, read_median=1.3
 
 class NoiseMaker:
     def __init__(self, QE=.8, electronsPerCount=27.32, readoutNoise=109.8, EMGain=0, background=0., floor=967, shutterOpen = True,
-                 numGainElements=536, vbreakdown=6.6, temperature = -70., fast_read_approx=True):
+                 numGainElements=536, vbreakdown=6.6, temperature = -70., fast_read_approx=True, seed=None):
+        """
+        floor and readoutNoise can either be scalars, or per-pixel maps for sCMOS simulation (e.g. the 'dark' map and
+        the square root of the 'variance' map from generate_camera_maps).
+        
+        If the native noise generator is available, the noise for each frame is drawn from a counter based random
+        stream keyed on (seed, frame index), so that a given seed and frame index always gives the same noise. In this
+        case fast_read_approx is ignored, as the native generator is fast enough not to need it.
+        """
         self.QE = QE
         self.ElectronsPerCount = electronsPerCount
         self.ReadoutNoise=readoutNoise
@@ -104,6 +114,11 @@ class NoiseMaker:
         self._ar_key = None
         self._ar_cache = None
         
+        if seed is None:
+            seed = np.random.randint(0, 2**63, dtype='int64')
+        self.seed = int(seed)
+        self._frame_index = 0
+        
     def _read_approx(self, im_shape):
         """
         Really dirty fast approximation to readout noise by indexing into a random location within a pre-calculated noise
@@ -127,13 +142,36 @@ class NoiseMaker:
         offset = np.random.randint(0, nEntries)
         return self._ar_cache[offset:(offset+nEntries)].reshape(im_shape)
 
-    def noisify(self, im):
+    def _noisify_native(self, im, M, F2, frame_index, nThreads=None):
+        from PYME.Acquire.Hardware.Simulator import camNoise
+        
+        im = np.atleast_2d(im)
+        out = np.zeros(im.shape, 'd')
+        
+        if nThreads is None:
+            nThreads = multiprocessing.cpu_count()
+        
+        bounds = np.linspace(0, im.shape[0], max(min(nThreads, im.shape[0]), 1) + 1).astype('i')
+        
+        args = (im.astype('f'), out, self.ADOffset, self.ReadoutNoise, self.ElectronsPerCount, self.QE*F2,
+                M/(self.ElectronsPerCount*F2), self.background, int(self.shutterOpen), self.seed, frame_index)
+        
+        def _noisify_rows(start, end):
+            camNoise.noisify(*(args + (start, end)))
+        
+        run_threaded(_noisify_rows, [(bounds[i], bounds[i+1]) for i in range(len(bounds) - 1)])
+        
+        return out
+    
+    def noisify(self, im, frame_index=None):
         """Add noise to image using an EMCCD noise model
         
         Inputs
         ------
         
         im : NxM array of intensities (in photons)
+        frame_index : index of the frame, used (together with the seed) to key the random number stream when the
+                      native generator is available. Defaults to a counter which is incremented on each call.
         
         Outputs
         -------
@@ -144,6 +182,15 @@ class NoiseMaker:
 
         M = EMCCDTheory.M((80. + self.EMGain)/(255 + 80.), self.vbreakdown, self.temperature, self.NGainElements, 2.2)
         F2 = 1.0/EMCCDTheory.FSquared(M, self.NGainElements)
+        
+        if frame_index is None:
+            frame_index = self._frame_index
+            self._frame_index += 1
+        
+        try:
+            return self._noisify_native(im, M, F2, frame_index)
+        except ImportError:
+            pass
 
         if self.approximate_read_noise:
             o = self._read_approx(im.shape)
@@ -38,7 +38,7 @@ import numpy as np
 
 from PYME.IO.FileUtils.nameUtils import getFullExistingFilename
 import multiprocessing
-import threading
+from PYME.util.threaded import run_threaded
 from PYME.Deconv.wiener import resizePSF
 
 #import threading
@@ -496,17 +496,28 @@ def SIMIllumFcn(fluors, postion):
 
 
     
-def _rFluorSubset(im, fl, A, x0, y0, z, dx, dy, dz, maxz, ChanXOffsets=[0,], ChanZOffsets=[0,], ChanSpecs = None):
-    if ChanSpecs is None:
-        z_ = np.clip(z - fl['z'], -maxz, maxz).astype('f')
-        roiSize = np.minimum(8 + np.abs(z_) * (2.5 / dx), 140).astype('i')
-        cInterp.InterpolateInplaceM(interpModel(), im, (fl['x'] - x0), (fl['y'] - y0), z_, A, roiSize,dx,dy,dz)
-    else:
-        for x_offset, z_offset, spec_chan, chan in zip(ChanXOffsets, ChanZOffsets, ChanSpecs, range(len(ChanSpecs))):
-            z_ = np.clip(z - fl['z'] + z_offset, -maxz, maxz).astype('f')
-            roiSize = np.minimum(8 + np.abs(z_) * (2.5 / dx), 140).astype('i')
-            cInterp.InterpolateInplaceM(interpModel(chan), im, (fl['x'] - x0 + x_offset), (fl['y'] - y0),
-                                        z_, A * fl['spec'][:, spec_chan], roiSize, dx, dy, dz)
+def _render_tiled(im, x, y, z, A, roiSize, chan, models, dx, dy, dz, tileSize=32):
+    """
+    Render emitters into im, splitting the image into tiles which are rendered in parallel. Each thread only writes to
+    its own tiles, and the result is independent of the number of threads.
+    """
+    x, y, z, A = [np.ascontiguousarray(v, 'f') for v in (x, y, z, A)]
+    roiSize = roiSize.astype('i')
+    chan = chan.astype('i')
+    
+    tileStarts, tileIdx = cInterp.TileBins(x, y, roiSize, im.shape[0], im.shape[1], dx, dy, tileSize)
+    nTiles = len(tileStarts) - 1
+    
+    #split tiles between threads so that each gets a similar number of emitters to render
+    nThreads = max(min(multiprocessing.cpu_count(), nTiles), 1)
+    bounds = np.searchsorted(tileStarts, np.linspace(0, tileStarts[-1], nThreads + 1))
+    bounds[0], bounds[-1] = 0, nTiles
+    
+    def _render(start, end):
+        cInterp.InterpolateTiles(models, im, x, y, z, A, roiSize, chan, tileStarts, tileIdx, dx, dy, dz, tileSize,
+                                 start, end)
+    
+    run_threaded(_render, [(bounds[i], bounds[i + 1]) for i in range(nThreads)])
 
 
 def simPalmImFI(X,Y, z, fluors, intTime=.1, numSubSteps=10, roiSize=100, laserPowers = [.1,1], position=[0,0,0], illuminationFunction='ConstIllum', ChanXOffsets=[0,], ChanZOffsets=[0,], ChanSpecs = None):
@@ -522,8 +533,6 @@ def simPalmImFI(X,Y, z, fluors, intTime=.1, numSubSteps=10, roiSize=100, laserPo
     
     for n  in range(numSubSteps):
         A += fluors.illuminate(laserPowers,intTime/numSubSteps, position=position, illuminationFunction=illuminationFunction)
-
-    flOn = where(A > 0.1)[0]
     
     dx = X[1] - X[0]
     dy = Y[1] - Y[0]
@@ -538,27 +547,28 @@ def simPalmImFI(X,Y, z, fluors, intTime=.1, numSubSteps=10, roiSize=100, laserPo
     fl = fluors.fl[m]
     A2 = A[m]
     
-    #z2 = np.minimum(np.maximum(z - fl['z'], -maxz), maxz)#.astype('f')
-    
-    #roiS = np.minimum(3 + np.abs(z2)*(2.5/70), 100).astype('i')
-    #roiS = np.minimum(8 + np.abs(z2)*(2.5/70), 140).astype('i')
-
+    if len(fl) == 0:
+        return im
     
-    nCPUs = int(min(multiprocessing.cpu_count(), len(flOn)))
+    #render all channels in one pass, with a model per channel
+    if ChanSpecs is None:
+        chans = [(0, 0, None, 0)]
+    else:
+        chans = list(zip(ChanXOffsets, ChanZOffsets, ChanSpecs, range(len(ChanSpecs))))
     
-    if nCPUs > 0:
-        threads = [threading.Thread(target = _rFluorSubset, args=(im, fl[i::nCPUs], A2[i::nCPUs], x0, y0, z, dx, dy, dz, maxz, ChanXOffsets, ChanZOffsets, ChanSpecs)) for i in range(nCPUs)]
+    xs, ys, zs, As, cs = [], [], [], [], []
+    for x_offset, z_offset, spec_chan, chan in chans:
+        xs.append(fl['x'] - x0 + x_offset)
+        ys.append(fl['y'] - y0)
+        zs.append(np.clip(z - fl['z'] + z_offset, -maxz, maxz))
+        As.append(A2 if spec_chan is None else A2 * fl['spec'][:, spec_chan])
+        cs.append(np.ones(len(fl), 'i')*chan)
     
-        for p in threads:
-            p.start()
+    z_ = np.hstack(zs).astype('f')
+    roiSizes = np.minimum(8 + np.abs(z_) * (2.5 / dx), 140).astype('i')
+    models = [interpModel(c[3]) for c in chans]
     
-        for p in threads:
-            p.join()
-
-    #for i in flOn:
-    #    x = fluors.fl['x'][i] #+ position[0]
-    #    y = fluors.fl['y'][i] #+ position[1]
-    #    cInterp.InterpolateInplace(interpModel, im, x - x0, y - y0, min(max(z - fluors.fl['z'][i], -maxz), maxz-dz), roiSize, roiSize,dx,dy,dz, A[i])
+    _render_tiled(im, np.hstack(xs), np.hstack(ys), z_, np.hstack(As), roiSizes, np.hstack(cs), models, dx, dy, dz)
 
     return im
 
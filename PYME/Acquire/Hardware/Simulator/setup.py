@@ -45,6 +45,12 @@ def configuration(parent_package = '', top_path = None):
 
     config = Configuration('Simulator', parent_package, top_path, ext_modules=cythonize([ext]))
     
+    config.add_extension('camNoise',
+        sources=['camNoise.c'],
+        include_dirs = [get_numpy_include_dirs()],
+        extra_compile_args = ['-O3', '-fno-exceptions', '-ffast-math'],
+        extra_link_args=linkArgs)
+    
     # config = Configuration('Simulator', parent_package, top_path)
     #
     # config.add_extension('illuminate',
@@ -99,11 +99,12 @@ class Spooler(sp.Spooler):
           
         #self.tq.postTask(cSMI.CDataStack_AsArray(caller.ds, 0).reshape(1,self.scope.cam.GetPicWidth(),self.scope.cam.GetPicHeight()), self.seriesName)
 
-        # NOTE: copy is now performed in frameWrangler, so we don't need to worry about it here
+        # NOTE: frameData may be a view into the frameWrangler's frame ring, which will be overwritten when the ring
+        # wraps around. We hold on to frames until the buffer is flushed, so take a copy.
         if frameData.shape[0] == 1:
-            self.buffer.append(frameData)
+            self.buffer.append(frameData.copy())
         else:
-            self.buffer.append(frameData.reshape(1,frameData.shape[0],frameData.shape[1]))
+            self.buffer.append(frameData.reshape(1,frameData.shape[0],frameData.shape[1]).copy())
 
         if self.imNum == 0: #first frame
             self.md.setEntry('imageID', fileID.genFrameID(self.buffer[-1].squeeze()))
@@ -88,7 +88,10 @@ class Spooler:
         frameSource : dispatch.Signal object
             A source of frames we can subscribe to. It should implement a "connect"
             method allowing us to register a callback and then call the callback with
-            the frame data in a "frameData" kwarg.
+            the frame data in a "frameData" kwarg. Frame sources backed by a
+            frame ring (see `PYME.Acquire.frameRing`) also pass "frameNum" and
+            "frameRing" kwargs, and "frameData" is only valid until the ring
+            wraps around.
         protocol : PYME.Acquire.protocol.TaskListProtocol object
             The acquisition protocol
         guiUpdateCallback : function
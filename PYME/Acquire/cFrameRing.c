@@ -0,0 +1,457 @@
+/*
+##################
+# cFrameRing.c
+#
+# Copyright David Baddeley, 2019
+# d.baddeley@auckland.ac.nz
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+##################
+ */
+
+/*
+Lock-free bookkeeping for a single producer / multiple consumer ring of frame slots (see frameRing.FrameRing).
+
+The frame memory itself is allocated in python. Here we only deal with two int64 arrays:
+
+ctrl: [nSlots, maxConsumers, writeCursor, reserved, (active, readCursor, overflows, reserved) * maxConsumers]
+seq: [nSlots] - the number of the frame held in each slot, or -1 if the slot is empty or being written
+
+The producer never waits for consumers. When it is about to overwrite a frame which a consumer has not yet released,
+it moves that consumer's read cursor on and counts the frame as an overflow. Consumers read slots in place and can
+check (seqlock style) whether the slot was overwritten while they were reading it.
+*/
+
+#include "Python.h"
+#include <math.h>
+#include "numpy/arrayobject.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define MIN(a, b) ((a<b) ? a : b)
+#define MAX(a, b) ((a>b) ? a : b)
+
+#define CTRL_NSLOTS 0
+#define CTRL_NCONSUMERS 1
+#define CTRL_WRITE 2
+#define CTRL_HEADER 4
+#define CONSUMER_SIZE 4
+#define CONSUMER_ACTIVE 0
+#define CONSUMER_READ 1
+#define CONSUMER_OVERFLOWS 2
+
+#ifdef _MSC_VER
+//MSVC doesn't have the __atomic builtins - use the Interlocked equivalents instead (these are all full barriers)
+#include <windows.h>
+static __inline npy_int64 atomic_load(npy_int64 *p)
+{
+    return InterlockedCompareExchange64((LONGLONG volatile *) p, 0, 0);
+}
+
+static __inline void atomic_store(npy_int64 *p, npy_int64 v)
+{
+    InterlockedExchange64((LONGLONG volatile *) p, v);
+}
+
+static __inline int atomic_cas(npy_int64 *p, npy_int64 *expected, npy_int64 desired)
+{
+    npy_int64 prev = InterlockedCompareExchange64((LONGLONG volatile *) p, desired, *expected);
+    if (prev == *expected) return 1;
+
+    //mirror __atomic_compare_exchange_n, which hands back the current value on failure
+    *expected = prev;
+    return 0;
+}
+
+#define LOAD(p) atomic_load(p)
+#define STORE(p, v) atomic_store(p, v)
+#define CAS(p, expected, desired) atomic_cas(p, expected, desired)
+#define FETCH_ADD(p, v) InterlockedExchangeAdd64((LONGLONG volatile *) (p), v)
+#define FENCE() MemoryBarrier()
+#else
+#define LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define CAS(p, expected, desired) __atomic_compare_exchange_n(p, expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define FETCH_ADD(p, v) __atomic_fetch_add(p, v, __ATOMIC_ACQ_REL)
+#define FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+/* get the control and sequence arrays, checking that they are consistent */
+static int get_ring(PyObject *oCtrl, PyObject *oSeq, npy_int64 **ctrl, npy_int64 **seq)
+{
+    PyArrayObject *aCtrl, *aSeq;
+
+    if (!PyArray_Check(oCtrl) || !PyArray_Check(oSeq))
+    {
+        PyErr_Format(PyExc_RuntimeError, "ctrl and seq must be arrays");
+        return 0;
+    }
+
+    aCtrl = (PyArrayObject *) oCtrl;
+    aSeq = (PyArrayObject *) oSeq;
+
+    if ((PyArray_TYPE(aCtrl) != NPY_INT64) || !PyArray_ISCARRAY(aCtrl) || (PyArray_SIZE(aCtrl) < CTRL_HEADER) ||
+        (PyArray_TYPE(aSeq) != NPY_INT64) || !PyArray_ISCARRAY(aSeq))
+    {
+        PyErr_Format(PyExc_RuntimeError, "ctrl and seq must be contiguous int64 arrays");
+        return 0;
+    }
+
+    *ctrl = (npy_int64 *) PyArray_DATA(aCtrl);
+    *seq = (npy_int64 *) PyArray_DATA(aSeq);
+
+    if (((*ctrl)[CTRL_NSLOTS] < 1) || (PyArray_SIZE(aSeq) != (*ctrl)[CTRL_NSLOTS]) ||
+        (PyArray_SIZE(aCtrl) != CTRL_HEADER + CONSUMER_SIZE*(*ctrl)[CTRL_NCONSUMERS]))
+    {
+        PyErr_Format(PyExc_RuntimeError, "ctrl and seq are inconsistent");
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+Claim the slot for the next frame. Any consumer still holding on to the frame which is about to be overwritten is
+moved on, and the frame counted as an overflow.
+*/
+static npy_int64 begin_write(npy_int64 *ctrl, npy_int64 *seq)
+{
+    npy_int64 nSlots = ctrl[CTRL_NSLOTS];
+    npy_int64 w = LOAD(&ctrl[CTRL_WRITE]);
+    npy_int64 old = w - nSlots;
+    npy_int64 slot = w % nSlots;
+    npy_int64 *consumer, r;
+    int c;
+
+    if (old >= 0)
+    {
+        for (c = 0; c < ctrl[CTRL_NCONSUMERS]; c++)
+        {
+            consumer = ctrl + CTRL_HEADER + CONSUMER_SIZE*c;
+            if (LOAD(&consumer[CONSUMER_ACTIVE]) != 1) continue;
+
+            r = LOAD(&consumer[CONSUMER_READ]);
+            while (r <= old)
+            {
+                if (CAS(&consumer[CONSUMER_READ], &r, old + 1))
+                {
+                    FETCH_ADD(&consumer[CONSUMER_OVERFLOWS], old + 1 - r);
+                    break;
+                }
+            }
+        }
+    }
+
+    //mark the slot as being written before we touch the data
+    STORE(&seq[slot], -1);
+    FENCE();
+
+    return slot;
+}
+
+static npy_int64 publish(npy_int64 *ctrl, npy_int64 *seq)
+{
+    npy_int64 w = LOAD(&ctrl[CTRL_WRITE]);
+
+    STORE(&seq[w % ctrl[CTRL_NSLOTS]], w);
+    STORE(&ctrl[CTRL_WRITE], w + 1);
+
+    return w;
+}
+
+static PyObject * beginWrite(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oCtrl=0, *oSeq=0;
+    npy_int64 *ctrl, *seq;
+
+    static char *kwlist[] = {"ctrl", "seq", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OO", kwlist, &oCtrl, &oSeq))
+        return NULL;
+
+    if (!get_ring(oCtrl, oSeq, &ctrl, &seq)) return NULL;
+
+    return Py_BuildValue("L", (long long) begin_write(ctrl, seq));
+}
+
+static PyObject * publishFrame(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oCtrl=0, *oSeq=0;
+    npy_int64 *ctrl, *seq;
+
+    static char *kwlist[] = {"ctrl", "seq", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OO", kwlist, &oCtrl, &oSeq))
+        return NULL;
+
+    if (!get_ring(oCtrl, oSeq, &ctrl, &seq)) return NULL;
+
+    return Py_BuildValue("L", (long long) publish(ctrl, seq));
+}
+
+static PyObject * pushFrame(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oCtrl=0, *oSeq=0, *oSlots=0, *oFrame=0;
+    PyArrayObject *aSlots, *aFrame=0;
+    npy_int64 *ctrl, *seq, slot, w;
+    npy_intp slotBytes;
+    char *dst;
+
+    static char *kwlist[] = {"ctrl", "seq", "slots", "frame", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOOO", kwlist, &oCtrl, &oSeq, &oSlots, &oFrame))
+        return NULL;
+
+    if (!get_ring(oCtrl, oSeq, &ctrl, &seq)) return NULL;
+
+    //slots is the [nSlots, slotBytes] uint8 view onto the (aligned) frame memory
+    if (!PyArray_Check(oSlots))
+    {
+        PyErr_Format(PyExc_RuntimeError, "slots must be an array");
+        return NULL;
+    }
+    aSlots = (PyArrayObject *) oSlots;
+    if ((PyArray_NDIM(aSlots) != 2) || (PyArray_DIM(aSlots, 0) != ctrl[CTRL_NSLOTS]) ||
+        (PyArray_ITEMSIZE(aSlots) != 1) || (PyArray_STRIDE(aSlots, 1) != 1))
+    {
+        PyErr_Format(PyExc_RuntimeError, "slots must be a [nSlots, slotBytes] uint8 array");
+        return NULL;
+    }
+    slotBytes = PyArray_DIM(aSlots, 1);
+
+    //the frame is copied byte for byte, so it must already be in the memory order of the ring
+    aFrame = (PyArrayObject *) PyArray_FromAny(oFrame, NULL, 0, 0, NPY_ARRAY_ALIGNED, NULL);
+    if (aFrame == NULL) return NULL;
+
+    if (!PyArray_ISONESEGMENT(aFrame) || (PyArray_NBYTES(aFrame) > slotBytes))
+    {
+        Py_DECREF(aFrame);
+        PyErr_Format(PyExc_RuntimeError, "frame must be contiguous and no larger than a slot");
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS;
+    slot = begin_write(ctrl, seq);
+    dst = PyArray_BYTES(aSlots) + slot*PyArray_STRIDE(aSlots, 0);
+    memcpy(dst, PyArray_DATA(aFrame), PyArray_NBYTES(aFrame));
+    w = publish(ctrl, seq);
+    Py_END_ALLOW_THREADS;
+
+    Py_DECREF(aFrame);
+
+    return Py_BuildValue("L", (long long) w);
+}
+
+/* slot holding frameNum, or -1 if it has been overwritten (or is not yet written) */
+static PyObject * frameSlot(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oCtrl=0, *oSeq=0;
+    npy_int64 *ctrl, *seq, slot;
+    long long frameNum;
+
+    static char *kwlist[] = {"ctrl", "seq", "frameNum", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOL", kwlist, &oCtrl, &oSeq, &frameNum))
+        return NULL;
+
+    if (!get_ring(oCtrl, oSeq, &ctrl, &seq)) return NULL;
+
+    if (frameNum < 0) return Py_BuildValue("L", -1LL);
+
+    //make sure any reads of the slot data the caller did before this call are complete before we check the sequence
+    FENCE();
+
+    slot = frameNum % ctrl[CTRL_NSLOTS];
+    if (LOAD(&seq[slot]) != frameNum) slot = -1;
+
+    return Py_BuildValue("L", (long long) slot);
+}
+
+static PyObject * registerConsumer(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oCtrl=0, *oSeq=0;
+    npy_int64 *ctrl, *seq, *consumer, expected;
+    int c;
+
+    static char *kwlist[] = {"ctrl", "seq", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OO", kwlist, &oCtrl, &oSeq))
+        return NULL;
+
+    if (!get_ring(oCtrl, oSeq, &ctrl, &seq)) return NULL;
+
+    for (c = 0; c < ctrl[CTRL_NCONSUMERS]; c++)
+    {
+        consumer = ctrl + CTRL_HEADER + CONSUMER_SIZE*c;
+        expected = 0;
+
+        //reset the cursor and counters before marking the consumer as active, so that the producer never sees stale
+        //values. Another thread claiming the same entry will fail the compare and exchange.
+        if (CAS(&consumer[CONSUMER_ACTIVE], &expected, -1))
+        {
+            STORE(&consumer[CONSUMER_READ], LOAD(&ctrl[CTRL_WRITE]));
+            STORE(&consumer[CONSUMER_OVERFLOWS], 0);
+            STORE(&consumer[CONSUMER_ACTIVE], 1);
+            return Py_BuildValue("i", c);
+        }
+    }
+
+    PyErr_Format(PyExc_RuntimeError, "No free consumer slots");
+    return NULL;
+}
+
+static PyObject * unregisterConsumer(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oCtrl=0, *oSeq=0;
+    npy_int64 *ctrl, *seq;
+    int c;
+
+    static char *kwlist[] = {"ctrl", "seq", "consumer", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOi", kwlist, &oCtrl, &oSeq, &c))
+        return NULL;
+
+    if (!get_ring(oCtrl, oSeq, &ctrl, &seq)) return NULL;
+
+    if ((c < 0) || (c >= ctrl[CTRL_NCONSUMERS]))
+    {
+        PyErr_Format(PyExc_RuntimeError, "Bad consumer");
+        return NULL;
+    }
+
+    STORE(&ctrl[CTRL_HEADER + CONSUMER_SIZE*c + CONSUMER_ACTIVE], 0);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+/* tell the producer we no longer need frames before `upTo`. Returns the new read cursor */
+static PyObject * releaseFrames(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oCtrl=0, *oSeq=0;
+    npy_int64 *ctrl, *seq, *cursor, r;
+    long long upTo;
+    int c;
+
+    static char *kwlist[] = {"ctrl", "seq", "consumer", "upTo", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOiL", kwlist, &oCtrl, &oSeq, &c, &upTo))
+        return NULL;
+
+    if (!get_ring(oCtrl, oSeq, &ctrl, &seq)) return NULL;
+
+    if ((c < 0) || (c >= ctrl[CTRL_NCONSUMERS]))
+    {
+        PyErr_Format(PyExc_RuntimeError, "Bad consumer");
+        return NULL;
+    }
+
+    //never move past frames which haven't been written yet
+    upTo = MIN(upTo, (long long) LOAD(&ctrl[CTRL_WRITE]));
+
+    //the producer may move the cursor on concurrently, so only ever increase it
+    cursor = &ctrl[CTRL_HEADER + CONSUMER_SIZE*c + CONSUMER_READ];
+    r = LOAD(cursor);
+    while ((r < upTo) && !CAS(cursor, &r, (npy_int64) upTo)) {}
+
+    return Py_BuildValue("L", (long long) LOAD(cursor));
+}
+
+/* (writeCursor, readCursor, overflows) for a consumer */
+static PyObject * consumerState(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oCtrl=0, *oSeq=0;
+    npy_int64 *ctrl, *seq, *consumer;
+    int c;
+
+    static char *kwlist[] = {"ctrl", "seq", "consumer", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOi", kwlist, &oCtrl, &oSeq, &c))
+        return NULL;
+
+    if (!get_ring(oCtrl, oSeq, &ctrl, &seq)) return NULL;
+
+    if ((c < 0) || (c >= ctrl[CTRL_NCONSUMERS]))
+    {
+        PyErr_Format(PyExc_RuntimeError, "Bad consumer");
+        return NULL;
+    }
+
+    consumer = ctrl + CTRL_HEADER + CONSUMER_SIZE*c;
+
+    return Py_BuildValue("(LLL)", (long long) LOAD(&ctrl[CTRL_WRITE]), (long long) LOAD(&consumer[CONSUMER_READ]),
+                         (long long) LOAD(&consumer[CONSUMER_OVERFLOWS]));
+}
+
+#ifndef _MSC_VER
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+#endif
+
+static PyMethodDef cFrameRingMethods[] = {
+    {"beginWrite",  beginWrite, METH_VARARGS | METH_KEYWORDS,
+    "Claim the slot for the next frame and return its index. The frame must then be written into the slot, and made "
+    "visible to consumers with publishFrame.\n Arguments are: 'ctrl', 'seq'"},
+    {"publishFrame",  publishFrame, METH_VARARGS | METH_KEYWORDS,
+    "Publish the frame written into the slot returned by beginWrite, and return its frame number.\n Arguments are: "
+    "'ctrl', 'seq'"},
+    {"pushFrame",  pushFrame, METH_VARARGS | METH_KEYWORDS,
+    "Copy a frame into the next slot and publish it, returning its frame number.\n Arguments are: 'ctrl', 'seq', "
+    "'slots' (uint8 [nSlots, slotBytes]), 'frame'"},
+    {"frameSlot",  frameSlot, METH_VARARGS | METH_KEYWORDS,
+    "Return the slot holding frame `frameNum`, or -1 if it is not (or no longer) in the ring. Calling this again after "
+    "reading the slot tells you whether it was overwritten while you were reading.\n Arguments are: 'ctrl', 'seq', "
+    "'frameNum'"},
+    {"registerConsumer",  registerConsumer, METH_VARARGS | METH_KEYWORDS,
+    "Register a new consumer, starting at the next frame to be written, and return its id.\n Arguments are: 'ctrl', "
+    "'seq'"},
+    {"unregisterConsumer",  unregisterConsumer, METH_VARARGS | METH_KEYWORDS,
+    "Unregister a consumer.\n Arguments are: 'ctrl', 'seq', 'consumer'"},
+    {"releaseFrames",  releaseFrames, METH_VARARGS | METH_KEYWORDS,
+    "Mark all frames before `upTo` as done with, and return the consumer's read cursor.\n Arguments are: 'ctrl', "
+    "'seq', 'consumer', 'upTo'"},
+    {"consumerState",  consumerState, METH_VARARGS | METH_KEYWORDS,
+    "Return (writeCursor, readCursor, overflows) for a consumer.\n Arguments are: 'ctrl', 'seq', 'consumer'"},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+#ifndef _MSC_VER
+#pragma GCC diagnostic pop
+#endif
+
+#if PY_MAJOR_VERSION>=3
+static struct PyModuleDef moduledef = {
+        PyModuleDef_HEAD_INIT,
+        "cFrameRing",     /* m_name */
+        "lock-free frame ring bookkeeping",  /* m_doc */
+        -1,                  /* m_size */
+        cFrameRingMethods,    /* m_methods */
+        NULL,                /* m_reload */
+        NULL,                /* m_traverse */
+        NULL,                /* m_clear */
+        NULL,                /* m_free */
+    };
+
+PyMODINIT_FUNC PyInit_cFrameRing(void)
+{
+	PyObject *m;
+    m = PyModule_Create(&moduledef);
+    import_array()
+    return m;
+}
+
+#else
+PyMODINIT_FUNC initcFrameRing(void)
+{
+    PyObject *m;
+
+    m = Py_InitModule("cFrameRing", cFrameRingMethods);
+    import_array()
+}
+#endif
@@ -0,0 +1,184 @@
+"""
+A ring of preallocated frame slots, written by a single producer (the FrameWrangler polling thread) and read, in
+place, by any number of consumers (spoolers, previews etc ...).
+
+The producer never waits on consumers. Each consumer has a read cursor (the oldest frame it still needs) which it
+advances by calling `RingConsumer.release`. If the producer needs to overwrite a frame a consumer has not released,
+the frame is dropped for that consumer and counted in `RingConsumer.overflows`. Because frames are read in place, a
+consumer which is slow enough to be lapped can see a slot change underneath it - use `FrameRing.is_valid` after
+processing a frame to check that it was not overwritten in the meantime. Consumers which cannot afford to lose frames
+should apply their own backpressure (see `HTTPSpooler.Spooler.OnFrame`), by waiting in their `onFrame` handler (which
+runs in the producer thread) until `RingConsumer.lag` is less than `n_slots`.
+
+The bookkeeping is done with atomic operations in the `cFrameRing` extension module.
+"""
+
+import numpy as np
+import ctypes
+
+from PYME.Acquire import cFrameRing
+
+#align slots to cache lines (and AVX vectors)
+SLOT_ALIGNMENT = 64
+
+CTRL_HEADER = 4
+CONSUMER_SIZE = 4
+
+
+class FrameRing(object):
+    def __init__(self, frame_shape, dtype='uint16', order='C', n_slots=64, max_consumers=8):
+        """
+        Parameters
+        ----------
+        frame_shape : tuple
+            shape of each frame
+        dtype : numpy dtype
+        order : 'C' or 'F'
+            memory order of the frames
+        n_slots : int
+            number of frames in the ring
+        max_consumers : int
+            maximum number of consumers which can be registered at once
+        """
+        self.frame_shape = tuple(frame_shape)
+        self.dtype = np.dtype(dtype)
+        self.order = order
+        self.n_slots = int(n_slots)
+
+        frame_bytes = int(np.prod(self.frame_shape))*self.dtype.itemsize
+        self.slot_bytes = SLOT_ALIGNMENT*int(np.ceil(frame_bytes/float(SLOT_ALIGNMENT)))
+
+        # over-allocate so that we can align the first slot
+        self._mem = np.zeros(self.n_slots*self.slot_bytes + SLOT_ALIGNMENT, 'uint8')
+        offset = (-self._mem.ctypes.data) % SLOT_ALIGNMENT
+        self._slots = self._mem[offset:(offset + self.n_slots*self.slot_bytes)].reshape(self.n_slots, self.slot_bytes)
+
+        self._frames = [np.ndarray(self.frame_shape, dtype=self.dtype, buffer=self._slots[i, :frame_bytes],
+                                   order=self.order) for i in range(self.n_slots)]
+
+        self._ctrl = np.zeros(CTRL_HEADER + CONSUMER_SIZE*max_consumers, 'int64')
+        self._ctrl[0] = self.n_slots
+        self._ctrl[1] = max_consumers
+        self._seq = -np.ones(self.n_slots, 'int64')
+
+    def matches(self, frame_shape, dtype, order):
+        """Can this ring hold frames of the given shape, type and order?"""
+        return (tuple(frame_shape) == self.frame_shape) and (np.dtype(dtype) == self.dtype) and (order == self.order)
+
+    def begin_write(self):
+        """
+        Claim the slot for the next frame (only to be called from the producer thread).
+
+        Returns
+        -------
+        frame : ndarray
+            the slot, to be written in place before calling `publish`
+        """
+        return self._frames[cFrameRing.beginWrite(self._ctrl, self._seq)]
+
+    def publish(self):
+        """Make the frame written after `begin_write` visible to consumers, returning its frame number"""
+        return cFrameRing.publishFrame(self._ctrl, self._seq)
+
+    def push(self, frame):
+        """Copy a frame into the ring (in a single call, with the GIL released), returning its frame number"""
+        return cFrameRing.pushFrame(self._ctrl, self._seq, self._slots,
+                                    np.asarray(frame, dtype=self.dtype, order=self.order))
+
+    @property
+    def n_written(self):
+        """number of frames written so far"""
+        return int(self._ctrl[2])
+
+    def get(self, frame_num):
+        """The frame `frame_num`, read in place, or None if it is no longer in the ring"""
+        slot = cFrameRing.frameSlot(self._ctrl, self._seq, frame_num)
+        if slot < 0:
+            return None
+
+        return self._frames[slot]
+
+    def is_valid(self, frame_num):
+        """Is frame `frame_num` still in the ring? Call after reading a frame to check it was not overwritten."""
+        return cFrameRing.frameSlot(self._ctrl, self._seq, frame_num) >= 0
+
+    def copy_latest(self, out):
+        """
+        Copy the most recent frame into `out`. The copy is a raw copy of the frame memory, so `out` should be a
+        contiguous array with the same memory layout as the ring (but can have a different shape).
+
+        Returns
+        -------
+        frame_num : the number of the frame copied, or -1 if there was no valid frame to copy
+        """
+        frame_num = self.n_written - 1
+
+        f = self.get(frame_num)
+        if f is None:
+            return -1
+
+        ctypes.memmove(out.ctypes.data, f.ctypes.data, min(out.nbytes, f.nbytes))
+        if not self.is_valid(frame_num):
+            return -1
+
+        return frame_num
+
+    def register_consumer(self):
+        return RingConsumer(self)
+
+
+class RingConsumer(object):
+    def __init__(self, ring):
+        self.ring = ring
+        self.id = cFrameRing.registerConsumer(ring._ctrl, ring._seq)
+        self._next = ring.n_written
+
+    def next(self):
+        """
+        Get the next frame, in order, from the ring. Frames dropped due to overflows are skipped.
+
+        Returns
+        -------
+        (frame_num, frame), or None if no new frames are available
+        """
+        write, read, overflows = self.state
+        self._next = max(self._next, read)
+
+        while self._next < write:
+            f = self.ring.get(self._next)
+            self._next += 1
+            if f is not None:
+                return self._next - 1, f
+
+        return None
+
+    def release(self, up_to):
+        """Tell the producer that we are done with all frames before `up_to`"""
+        return cFrameRing.releaseFrames(self.ring._ctrl, self.ring._seq, self.id, up_to)
+
+    @property
+    def state(self):
+        """(frames written, read cursor, overflows)"""
+        return cFrameRing.consumerState(self.ring._ctrl, self.ring._seq, self.id)
+
+    @property
+    def lag(self):
+        """number of frames written but not yet released"""
+        write, read, overflows = self.state
+        return write - read
+
+    @property
+    def overflows(self):
+        """number of frames which were overwritten before we released them"""
+        return self.state[2]
+
+    def close(self):
+        if self.id is not None:
+            cFrameRing.unregisterConsumer(self.ring._ctrl, self.ring._seq, self.id)
+            self.id = None
+
+    def __del__(self):
+        try:
+            self.close()
+        except Exception:
+            pass
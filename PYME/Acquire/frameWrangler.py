@@ -50,7 +50,14 @@ from PYME.contrib import dispatch
 import warnings
 
 from PYME.Acquire import eventLog
+from PYME import config
 import threading
+
+try:
+    from PYME.Acquire import frameRing
+except ImportError:
+    logger.info('Could not import frameRing (is the cFrameRing extension built?), frames will be allocated individually')
+    frameRing = None
 #sfrom PYME.ui import mytimer
 
 class FrameWrangler(object):
@@ -70,6 +77,13 @@ class FrameWrangler(object):
         per new frame, the new frames are only checked for once per polling
         cycle, meaning that this event will be fired N-times for each 
         `onFrameGroup` event.
+        
+        When the frame ring is available, `frameData` is a view into a slot of
+        `frameRing` (also passed, together with the `frameNum` of the frame
+        within the ring) rather than a copy. The slot will be overwritten when
+        the ring wraps around, so receivers which hold on to frames must either
+        copy them, or register as a consumer of the ring (see
+        `PYME.Acquire.frameRing`).
     onFrameGroup : dispatch.Signal
         Called on each new frame group (once per polling interval) - use for 
         updateing GUIs etc.
@@ -92,6 +106,11 @@ class FrameWrangler(object):
         
         self.currentFrame = _ds
         self.cam = _cam
+        
+        # ring of preallocated frames which the camera is read into (see getFrame)
+        self.frameRing = None
+        self._cf_num = -1
+        self._current_frame_num = -1
 
         self.aqOn = False
 
@@ -179,12 +198,31 @@ class FrameWrangler(object):
    
 
             
+    def _get_frame_ring(self, shape):
+        """Get a frame ring which matches the current frame shape, (re)allocating it if necessary"""
+        if frameRing is None:
+            return None
+        
+        if (self.frameRing is None) or not self.frameRing.matches(shape, 'uint16', self.order):
+            frame_bytes = 2*int(np.prod(shape))
+            n_slots = max(int(config.get('framewrangler-ring-mb', 256)*1e6/frame_bytes), 8)
+            logger.debug('Allocating frame ring with %d slots' % n_slots)
+            self.frameRing = frameRing.FrameRing(shape, 'uint16', self.order, n_slots)
+            self._current_frame_num = -1
+            
+        return self.frameRing
+            
     def getFrame(self, colours=None):
         """Ask the camera to put a frame into our buffer"""
         #logger.debug('acquire _current_frame_lock in getFrame()')
         with self._current_frame_lock:
-            self._cf = np.empty([1, self.cam.GetPicWidth(), self.cam.GetPicHeight(),
-	                                ], dtype = 'uint16', order = self.order)
+            shape = [1, self.cam.GetPicWidth(), self.cam.GetPicHeight()]
+            ring = self._get_frame_ring(shape)
+            if ring is None:
+                self._cf = np.empty(shape, dtype = 'uint16', order = self.order)
+            else:
+                # have the camera write directly into the next slot of the ring
+                self._cf = ring.begin_write()
 	        
             if getattr(self.cam, 'numpy_frames', False):
                 cs = self._cf[0,:,:] #self.currentFrame[:,:,0]
@@ -197,6 +235,9 @@ class FrameWrangler(object):
             #for newer cameras, we pass a numpy array object, and the camera code
             #copies the data into that array.
             self.cam.ExtractColor(cs,0)
+            
+            if ring is not None:
+                self._cf_num = ring.publish()
 
         #logger.debug('release _current_frame_lock in getFrame()')
         return self._cf
@@ -233,7 +274,7 @@ class FrameWrangler(object):
             #d = self.dsa.copy()
             #d = np.empty_like(self.dsa)
             #ctypes.cdll.msvcrt.memcpy(d.ctypes.data_as(ctypes.POINTER(ctypes.c_uint8)), self.dsa.ctypes.data_as(ctypes.POINTER(ctypes.c_uint8)), d.nbytes)
-            self.onFrame.send(sender=self, frameData=d)
+            self.onFrame.send(sender=self, frameData=d, frameNum=self._cf_num, frameRing=self.frameRing)
         except:
             import traceback
             traceback.print_exc()
@@ -363,9 +404,17 @@ class FrameWrangler(object):
                  
                 # just copy data to the current frame once per frame group - individual frames don't get copied
                 # directly calling memcpy is a bit of a cheat, but is significantly faster than the alternatives
-                with self._current_frame_lock:
-                    memcpy(self.currentFrame.ctypes.data_as(ctypes.POINTER(ctypes.c_uint8)),
-                           self._cf.ctypes.data_as(ctypes.POINTER(ctypes.c_uint8)),self.currentFrame.nbytes)
+                ring = self.frameRing
+                if ring is not None and (self._cf is not None) and (self._cf.nbytes == self.currentFrame.nbytes):
+                    # no need to lock, the ring tells us if the frame got overwritten while we were copying it
+                    if ring.n_written - 1 != self._current_frame_num:
+                        frame_num = ring.copy_latest(self.currentFrame)
+                        if frame_num >= 0:
+                            self._current_frame_num = frame_num
+                else:
+                    with self._current_frame_lock:
+                        memcpy(self.currentFrame.ctypes.data_as(ctypes.POINTER(ctypes.c_uint8)),
+                               self._cf.ctypes.data_as(ctypes.POINTER(ctypes.c_uint8)),self.currentFrame.nbytes)
                 
     
                 if self.bufferOverflowed:
@@ -32,6 +32,11 @@ def configuration(parent_package = '', top_path = None):
     config.add_data_dir('Scripts')
     config.add_subpackage('ui')
     config.add_subpackage('Utils')
+    
+    config.add_extension('cFrameRing',
+                         sources=['cFrameRing.c'],
+                         include_dirs=[get_numpy_include_dirs()],
+                         extra_compile_args=['-O3', '-fno-exceptions'])
     #config.add_data_files('logo.png')
 
     return config
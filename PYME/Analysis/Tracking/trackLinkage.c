@@ -0,0 +1,523 @@
+/*
+##################
+# trackLinkage.c
+#
+# Copyright David Baddeley, 2015
+# d.baddeley@auckland.ac.nz
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+##################
+ */
+
+/*
+Sparse, grid-gated version of the frame to frame linkage in tracking.Tracker.
+
+Rather than computing a full distance matrix between the objects in two frames, the objects in the previous frame are
+binned into a regular grid (using the first two feature dimensions) with a cell size of at least the gating radius.
+Only objects in the 3x3 neighbourhood of cells around each object in the current frame are scored, and the linkage
+likelihoods are stored as a sparse candidate list. The normalisation and "competition" steps are otherwise the same as
+in Tracker.calcLinkageMatrix.
+*/
+
+#include "Python.h"
+#include <math.h>
+#include "numpy/arrayobject.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MIN(a, b) ((a<b) ? a : b)
+#define MAX(a, b) ((a>b) ? a : b)
+
+//upper bound on grid cells per object in the previous frame (cell size is increased for sparse frames)
+#define MAX_CELLS_PER_OBJECT 4
+
+typedef struct
+{
+    float p; //linkage likelihood
+    int i; //index of object in current frame (relative to frame start)
+    int j; //index of object in previous frame (relative to frame start), -1 if a new object
+} link_t;
+
+typedef struct
+{
+    link_t *links;
+    int nLinks;
+    int size;
+} link_list_t;
+
+static int push_link(link_list_t *ll, float p, int i, int j)
+{
+    link_t * tmp;
+
+    if (ll->nLinks >= ll->size)
+    {
+        ll->size = MAX(2*ll->size, 256);
+        tmp = realloc(ll->links, ll->size*sizeof(link_t));
+        if (tmp == NULL) return -1;
+        ll->links = tmp;
+    }
+
+    ll->links[ll->nLinks].p = p;
+    ll->links[ll->nLinks].i = i;
+    ll->links[ll->nLinks].j = j;
+    ll->nLinks++;
+
+    return 0;
+}
+
+static int cmp_links_desc(const void *a, const void *b)
+{
+    const link_t *la = (const link_t *) a;
+    const link_t *lb = (const link_t *) b;
+
+    if (la->p > lb->p) return -1;
+    if (la->p < lb->p) return 1;
+    //tie break on indices so that results are deterministic
+    if (la->i != lb->i) return la->i - lb->i;
+    return la->j - lb->j;
+}
+
+/*
+Calculate the significant linkage candidates between the ni objects in the current frame (feats_i) and the nj objects
+in the previous frame (feats_j). Features are stored row-major as [n, nFeats].
+
+The candidates are returned in `out`, grouped by i and in descending order of probability within each i. Returns 0 on
+success and -1 on allocation failure. Does not touch any python objects and is safe to call without the GIL.
+*/
+static int link_pair(const float *feats_i, int ni, const float *feats_j, int nj, int nFeats,
+                     float r0, float pNew, float cutoff, float gate, link_list_t *out)
+{
+    float xmin = 0, xmax = 0, ymin = 0, ymax = 0;
+    float cellSize = gate, d, dx, p, S, l;
+    int nx = 1, ny = 1, nCells, cx, cy, ix, iy, c, k, i, j, f, start, nSig;
+    int hasY = (nFeats > 1);
+    int *cellStarts = NULL, *cellFill = NULL, *cellObjs = NULL, *objCells = NULL, *candStarts = NULL;
+    float *rowMax = NULL;
+    link_list_t cand = {NULL, 0, 0};
+    int ret = -1;
+
+    out->nLinks = 0;
+
+    if (ni == 0) return 0;
+
+    candStarts = malloc((ni + 1)*sizeof(int));
+    if (candStarts == NULL) goto FINALIZE_link_pair;
+
+    if (nj > 0)
+    {
+        /* --------- bin the objects in the previous frame --------- */
+        xmin = xmax = feats_j[0];
+        ymin = ymax = hasY ? feats_j[1] : 0;
+        for (j = 0; j < nj; j++)
+        {
+            xmin = MIN(xmin, feats_j[j*nFeats]);
+            xmax = MAX(xmax, feats_j[j*nFeats]);
+            if (hasY)
+            {
+                ymin = MIN(ymin, feats_j[j*nFeats + 1]);
+                ymax = MAX(ymax, feats_j[j*nFeats + 1]);
+            }
+        }
+
+        //limit the number of cells to something proportional to the number of objects
+        while (1)
+        {
+            nx = (int)((xmax - xmin)/cellSize) + 1;
+            ny = hasY ? (int)((ymax - ymin)/cellSize) + 1 : 1;
+            if (((double)nx*(double)ny) <= (double)(MAX_CELLS_PER_OBJECT*nj + 16)) break;
+            cellSize *= 2;
+        }
+        nCells = nx*ny;
+
+        cellStarts = calloc(nCells + 1, sizeof(int));
+        cellFill = malloc(nCells*sizeof(int));
+        cellObjs = malloc(nj*sizeof(int));
+        objCells = malloc(nj*sizeof(int));
+        rowMax = calloc(nj, sizeof(float));
+        if ((cellStarts == NULL) || (cellFill == NULL) || (cellObjs == NULL) || (objCells == NULL) || (rowMax == NULL))
+            goto FINALIZE_link_pair;
+
+        //counting sort of objects into cells
+        for (j = 0; j < nj; j++)
+        {
+            cx = (int)((feats_j[j*nFeats] - xmin)/cellSize);
+            cy = hasY ? (int)((feats_j[j*nFeats + 1] - ymin)/cellSize) : 0;
+            objCells[j] = cy*nx + cx;
+            cellStarts[objCells[j] + 1]++;
+        }
+
+        for (c = 0; c < nCells; c++)
+        {
+            cellStarts[c + 1] += cellStarts[c];
+            cellFill[c] = cellStarts[c];
+        }
+
+        for (j = 0; j < nj; j++) cellObjs[cellFill[objCells[j]]++] = j;
+    }
+
+    /* --------- gated candidate search & normalisation over candidates (lMatch) --------- */
+    for (i = 0; i < ni; i++)
+    {
+        candStarts[i] = cand.nLinks;
+        S = pNew;
+
+        if (nj > 0)
+        {
+            cx = (int)floorf((feats_i[i*nFeats] - xmin)/cellSize);
+            cy = hasY ? (int)floorf((feats_i[i*nFeats + 1] - ymin)/cellSize) : 0;
+
+            for (iy = MAX(cy - 1, 0); iy <= MIN(cy + 1, ny - 1); iy++)
+            {
+                for (ix = MAX(cx - 1, 0); ix <= MIN(cx + 1, nx - 1); ix++)
+                {
+                    c = iy*nx + ix;
+                    for (k = cellStarts[c]; k < cellStarts[c + 1]; k++)
+                    {
+                        j = cellObjs[k];
+
+                        d = 0;
+                        for (f = 0; f < nFeats; f++)
+                        {
+                            dx = feats_i[i*nFeats + f] - feats_j[j*nFeats + f];
+                            d += dx*dx;
+                        }
+                        d = sqrtf(d);
+
+                        if (d < gate)
+                        {
+                            p = expf(-d/r0);
+                            if (push_link(&cand, p, i, j) < 0) goto FINALIZE_link_pair;
+                            S += p;
+                        }
+                    }
+                }
+            }
+        }
+
+        for (k = candStarts[i]; k < cand.nLinks; k++)
+        {
+            cand.links[k].p /= S;
+            rowMax[cand.links[k].j] = MAX(rowMax[cand.links[k].j], cand.links[k].p);
+        }
+
+        //the probability that the object is new in this frame is stored as a candidate with j = -1
+        if (push_link(&cand, pNew/S, i, -1) < 0) goto FINALIZE_link_pair;
+    }
+    candStarts[ni] = cand.nLinks;
+
+    /* --------- competition between objects in this frame for the same object in the previous frame --------- */
+    for (i = 0; i < ni; i++)
+    {
+        start = candStarts[i];
+
+        S = 0;
+        for (k = start; k < candStarts[i+1]; k++)
+        {
+            j = cand.links[k].j;
+            if (j >= 0)
+            {
+                l = cand.links[k].p/rowMax[j];
+                cand.links[k].p *= l*l;
+            }
+            S += cand.links[k].p;
+        }
+
+        for (k = start; k < candStarts[i+1]; k++) cand.links[k].p /= S;
+
+        qsort(cand.links + start, candStarts[i+1] - start, sizeof(link_t), cmp_links_desc);
+
+        //keep the significant candidates, or the most likely one if none are significant
+        nSig = 0;
+        for (k = start; k < candStarts[i+1]; k++)
+        {
+            if (cand.links[k].p > cutoff)
+            {
+                if (push_link(out, cand.links[k].p, i, cand.links[k].j) < 0) goto FINALIZE_link_pair;
+                nSig++;
+            }
+        }
+
+        if (nSig == 0)
+        {
+            if (push_link(out, cand.links[start].p, i, cand.links[start].j) < 0) goto FINALIZE_link_pair;
+        }
+    }
+
+    ret = 0;
+
+FINALIZE_link_pair:
+    free(candStarts);
+    free(cellStarts);
+    free(cellFill);
+    free(cellObjs);
+    free(objCells);
+    free(rowMax);
+    free(cand.links);
+
+    return ret;
+}
+
+/*
+Greedily assign the links for one frame pair (as in Tracker.updateTrack) - links are taken in order of decreasing
+probability, and each object in either frame may only participate in one link. Writes the (global) index of the
+parent object into parents for each object in the current frame (or -1 for new objects).
+*/
+static int assign_links(link_list_t *links, int i0, int ni, int j0, int nj, int *parents)
+{
+    char *iUsed, *jUsed;
+    int k;
+    link_t *lk;
+
+    iUsed = calloc(ni + 1, 1);
+    jUsed = calloc(nj + 1, 1);
+    if ((iUsed == NULL) || (jUsed == NULL))
+    {
+        free(iUsed);
+        free(jUsed);
+        return -1;
+    }
+
+    qsort(links->links, links->nLinks, sizeof(link_t), cmp_links_desc);
+
+    for (k = 0; k < ni; k++) parents[i0 + k] = -1;
+
+    for (k = 0; k < links->nLinks; k++)
+    {
+        lk = &(links->links[k]);
+        if ((lk->p == 0) || iUsed[lk->i]) continue;
+        if ((lk->j >= 0) && jUsed[lk->j]) continue;
+
+        iUsed[lk->i] = 1;
+        if (lk->j >= 0)
+        {
+            jUsed[lk->j] = 1;
+            parents[i0 + lk->i] = j0 + lk->j;
+        }
+    }
+
+    free(iUsed);
+    free(jUsed);
+    return 0;
+}
+
+static PyObject * linkFrames(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oFeats=0, *oFrameStarts=0, *oParents=0;
+    PyArrayObject *aFeats=0, *aFrameStarts=0;
+    PyArrayObject *aParents=0;
+
+    float *feats;
+    int *frameStarts, *parents;
+    int nFeats, nFrames, fr, i0, i1, j0, j1;
+    int startFrame = 1, endFrame = -1;
+    int err = 0;
+
+    float r0 = 500, pNew = 0.2, cutoff = 0.1, gate = 0;
+
+    link_list_t links = {NULL, 0, 0};
+
+    static char *kwlist[] = {"feats", "frameStarts", "parents", "r0", "pNew", "linkageCutoffProb", "gateRadius",
+                             "startFrame", "endFrame", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOO|ffffii", kwlist,
+         &oFeats, &oFrameStarts, &oParents, &r0, &pNew, &cutoff, &gate, &startFrame, &endFrame))
+        return NULL;
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_linkFrames;\
+        }
+
+    aFeats = (PyArrayObject *) PyArray_ContiguousFromObject(oFeats, NPY_FLOAT, 2, 2);
+    if (aFeats == NULL) ABORT("Bad feats - expecting a 2D [nObjects, nFeatures] array")
+
+    aFrameStarts = (PyArrayObject *) PyArray_ContiguousFromObject(oFrameStarts, NPY_INT, 1, 1);
+    if (aFrameStarts == NULL) ABORT("Bad frameStarts")
+
+    //parents is an output array and must be written in place
+    if (!PyArray_Check(oParents)) ABORT("parents must be an array")
+    aParents = (PyArrayObject *) oParents;
+    if ((PyArray_TYPE(aParents) != NPY_INT) || !PyArray_ISCARRAY(aParents) ||
+        (PyArray_SIZE(aParents) != PyArray_DIM(aFeats, 0)))
+        ABORT("parents must be a contiguous int32 array with one entry per object")
+
+    if (gate <= 0) gate = 10*r0;
+
+    feats = (float *) PyArray_DATA(aFeats);
+    nFeats = (int) PyArray_DIM(aFeats, 1);
+    frameStarts = (int *) PyArray_DATA(aFrameStarts);
+    nFrames = (int) PyArray_DIM(aFrameStarts, 0) - 1;
+    parents = (int *) PyArray_DATA(aParents);
+
+    if (endFrame < 0) endFrame = nFrames;
+    startFrame = MAX(startFrame, 1);
+    endFrame = MIN(endFrame, nFrames);
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (fr = startFrame; fr < endFrame; fr++)
+    {
+        i0 = frameStarts[fr];
+        i1 = frameStarts[fr + 1];
+        j0 = frameStarts[fr - 1];
+        j1 = frameStarts[fr];
+
+        if (link_pair(feats + i0*nFeats, i1 - i0, feats + j0*nFeats, j1 - j0, nFeats, r0, pNew, cutoff, gate, &links) < 0)
+        {
+            err = 1;
+            break;
+        }
+
+        if (assign_links(&links, i0, i1 - i0, j0, j1 - j0, parents) < 0)
+        {
+            err = 1;
+            break;
+        }
+    }
+    Py_END_ALLOW_THREADS;
+
+    free(links.links);
+
+    if (err) ABORT("Error allocating memory for linkages")
+
+    Py_XDECREF(aFeats);
+    Py_XDECREF(aFrameStarts);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+
+FINALIZE_linkFrames:
+    #undef ABORT
+
+    Py_XDECREF(aFeats);
+    Py_XDECREF(aFrameStarts);
+
+    return NULL;
+}
+
+static PyObject * frameLinkages(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oFeats_i=0, *oFeats_j=0;
+    PyArrayObject *aFeats_i=0, *aFeats_j=0;
+    PyArrayObject *aI=0, *aJ=0, *aP=0;
+    PyObject *res = NULL;
+
+    int *pI, *pJ;
+    float *pP;
+    int k, ret;
+    npy_intp dims[1];
+
+    float r0 = 500, pNew = 0.2, cutoff = 0.1, gate = 0;
+
+    link_list_t links = {NULL, 0, 0};
+
+    static char *kwlist[] = {"feats_i", "feats_j", "r0", "pNew", "linkageCutoffProb", "gateRadius", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OO|ffff", kwlist,
+         &oFeats_i, &oFeats_j, &r0, &pNew, &cutoff, &gate))
+        return NULL;
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_frameLinkages;\
+        }
+
+    aFeats_i = (PyArrayObject *) PyArray_ContiguousFromObject(oFeats_i, NPY_FLOAT, 2, 2);
+    if (aFeats_i == NULL) ABORT("Bad feats_i - expecting a 2D [nObjects, nFeatures] array")
+
+    aFeats_j = (PyArrayObject *) PyArray_ContiguousFromObject(oFeats_j, NPY_FLOAT, 2, 2);
+    if ((aFeats_j == NULL) || (PyArray_DIM(aFeats_j, 1) != PyArray_DIM(aFeats_i, 1)))
+        ABORT("Bad feats_j - expecting a 2D [nObjects, nFeatures] array")
+
+    if (gate <= 0) gate = 10*r0;
+
+    Py_BEGIN_ALLOW_THREADS;
+    ret = link_pair((float *) PyArray_DATA(aFeats_i), (int) PyArray_DIM(aFeats_i, 0),
+                    (float *) PyArray_DATA(aFeats_j), (int) PyArray_DIM(aFeats_j, 0), (int) PyArray_DIM(aFeats_i, 1),
+                    r0, pNew, cutoff, gate, &links);
+    Py_END_ALLOW_THREADS;
+
+    if (ret < 0) ABORT("Error allocating memory for linkages")
+
+    dims[0] = links.nLinks;
+    aI = (PyArrayObject *) PyArray_SimpleNew(1, dims, NPY_INT);
+    aJ = (PyArrayObject *) PyArray_SimpleNew(1, dims, NPY_INT);
+    aP = (PyArrayObject *) PyArray_SimpleNew(1, dims, NPY_FLOAT);
+    if ((aI == NULL) || (aJ == NULL) || (aP == NULL)) ABORT("Error allocating output arrays")
+
+    pI = (int *) PyArray_DATA(aI);
+    pJ = (int *) PyArray_DATA(aJ);
+    pP = (float *) PyArray_DATA(aP);
+
+    for (k = 0; k < links.nLinks; k++)
+    {
+        pI[k] = links.links[k].i;
+        pJ[k] = links.links[k].j;
+        pP[k] = links.links[k].p;
+    }
+
+    res = Py_BuildValue("(OOO)", aI, aJ, aP);
+
+FINALIZE_frameLinkages:
+    #undef ABORT
+
+    free(links.links);
+    Py_XDECREF(aFeats_i);
+    Py_XDECREF(aFeats_j);
+    Py_XDECREF(aI);
+    Py_XDECREF(aJ);
+    Py_XDECREF(aP);
+
+    return res;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+static PyMethodDef trackLinkageMethods[] = {
+    {"linkFrames",  linkFrames, METH_VARARGS | METH_KEYWORDS,
+    "Link objects in each frame in [startFrame, endFrame) to those in the previous frame, writing the index of the "
+    "matched object (or -1) into `parents`.\n Arguments are: 'feats' [nObjects, nFeatures] (sorted by frame), "
+    "'frameStarts' (nFrames + 1 offsets into feats), 'parents', 'r0'=500, 'pNew'=0.2, 'linkageCutoffProb'=0.1, "
+    "'gateRadius'=10*r0, 'startFrame'=1, 'endFrame'=nFrames"},
+    {"frameLinkages",  frameLinkages, METH_VARARGS | METH_KEYWORDS,
+    "Calculate the significant linkage candidates between two frames. Returns (i, j, p) arrays, with j=-1 for new "
+    "objects.\n Arguments are: 'feats_i', 'feats_j', 'r0'=500, 'pNew'=0.2, 'linkageCutoffProb'=0.1, 'gateRadius'=10*r0"},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+#pragma GCC diagnostic pop
+
+#if PY_MAJOR_VERSION>=3
+static struct PyModuleDef moduledef = {
+        PyModuleDef_HEAD_INIT,
+        "trackLinkage",     /* m_name */
+        "sparse, gated frame to frame linkage for tracking",  /* m_doc */
+        -1,                  /* m_size */
+        trackLinkageMethods,    /* m_methods */
+        NULL,                /* m_reload */
+        NULL,                /* m_traverse */
+        NULL,                /* m_clear */
+        NULL,                /* m_free */
+    };
+
+PyMODINIT_FUNC PyInit_trackLinkage(void)
+{
+	PyObject *m;
+    m = PyModule_Create(&moduledef);
+    import_array()
+    return m;
+}
+
+#else
+PyMODINIT_FUNC inittrackLinkage(void)
+{
+    PyObject *m;
+
+    m = Py_InitModule("trackLinkage", trackLinkageMethods);
+    import_array()
+}
+#endif
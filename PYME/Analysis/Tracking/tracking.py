@@ -8,18 +8,31 @@ Created on Wed Mar 11 15:41:31 2015
 import numpy as np
 from scipy import spatial
 from six.moves import xrange
+import multiprocessing
+from PYME.util.threaded import run_threaded
+
+try:
+    from . import trackLinkage
+except ImportError:
+    trackLinkage = None
+
+NUM_PROCS = multiprocessing.cpu_count()
 
 #rt = [np.vstack([x[t==i], y[t == i]]) for i in range(t.max() + 1)]
 #ind_t = [index[t == i]]
 
 class Tracker(object):
-    def __init__(self, t, xvs, pNew=0.2, r0=500, linkageCuttoffProb=0.1):
+    def __init__(self, t, xvs, pNew=0.2, r0=500, linkageCuttoffProb=0.1, gateRadius=None):
         self.t = t
         self.xvs = xvs
         
         self.pNew = pNew #probability of an object not being present in previous frame
         self.r0 = r0 #mean distance an object can move
         self.linkageCuttoffProb = linkageCuttoffProb #probability below which a possible inkage is ignored
+        
+        #distance beyond which we don't consider linkages (when using the native linkage code). If None, this is
+        #chosen such that a gated candidate could not have a linkage probability above linkageCuttoffProb/10
+        self.gateRadius = gateRadius
 
         #index of objects
         self.objIndex = np.arange(len(t))
@@ -104,9 +117,81 @@ class Tracker(object):
             
         return linkages
         
+    def _gate(self):
+        if self.gateRadius:
+            return float(self.gateRadius)
+        
+        return float(self.r0*np.log(10./(self.pNew*self.linkageCuttoffProb)))
+        
     def calcLinkages(self, i, j, manualLinkages = []):
-        lMatch, jIndices = self.calcLinkageMatrix(i,j, manualLinkages=manualLinkages)
-        return self.getLinkageCandidates(lMatch, jIndices)
+        if (trackLinkage is None) or (len(manualLinkages) > 0):
+            lMatch, jIndices = self.calcLinkageMatrix(i,j, manualLinkages=manualLinkages)
+            return self.getLinkageCandidates(lMatch, jIndices)
+        
+        #use the sparse, gated, native version
+        if i >= len(self.xvsByT):
+            return {}
+        
+        jIndices = self.indicesByT[j]
+        ii, jj, pp = trackLinkage.frameLinkages(self.xvsByT[i].T.astype('f4'), self.xvsByT[j].T.astype('f4'),
+                                                r0=self.r0, pNew=self.pNew,
+                                                linkageCutoffProb=self.linkageCuttoffProb, gateRadius=self._gate())
+        
+        absJ = np.where(jj >= 0, jIndices[np.maximum(jj, 0)] if len(jIndices) > 0 else -1, -1)
+        
+        #group the candidates by object in i (stable, to keep the kernel's ordering within each object)
+        order = np.argsort(ii, kind='mergesort')
+        keys, starts = np.unique(ii[order], return_index=True)
+        
+        return dict(zip(keys, zip(np.split(absJ[order], starts[1:]), np.split(pp[order], starts[1:]))))
+    
+    def track(self, nThreads=NUM_PROCS):
+        """
+        Link all frames to their predecessors (equivalent to calling calcLinkages(i, i-1) followed by updateTrack(i, L)
+        for every frame) using the native, grid gated, linkage code. Frame pairs are processed in parallel.
+        
+        Returns
+        -------
+        
+        clumpIndex : the track index for each object (also stored as self.clumpIndex)
+        """
+        if trackLinkage is None:
+            for i in range(1, len(self.indicesByT)):
+                self.updateTrack(i, self.calcLinkages(i, i - 1))
+                
+            return self.clumpIndex
+        
+        nFrames = len(self.indicesByT)
+        
+        #sort objects by frame so that each frame is a contiguous block of rows
+        I = np.argsort(self.t, kind='mergesort')
+        feats = np.ascontiguousarray(np.atleast_2d(self.xvs)[:, I].T, dtype='f4')
+        frameStarts = np.searchsorted(self.t[I], np.arange(nFrames + 1)).astype('i4')
+        
+        parents = -np.ones(len(I), 'i4')
+        
+        kwargs = dict(r0=self.r0, pNew=self.pNew, linkageCutoffProb=self.linkageCuttoffProb,
+                      gateRadius=self._gate())
+        
+        #split the frame pairs between threads, balancing on the number of objects
+        nThreads = max(min(nThreads, nFrames - 1), 1)
+        bounds = np.searchsorted(frameStarts, np.linspace(0, len(I), nThreads + 1)[1:-1])
+        bounds = np.unique(np.hstack([1, bounds, nFrames]))
+        
+        def _link(start, end):
+            trackLinkage.linkFrames(feats, frameStarts, parents, startFrame=int(start), endFrame=int(end), **kwargs)
+        
+        run_threaded(_link, list(zip(bounds[:-1], bounds[1:])))
+        
+        #propagate the track indices forward in time
+        parents = np.where(parents >= 0, I[np.maximum(parents, 0)], -1)
+        for i in range(1, nFrames):
+            inds = I[frameStarts[i]:frameStarts[i+1]]
+            p = parents[frameStarts[i]:frameStarts[i+1]]
+            m = p >= 0
+            self.clumpIndex[inds[m]] = self.clumpIndex[p[m]]
+            
+        return self.clumpIndex
         
     def updateTrack(self, i, linkages):
         if i >= len(self.indicesByT):
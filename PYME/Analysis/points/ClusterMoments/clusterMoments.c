@@ -0,0 +1,269 @@
+/*
+##################
+# clusterMoments.c
+#
+# Copyright David Baddeley, 2019
+# d.baddeley@auckland.ac.nz
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+##################
+ */
+
+/*
+Centred moments (see moments.calcCenteredMoments) for many clusters at once.
+
+The points for each cluster must be contiguous (i.e. the table sorted by cluster label), with the offsets of each
+cluster given by `starts`. Optionally, the moments are estimated as in moments.calcMCCenteredMoments by averaging over
+nSamples random half-subsamples of each cluster, with the standard deviation over the subsamples as an error estimate.
+
+The random subsampling uses a counter based generator keyed on (seed, cluster, sample, point), so that the results do
+not depend on how the clusters are split between threads.
+*/
+
+#include "Python.h"
+#include <math.h>
+#include "numpy/arrayobject.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define MIN(a, b) ((a<b) ? a : b)
+#define MAX(a, b) ((a>b) ? a : b)
+
+#define MAX_ORDER 20
+
+/* splitmix64 finaliser - a cheap, well mixed hash of a 64 bit counter */
+static uint64_t mix64(uint64_t z)
+{
+    z += 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27))*0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* include point i of cluster c in subsample s with probability 0.5 */
+static int in_subsample(uint64_t seed, int c, int s, int i)
+{
+    uint64_t key = mix64(seed ^ mix64(((uint64_t) c << 32) ^ (uint64_t) s));
+    return (int) (mix64(key + (uint64_t) i) >> 63);
+}
+
+/*
+Calculate the [N, N] centred moments (N = order + 1) of the points [i0, i1) into m. If seed/s are given (s >= 0),
+only the points in the given subsample are used.
+*/
+static void centred_moments(const double *x, const double *y, int i0, int i1, int order, int c, int s, uint64_t seed,
+                            double *m)
+{
+    int N = order + 1;
+    int i, j, k, n = 0;
+    double xm = 0, ym = 0;
+    double px[MAX_ORDER + 1], py[MAX_ORDER + 1];
+
+    for (i = i0; i < i1; i++)
+    {
+        if ((s >= 0) && !in_subsample(seed, c, s, i - i0)) continue;
+        xm += x[i];
+        ym += y[i];
+        n++;
+    }
+
+    for (j = 0; j < N*N; j++) m[j] = 0;
+
+    if (n == 0)
+    {
+        //matches numpy's behaviour for an empty selection
+        for (j = 0; j < N*N; j++) m[j] = NAN;
+        return;
+    }
+
+    xm /= n;
+    ym /= n;
+
+    for (i = i0; i < i1; i++)
+    {
+        if ((s >= 0) && !in_subsample(seed, c, s, i - i0)) continue;
+
+        px[0] = 1;
+        py[0] = 1;
+        for (j = 1; j < N; j++)
+        {
+            px[j] = px[j - 1]*(x[i] - xm);
+            py[j] = py[j - 1]*(y[i] - ym);
+        }
+
+        for (j = 0; j < N; j++)
+            for (k = 0; k < N; k++) m[j*N + k] += px[j]*py[k];
+    }
+
+    for (j = 0; j < N*N; j++) m[j] /= n;
+}
+
+static PyObject * momentsByCluster(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oX=0, *oY=0, *oStarts=0, *oMoments=0, *oErrors=0;
+    PyArrayObject *aX=0, *aY=0, *aStarts=0, *aMoments=0, *aErrors=0;
+    double *x, *y, *moments, *errors, *mc, *me;
+    double *m=NULL;
+    int *starts;
+    int nPts, nClusters, N, NN, c, s, j;
+    int order = 4, nSamples = 0, startCluster = 0, endCluster = -1;
+    unsigned long long seed = 0;
+    double d;
+
+    static char *kwlist[] = {"x", "y", "starts", "moments", "errors", "order", "nSamples", "seed", "startCluster",
+                             "endCluster", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOOOO|iiKii", kwlist, &oX, &oY, &oStarts, &oMoments, &oErrors,
+         &order, &nSamples, &seed, &startCluster, &endCluster))
+        return NULL;
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_momentsByCluster;\
+        }
+
+    if ((order < 0) || (order > MAX_ORDER)) ABORT("order must be in [0, 20]")
+    N = order + 1;
+    NN = N*N;
+
+    aX = (PyArrayObject *) PyArray_ContiguousFromObject(oX, NPY_DOUBLE, 1, 1);
+    if (aX == NULL) ABORT("Bad x")
+    nPts = (int) PyArray_DIM(aX, 0);
+
+    aY = (PyArrayObject *) PyArray_ContiguousFromObject(oY, NPY_DOUBLE, 1, 1);
+    if ((aY == NULL) || (PyArray_DIM(aY, 0) != nPts)) ABORT("Bad y")
+
+    aStarts = (PyArrayObject *) PyArray_ContiguousFromObject(oStarts, NPY_INT, 1, 1);
+    if ((aStarts == NULL) || (PyArray_DIM(aStarts, 0) < 1)) ABORT("Bad starts - expecting nClusters + 1 offsets")
+    nClusters = (int) PyArray_DIM(aStarts, 0) - 1;
+    starts = (int *) PyArray_DATA(aStarts);
+
+    for (c = 0; c < nClusters; c++)
+        if ((starts[c] < 0) || (starts[c + 1] < starts[c]) || (starts[c + 1] > nPts))
+            ABORT("starts must be non-decreasing offsets into the points")
+
+    //moments and errors are output arrays and must be written in place
+    if (!PyArray_Check(oMoments) || !PyArray_Check(oErrors)) ABORT("moments and errors must be arrays")
+    aMoments = (PyArrayObject *) oMoments;
+    aErrors = (PyArrayObject *) oErrors;
+    if ((PyArray_TYPE(aMoments) != NPY_DOUBLE) || !PyArray_ISCARRAY(aMoments) || (PyArray_SIZE(aMoments) != nClusters*NN) ||
+        (PyArray_TYPE(aErrors) != NPY_DOUBLE) || !PyArray_ISCARRAY(aErrors) || (PyArray_SIZE(aErrors) != nClusters*NN))
+        ABORT("moments and errors must be contiguous float64 [nClusters, order + 1, order + 1] arrays")
+
+    x = (double *) PyArray_DATA(aX);
+    y = (double *) PyArray_DATA(aY);
+    moments = (double *) PyArray_DATA(aMoments);
+    errors = (double *) PyArray_DATA(aErrors);
+
+    m = (double *) malloc(NN*sizeof(double));
+    if (m == NULL) ABORT("Error allocating memory")
+
+    if (endCluster < 0) endCluster = nClusters;
+    startCluster = MAX(startCluster, 0);
+    endCluster = MIN(endCluster, nClusters);
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (c = startCluster; c < endCluster; c++)
+    {
+        mc = moments + (size_t) c*NN;
+        me = errors + (size_t) c*NN;
+
+        if (nSamples <= 0)
+        {
+            centred_moments(x, y, starts[c], starts[c + 1], order, c, -1, seed, mc);
+            for (j = 0; j < NN; j++) me[j] = 0;
+            continue;
+        }
+
+        //accumulate the mean and variance over the subsamples (Welford)
+        for (j = 0; j < NN; j++)
+        {
+            mc[j] = 0;
+            me[j] = 0;
+        }
+
+        for (s = 0; s < nSamples; s++)
+        {
+            centred_moments(x, y, starts[c], starts[c + 1], order, c, s, seed, m);
+            for (j = 0; j < NN; j++)
+            {
+                d = m[j] - mc[j];
+                mc[j] += d/(s + 1);
+                me[j] += d*(m[j] - mc[j]);
+            }
+        }
+
+        for (j = 0; j < NN; j++) me[j] = sqrt(me[j]/nSamples);
+    }
+    Py_END_ALLOW_THREADS;
+
+    free(m);
+
+    Py_XDECREF(aX);
+    Py_XDECREF(aY);
+    Py_XDECREF(aStarts);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+
+FINALIZE_momentsByCluster:
+    #undef ABORT
+
+    if (m) free(m);
+
+    Py_XDECREF(aX);
+    Py_XDECREF(aY);
+    Py_XDECREF(aStarts);
+
+    return NULL;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+static PyMethodDef clusterMomentsMethods[] = {
+    {"momentsByCluster",  momentsByCluster, METH_VARARGS | METH_KEYWORDS,
+    "Calculate the centred moments of each cluster [starts[i], starts[i+1]) for clusters [startCluster, endCluster), "
+    "writing them into `moments` and `errors`.\n Arguments are: 'x', 'y', 'starts', 'moments', 'errors' (float64 "
+    "[nClusters, order + 1, order + 1]), 'order'=4, 'nSamples'=0 (if > 0, average over random half-subsamples and "
+    "report their std. deviation as the error), 'seed'=0, 'startCluster'=0, 'endCluster'=nClusters"},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+#pragma GCC diagnostic pop
+
+#if PY_MAJOR_VERSION>=3
+static struct PyModuleDef moduledef = {
+        PyModuleDef_HEAD_INIT,
+        "clusterMoments",     /* m_name */
+        "centred moments of many clusters",  /* m_doc */
+        -1,                  /* m_size */
+        clusterMomentsMethods,    /* m_methods */
+        NULL,                /* m_reload */
+        NULL,                /* m_traverse */
+        NULL,                /* m_clear */
+        NULL,                /* m_free */
+    };
+
+PyMODINIT_FUNC PyInit_clusterMoments(void)
+{
+	PyObject *m;
+    m = PyModule_Create(&moduledef);
+    import_array()
+    return m;
+}
+
+#else
+PyMODINIT_FUNC initclusterMoments(void)
+{
+    PyObject *m;
+
+    m = Py_InitModule("clusterMoments", clusterMomentsMethods);
+    import_array()
+}
+#endif
@@ -1045,6 +1045,380 @@ static PyObject * aggregateSum(PyObject *self, PyObject *args, PyObject *keywds)
 }
 
 
+/*
+Multiview / multi-channel clumping using a spatial-temporal hash.
+
+Points are visited in time order (given by `order`, so that the columns themselves do not need to be re-ordered), and
+inserted into a hash table keyed on their spatial cell. Each cell holds a newest-first chain of the points which have
+fallen into it, so that a search for candidates within the last nFrames frames can stop as soon as it reaches a point
+which is outside the frame window. Each point joins the clump of the nearest candidate within 2*delta_x (the same
+criterion as findClumpsN), or starts a new clump.
+
+Columns may be either float32 or float64 (or int32 for t), and are read in place.
+*/
+
+/* the grid cell size is this percentile of the search radii */
+#define MV_CELL_PERCENTILE 90
+
+/* points which would need to search more than this many cells either side of their own look at all cells instead */
+#define MV_MAX_SEARCH_CELLS 8
+
+typedef struct
+{
+    char *data;
+    int typenum;
+} mv_col_t;
+
+static inline double mv_get(mv_col_t *col, npy_intp i)
+{
+    switch (col->typenum)
+    {
+        case NPY_DOUBLE:
+            return ((double *) col->data)[i];
+        case NPY_FLOAT:
+            return ((float *) col->data)[i];
+        case NPY_INT:
+            return ((int *) col->data)[i];
+        default:
+            return ((npy_longlong *) col->data)[i];
+    }
+}
+
+//get a contiguous view of a column without changing its type (if it is one of the types we know how to read)
+static PyArrayObject * mv_column(PyObject *o, npy_intp n, mv_col_t *col)
+{
+    PyArrayObject *a = NULL;
+    int typenum = NPY_DOUBLE;
+
+    if (PyArray_Check(o))
+    {
+        typenum = PyArray_TYPE((PyArrayObject *) o);
+        if ((typenum != NPY_FLOAT) && (typenum != NPY_DOUBLE) && (typenum != NPY_INT) && (typenum != NPY_LONGLONG))
+            typenum = NPY_DOUBLE;
+    }
+
+    a = (PyArrayObject *) PyArray_ContiguousFromObject(o, typenum, 1, 1);
+    if (a == NULL) return NULL;
+
+    if (PyArray_DIM(a, 0) != n)
+    {
+        Py_DECREF(a);
+        return NULL;
+    }
+
+    col->data = PyArray_DATA(a);
+    col->typenum = typenum;
+
+    return a;
+}
+
+static inline npy_uint64 mv_hash(long long cx, long long cy)
+{
+    npy_uint64 h = ((npy_uint64) cx)*0x9E3779B97F4A7C15ULL ^ ((npy_uint64) cy)*0xC2B2AE3D27D4EB4FULL;
+    return h ^ (h >> 29);
+}
+
+/*
+Look through the (newest first) chain of points in a cell for the nearest point to i which is within the frame window
+(t > t_i - nFrames, as in findClumpsN) and closer than sqrt(best).
+*/
+static inline void mv_scan_chain(npy_intp k, npy_intp i, int *next, mv_col_t *t, double tmin, int withinChannel,
+                                 int *chan, double *xs, double *ys, double *best, int *bestJ)
+{
+    double d2;
+
+    for (; k >= 0; k = next[k])
+    {
+        //stop once we leave the frame window
+        if (mv_get(t, k) <= tmin) break;
+        if (withinChannel && (chan[k] != chan[i])) continue;
+
+        d2 = (xs[k] - xs[i])*(xs[k] - xs[i]) + (ys[k] - ys[i])*(ys[k] - ys[i]);
+        if (d2 < *best)
+        {
+            *best = d2;
+            *bestJ = (int) k;
+        }
+    }
+}
+
+/* the kth smallest of n values (partially reorders a) */
+static double mv_select(double *a, npy_intp n, npy_intp kth)
+{
+    npy_intp lo = 0, hi = n - 1, i, j;
+    double pivot, tmp;
+
+    while (lo < hi)
+    {
+        pivot = a[(lo + hi)/2];
+        i = lo;
+        j = hi;
+        while (i <= j)
+        {
+            while (a[i] < pivot) i++;
+            while (a[j] > pivot) j--;
+            if (i <= j)
+            {
+                tmp = a[i]; a[i] = a[j]; a[j] = tmp;
+                i++;
+                j--;
+            }
+        }
+
+        if (kth <= j) hi = j;
+        else if (kth >= i) lo = i;
+        else break;
+    }
+
+    return a[kth];
+}
+
+static PyObject * findClumpsMultiview(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *tO=0, *xO=0, *yO=0, *delta_xO=0, *chanO=0, *orderO=Py_None, *dxO=Py_None, *dyO=Py_None;
+    PyObject *chan_dxO=Py_None, *chan_dyO=Py_None;
+    PyArrayObject *tA=0, *xA=0, *yA=0, *delta_xA=0, *chanA=0, *orderA=0, *dxA=0, *dyA=0, *chan_dxA=0, *chan_dyA=0;
+    PyArrayObject *assignedA=0, *maskA=0, *sortA=0;
+    PyObject *res = NULL;
+
+    mv_col_t t, x, y, delta_x, dx, dy;
+    int *chan, *order, *assigned, *next = NULL, *heads = NULL;
+    npy_uint32 *masks;
+    long long *keys = NULL;
+    double *chan_dx = NULL, *chan_dy = NULL, *xs = NULL, *ys = NULL, *radii = NULL;
+    int nFrames = 10, withinChannel = 0, nChanOffsets = 0, err = 0;
+    npy_intp nPts, i, n, nRadii = 0, slot;
+    npy_uint64 tableSize, h;
+    long long cx, cy, ix, iy, key, m;
+    double cellSize = 0, r, best, tmin;
+    int bestJ, c, clumpNum = 1;
+    npy_intp dims[1];
+
+    static char *kwlist[] = {"t", "x", "y", "delta_x", "chan", "order", "nFrames", "dx", "dy", "chan_dx", "chan_dy",
+                             "within_channel", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOOOO|OiOOOOi", kwlist,
+         &tO, &xO, &yO, &delta_xO, &chanO, &orderO, &nFrames, &dxO, &dyO, &chan_dxO, &chan_dyO, &withinChannel))
+        return NULL;
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_findClumpsMultiview;\
+        }
+
+    chanA = (PyArrayObject *) PyArray_ContiguousFromObject(chanO, NPY_INT, 1, 1);
+    if (chanA == NULL) ABORT("Bad chan")
+
+    nPts = PyArray_DIM(chanA, 0);
+    chan = (int *) PyArray_DATA(chanA);
+
+    tA = mv_column(tO, nPts, &t);
+    if (tA == NULL) ABORT("Bad t")
+
+    xA = mv_column(xO, nPts, &x);
+    if (xA == NULL) ABORT("Bad x")
+
+    yA = mv_column(yO, nPts, &y);
+    if (yA == NULL) ABORT("Bad y")
+
+    delta_xA = mv_column(delta_xO, nPts, &delta_x);
+    if (delta_xA == NULL) ABORT("Bad delta_x")
+
+    if (orderO != Py_None)
+    {
+        orderA = (PyArrayObject *) PyArray_ContiguousFromObject(orderO, NPY_INT, 1, 1);
+        if ((orderA == NULL) || (PyArray_DIM(orderA, 0) != nPts)) ABORT("Bad order")
+    }
+    else
+    {
+        //the frame windows rely on visiting points in time order - sort them ourselves if no order was given
+        sortA = (PyArrayObject *) PyArray_ArgSort(tA, 0, NPY_MERGESORT);
+        if (sortA == NULL) ABORT("Error sorting t")
+        orderA = (PyArrayObject *) PyArray_FROM_OTF((PyObject *) sortA, NPY_INT, NPY_ARRAY_IN_ARRAY | NPY_ARRAY_FORCECAST);
+        if (orderA == NULL) ABORT("Error sorting t")
+    }
+
+    order = (int *) PyArray_DATA(orderA);
+    for (n = 0; n < nPts; n++)
+        if ((order[n] < 0) || (order[n] >= nPts)) ABORT("Bad order - index out of range")
+
+    if (dxO != Py_None)
+    {
+        dxA = mv_column(dxO, nPts, &dx);
+        if (dxA == NULL) ABORT("Bad dx")
+    }
+
+    if (dyO != Py_None)
+    {
+        dyA = mv_column(dyO, nPts, &dy);
+        if (dyA == NULL) ABORT("Bad dy")
+    }
+
+    if ((chan_dxO != Py_None) && (chan_dyO != Py_None))
+    {
+        chan_dxA = (PyArrayObject *) PyArray_ContiguousFromObject(chan_dxO, NPY_DOUBLE, 1, 1);
+        chan_dyA = (PyArrayObject *) PyArray_ContiguousFromObject(chan_dyO, NPY_DOUBLE, 1, 1);
+        if ((chan_dxA == NULL) || (chan_dyA == NULL) || (PyArray_DIM(chan_dxA, 0) != PyArray_DIM(chan_dyA, 0)))
+            ABORT("Bad channel offsets")
+
+        nChanOffsets = (int) PyArray_DIM(chan_dxA, 0);
+        chan_dx = (double *) PyArray_DATA(chan_dxA);
+        chan_dy = (double *) PyArray_DATA(chan_dyA);
+    }
+
+    dims[0] = nPts;
+    assignedA = (PyArrayObject *) PyArray_SimpleNew(1, dims, NPY_INT);
+    if (assignedA == NULL) ABORT("Error allocating array for clump assignments")
+    assigned = (int *) PyArray_DATA(assignedA);
+
+    Py_BEGIN_ALLOW_THREADS;
+
+    //corrected positions, and the search cell size (the largest search radius)
+    xs = malloc(nPts*sizeof(double));
+    ys = malloc(nPts*sizeof(double));
+    next = malloc(nPts*sizeof(int));
+    radii = malloc(nPts*sizeof(double));
+
+    tableSize = 16;
+    while (tableSize < (npy_uint64) (2*nPts)) tableSize *= 2;
+    heads = malloc(tableSize*sizeof(int));
+    keys = malloc(tableSize*sizeof(long long));
+
+    if ((xs == NULL) || (ys == NULL) || (next == NULL) || (radii == NULL) || (heads == NULL) || (keys == NULL))
+    {
+        err = 1;
+    }
+    else
+    {
+        for (i = 0; i < nPts; i++)
+        {
+            xs[i] = mv_get(&x, i);
+            ys[i] = mv_get(&y, i);
+            if (dxA) xs[i] += mv_get(&dx, i);
+            if (dyA) ys[i] += mv_get(&dy, i);
+            if (chan_dx && (chan[i] >= 0) && (chan[i] < nChanOffsets))
+            {
+                xs[i] += chan_dx[chan[i]];
+                ys[i] += chan_dy[chan[i]];
+            }
+
+            r = 2*mv_get(&delta_x, i);
+            if ((r > 0) && (r < INFINITY)) radii[nRadii++] = r;
+        }
+
+        //size the cells for the typical search radius (not the largest - a few points with large errors would
+        //otherwise make the grid useless). Points with larger radii search more cells.
+        if (nRadii > 0) cellSize = mv_select(radii, nRadii, (nRadii*MV_CELL_PERCENTILE)/100);
+        if (cellSize <= 0) cellSize = 1;
+
+        for (h = 0; h < tableSize; h++) heads[h] = -1;
+
+        for (n = 0; n < nPts; n++)
+        {
+            i = order[n];
+            assigned[i] = 0;
+
+            //points with a negative channel are never clumped
+            if (chan[i] < 0)
+            {
+                assigned[i] = clumpNum++;
+                continue;
+            }
+
+            cx = (long long) floor(xs[i]/cellSize);
+            cy = (long long) floor(ys[i]/cellSize);
+            r = 2*mv_get(&delta_x, i);
+            tmin = mv_get(&t, i) - nFrames;
+            best = r*r;
+            bestJ = -1;
+
+            //the number of cells we need to search either side of our own
+            if (!(r > 0)) m = 1;
+            else if (r/cellSize > MV_MAX_SEARCH_CELLS) m = MV_MAX_SEARCH_CELLS + 1;
+            else m = (long long) ceil(r/cellSize);
+
+            if (m > MV_MAX_SEARCH_CELLS)
+            {
+                //a (rare) point with a very large search radius - just look at every occupied cell
+                for (h = 0; h < tableSize; h++)
+                    if (heads[h] >= 0)
+                        mv_scan_chain(heads[h], i, next, &t, tmin, withinChannel, chan, xs, ys, &best, &bestJ);
+            }
+            else
+            {
+                for (ix = cx - m; ix <= cx + m; ix++)
+                    for (iy = cy - m; iy <= cy + m; iy++)
+                    {
+                        key = (long long) (((npy_uint64) ix << 32) ^ ((npy_uint64) iy & 0xffffffffULL));
+                        for (h = mv_hash(ix, iy) & (tableSize - 1); heads[h] >= 0; h = (h + 1) & (tableSize - 1))
+                        {
+                            if (keys[h] != key) continue;
+
+                            mv_scan_chain(heads[h], i, next, &t, tmin, withinChannel, chan, xs, ys, &best, &bestJ);
+                            break;
+                        }
+                    }
+            }
+
+            assigned[i] = (bestJ >= 0) ? assigned[bestJ] : clumpNum++;
+
+            //insert into the hash table
+            key = (long long) (((npy_uint64) cx << 32) ^ ((npy_uint64) cy & 0xffffffffULL));
+            for (slot = mv_hash(cx, cy) & (tableSize - 1); heads[slot] >= 0; slot = (slot + 1) & (tableSize - 1))
+                if (keys[slot] == key) break;
+
+            keys[slot] = key;
+            next[i] = heads[slot];
+            heads[slot] = (int) i;
+        }
+    }
+
+    free(xs);
+    free(ys);
+    free(next);
+    free(radii);
+    free(heads);
+    free(keys);
+
+    Py_END_ALLOW_THREADS;
+
+    if (err) ABORT("Error allocating memory for clumping")
+
+    //bitmask of the channels present in each clump
+    dims[0] = clumpNum;
+    maskA = (PyArrayObject *) PyArray_ZEROS(1, dims, NPY_UINT32, 0);
+    if (maskA == NULL) ABORT("Error allocating array for channel masks")
+    masks = (npy_uint32 *) PyArray_DATA(maskA);
+
+    for (i = 0; i < nPts; i++)
+    {
+        c = chan[i];
+        if ((c >= 0) && (c < 32)) masks[assigned[i]] |= (1u << c);
+    }
+
+    res = Py_BuildValue("(OO)", assignedA, maskA);
+
+FINALIZE_findClumpsMultiview:
+    #undef ABORT
+
+    Py_XDECREF(tA);
+    Py_XDECREF(xA);
+    Py_XDECREF(yA);
+    Py_XDECREF(delta_xA);
+    Py_XDECREF(chanA);
+    Py_XDECREF(orderA);
+    Py_XDECREF(sortA);
+    Py_XDECREF(dxA);
+    Py_XDECREF(dyA);
+    Py_XDECREF(chan_dxA);
+    Py_XDECREF(chan_dyA);
+    Py_XDECREF(assignedA);
+    Py_XDECREF(maskA);
+
+    return res;
+}
+
+
 static PyMethodDef deClumpMethods[] = {
     {"findClumps",  findClumps, METH_VARARGS | METH_KEYWORDS,
     ""},
@@ -1058,6 +1432,10 @@ static PyMethodDef deClumpMethods[] = {
     "Aggregate data into clumps by taking the minimum. This assumes data has been sorted by clumpIndex."},
     {"aggregateSum",  aggregateSum, METH_VARARGS | METH_KEYWORDS,
     "Aggregate data into clumps by taking the sum. This assumes data has been sorted by clumpIndex."},
+    {"findClumpsMultiview",  findClumpsMultiview, METH_VARARGS | METH_KEYWORDS,
+    "Clump localizations from all channels in one pass using a spatial-temporal hash. Returns (assigned, chan_masks), "
+    "where chan_masks is a bitmask of the channels present in each clump. Does not require data to be sorted - "
+    "`order` (a stable argsort of t) is calculated if not given."},
     
     {NULL, NULL, 0, NULL}        /* Sentinel */
 };
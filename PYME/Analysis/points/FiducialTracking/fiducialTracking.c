@@ -0,0 +1,422 @@
+/*
+##################
+# fiducialTracking.c
+#
+# Copyright David Baddeley, 2017
+# d.baddeley@auckland.ac.nz
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+##################
+ */
+
+/*
+Streaming (frame by frame) version of the fiducial drift estimation in fiducials.extractAverageTrajectory.
+
+All state lives in numpy arrays owned by the caller (see fiducials.StreamingDriftEstimator), so that each call only has
+to process the frames which have arrived since the last call:
+
+- tracks [maxTracks, TRACK_NFIELDS] holds the fiducial tracks. Each fiducial position in a new frame is linked to the
+  nearest live track (last seen within timeWindow frames, and within 2*delta_x). Once a track has been seen in
+  minTrackLength frames it becomes "established", and its reference position is fixed as the mean of its drift
+  corrected positions.
+- drift [maxFrames, 3] is the raw drift for each frame - the mean offset of all established tracks from their reference
+  positions. Frames without any established fiducials hold the previous value (nFid is 0 for these frames).
+- filtDrift [maxFrames, 3] is the drift after a causal version of the temporal filter (i.e. only using current and
+  past frames), so that the estimate for a frame never changes once that frame has been processed.
+- state [STATE_NFIELDS] holds the index of the next frame to process.
+
+The per-frame cost depends only on the number of fiducials and the filter length, not on the length of the series.
+*/
+
+#include "Python.h"
+#include <math.h>
+#include "numpy/arrayobject.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MIN(a, b) ((a<b) ? a : b)
+#define MAX(a, b) ((a>b) ? a : b)
+
+//fields of the track table
+#define TRACK_REF_X 0
+#define TRACK_REF_Y 1
+#define TRACK_REF_Z 2
+#define TRACK_LAST_X 3
+#define TRACK_LAST_Y 4
+#define TRACK_N 5
+#define TRACK_LAST_T 6
+#define TRACK_ESTABLISHED 7
+#define TRACK_ACTIVE 8
+#define TRACK_NFIELDS 9
+
+//fields of the state vector
+#define STATE_NEXT_FRAME 0
+#define STATE_NFIELDS 4
+
+#define FILTER_GAUSSIAN 0
+#define FILTER_UNIFORM 1
+#define FILTER_MEDIAN 2
+
+//maximum number of (past) frames in the causal filter window
+#define MAX_FILTER_WINDOW 1024
+
+static int filter_window(int filterMode, float filterScale)
+{
+    int w;
+
+    if (filterMode == FILTER_GAUSSIAN)
+        w = (int) ceil(3*filterScale) + 1;
+    else
+        w = (int) filterScale;
+
+    return MIN(MAX(w, 1), MAX_FILTER_WINDOW);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double da = *((const double *) a);
+    double db = *((const double *) b);
+
+    return (da > db) - (da < db);
+}
+
+/* causally filter the (held) drift for frame fr, using frames [fr - window + 1, fr] */
+static void filter_frame(double *drift, double *filtDrift, int fr, int filterMode, float filterScale, double *buf)
+{
+    int w = filter_window(filterMode, filterScale);
+    int n = MIN(w, fr + 1);
+    int d, k;
+    double wt, s, sw;
+
+    for (k = 0; k < 3; k++)
+    {
+        if (filterMode == FILTER_MEDIAN)
+        {
+            for (d = 0; d < n; d++) buf[d] = drift[3*(fr - d) + k];
+            qsort(buf, n, sizeof(double), cmp_double);
+            filtDrift[3*fr + k] = (n % 2) ? buf[n/2] : 0.5*(buf[n/2 - 1] + buf[n/2]);
+        } else
+        {
+            s = 0;
+            sw = 0;
+            for (d = 0; d < n; d++)
+            {
+                if (filterMode == FILTER_GAUSSIAN)
+                    wt = exp(-0.5*d*d/(filterScale*filterScale));
+                else
+                    wt = 1;
+
+                s += wt*drift[3*(fr - d) + k];
+                sw += wt;
+            }
+            filtDrift[3*fr + k] = s/sw;
+        }
+    }
+}
+
+/* process the points of a single frame, updating the tracks and the raw drift for that frame */
+static void process_frame(int fr, int nPts, float *x, float *y, float *z, float *delta_x, double *tracks, int maxTracks,
+                          int *claimed, int *matches, int timeWindow, int minTrackLength, double *drift, int *nFid)
+{
+    int i, k, best, nEst = 0;
+    double *tr;
+    double dx, dy, d2, bestD2;
+    double drx = 0, dry = 0, drz = 0;
+    double prev_x = 0, prev_y = 0, prev_z = 0;
+
+    if (fr > 0)
+    {
+        prev_x = drift[3*(fr - 1)];
+        prev_y = drift[3*(fr - 1) + 1];
+        prev_z = drift[3*(fr - 1) + 2];
+    }
+
+    //expire tracks which have not been seen recently
+    for (k = 0; k < maxTracks; k++)
+    {
+        tr = tracks + k*TRACK_NFIELDS;
+        claimed[k] = 0;
+        if (tr[TRACK_ACTIVE] && ((fr - (int) tr[TRACK_LAST_T]) > timeWindow)) tr[TRACK_ACTIVE] = 0;
+    }
+
+    //link each point to the nearest unclaimed live track
+    for (i = 0; i < nPts; i++)
+    {
+        best = -1;
+        bestD2 = 4*delta_x[i]*delta_x[i];
+
+        for (k = 0; k < maxTracks; k++)
+        {
+            tr = tracks + k*TRACK_NFIELDS;
+            if (!tr[TRACK_ACTIVE] || claimed[k]) continue;
+
+            dx = x[i] - tr[TRACK_LAST_X];
+            dy = y[i] - tr[TRACK_LAST_Y];
+            d2 = dx*dx + dy*dy;
+
+            if (d2 < bestD2)
+            {
+                bestD2 = d2;
+                best = k;
+            }
+        }
+
+        matches[i] = best;
+        if (best >= 0)
+        {
+            claimed[best] = 1;
+
+            tr = tracks + best*TRACK_NFIELDS;
+            if (tr[TRACK_ESTABLISHED])
+            {
+                drx += x[i] - tr[TRACK_REF_X];
+                dry += y[i] - tr[TRACK_REF_Y];
+                drz += z[i] - tr[TRACK_REF_Z];
+                nEst++;
+            }
+        }
+    }
+
+    if (nEst > 0)
+    {
+        drift[3*fr] = drx/nEst;
+        drift[3*fr + 1] = dry/nEst;
+        drift[3*fr + 2] = drz/nEst;
+    } else
+    {
+        //hold the previous estimate
+        drift[3*fr] = prev_x;
+        drift[3*fr + 1] = prev_y;
+        drift[3*fr + 2] = prev_z;
+    }
+    nFid[fr] = nEst;
+
+    //update the tracks, and start new tracks for any unmatched points
+    for (i = 0; i < nPts; i++)
+    {
+        k = matches[i];
+        if (k < 0)
+        {
+            //find a free slot
+            for (k = 0; k < maxTracks; k++)
+                if (!tracks[k*TRACK_NFIELDS + TRACK_ACTIVE]) break;
+
+            if (k == maxTracks) continue; //no room - ignore point
+
+            tr = tracks + k*TRACK_NFIELDS;
+            tr[TRACK_REF_X] = 0;
+            tr[TRACK_REF_Y] = 0;
+            tr[TRACK_REF_Z] = 0;
+            tr[TRACK_N] = 0;
+            tr[TRACK_ESTABLISHED] = 0;
+            tr[TRACK_ACTIVE] = 1;
+        }
+
+        tr = tracks + k*TRACK_NFIELDS;
+        tr[TRACK_LAST_X] = x[i];
+        tr[TRACK_LAST_Y] = y[i];
+        tr[TRACK_LAST_T] = fr;
+
+        if (!tr[TRACK_ESTABLISHED])
+        {
+            //accumulate the drift corrected position until we have enough observations to fix the reference
+            tr[TRACK_REF_X] += x[i] - drift[3*fr];
+            tr[TRACK_REF_Y] += y[i] - drift[3*fr + 1];
+            tr[TRACK_REF_Z] += z[i] - drift[3*fr + 2];
+            tr[TRACK_N] += 1;
+
+            if (tr[TRACK_N] >= minTrackLength)
+            {
+                tr[TRACK_REF_X] /= tr[TRACK_N];
+                tr[TRACK_REF_Y] /= tr[TRACK_N];
+                tr[TRACK_REF_Z] /= tr[TRACK_N];
+                tr[TRACK_ESTABLISHED] = 1;
+            }
+        } else tr[TRACK_N] += 1;
+    }
+}
+
+static PyObject * processFrames(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oTracks=0, *oState=0, *oDrift=0, *oNFid=0, *oFiltDrift=0;
+    PyObject *oT=0, *oX=0, *oY=0, *oZ=0, *oDelta=0;
+    PyArrayObject *aTracks=0, *aState=0, *aDrift=0, *aNFid=0, *aFiltDrift=0;
+    PyArrayObject *aT=0, *aX=0, *aY=0, *aZ=0, *aDelta=0;
+
+    double *tracks, *drift, *filtDrift, *buf=NULL;
+    npy_int64 *state;
+    int *t, *nFid, *claimed=NULL, *matches=NULL;
+    float *x, *y, *z, *delta_x;
+    int nPts, maxTracks, maxFrames, fr, i0, i1;
+    int endFrame = -1;
+    int timeWindow = 25, minTrackLength = 50, filterMode = FILTER_GAUSSIAN;
+    float filterScale = 10;
+
+    static char *kwlist[] = {"tracks", "state", "drift", "nFid", "filtDrift", "t", "x", "y", "z", "delta_x", "endFrame",
+                             "timeWindow", "minTrackLength", "filterMode", "filterScale", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOOOOOOOOOi|iiif", kwlist,
+         &oTracks, &oState, &oDrift, &oNFid, &oFiltDrift, &oT, &oX, &oY, &oZ, &oDelta, &endFrame,
+         &timeWindow, &minTrackLength, &filterMode, &filterScale))
+        return NULL;
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_processFrames;\
+        }
+
+    //state arrays are modified in place
+    #define CHECK_INPLACE(o, a, npytype, msg) {\
+        if (!PyArray_Check(o)) ABORT(msg)\
+        a = (PyArrayObject *) o;\
+        if ((PyArray_TYPE(a) != npytype) || !PyArray_ISCARRAY(a)) ABORT(msg)\
+        }
+
+    CHECK_INPLACE(oTracks, aTracks, NPY_DOUBLE, "tracks must be a contiguous float64 [maxTracks, 9] array")
+    CHECK_INPLACE(oState, aState, NPY_INT64, "state must be a contiguous int64 array")
+    CHECK_INPLACE(oDrift, aDrift, NPY_DOUBLE, "drift must be a contiguous float64 [maxFrames, 3] array")
+    CHECK_INPLACE(oNFid, aNFid, NPY_INT, "nFid must be a contiguous int32 array")
+    CHECK_INPLACE(oFiltDrift, aFiltDrift, NPY_DOUBLE, "filtDrift must be a contiguous float64 [maxFrames, 3] array")
+    #undef CHECK_INPLACE
+
+    if ((PyArray_NDIM(aTracks) != 2) || (PyArray_DIM(aTracks, 1) != TRACK_NFIELDS)) ABORT("tracks must be [maxTracks, 9]")
+    if (PyArray_SIZE(aState) < STATE_NFIELDS) ABORT("state is too short")
+
+    maxTracks = (int) PyArray_DIM(aTracks, 0);
+    maxFrames = (int) PyArray_SIZE(aNFid);
+    if ((PyArray_SIZE(aDrift) != 3*maxFrames) || (PyArray_SIZE(aFiltDrift) != 3*maxFrames))
+        ABORT("drift, filtDrift and nFid must have the same number of frames")
+
+    aT = (PyArrayObject *) PyArray_ContiguousFromObject(oT, NPY_INT, 1, 1);
+    if (aT == NULL) ABORT("Bad t")
+    nPts = (int) PyArray_DIM(aT, 0);
+
+    aX = (PyArrayObject *) PyArray_ContiguousFromObject(oX, NPY_FLOAT, 1, 1);
+    if ((aX == NULL) || (PyArray_DIM(aX, 0) != nPts)) ABORT("Bad x")
+
+    aY = (PyArrayObject *) PyArray_ContiguousFromObject(oY, NPY_FLOAT, 1, 1);
+    if ((aY == NULL) || (PyArray_DIM(aY, 0) != nPts)) ABORT("Bad y")
+
+    aZ = (PyArrayObject *) PyArray_ContiguousFromObject(oZ, NPY_FLOAT, 1, 1);
+    if ((aZ == NULL) || (PyArray_DIM(aZ, 0) != nPts)) ABORT("Bad z")
+
+    aDelta = (PyArrayObject *) PyArray_ContiguousFromObject(oDelta, NPY_FLOAT, 1, 1);
+    if ((aDelta == NULL) || (PyArray_DIM(aDelta, 0) != nPts)) ABORT("Bad delta_x")
+
+    tracks = (double *) PyArray_DATA(aTracks);
+    state = (npy_int64 *) PyArray_DATA(aState);
+    drift = (double *) PyArray_DATA(aDrift);
+    nFid = (int *) PyArray_DATA(aNFid);
+    filtDrift = (double *) PyArray_DATA(aFiltDrift);
+    t = (int *) PyArray_DATA(aT);
+    x = (float *) PyArray_DATA(aX);
+    y = (float *) PyArray_DATA(aY);
+    z = (float *) PyArray_DATA(aZ);
+    delta_x = (float *) PyArray_DATA(aDelta);
+
+    if (endFrame > maxFrames) ABORT("endFrame is larger than the drift arrays")
+
+    //points must be sorted by frame, and not before the next frame to process
+    for (i0 = 1; i0 < nPts; i0++) if (t[i0] < t[i0 - 1]) ABORT("points must be sorted by frame")
+    if ((nPts > 0) && ((t[0] < state[STATE_NEXT_FRAME]) || (t[nPts - 1] >= endFrame)))
+        ABORT("points must be in frames [nextFrame, endFrame)")
+
+    claimed = (int *) malloc(maxTracks*sizeof(int));
+    matches = (int *) malloc(MAX(nPts, 1)*sizeof(int));
+    buf = (double *) malloc(MAX_FILTER_WINDOW*sizeof(double));
+    if ((claimed == NULL) || (matches == NULL) || (buf == NULL)) ABORT("Error allocating memory")
+
+    Py_BEGIN_ALLOW_THREADS;
+    i0 = 0;
+    for (fr = (int) state[STATE_NEXT_FRAME]; fr < endFrame; fr++)
+    {
+        i1 = i0;
+        while ((i1 < nPts) && (t[i1] == fr)) i1++;
+
+        process_frame(fr, i1 - i0, x + i0, y + i0, z + i0, delta_x + i0, tracks, maxTracks, claimed, matches,
+                      timeWindow, minTrackLength, drift, nFid);
+        filter_frame(drift, filtDrift, fr, filterMode, filterScale, buf);
+
+        i0 = i1;
+    }
+    state[STATE_NEXT_FRAME] = MAX(state[STATE_NEXT_FRAME], endFrame);
+    Py_END_ALLOW_THREADS;
+
+    free(claimed);
+    free(matches);
+    free(buf);
+
+    Py_XDECREF(aT);
+    Py_XDECREF(aX);
+    Py_XDECREF(aY);
+    Py_XDECREF(aZ);
+    Py_XDECREF(aDelta);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+
+FINALIZE_processFrames:
+    #undef ABORT
+
+    if (claimed) free(claimed);
+    if (matches) free(matches);
+    if (buf) free(buf);
+
+    Py_XDECREF(aT);
+    Py_XDECREF(aX);
+    Py_XDECREF(aY);
+    Py_XDECREF(aZ);
+    Py_XDECREF(aDelta);
+
+    return NULL;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+static PyMethodDef fiducialTrackingMethods[] = {
+    {"processFrames",  processFrames, METH_VARARGS | METH_KEYWORDS,
+    "Update fiducial tracks and the (raw and causally filtered) drift for all frames from state[0] up to endFrame. "
+    "State arrays are updated in place.\n Arguments are: 'tracks' float64 [maxTracks, 9], 'state' int64 [4], 'drift' "
+    "float64 [maxFrames, 3], 'nFid' int32 [maxFrames], 'filtDrift' float64 [maxFrames, 3], 't', 'x', 'y', 'z', "
+    "'delta_x' (fiducial positions in frames [state[0], endFrame), sorted by t), 'endFrame', 'timeWindow'=25, "
+    "'minTrackLength'=50, 'filterMode'=0 (0=Gaussian, 1=Uniform, 2=Median), 'filterScale'=10"},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+#pragma GCC diagnostic pop
+
+#if PY_MAJOR_VERSION>=3
+static struct PyModuleDef moduledef = {
+        PyModuleDef_HEAD_INIT,
+        "fiducialTracking",     /* m_name */
+        "streaming fiducial tracking and drift estimation",  /* m_doc */
+        -1,                  /* m_size */
+        fiducialTrackingMethods,    /* m_methods */
+        NULL,                /* m_reload */
+        NULL,                /* m_traverse */
+        NULL,                /* m_clear */
+        NULL,                /* m_free */
+    };
+
+PyMODINIT_FUNC PyInit_fiducialTracking(void)
+{
+	PyObject *m;
+    m = PyModule_Create(&moduledef);
+    import_array()
+    return m;
+}
+
+#else
+PyMODINIT_FUNC initfiducialTracking(void)
+{
+    PyObject *m;
+
+    m = Py_InitModule("fiducialTracking", fiducialTrackingMethods);
+    import_array()
+}
+#endif
@@ -0,0 +1,249 @@
+/*
+##################
+# shiftField.c
+#
+# Copyright David Baddeley, 2017
+# d.baddeley@auckland.ac.nz
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+##################
+ */
+
+/*
+Fast evaluation of chromatic shift fields from a pre-sampled lookup grid.
+
+The shift models in twoColour.py (and scipy splines) are sampled once on a regular grid, and points are then corrected
+using Catmull-Rom bicubic interpolation of that grid. Each channel has 4 component grids - dx, d(dx)/dz, dy and
+d(dy)/dz - so that models with a (linear) z dependence can be applied in the same pass. The interpolation weights for a
+point are computed once and re-used for all components.
+*/
+
+#include "Python.h"
+#include <math.h>
+#include "numpy/arrayobject.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MIN(a, b) ((a<b) ? a : b)
+#define MAX(a, b) ((a>b) ? a : b)
+
+#define N_COMPONENTS 4
+
+/* Catmull-Rom weights for fractional offset t in [0, 1) */
+static void cr_weights(double t, double *w)
+{
+    w[0] = 0.5*((-t + 2)*t - 1)*t;
+    w[1] = 0.5*((3*t - 5)*t*t + 2);
+    w[2] = 0.5*((-3*t + 4)*t + 1)*t;
+    w[3] = 0.5*(t - 1)*t*t;
+}
+
+/* find the 4 (edge clamped) sample indices and weights along one axis */
+static void axis_taps(double u, int n, int *idx, double *w)
+{
+    int i0, k;
+
+    //clamp to the grid so that points outside the sampled region get the edge value
+    u = MAX(u, 0);
+    u = MIN(u, (double) (n - 1));
+
+    i0 = (int) floor(u);
+    cr_weights(u - i0, w);
+
+    for (k = 0; k < 4; k++) idx[k] = MIN(MAX(i0 - 1 + k, 0), n - 1);
+}
+
+static float interp_component(const float *g, int nx, const int *ix, const int *iy, const double *wx, const double *wy)
+{
+    int j;
+    double r = 0;
+    const float *row;
+
+    for (j = 0; j < 4; j++)
+    {
+        row = g + iy[j]*nx;
+        r += wy[j]*(wx[0]*row[ix[0]] + wx[1]*row[ix[1]] + wx[2]*row[ix[2]] + wx[3]*row[ix[3]]);
+    }
+
+    return (float) r;
+}
+
+static PyObject * applyShiftField(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oGrids=0, *oX=0, *oY=0, *oDx=0, *oDy=0, *oZ=Py_None, *oChan=Py_None;
+    PyArrayObject *aGrids=0, *aX=0, *aY=0, *aZ=0, *aChan=0;
+    PyArrayObject *aDx=0, *aDy=0;
+
+    float *grids, *g;
+    double *x, *y, *z=NULL, *dx, *dy;
+    int *chan=NULL;
+    int nChan, ny, nx, nPts, i, c;
+    int start = 0, end = -1;
+    int ix[4], iy[4];
+    double wx[4], wy[4];
+    double x0 = 0, y0 = 0, spacing = 100;
+
+    static char *kwlist[] = {"grids", "x", "y", "dx", "dy", "z", "chan", "x0", "y0", "spacing", "start", "end", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOOOO|OOdddii", kwlist,
+         &oGrids, &oX, &oY, &oDx, &oDy, &oZ, &oChan, &x0, &y0, &spacing, &start, &end))
+        return NULL;
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_applyShiftField;\
+        }
+
+    aGrids = (PyArrayObject *) PyArray_ContiguousFromObject(oGrids, NPY_FLOAT, 4, 4);
+    if ((aGrids == NULL) || (PyArray_DIM(aGrids, 1) != N_COMPONENTS))
+        ABORT("Bad grids - expecting a float32 [nChannels, 4, ny, nx] array")
+
+    if (spacing <= 0) ABORT("spacing must be positive")
+
+    aX = (PyArrayObject *) PyArray_ContiguousFromObject(oX, NPY_DOUBLE, 1, 1);
+    if (aX == NULL) ABORT("Bad x")
+    nPts = (int) PyArray_DIM(aX, 0);
+
+    aY = (PyArrayObject *) PyArray_ContiguousFromObject(oY, NPY_DOUBLE, 1, 1);
+    if ((aY == NULL) || (PyArray_DIM(aY, 0) != nPts)) ABORT("Bad y")
+
+    if (oZ != Py_None)
+    {
+        aZ = (PyArrayObject *) PyArray_ContiguousFromObject(oZ, NPY_DOUBLE, 1, 1);
+        if ((aZ == NULL) || (PyArray_DIM(aZ, 0) != nPts)) ABORT("Bad z")
+        z = (double *) PyArray_DATA(aZ);
+    }
+
+    if (oChan != Py_None)
+    {
+        aChan = (PyArrayObject *) PyArray_ContiguousFromObject(oChan, NPY_INT, 1, 1);
+        if ((aChan == NULL) || (PyArray_DIM(aChan, 0) != nPts)) ABORT("Bad chan")
+        chan = (int *) PyArray_DATA(aChan);
+    }
+
+    //dx and dy are output arrays and must be written in place
+    if (!PyArray_Check(oDx) || !PyArray_Check(oDy)) ABORT("dx and dy must be arrays")
+    aDx = (PyArrayObject *) oDx;
+    aDy = (PyArrayObject *) oDy;
+    if ((PyArray_TYPE(aDx) != NPY_DOUBLE) || !PyArray_ISCARRAY(aDx) || (PyArray_SIZE(aDx) != nPts) ||
+        (PyArray_TYPE(aDy) != NPY_DOUBLE) || !PyArray_ISCARRAY(aDy) || (PyArray_SIZE(aDy) != nPts))
+        ABORT("dx and dy must be contiguous float64 arrays with one entry per point")
+
+    grids = (float *) PyArray_DATA(aGrids);
+    nChan = (int) PyArray_DIM(aGrids, 0);
+    ny = (int) PyArray_DIM(aGrids, 2);
+    nx = (int) PyArray_DIM(aGrids, 3);
+    x = (double *) PyArray_DATA(aX);
+    y = (double *) PyArray_DATA(aY);
+    dx = (double *) PyArray_DATA(aDx);
+    dy = (double *) PyArray_DATA(aDy);
+
+    if (end < 0) end = nPts;
+    start = MAX(start, 0);
+    end = MIN(end, nPts);
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (i = start; i < end; i++)
+    {
+        c = chan ? chan[i] : 0;
+
+        if ((c < 0) || (c >= nChan))
+        {
+            //channels without a shift model are not shifted
+            dx[i] = 0;
+            dy[i] = 0;
+            continue;
+        }
+
+        if (isnan(x[i]) || isnan(y[i]))
+        {
+            dx[i] = NAN;
+            dy[i] = NAN;
+            continue;
+        }
+
+        axis_taps((x[i] - x0)/spacing, nx, ix, wx);
+        axis_taps((y[i] - y0)/spacing, ny, iy, wy);
+
+        g = grids + (size_t) c*N_COMPONENTS*nx*ny;
+
+        dx[i] = interp_component(g, nx, ix, iy, wx, wy);
+        dy[i] = interp_component(g + 2*nx*ny, nx, ix, iy, wx, wy);
+
+        if (z)
+        {
+            dx[i] += z[i]*interp_component(g + nx*ny, nx, ix, iy, wx, wy);
+            dy[i] += z[i]*interp_component(g + 3*nx*ny, nx, ix, iy, wx, wy);
+        }
+    }
+    Py_END_ALLOW_THREADS;
+
+    Py_XDECREF(aGrids);
+    Py_XDECREF(aX);
+    Py_XDECREF(aY);
+    Py_XDECREF(aZ);
+    Py_XDECREF(aChan);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+
+FINALIZE_applyShiftField:
+    #undef ABORT
+
+    Py_XDECREF(aGrids);
+    Py_XDECREF(aX);
+    Py_XDECREF(aY);
+    Py_XDECREF(aZ);
+    Py_XDECREF(aChan);
+
+    return NULL;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+static PyMethodDef shiftFieldMethods[] = {
+    {"applyShiftField",  applyShiftField, METH_VARARGS | METH_KEYWORDS,
+    "Evaluate shift corrections for points [start, end) by bicubic interpolation of pre-sampled shift field grids, "
+    "writing the results into `dx` and `dy`.\n Arguments are: 'grids' float32 [nChannels, 4, ny, nx] (dx, d(dx)/dz, "
+    "dy, d(dy)/dz), 'x', 'y', 'dx', 'dy' (float64 outputs), 'z'=None, 'chan'=None (points in channels without a grid "
+    "get zero shift), 'x0'=0, 'y0'=0, 'spacing'=100, 'start'=0, 'end'=nPoints"},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+#pragma GCC diagnostic pop
+
+#if PY_MAJOR_VERSION>=3
+static struct PyModuleDef moduledef = {
+        PyModuleDef_HEAD_INIT,
+        "shiftField",     /* m_name */
+        "fast lookup-grid evaluation of chromatic shift fields",  /* m_doc */
+        -1,                  /* m_size */
+        shiftFieldMethods,    /* m_methods */
+        NULL,                /* m_reload */
+        NULL,                /* m_traverse */
+        NULL,                /* m_clear */
+        NULL,                /* m_free */
+    };
+
+PyMODINIT_FUNC PyInit_shiftField(void)
+{
+	PyObject *m;
+    m = PyModule_Create(&moduledef);
+    import_array()
+    return m;
+}
+
+#else
+PyMODINIT_FUNC initshiftField(void)
+{
+    PyObject *m;
+
+    m = Py_InitModule("shiftField", shiftFieldMethods);
+    import_array()
+}
+#endif
@@ -0,0 +1,699 @@
+/*
+##################
+# sphHarm.c
+#
+# Copyright David Baddeley, 2019
+# d.baddeley@auckland.ac.nz
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+##################
+ */
+
+/*
+Native helpers for spherical_harmonics.py.
+
+The real spherical harmonics use the same conventions and ordering as spherical_harmonics.r_sph_harm/sphere_expansion
+(modes ordered by n, then m = -n..n; m > 0 are the cosine terms and m < 0 the sine terms). All the harmonics up to n_max
+are evaluated for a point in a single pass, using the standard recurrences for the fully normalised associated Legendre
+functions and for cos(m*azimuth) / sin(m*azimuth).
+
+The shell fits solve the least squares problem through the normal equations, accumulated point by point so that the
+design matrix is never stored, and solved in place by Cholesky decomposition. Rank deficient (or nearly so) fits are
+returned as NaN.
+*/
+
+#include "Python.h"
+#include <math.h>
+#include "numpy/arrayobject.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MIN(a, b) ((a<b) ? a : b)
+#define MAX(a, b) ((a>b) ? a : b)
+
+#define N_MODES(n_max) (((n_max) + 1)*((n_max) + 1))
+#define MODE_INDEX(m, n) ((n)*(n) + (n) + (m))
+
+//limited by the size of the stack buffers below
+#define MAX_N_MAX 40
+
+//maximum size (in doubles) of the per-thread cache of basis values used when fitting shells
+#define MAX_BASIS_CACHE (1 << 22)
+
+//fits where a Cholesky pivot falls below this fraction of its diagonal element are treated as rank deficient (and
+//re-fitted with lstsq in spherical_harmonics.sphere_expansion_batch)
+#define CHOL_MIN_RELATIVE_PIVOT 1e-10
+
+/*
+Coefficients of the associated Legendre recurrences. These only depend on n_max, so are computed once per call rather
+than for every point.
+*/
+typedef struct
+{
+    int n_max;
+    double *a; //a[MODE_INDEX(m, n)], for n >= m + 2
+    double *b;
+    double pmm[MAX_N_MAX + 1]; //sqrt((2m + 1)/2m), for the diagonal P_m^m
+    double pm1[MAX_N_MAX + 1]; //sqrt(2m + 3), for P_(m+1)^m
+} legendre_coeffs_t;
+
+static int init_legendre_coeffs(legendre_coeffs_t *lc, int n_max)
+{
+    int n, m;
+
+    lc->n_max = n_max;
+    lc->a = (double *) malloc(N_MODES(n_max)*sizeof(double));
+    lc->b = (double *) malloc(N_MODES(n_max)*sizeof(double));
+    if ((lc->a == NULL) || (lc->b == NULL)) return -1;
+
+    for (m = 0; m <= n_max; m++)
+    {
+        lc->pmm[m] = (m > 0) ? sqrt((2.0*m + 1)/(2.0*m)) : 1;
+        lc->pm1[m] = sqrt(2.0*m + 3);
+
+        for (n = m + 2; n <= n_max; n++)
+        {
+            lc->a[MODE_INDEX(m, n)] = sqrt((4.0*n*n - 1)/((double) n*n - m*m));
+            lc->b[MODE_INDEX(m, n)] = sqrt(((n - 1.0)*(n - 1.0) - m*m)/(4.0*(n - 1.0)*(n - 1.0) - 1));
+        }
+    }
+
+    return 0;
+}
+
+static void free_legendre_coeffs(legendre_coeffs_t *lc)
+{
+    if (lc->a) free(lc->a);
+    if (lc->b) free(lc->b);
+    lc->a = NULL;
+    lc->b = NULL;
+}
+
+/*
+Evaluate all real spherical harmonics up to lc->n_max at a single (azimuth, zenith) into Y (length N_MODES(n_max)).
+P is scratch space of at least N_MODES(n_max) doubles.
+*/
+static void real_sph_harm_all(double azimuth, double zenith, const legendre_coeffs_t *lc, double *Y, double *P)
+{
+    int n, m, k;
+    int n_max = lc->n_max;
+    double x = cos(zenith);
+    double s = sin(zenith);
+    double cm[MAX_N_MAX + 1], sm[MAX_N_MAX + 1];
+    double pmm;
+
+    //normalised associated Legendre functions (without the Condon-Shortley phase), stored at MODE_INDEX(m, n), m >= 0
+    pmm = sqrt(0.25/M_PI);
+    for (m = 0; m <= n_max; m++)
+    {
+        if (m > 0) pmm *= s*lc->pmm[m];
+        P[MODE_INDEX(m, m)] = pmm;
+
+        if (m < n_max) P[MODE_INDEX(m, m + 1)] = x*lc->pm1[m]*pmm;
+
+        for (n = m + 2; n <= n_max; n++)
+        {
+            k = MODE_INDEX(m, n);
+            P[k] = lc->a[k]*(x*P[MODE_INDEX(m, n - 1)] - lc->b[k]*P[MODE_INDEX(m, n - 2)]);
+        }
+    }
+
+    //cos(m*az) and sin(m*az) by Chebyshev recurrence
+    cm[0] = 1;
+    sm[0] = 0;
+    if (n_max > 0)
+    {
+        cm[1] = cos(azimuth);
+        sm[1] = sin(azimuth);
+    }
+    for (m = 2; m <= n_max; m++)
+    {
+        cm[m] = 2*cm[1]*cm[m - 1] - cm[m - 2];
+        sm[m] = 2*cm[1]*sm[m - 1] - sm[m - 2];
+    }
+
+    for (n = 0; n <= n_max; n++)
+    {
+        Y[MODE_INDEX(0, n)] = P[MODE_INDEX(0, n)];
+        for (m = 1; m <= n; m++)
+        {
+            Y[MODE_INDEX(m, n)] = M_SQRT1_2*P[MODE_INDEX(m, n)]*cm[m];
+            //sign matches the (-1)^m*Im(Y_n^-m) convention of r_sph_harm
+            Y[MODE_INDEX(-m, n)] = ((m % 2) ? M_SQRT1_2 : -M_SQRT1_2)*P[MODE_INDEX(m, n)]*sm[m];
+        }
+    }
+}
+
+static double dot(const double *a, const double *b, int n)
+{
+    int i;
+    double r = 0;
+    for (i = 0; i < n; i++) r += a[i]*b[i];
+    return r;
+}
+
+/* solve the (symmetric, positive definite) system ATA c = ATr in place (ATA is overwritten by its Cholesky factor,
+ATr by the solution). Returns -1 if the matrix is not positive definite, or so badly conditioned that the solution
+would be meaningless (the normal equations square the condition number of the least squares problem). */
+static int chol_solve_inplace(double *ATA, double *ATr, int n)
+{
+    int i, j, k;
+    double s;
+
+    for (j = 0; j < n; j++)
+    {
+        s = ATA[j*n + j];
+        for (k = 0; k < j; k++) s -= ATA[j*n + k]*ATA[j*n + k];
+        if (s <= CHOL_MIN_RELATIVE_PIVOT*ATA[j*n + j]) return -1;
+        ATA[j*n + j] = sqrt(s);
+
+        for (i = j + 1; i < n; i++)
+        {
+            s = ATA[i*n + j];
+            for (k = 0; k < j; k++) s -= ATA[i*n + k]*ATA[j*n + k];
+            ATA[i*n + j] = s/ATA[j*n + j];
+        }
+    }
+
+    //forward substitution
+    for (i = 0; i < n; i++)
+    {
+        s = ATr[i];
+        for (k = 0; k < i; k++) s -= ATA[i*n + k]*ATr[k];
+        ATr[i] = s/ATA[i*n + i];
+    }
+
+    //back substitution
+    for (i = n - 1; i >= 0; i--)
+    {
+        s = ATr[i];
+        for (k = i + 1; k < n; k++) s -= ATA[k*n + i]*ATr[k];
+        ATr[i] = s/ATA[i*n + i];
+    }
+
+    return 0;
+}
+
+/* harmonics for point i of a shell fit - either from the cache (filling it on the first pass) or computed into Y */
+static const double * point_basis(const double *azimuth, const double *zenith, int i, int i0, int first,
+                                  const legendre_coeffs_t *lc, double *Ycache, double *Y, double *P)
+{
+    double *row;
+
+    if (Ycache == NULL)
+    {
+        real_sph_harm_all(azimuth[i], zenith[i], lc, Y, P);
+        return Y;
+    }
+
+    row = Ycache + (size_t) (i - i0)*N_MODES(lc->n_max);
+    if (first) real_sph_harm_all(azimuth[i], zenith[i], lc, row, P);
+    return row;
+}
+
+/*
+Fit a single shell to the points in [i0, i1), replicating the outlier rejection of sphere_expansion_clean. Returns the
+summed squared residuals of the final fit (or NaN if the fit failed). Ycache is either NULL or has room for the
+harmonics of every point, so that they are only evaluated once.
+*/
+static double fit_shell(const double *azimuth, const double *zenith, const double *r, int i0, int i1,
+                        const legendre_coeffs_t *lc, int max_iters, double tol, double *c, double *Y, double *P,
+                        double *ATA, char *mask, double *Ycache)
+{
+    int nModes = N_MODES(lc->n_max);
+    int i, j, k, it, nUsed;
+    double err, res, resid = 0;
+    const double *Yi;
+
+    for (i = i0; i < i1; i++) mask[i - i0] = 1;
+
+    for (it = 0; it <= max_iters; it++)
+    {
+        for (j = 0; j < nModes*nModes; j++) ATA[j] = 0;
+        for (j = 0; j < nModes; j++) c[nModes + j] = 0; //ATr, stored after the current coefficients
+
+        nUsed = 0;
+        for (i = i0; i < i1; i++)
+        {
+            Yi = point_basis(azimuth, zenith, i, i0, it == 0, lc, Ycache, Y, P);
+
+            if (it > 0)
+            {
+                //discard outliers relative to the previous fit
+                err = fabs(r[i] - dot(Yi, c, nModes))/r[i];
+                mask[i - i0] = (err < tol);
+            }
+
+            if (!mask[i - i0]) continue;
+
+            nUsed++;
+            for (j = 0; j < nModes; j++)
+            {
+                c[nModes + j] += Yi[j]*r[i];
+                for (k = 0; k <= j; k++) ATA[j*nModes + k] += Yi[j]*Yi[k];
+            }
+        }
+
+        if (it > 0) tol /= 2;
+
+        for (j = 0; j < nModes; j++)
+            for (k = j + 1; k < nModes; k++) ATA[j*nModes + k] = ATA[k*nModes + j];
+
+        if ((nUsed < nModes) || (chol_solve_inplace(ATA, c + nModes, nModes) < 0))
+        {
+            for (j = 0; j < nModes; j++) c[j] = NAN;
+            return NAN;
+        }
+
+        for (j = 0; j < nModes; j++) c[j] = c[nModes + j];
+    }
+
+    for (i = i0; i < i1; i++)
+    {
+        if (!mask[i - i0]) continue;
+        Yi = point_basis(azimuth, zenith, i, i0, 0, lc, Ycache, Y, P);
+        res = r[i] - dot(Yi, c, nModes);
+        resid += res*res;
+    }
+
+    return resid;
+}
+
+static PyObject * realSphHarm(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oAz=0, *oZen=0;
+    PyArrayObject *aAz=0, *aZen=0, *aOut=0;
+    double *az, *zen, *out, *P=NULL;
+    int n_max = 3, nPts, nModes, i;
+    npy_intp dims[2];
+    legendre_coeffs_t lc = {0};
+
+    static char *kwlist[] = {"azimuth", "zenith", "n_max", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OO|i", kwlist, &oAz, &oZen, &n_max))
+        return NULL;
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_realSphHarm;\
+        }
+
+    if ((n_max < 0) || (n_max > MAX_N_MAX)) ABORT("n_max must be in [0, 40]")
+
+    aAz = (PyArrayObject *) PyArray_ContiguousFromObject(oAz, NPY_DOUBLE, 1, 1);
+    if (aAz == NULL) ABORT("Bad azimuth")
+    nPts = (int) PyArray_DIM(aAz, 0);
+
+    aZen = (PyArrayObject *) PyArray_ContiguousFromObject(oZen, NPY_DOUBLE, 1, 1);
+    if ((aZen == NULL) || (PyArray_DIM(aZen, 0) != nPts)) ABORT("Bad zenith")
+
+    nModes = N_MODES(n_max);
+    dims[0] = nPts;
+    dims[1] = nModes;
+    aOut = (PyArrayObject *) PyArray_SimpleNew(2, dims, NPY_DOUBLE);
+    P = (double *) malloc(nModes*sizeof(double));
+    if ((aOut == NULL) || (P == NULL) || (init_legendre_coeffs(&lc, n_max) < 0)) ABORT("Error allocating memory")
+
+    az = (double *) PyArray_DATA(aAz);
+    zen = (double *) PyArray_DATA(aZen);
+    out = (double *) PyArray_DATA(aOut);
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (i = 0; i < nPts; i++) real_sph_harm_all(az[i], zen[i], &lc, out + (size_t) i*nModes, P);
+    Py_END_ALLOW_THREADS;
+
+    free(P);
+    free_legendre_coeffs(&lc);
+    Py_XDECREF(aAz);
+    Py_XDECREF(aZen);
+
+    return (PyObject*) aOut;
+
+FINALIZE_realSphHarm:
+    #undef ABORT
+
+    if (P) free(P);
+    free_legendre_coeffs(&lc);
+    Py_XDECREF(aAz);
+    Py_XDECREF(aZen);
+    Py_XDECREF(aOut);
+
+    return NULL;
+}
+
+static PyObject * reconstructShell(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oAz=0, *oZen=0, *oC=0;
+    PyArrayObject *aAz=0, *aZen=0, *aC=0, *aOut=0;
+    double *az, *zen, *c, *out, *Y=NULL, *P=NULL;
+    int n_max, nPts, nModes, i;
+    npy_intp dims[1];
+    legendre_coeffs_t lc = {0};
+
+    static char *kwlist[] = {"azimuth", "zenith", "coefficients", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOO", kwlist, &oAz, &oZen, &oC))
+        return NULL;
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_reconstructShell;\
+        }
+
+    aAz = (PyArrayObject *) PyArray_ContiguousFromObject(oAz, NPY_DOUBLE, 1, 1);
+    if (aAz == NULL) ABORT("Bad azimuth")
+    nPts = (int) PyArray_DIM(aAz, 0);
+
+    aZen = (PyArrayObject *) PyArray_ContiguousFromObject(oZen, NPY_DOUBLE, 1, 1);
+    if ((aZen == NULL) || (PyArray_DIM(aZen, 0) != nPts)) ABORT("Bad zenith")
+
+    aC = (PyArrayObject *) PyArray_ContiguousFromObject(oC, NPY_DOUBLE, 1, 1);
+    if (aC == NULL) ABORT("Bad coefficients")
+    nModes = (int) PyArray_DIM(aC, 0);
+    n_max = (int) (sqrt((double) nModes) + 0.5) - 1;
+    if ((N_MODES(n_max) != nModes) || (n_max > MAX_N_MAX))
+        ABORT("Expecting (n_max + 1)**2 coefficients, in sphere_expansion order")
+
+    dims[0] = nPts;
+    aOut = (PyArrayObject *) PyArray_SimpleNew(1, dims, NPY_DOUBLE);
+    Y = (double *) malloc(nModes*sizeof(double));
+    P = (double *) malloc(nModes*sizeof(double));
+    if ((aOut == NULL) || (Y == NULL) || (P == NULL) || (init_legendre_coeffs(&lc, n_max) < 0))
+        ABORT("Error allocating memory")
+
+    az = (double *) PyArray_DATA(aAz);
+    zen = (double *) PyArray_DATA(aZen);
+    c = (double *) PyArray_DATA(aC);
+    out = (double *) PyArray_DATA(aOut);
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (i = 0; i < nPts; i++)
+    {
+        real_sph_harm_all(az[i], zen[i], &lc, Y, P);
+        out[i] = dot(Y, c, nModes);
+    }
+    Py_END_ALLOW_THREADS;
+
+    free(Y);
+    free(P);
+    free_legendre_coeffs(&lc);
+    Py_XDECREF(aAz);
+    Py_XDECREF(aZen);
+    Py_XDECREF(aC);
+
+    return (PyObject*) aOut;
+
+FINALIZE_reconstructShell:
+    #undef ABORT
+
+    if (Y) free(Y);
+    if (P) free(P);
+    free_legendre_coeffs(&lc);
+    Py_XDECREF(aAz);
+    Py_XDECREF(aZen);
+    Py_XDECREF(aC);
+    Py_XDECREF(aOut);
+
+    return NULL;
+}
+
+static PyObject * fitShells(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oAz=0, *oZen=0, *oR=0, *oStarts=0, *oCoeffs=0, *oResid=0;
+    PyArrayObject *aAz=0, *aZen=0, *aR=0, *aStarts=0, *aCoeffs=0, *aResid=0;
+    double *az, *zen, *r, *coeffs, *resid;
+    double *c=NULL, *Y=NULL, *P=NULL, *ATA=NULL, *Ycache=NULL;
+    char *mask=NULL;
+    int *starts;
+    int n_max = 3, max_iters = 2, nPts, nCells, nModes, maxCellSize = 0, cell, j;
+    int startCell = 0, endCell = -1;
+    double tol_init = 0.3;
+    legendre_coeffs_t lc = {0};
+
+    static char *kwlist[] = {"azimuth", "zenith", "r", "starts", "coefficients", "residuals", "n_max", "max_iters",
+                             "tol_init", "startCell", "endCell", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOOOOO|iidii", kwlist, &oAz, &oZen, &oR, &oStarts, &oCoeffs,
+         &oResid, &n_max, &max_iters, &tol_init, &startCell, &endCell))
+        return NULL;
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_fitShells;\
+        }
+
+    if ((n_max < 0) || (n_max > MAX_N_MAX)) ABORT("n_max must be in [0, 40]")
+    nModes = N_MODES(n_max);
+
+    aAz = (PyArrayObject *) PyArray_ContiguousFromObject(oAz, NPY_DOUBLE, 1, 1);
+    if (aAz == NULL) ABORT("Bad azimuth")
+    nPts = (int) PyArray_DIM(aAz, 0);
+
+    aZen = (PyArrayObject *) PyArray_ContiguousFromObject(oZen, NPY_DOUBLE, 1, 1);
+    if ((aZen == NULL) || (PyArray_DIM(aZen, 0) != nPts)) ABORT("Bad zenith")
+
+    aR = (PyArrayObject *) PyArray_ContiguousFromObject(oR, NPY_DOUBLE, 1, 1);
+    if ((aR == NULL) || (PyArray_DIM(aR, 0) != nPts)) ABORT("Bad r")
+
+    aStarts = (PyArrayObject *) PyArray_ContiguousFromObject(oStarts, NPY_INT, 1, 1);
+    if ((aStarts == NULL) || (PyArray_DIM(aStarts, 0) < 1)) ABORT("Bad starts - expecting nCells + 1 offsets")
+    nCells = (int) PyArray_DIM(aStarts, 0) - 1;
+    starts = (int *) PyArray_DATA(aStarts);
+
+    for (cell = 0; cell < nCells; cell++)
+    {
+        if ((starts[cell] < 0) || (starts[cell + 1] < starts[cell]) || (starts[cell + 1] > nPts))
+            ABORT("starts must be non-decreasing offsets into the points")
+        maxCellSize = MAX(maxCellSize, starts[cell + 1] - starts[cell]);
+    }
+
+    //coefficients and residuals are output arrays and must be written in place
+    if (!PyArray_Check(oCoeffs) || !PyArray_Check(oResid)) ABORT("coefficients and residuals must be arrays")
+    aCoeffs = (PyArrayObject *) oCoeffs;
+    aResid = (PyArrayObject *) oResid;
+    if ((PyArray_TYPE(aCoeffs) != NPY_DOUBLE) || !PyArray_ISCARRAY(aCoeffs) || (PyArray_SIZE(aCoeffs) != nCells*nModes))
+        ABORT("coefficients must be a contiguous float64 [nCells, (n_max + 1)**2] array")
+    if ((PyArray_TYPE(aResid) != NPY_DOUBLE) || !PyArray_ISCARRAY(aResid) || (PyArray_SIZE(aResid) != nCells))
+        ABORT("residuals must be a contiguous float64 [nCells] array")
+
+    az = (double *) PyArray_DATA(aAz);
+    zen = (double *) PyArray_DATA(aZen);
+    r = (double *) PyArray_DATA(aR);
+    coeffs = (double *) PyArray_DATA(aCoeffs);
+    resid = (double *) PyArray_DATA(aResid);
+
+    c = (double *) malloc(2*nModes*sizeof(double));
+    Y = (double *) malloc(nModes*sizeof(double));
+    P = (double *) malloc(nModes*sizeof(double));
+    ATA = (double *) malloc(nModes*nModes*sizeof(double));
+    mask = (char *) malloc(MAX(maxCellSize, 1));
+    if ((c == NULL) || (Y == NULL) || (P == NULL) || (ATA == NULL) || (mask == NULL) ||
+        (init_legendre_coeffs(&lc, n_max) < 0))
+        ABORT("Error allocating memory")
+
+    //cache the harmonics if the largest cell is small enough (otherwise they are recomputed on each pass)
+    if ((double) maxCellSize*nModes <= MAX_BASIS_CACHE)
+        Ycache = (double *) malloc(MAX((size_t) maxCellSize*nModes, 1)*sizeof(double));
+
+    if (endCell < 0) endCell = nCells;
+    startCell = MAX(startCell, 0);
+    endCell = MIN(endCell, nCells);
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (cell = startCell; cell < endCell; cell++)
+    {
+        resid[cell] = fit_shell(az, zen, r, starts[cell], starts[cell + 1], &lc, max_iters, tol_init, c, Y, P, ATA,
+                                mask, Ycache);
+        for (j = 0; j < nModes; j++) coeffs[(size_t) cell*nModes + j] = c[j];
+    }
+    Py_END_ALLOW_THREADS;
+
+    free(c);
+    free(Y);
+    free(P);
+    free(ATA);
+    free(mask);
+    if (Ycache) free(Ycache);
+    free_legendre_coeffs(&lc);
+
+    Py_XDECREF(aAz);
+    Py_XDECREF(aZen);
+    Py_XDECREF(aR);
+    Py_XDECREF(aStarts);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+
+FINALIZE_fitShells:
+    #undef ABORT
+
+    if (c) free(c);
+    if (Y) free(Y);
+    if (P) free(P);
+    if (ATA) free(ATA);
+    if (mask) free(mask);
+    if (Ycache) free(Ycache);
+    free_legendre_coeffs(&lc);
+
+    Py_XDECREF(aAz);
+    Py_XDECREF(aZen);
+    Py_XDECREF(aR);
+    Py_XDECREF(aStarts);
+
+    return NULL;
+}
+
+static PyObject * closestShellPoints(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oX=0, *oY=0, *oZ=0, *oShell=0, *oDist=0, *oIdx=0;
+    PyArrayObject *aX=0, *aY=0, *aZ=0, *aShell=0, *aDist=0, *aIdx=0;
+    double *x, *y, *z, *shell, *dist;
+    int *idx;
+    int nPts, nShell, i, k, best;
+    int start = 0, end = -1;
+    double dx, dy, dz, d2, bestD2;
+
+    static char *kwlist[] = {"x", "y", "z", "shell", "distances", "indices", "start", "end", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOOOOO|ii", kwlist, &oX, &oY, &oZ, &oShell, &oDist, &oIdx,
+         &start, &end))
+        return NULL;
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_closestShellPoints;\
+        }
+
+    aX = (PyArrayObject *) PyArray_ContiguousFromObject(oX, NPY_DOUBLE, 1, 1);
+    if (aX == NULL) ABORT("Bad x")
+    nPts = (int) PyArray_DIM(aX, 0);
+
+    aY = (PyArrayObject *) PyArray_ContiguousFromObject(oY, NPY_DOUBLE, 1, 1);
+    if ((aY == NULL) || (PyArray_DIM(aY, 0) != nPts)) ABORT("Bad y")
+
+    aZ = (PyArrayObject *) PyArray_ContiguousFromObject(oZ, NPY_DOUBLE, 1, 1);
+    if ((aZ == NULL) || (PyArray_DIM(aZ, 0) != nPts)) ABORT("Bad z")
+
+    aShell = (PyArrayObject *) PyArray_ContiguousFromObject(oShell, NPY_DOUBLE, 2, 2);
+    if ((aShell == NULL) || (PyArray_DIM(aShell, 1) != 3) || (PyArray_DIM(aShell, 0) < 1))
+        ABORT("Bad shell - expecting a [nShellPoints, 3] array")
+    nShell = (int) PyArray_DIM(aShell, 0);
+
+    //distances and indices are output arrays and must be written in place
+    if (!PyArray_Check(oDist) || !PyArray_Check(oIdx)) ABORT("distances and indices must be arrays")
+    aDist = (PyArrayObject *) oDist;
+    aIdx = (PyArrayObject *) oIdx;
+    if ((PyArray_TYPE(aDist) != NPY_DOUBLE) || !PyArray_ISCARRAY(aDist) || (PyArray_SIZE(aDist) != nPts) ||
+        (PyArray_TYPE(aIdx) != NPY_INT) || !PyArray_ISCARRAY(aIdx) || (PyArray_SIZE(aIdx) != nPts))
+        ABORT("distances and indices must be contiguous float64 and int32 arrays with one entry per point")
+
+    x = (double *) PyArray_DATA(aX);
+    y = (double *) PyArray_DATA(aY);
+    z = (double *) PyArray_DATA(aZ);
+    shell = (double *) PyArray_DATA(aShell);
+    dist = (double *) PyArray_DATA(aDist);
+    idx = (int *) PyArray_DATA(aIdx);
+
+    if (end < 0) end = nPts;
+    start = MAX(start, 0);
+    end = MIN(end, nPts);
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (i = start; i < end; i++)
+    {
+        best = 0;
+        bestD2 = INFINITY;
+        for (k = 0; k < nShell; k++)
+        {
+            dx = x[i] - shell[3*k];
+            dy = y[i] - shell[3*k + 1];
+            dz = z[i] - shell[3*k + 2];
+            d2 = dx*dx + dy*dy + dz*dz;
+            if (d2 < bestD2)
+            {
+                bestD2 = d2;
+                best = k;
+            }
+        }
+        dist[i] = sqrt(bestD2);
+        idx[i] = best;
+    }
+    Py_END_ALLOW_THREADS;
+
+    Py_XDECREF(aX);
+    Py_XDECREF(aY);
+    Py_XDECREF(aZ);
+    Py_XDECREF(aShell);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+
+FINALIZE_closestShellPoints:
+    #undef ABORT
+
+    Py_XDECREF(aX);
+    Py_XDECREF(aY);
+    Py_XDECREF(aZ);
+    Py_XDECREF(aShell);
+
+    return NULL;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+static PyMethodDef sphHarmMethods[] = {
+    {"realSphHarm",  realSphHarm, METH_VARARGS | METH_KEYWORDS,
+    "Evaluate all real spherical harmonics up to n_max. Returns a [nPoints, (n_max + 1)**2] array with modes in "
+    "sphere_expansion order.\n Arguments are: 'azimuth', 'zenith', 'n_max'=3"},
+    {"reconstructShell",  reconstructShell, METH_VARARGS | METH_KEYWORDS,
+    "Evaluate a spherical harmonic expansion (coefficients in sphere_expansion order) at the given angles.\n "
+    "Arguments are: 'azimuth', 'zenith', 'coefficients'"},
+    {"fitShells",  fitShells, METH_VARARGS | METH_KEYWORDS,
+    "Fit spherical harmonic expansions (with the outlier rejection of sphere_expansion_clean) to each set of points "
+    "[starts[i], starts[i+1]), for cells [startCell, endCell), writing the results into `coefficients` and "
+    "`residuals`.\n Arguments are: 'azimuth', 'zenith', 'r', 'starts', 'coefficients' float64 [nCells, nModes], "
+    "'residuals' float64 [nCells], 'n_max'=3, 'max_iters'=2, 'tol_init'=0.3, 'startCell'=0, 'endCell'=nCells"},
+    {"closestShellPoints",  closestShellPoints, METH_VARARGS | METH_KEYWORDS,
+    "Find the closest of a set of (pre-computed) shell points to each query point in [start, end), writing the distance "
+    "and shell point index into `distances` and `indices`.\n Arguments are: 'x', 'y', 'z', 'shell' [nShellPoints, 3], "
+    "'distances', 'indices', 'start'=0, 'end'=nPoints"},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+#pragma GCC diagnostic pop
+
+#if PY_MAJOR_VERSION>=3
+static struct PyModuleDef moduledef = {
+        PyModuleDef_HEAD_INIT,
+        "sphHarm",     /* m_name */
+        "native real spherical harmonic evaluation and shell fitting",  /* m_doc */
+        -1,                  /* m_size */
+        sphHarmMethods,    /* m_methods */
+        NULL,                /* m_reload */
+        NULL,                /* m_traverse */
+        NULL,                /* m_clear */
+        NULL,                /* m_free */
+    };
+
+PyMODINIT_FUNC PyInit_sphHarm(void)
+{
+	PyObject *m;
+    m = PyModule_Create(&moduledef);
+    import_array()
+    return m;
+}
+
+#else
+PyMODINIT_FUNC initsphHarm(void)
+{
+    PyObject *m;
+
+    m = Py_InitModule("sphHarm", sphHarmMethods);
+    import_array()
+}
+#endif
@@ -534,6 +534,515 @@ static PyObject * py_quad_surf_mf(PyObject *self, PyObject *args, PyObject *keyw
 }
 
 
+/*
+Batched quadratic surface patch fitting (used by surfit.fit_quad_surfaces_Pr)
+
+Fits the same model as surfit.fit_quad_surf (i.e. quad_surf_mf above) to the neighbourhood of every control point, but
+does the neighbour search, the Levenberg-Marquardt iterations, and the (analytic) Jacobian calculation in c. The
+neighbour search uses a spatial hash of the points - points are binned into cubic cells with side length equal to the
+fit radius, and the (sorted) cell keys, cell start offsets and the point ordering are calculated in python and passed
+in (see surfit._build_neighbour_grid).
+*/
+
+#define SURF_MIN_PTS 10
+#define SURF_MAX_ITER 100
+#define SURF_N_PARAMS 8
+
+//record layout of surfit.SURF_PATCH_DTYPE_FLAT
+typedef struct
+{
+    float results[SURF_N_PARAMS]; //x, y, z, theta, phi, psi, A, B
+    float pos[3];
+    int N;
+} surf_patch_t;
+
+/*
+Calculate the residuals and the jacobian of the quad_surf_mf model. p contains all 8 parameters, if fitPos is false
+only the derivatives w.r.t. the last 5 (theta, phi, psi, A, B) are calculated. J is stored row major [nPts, nP].
+*/
+static void quad_surf_jac(double *p, int fitPos, int nPts, float *x, float *y, float *z, double *res, double *J)
+{
+    double ctheta, stheta, cphi, sphi, cpsi, spsi, A, B;
+    double R[3][3], dRt[3][3], dRph[3][3], dRps[3][3];
+    double s[3], xr, yr, zr, g[3], dxr, dyr, dzr;
+    int i, k, nP, o;
+
+    ctheta = cos(p[3]); stheta = sin(p[3]);
+    cphi = cos(p[4]); sphi = sin(p[4]);
+    cpsi = cos(p[5]); spsi = sin(p[5]);
+    A = p[6]; B = p[7];
+
+    //rotation matrix - rows give xr, yr, zr (see quad_surf_mf)
+    R[0][0] = cpsi*ctheta; R[0][1] = ctheta*spsi; R[0][2] = -stheta;
+    R[1][0] = -cphi*spsi + cpsi*sphi*stheta; R[1][1] = cphi*cpsi + sphi*spsi*stheta; R[1][2] = ctheta*sphi;
+    R[2][0] = cphi*cpsi*stheta + sphi*spsi; R[2][1] = cphi*spsi*stheta - cpsi*sphi; R[2][2] = cphi*ctheta;
+
+    //derivatives w.r.t. theta
+    dRt[0][0] = -cpsi*stheta; dRt[0][1] = -stheta*spsi; dRt[0][2] = -ctheta;
+    dRt[1][0] = cpsi*sphi*ctheta; dRt[1][1] = sphi*spsi*ctheta; dRt[1][2] = -stheta*sphi;
+    dRt[2][0] = cphi*cpsi*ctheta; dRt[2][1] = cphi*spsi*ctheta; dRt[2][2] = -cphi*stheta;
+
+    //derivatives w.r.t. phi (dR1/dphi = R2, dR2/dphi = -R1)
+    for (k = 0; k < 3; k++)
+    {
+        dRph[0][k] = 0;
+        dRph[1][k] = R[2][k];
+        dRph[2][k] = -R[1][k];
+    }
+
+    //derivatives w.r.t. psi
+    dRps[0][0] = -spsi*ctheta; dRps[0][1] = ctheta*cpsi; dRps[0][2] = 0;
+    dRps[1][0] = -cphi*cpsi - spsi*sphi*stheta; dRps[1][1] = -cphi*spsi + sphi*cpsi*stheta; dRps[1][2] = 0;
+    dRps[2][0] = -cphi*spsi*stheta + sphi*cpsi; dRps[2][1] = cphi*cpsi*stheta + spsi*sphi; dRps[2][2] = 0;
+
+    nP = fitPos ? 8 : 5;
+    o = fitPos ? 0 : 3;
+
+    for (i = 0; i < nPts; i++)
+    {
+        s[0] = x[i] - p[0];
+        s[1] = y[i] - p[1];
+        s[2] = z[i] - p[2];
+
+        xr = R[0][0]*s[0] + R[0][1]*s[1] + R[0][2]*s[2];
+        yr = R[1][0]*s[0] + R[1][1]*s[1] + R[1][2]*s[2];
+        zr = R[2][0]*s[0] + R[2][1]*s[1] + R[2][2]*s[2];
+
+        res[i] = zr - (A*xr*xr + B*yr*yr);
+
+        //d res/d s
+        for (k = 0; k < 3; k++) g[k] = R[2][k] - 2*A*xr*R[0][k] - 2*B*yr*R[1][k];
+
+        if (fitPos)
+        {
+            J[i*nP + 0] = -g[0];
+            J[i*nP + 1] = -g[1];
+            J[i*nP + 2] = -g[2];
+        }
+
+        dxr = dRt[0][0]*s[0] + dRt[0][1]*s[1] + dRt[0][2]*s[2];
+        dyr = dRt[1][0]*s[0] + dRt[1][1]*s[1] + dRt[1][2]*s[2];
+        dzr = dRt[2][0]*s[0] + dRt[2][1]*s[1] + dRt[2][2]*s[2];
+        J[i*nP + 3 - o] = dzr - 2*A*xr*dxr - 2*B*yr*dyr;
+
+        dxr = 0;
+        dyr = dRph[1][0]*s[0] + dRph[1][1]*s[1] + dRph[1][2]*s[2];
+        dzr = dRph[2][0]*s[0] + dRph[2][1]*s[1] + dRph[2][2]*s[2];
+        J[i*nP + 4 - o] = dzr - 2*B*yr*dyr;
+
+        dxr = dRps[0][0]*s[0] + dRps[0][1]*s[1];
+        dyr = dRps[1][0]*s[0] + dRps[1][1]*s[1];
+        dzr = dRps[2][0]*s[0] + dRps[2][1]*s[1];
+        J[i*nP + 5 - o] = dzr - 2*A*xr*dxr - 2*B*yr*dyr;
+
+        J[i*nP + 6 - o] = -xr*xr;
+        J[i*nP + 7 - o] = -yr*yr;
+    }
+}
+
+static double quad_surf_cost(double *p, int nPts, float *x, float *y, float *z, float *buf)
+{
+    int i;
+    double c = 0;
+
+    quad_surf_mf((float) p[0], (float) p[1], (float) p[2], (float) p[3], (float) p[4], (float) p[5], (float) p[6],
+                 (float) p[7], 0, nPts, x, y, z, buf);
+
+    for (i = 0; i < nPts; i++) c += buf[i]*buf[i];
+
+    return c;
+}
+
+//solve the (symmetric, positive definite) system M x = b in place using a Cholesky decomposition. Returns -1 on failure
+static int chol_solve(double *M, double *b, int n)
+{
+    int i, j, k;
+    double s;
+
+    for (j = 0; j < n; j++)
+    {
+        s = M[j*n + j];
+        for (k = 0; k < j; k++) s -= M[j*n + k]*M[j*n + k];
+        if (s <= 0) return -1;
+        M[j*n + j] = sqrt(s);
+
+        for (i = j + 1; i < n; i++)
+        {
+            s = M[i*n + j];
+            for (k = 0; k < j; k++) s -= M[i*n + k]*M[j*n + k];
+            M[i*n + j] = s/M[j*n + j];
+        }
+    }
+
+    //forward substitution
+    for (i = 0; i < n; i++)
+    {
+        s = b[i];
+        for (k = 0; k < i; k++) s -= M[i*n + k]*b[k];
+        b[i] = s/M[i*n + i];
+    }
+
+    //back substitution
+    for (i = n - 1; i >= 0; i--)
+    {
+        s = b[i];
+        for (k = i + 1; k < n; k++) s -= M[k*n + i]*b[k];
+        b[i] = s/M[i*n + i];
+    }
+
+    return 0;
+}
+
+/*
+Starting orientation for the fit - align the surface normal with the direction of least variance of the neighbourhood
+(found by inverse iteration on the 3x3 covariance matrix).
+*/
+static void quad_surf_initial_angles(int nPts, float *x, float *y, float *z, double *p)
+{
+    double C[9], M[9], v[3], w[3], m[3] = {0, 0, 0}, n;
+    int i, j, k, it;
+
+    for (i = 0; i < nPts; i++)
+    {
+        m[0] += x[i]; m[1] += y[i]; m[2] += z[i];
+    }
+    for (k = 0; k < 3; k++) m[k] /= nPts;
+
+    for (k = 0; k < 9; k++) C[k] = 0;
+    for (i = 0; i < nPts; i++)
+    {
+        w[0] = x[i] - m[0]; w[1] = y[i] - m[1]; w[2] = z[i] - m[2];
+        for (j = 0; j < 3; j++)
+            for (k = 0; k < 3; k++)
+                C[j*3 + k] += w[j]*w[k];
+    }
+
+    //regularise so that the inverse iteration is well defined for degenerate neighbourhoods
+    n = 1e-6*(C[0] + C[4] + C[8]) + 1e-12;
+    C[0] += n; C[4] += n; C[8] += n;
+
+    v[0] = 0.3; v[1] = 0.4; v[2] = 0.866;
+    for (it = 0; it < 20; it++)
+    {
+        for (k = 0; k < 9; k++) M[k] = C[k];
+        if (chol_solve(M, v, 3) < 0) break;
+
+        n = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+        for (k = 0; k < 3; k++) v[k] /= n;
+    }
+
+    //with psi = 0 the normal (zr axis) is [cos(phi)sin(theta), -sin(phi), cos(phi)cos(theta)]
+    p[3] = atan2(v[0], v[2]);
+    p[4] = asin(MAX(MIN(-v[1], 1.0), -1.0));
+    p[5] = 0;
+    p[6] = 0;
+    p[7] = 0;
+}
+
+/*
+Fit a single surface patch to the nPts points in x, y, z (which should already be relative to the control point).
+The fitted parameters are returned in p (positions also relative to the control point).
+*/
+static int quad_surf_fit_lm(int nPts, float *x, float *y, float *z, int fitPos, double *p, double *res, double *J,
+                            float *buf)
+{
+    double JtJ[SURF_N_PARAMS*SURF_N_PARAMS], M[SURF_N_PARAMS*SURF_N_PARAMS], Jtr[SURF_N_PARAMS], delta[SURF_N_PARAMS];
+    double pt[SURF_N_PARAMS];
+    double lambda = 1e-3, cost, cost_t;
+    int nP, o, it, i, j, k, accepted;
+
+    nP = fitPos ? 8 : 5;
+    o = fitPos ? 0 : 3;
+
+    cost = quad_surf_cost(p, nPts, x, y, z, buf);
+
+    for (it = 0; it < SURF_MAX_ITER; it++)
+    {
+        quad_surf_jac(p, fitPos, nPts, x, y, z, res, J);
+
+        for (j = 0; j < nP; j++)
+        {
+            Jtr[j] = 0;
+            for (k = 0; k < nP; k++) JtJ[j*nP + k] = 0;
+        }
+
+        for (i = 0; i < nPts; i++)
+        {
+            for (j = 0; j < nP; j++)
+            {
+                Jtr[j] += J[i*nP + j]*res[i];
+                for (k = 0; k <= j; k++) JtJ[j*nP + k] += J[i*nP + j]*J[i*nP + k];
+            }
+        }
+
+        for (j = 0; j < nP; j++)
+            for (k = j + 1; k < nP; k++)
+                JtJ[j*nP + k] = JtJ[k*nP + j];
+
+        accepted = 0;
+        while (lambda < 1e10)
+        {
+            for (k = 0; k < nP*nP; k++) M[k] = JtJ[k];
+            for (j = 0; j < nP; j++)
+            {
+                M[j*nP + j] += lambda*JtJ[j*nP + j] + 1e-12;
+                delta[j] = -Jtr[j];
+            }
+
+            if (chol_solve(M, delta, nP) == 0)
+            {
+                for (k = 0; k < SURF_N_PARAMS; k++) pt[k] = p[k];
+                for (j = 0; j < nP; j++) pt[j + o] += delta[j];
+
+                cost_t = quad_surf_cost(pt, nPts, x, y, z, buf);
+
+                if (cost_t < cost)
+                {
+                    accepted = 1;
+                    lambda = MAX(lambda/10, 1e-9);
+                    break;
+                }
+            }
+
+            lambda *= 10;
+        }
+
+        if (!accepted) break;
+
+        for (k = 0; k < SURF_N_PARAMS; k++) p[k] = pt[k];
+
+        if ((cost - cost_t) <= 1e-8*cost)
+        {
+            cost = cost_t;
+            break;
+        }
+
+        cost = cost_t;
+    }
+
+    return it;
+}
+
+static long long surf_cell_key(long long ix, long long iy, long long iz, long long ny, long long nz)
+{
+    return (ix*ny + iy)*nz + iz;
+}
+
+static int find_cell(long long *cellKeys, int nCells, long long key)
+{
+    int lo = 0, hi = nCells - 1, mid;
+
+    while (lo <= hi)
+    {
+        mid = (lo + hi)/2;
+        if (cellKeys[mid] == key) return mid;
+        if (cellKeys[mid] < key) lo = mid + 1;
+        else hi = mid - 1;
+    }
+
+    return -1;
+}
+
+/* grow a work buffer, leaving it untouched (so that it can still be freed) if the allocation fails */
+static int grow_buffer(void **buffer, size_t size)
+{
+    void *tmp = realloc(*buffer, size);
+    if (tmp == NULL) return -1;
+
+    *buffer = tmp;
+    return 0;
+}
+
+static PyObject * py_quad_surf_fit_batch(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oData=0, *oOrder=0, *oCellKeys=0, *oCellStarts=0, *oGrid=0, *oResults=0;
+    PyArrayObject *aData=0, *aOrder=0, *aCellKeys=0, *aCellStarts=0, *aGrid=0, *aResults=0;
+
+    float *data, *x=NULL, *y=NULL, *z=NULL, *buf=NULL;
+    int *order, *cellStarts;
+    long long *cellKeys;
+    double *grid, *res=NULL, *J=NULL;
+    surf_patch_t *results;
+
+    float radius = 100, r2, dx, dy, dz;
+    int fitPos = 0, start = 0, end = -1;
+    int nPts, nCells, nRes, i, c, k, n, nMax, err = 0;
+    long long ix, iy, iz, ny, nz, jx, jy, jz;
+    double p[SURF_N_PARAMS], cellSize;
+
+    static char *kwlist[] = {"data", "order", "cellKeys", "cellStarts", "grid", "results", "radius", "fitPos",
+                             "start", "end", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOOOOO|fiii", kwlist,
+         &oData, &oOrder, &oCellKeys, &oCellStarts, &oGrid, &oResults, &radius, &fitPos, &start, &end))
+        return NULL;
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_py_quad_surf_fit_batch;\
+        }
+
+    aData = (PyArrayObject *) PyArray_ContiguousFromObject(oData, NPY_FLOAT, 2, 2);
+    if ((aData == NULL) || (PyArray_DIM(aData, 1) != 3)) ABORT("Bad data - expecting a [N, 3] float32 array")
+
+    nPts = (int) PyArray_DIM(aData, 0);
+
+    aOrder = (PyArrayObject *) PyArray_ContiguousFromObject(oOrder, NPY_INT, 1, 1);
+    if ((aOrder == NULL) || (PyArray_DIM(aOrder, 0) != nPts)) ABORT("Bad order")
+
+    aCellKeys = (PyArrayObject *) PyArray_ContiguousFromObject(oCellKeys, NPY_LONGLONG, 1, 1);
+    if (aCellKeys == NULL) ABORT("Bad cellKeys")
+
+    nCells = (int) PyArray_DIM(aCellKeys, 0);
+
+    aCellStarts = (PyArrayObject *) PyArray_ContiguousFromObject(oCellStarts, NPY_INT, 1, 1);
+    if ((aCellStarts == NULL) || (PyArray_DIM(aCellStarts, 0) != (nCells + 1))) ABORT("Bad cellStarts")
+
+    //grid = [x0, y0, z0, cellSize, nx, ny, nz]
+    aGrid = (PyArrayObject *) PyArray_ContiguousFromObject(oGrid, NPY_DOUBLE, 1, 1);
+    if ((aGrid == NULL) || (PyArray_DIM(aGrid, 0) != 7)) ABORT("Bad grid")
+
+    //results is written in place
+    if (!PyArray_Check(oResults)) ABORT("results must be an array")
+    aResults = (PyArrayObject *) oResults;
+    if (!PyArray_ISCARRAY(aResults) || (PyArray_ITEMSIZE(aResults) != sizeof(surf_patch_t)))
+        ABORT("results must be a contiguous array with dtype SURF_PATCH_DTYPE_FLAT")
+
+    nRes = (int) PyArray_SIZE(aResults);
+
+    data = (float *) PyArray_DATA(aData);
+    order = (int *) PyArray_DATA(aOrder);
+    cellKeys = (long long *) PyArray_DATA(aCellKeys);
+    cellStarts = (int *) PyArray_DATA(aCellStarts);
+    grid = (double *) PyArray_DATA(aGrid);
+    results = (surf_patch_t *) PyArray_DATA(aResults);
+
+    if (end < 0) end = nRes;
+    end = MIN(end, MIN(nRes, nPts));
+
+    cellSize = grid[3];
+    ny = (long long) grid[5];
+    nz = (long long) grid[6];
+    r2 = radius*radius;
+
+    Py_BEGIN_ALLOW_THREADS;
+
+    //work buffers - grown as needed
+    nMax = 256;
+    x = malloc(nMax*sizeof(float));
+    y = malloc(nMax*sizeof(float));
+    z = malloc(nMax*sizeof(float));
+    buf = malloc(nMax*sizeof(float));
+    res = malloc(nMax*sizeof(double));
+    J = malloc(nMax*SURF_N_PARAMS*sizeof(double));
+
+    for (i = start; i < end; i++)
+    {
+        if ((x == NULL) || (y == NULL) || (z == NULL) || (buf == NULL) || (res == NULL) || (J == NULL))
+        {
+            err = 1;
+            break;
+        }
+
+        ix = (long long) ((data[3*i] - grid[0])/cellSize);
+        iy = (long long) ((data[3*i + 1] - grid[1])/cellSize);
+        iz = (long long) ((data[3*i + 2] - grid[2])/cellSize);
+
+        //gather the neighbourhood (relative to the control point)
+        n = 0;
+        for (jx = ix - 1; jx <= ix + 1; jx++)
+            for (jy = MAX(iy - 1, 0); jy <= MIN(iy + 1, ny - 1); jy++)
+                for (jz = MAX(iz - 1, 0); jz <= MIN(iz + 1, nz - 1); jz++)
+                {
+                    c = find_cell(cellKeys, nCells, surf_cell_key(jx, jy, jz, ny, nz));
+                    if (c < 0) continue;
+
+                    for (k = cellStarts[c]; k < cellStarts[c + 1]; k++)
+                    {
+                        dx = data[3*order[k]] - data[3*i];
+                        dy = data[3*order[k] + 1] - data[3*i + 1];
+                        dz = data[3*order[k] + 2] - data[3*i + 2];
+
+                        if ((dx*dx + dy*dy + dz*dz) <= r2)
+                        {
+                            if (n >= nMax)
+                            {
+                                nMax *= 2;
+                                if (grow_buffer((void **) &x, nMax*sizeof(float)) ||
+                                    grow_buffer((void **) &y, nMax*sizeof(float)) ||
+                                    grow_buffer((void **) &z, nMax*sizeof(float)) ||
+                                    grow_buffer((void **) &buf, nMax*sizeof(float)) ||
+                                    grow_buffer((void **) &res, nMax*sizeof(double)) ||
+                                    grow_buffer((void **) &J, nMax*SURF_N_PARAMS*sizeof(double)))
+                                {
+                                    err = 1;
+                                    goto DONE_py_quad_surf_fit_batch;
+                                }
+                            }
+
+                            x[n] = dx; y[n] = dy; z[n] = dz;
+                            n++;
+                        }
+                    }
+                }
+
+        results[i].pos[0] = data[3*i];
+        results[i].pos[1] = data[3*i + 1];
+        results[i].pos[2] = data[3*i + 2];
+
+        //bail if we don't have enough points for a meaningful surface fit (as in fit_quad_surf_to_neighbourbood)
+        if (n < SURF_MIN_PTS)
+        {
+            for (k = 0; k < SURF_N_PARAMS; k++) results[i].results[k] = 0;
+            results[i].N = 0;
+            continue;
+        }
+
+        p[0] = p[1] = p[2] = 0;
+        quad_surf_initial_angles(n, x, y, z, p);
+        quad_surf_fit_lm(n, x, y, z, fitPos, p, res, J, buf);
+
+        results[i].results[0] = (float) (p[0] + data[3*i]);
+        results[i].results[1] = (float) (p[1] + data[3*i + 1]);
+        results[i].results[2] = (float) (p[2] + data[3*i + 2]);
+        for (k = 3; k < SURF_N_PARAMS; k++) results[i].results[k] = (float) p[k];
+        results[i].N = n;
+    }
+
+DONE_py_quad_surf_fit_batch:
+    free(x);
+    free(y);
+    free(z);
+    free(buf);
+    free(res);
+    free(J);
+
+    Py_END_ALLOW_THREADS;
+
+    if (err) ABORT("Error allocating memory for neighbourhoods")
+
+    Py_XDECREF(aData);
+    Py_XDECREF(aOrder);
+    Py_XDECREF(aCellKeys);
+    Py_XDECREF(aCellStarts);
+    Py_XDECREF(aGrid);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+
+FINALIZE_py_quad_surf_fit_batch:
+    #undef ABORT
+
+    Py_XDECREF(aData);
+    Py_XDECREF(aOrder);
+    Py_XDECREF(aCellKeys);
+    Py_XDECREF(aCellStarts);
+    Py_XDECREF(aGrid);
+
+    return NULL;
+}
+
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
 
@@ -546,6 +1055,9 @@ static PyMethodDef arcmfMethods[] = {
     ""},
     {"quad_surf_mf",  py_quad_surf_mf, METH_VARARGS | METH_KEYWORDS,
     ""},
+    {"quad_surf_fit_batch",  py_quad_surf_fit_batch, METH_VARARGS | METH_KEYWORDS,
+    "Fit quadratic surface patches to the neighbourhoods of control points [start, end), writing into results "
+    "(SURF_PATCH_DTYPE_FLAT). See surfit.fit_quad_surfaces_batch for the python interface."},
     {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
@@ -140,3 +140,164 @@ def extractAverageTrajectory(pipeline, clumpRadiusVar='error_x', clumpRadiusMult
     filtered_corr = FILTER_FUNCS[filter](t_f, {'x': x_corr, 'y': y_corr, 'z': z_corr}, filterScale)
     
     return t_f, filtered_corr, clumpIndex
+
+
+FILTER_MODES = {'Gaussian': 0, 'Uniform': 1, 'Median': 2}
+
+class StreamingDriftEstimator(object):
+    """
+    Incremental version of extractAverageTrajectory which can be updated as fiducial localisations arrive (e.g. during
+    acquisition), at a constant cost per frame.
+    
+    Fiducials are linked into tracks frame by frame, and the drift for each frame is the mean offset of all established
+    tracks (those seen in at least `minTrackLength` frames) from their reference positions. The temporal filter is
+    applied causally (i.e. only using the current and previous frames) so that the drift estimate for a frame does not
+    change once it has been computed. This means the Gaussian and Uniform filters lag the true drift somewhat compared
+    to the (symmetric) filters used in extractAverageTrajectory.
+    
+    Usage
+    -----
+    
+    >>> est = StreamingDriftEstimator()
+    >>> est.add_points(t, x, y, delta_x=5*error_x) # repeat as results arrive
+    >>> t_f, drift = est.trajectory()
+    
+    Frames are processed once a later frame has been seen (so that all the localisations for a frame are available).
+    Call `flush()` at the end of a series to process the remaining frames.
+    """
+    def __init__(self, clumpRadiusMultiplier=5.0, timeWindow=25, filter='Gaussian', filterScale=10.0,
+                 minTrackLength=50, maxTracks=256):
+        from PYME.Analysis.points.FiducialTracking import fiducialTracking
+        self._processFrames = fiducialTracking.processFrames
+        
+        self.clumpRadiusMultiplier = clumpRadiusMultiplier
+        self.timeWindow = timeWindow
+        self.filterMode = FILTER_MODES[filter]
+        self.filterScale = filterScale
+        self.minTrackLength = minTrackLength
+        
+        self._tracks = np.zeros([maxTracks, 9], 'f8')
+        self._state = np.zeros(4, 'i8')
+        self._alloc(1024)
+        
+        #localisations from frames which might not yet be complete
+        self._pending = [np.zeros(0, 'i4')] + [np.zeros(0, 'f4')]*4
+        self.n_dropped = 0
+        
+    def _alloc(self, nFrames):
+        drift = np.zeros([nFrames, 3], 'f8')
+        nFid = np.zeros(nFrames, 'i4')
+        filt = np.zeros([nFrames, 3], 'f8')
+        
+        if hasattr(self, '_drift'):
+            n = self.n_frames
+            drift[:n] = self._drift[:n]
+            nFid[:n] = self._nFid[:n]
+            filt[:n] = self._filtDrift[:n]
+        
+        self._drift, self._nFid, self._filtDrift = drift, nFid, filt
+        
+    @property
+    def n_frames(self):
+        """number of frames for which the drift has been computed"""
+        return int(self._state[0])
+    
+    def add_points(self, t, x, y, z=None, delta_x=None, error_x=None):
+        """
+        Add fiducial localisations. Frames before the latest frame seen so far are processed immediately.
+        
+        Parameters
+        ----------
+        t, x, y : frame numbers and positions of the fiducials
+        z : optional z positions
+        delta_x : linkage radius for each point. If not given, clumpRadiusMultiplier*error_x is used, or
+            clumpRadiusMultiplier if error_x is also None (the equivalent of clumpRadiusVar='1.0')
+        """
+        t = np.asarray(t).astype('i4')
+        x = np.asarray(x).astype('f4')
+        y = np.asarray(y).astype('f4')
+        z = np.zeros_like(x) if z is None else np.asarray(z).astype('f4')
+        if delta_x is None:
+            if error_x is None:
+                delta_x = self.clumpRadiusMultiplier*np.ones_like(x)
+            else:
+                delta_x = self.clumpRadiusMultiplier*np.asarray(error_x)
+        delta_x = np.asarray(delta_x).astype('f4')
+        
+        #drop any points from frames we have already processed
+        late = t < self.n_frames
+        if np.any(late):
+            self.n_dropped += int(late.sum())
+            t, x, y, z, delta_x = [v[~late] for v in (t, x, y, z, delta_x)]
+        
+        self._pending = [np.hstack([p, v]) for p, v in zip(self._pending, (t, x, y, z, delta_x))]
+        
+        if len(self._pending[0]) > 0:
+            self._process(int(self._pending[0].max()))
+        
+    def flush(self):
+        """Process all pending frames"""
+        if len(self._pending[0]) > 0:
+            self._process(int(self._pending[0].max()) + 1)
+    
+    def _process(self, endFrame):
+        if endFrame <= self.n_frames:
+            return
+        
+        if endFrame > len(self._nFid):
+            self._alloc(max(2*len(self._nFid), endFrame))
+        
+        I = np.argsort(self._pending[0], kind='mergesort')
+        nReady = int(np.searchsorted(self._pending[0][I], endFrame))
+        
+        t, x, y, z, delta_x = [v[I[:nReady]] for v in self._pending]
+        self._processFrames(self._tracks, self._state, self._drift, self._nFid, self._filtDrift, t, x, y, z, delta_x,
+                            endFrame, timeWindow=int(self.timeWindow), minTrackLength=int(self.minTrackLength),
+                            filterMode=self.filterMode, filterScale=float(self.filterScale))
+        
+        self._pending = [v[I[nReady:]] for v in self._pending]
+        
+    def trajectory(self, raw=False):
+        """
+        Get the drift trajectory for all processed frames, in the same format as extractAverageTrajectory.
+        
+        Returns
+        -------
+        t_f : frame numbers
+        drift : dictionary of 'x', 'y', and 'z' drift for each frame (causally filtered unless raw=True)
+        """
+        n = self.n_frames
+        d = self._drift if raw else self._filtDrift
+        return np.arange(n, dtype='i'), {'x': d[:n, 0].copy(), 'y': d[:n, 1].copy(), 'z': d[:n, 2].copy()}
+    
+    def drift_at(self, t):
+        """Look up the filtered drift for frame(s) t. Frames beyond the last processed frame get the latest estimate."""
+        n = self.n_frames
+        if n == 0:
+            return np.zeros_like(t, dtype='f8'), np.zeros_like(t, dtype='f8'), np.zeros_like(t, dtype='f8')
+        ti = np.clip(np.asarray(t).astype('i'), 0, n - 1)
+        return self._filtDrift[ti, 0], self._filtDrift[ti, 1], self._filtDrift[ti, 2]
+
+
+def streamingAverageTrajectory(pipeline, clumpRadiusVar='error_x', clumpRadiusMultiplier=5.0,
+                               timeWindow=25, filter='Gaussian', filterScale=10.0, minTrackLength=50):
+    """
+    Estimate drift from fiducials using StreamingDriftEstimator. Takes the same arguments, and returns the same
+    (t_f, filtered_corr) trajectory as extractAverageTrajectory, but with a causal filter.
+    """
+    est = StreamingDriftEstimator(clumpRadiusMultiplier=clumpRadiusMultiplier, timeWindow=timeWindow, filter=filter,
+                                  filterScale=filterScale, minTrackLength=minTrackLength)
+    
+    try:
+        z = pipeline['z']
+    except:
+        z = None
+    
+    if clumpRadiusVar == '1.0':
+        est.add_points(pipeline['t'], pipeline['x'], pipeline['y'], z)
+    else:
+        est.add_points(pipeline['t'], pipeline['x'], pipeline['y'], z, error_x=pipeline[clumpRadiusVar])
+        
+    est.flush()
+    
+    return est.trajectory()
@@ -59,6 +59,68 @@ def calcMCCenteredMoments(x, y, order=4, nSamples=10):
 
     return ms.mean(0), np.std(ms, 0)
 
+def clusterMomentsDType(order=4):
+    N = order + 1
+    return [('label', 'i4'), ('NEvents', 'i4'), ('moments', '(%d,%d)f8' % (N, N)), ('momentErrors', '(%d,%d)f8' % (N, N))]
+
+def calcClusterMoments(x, y, labels, order=4, nSamples=0, seed=None, nThreads=None):
+    """
+    Calculate centered moments for every cluster in a table in one (multi-threaded) pass. Equivalent to calling
+    calcCenteredMoments (nSamples=0) or calcMCCenteredMoments (nSamples > 0) for each cluster.
+
+    Parameters
+    ----------
+    x, y : point positions
+    labels : cluster label for each point. Points with label <= 0 are ignored.
+    order : maximum order of moments to calculate
+    nSamples : number of random half-subsamples of each cluster to average over. If 0, the moments are calculated
+        directly from all points and the errors are 0.
+    seed : seed for the subsampling (random if None)
+    nThreads : number of threads to use (defaults to the number of CPUs)
+
+    Returns
+    -------
+    a structured array (see clusterMomentsDType) with an entry for each label, sorted by label
+    """
+    import multiprocessing
+    from PYME.Analysis.points.ClusterMoments import clusterMoments
+    from PYME.util.threaded import run_threaded
+
+    if nThreads is None:
+        nThreads = multiprocessing.cpu_count()
+    if seed is None:
+        seed = np.random.randint(0, 2**31)
+
+    labels = np.asarray(labels)
+    I = np.argsort(labels, kind='mergesort')
+    I = I[labels[I] > 0]
+    x = np.ascontiguousarray(np.asarray(x)[I], dtype='f8')
+    y = np.ascontiguousarray(np.asarray(y)[I], dtype='f8')
+
+    unique_labels, starts, counts = np.unique(labels[I], return_index=True, return_counts=True)
+    starts = np.hstack([starts, len(I)]).astype('i4')
+    nClusters = len(unique_labels)
+
+    N = order + 1
+    ms = np.zeros([nClusters, N, N], 'f8')
+    errs = np.zeros([nClusters, N, N], 'f8')
+
+    bounds = np.linspace(0, nClusters, max(min(nThreads, nClusters), 1) + 1).astype('i')
+
+    def _moments(start, end):
+        clusterMoments.momentsByCluster(x, y, starts, ms, errs, order=int(order), nSamples=int(nSamples),
+                                        seed=int(seed), startCluster=int(start), endCluster=int(end))
+
+    run_threaded(_moments, list(zip(bounds[:-1], bounds[1:])))
+
+    out = np.zeros(nClusters, dtype=clusterMomentsDType(order))
+    out['label'] = unique_labels
+    out['NEvents'] = counts
+    out['moments'] = ms
+    out['momentErrors'] = errs
+
+    return out
+
 def genIndexAndLabels(order=4):
     N = order + 1
     i,j = np.mgrid[:N,:N]
@@ -172,15 +172,15 @@ def foldX(datasource, mdh, inject=False, chroma_mappings=False):
 
     return datasource
 
-def correlative_shift(x0, y0, which_channel, pix_size_nm=115.):
+def correlative_channel_shifts(x, y, which_channel, pix_size_nm=115.):
     """
-    Laterally shifts all channels to the first using cross correlations
+    Estimates the lateral shift of each channel relative to the first using cross correlations
 
     Parameters
     ----------
-    x0 : ndarray
+    x : ndarray
         array of localization x positions; not yet registered
-    y0 : ndarray
+    y : ndarray
         array of localization y positions; not yet registered
     which_channel : ndarray
         contains the channel ID for each localization
@@ -189,15 +189,12 @@ def correlative_shift(x0, y0, which_channel, pix_size_nm=115.):
 
     Returns
     -------
-    x : ndarray
-        array of localization x positions registered to the first channel
-    y : ndarray
-        array of localization y positions registered to the first channel
+    shifts : dict
+        maps channel ID to the (dx, dy) which should be added to positions in that channel to register it to the first
     """
     from scipy.signal import fftconvolve  # , correlate2d
     from skimage import filters
 
-    x, y = np.copy(x0), np.copy(y0)
     # determine number of ~pixel size bins for histogram
     bin_count = round((x.max() - x.min()) / pix_size_nm)  # assume square FOV (NB - after folding)
     # make sure bin_count is odd so its possible to have zero shift
@@ -212,6 +209,8 @@ def correlative_shift(x0, y0, which_channel, pix_size_nm=115.):
     first_channel, r_bins, c_bins = np.histogram2d(x[mask], y[mask], bins=(bin_count, bin_count))
     first_channel = first_channel >= filters.threshold_otsu(first_channel)
     first_channel = filters.gaussian(first_channel.astype(float))
+    
+    shifts = {first_chan: (0., 0.)}
 
     # loop through channels, skipping the first
     for chan in channels:
@@ -232,15 +231,45 @@ def correlative_shift(x0, y0, which_channel, pix_size_nm=115.):
         r_shift = (center - r_off) * pix_size_nm
         c_shift = (center - c_off) * pix_size_nm
 
-        x[mask] -= c_shift
-        y[mask] -= r_shift
+        shifts[chan] = (-c_shift, -r_shift)
+
+    return shifts
+
+def correlative_shift(x0, y0, which_channel, pix_size_nm=115.):
+    """
+    Laterally shifts all channels to the first using cross correlations
+
+    Parameters
+    ----------
+    x0 : ndarray
+        array of localization x positions; not yet registered
+    y0 : ndarray
+        array of localization y positions; not yet registered
+    which_channel : ndarray
+        contains the channel ID for each localization
+    pix_size_nm : float
+        size of pixels to be used in generating 2D histograms which the correlations are then performed on
+
+    Returns
+    -------
+    x : ndarray
+        array of localization x positions registered to the first channel
+    y : ndarray
+        array of localization y positions registered to the first channel
+    """
+    x, y = np.copy(x0), np.copy(y0)
+    
+    for chan, (dx, dy) in correlative_channel_shifts(x0, y0, which_channel, pix_size_nm).items():
+        mask = which_channel == chan
+        x[mask] += dx
+        y[mask] += dy
 
     return x, y
 
 def pair_molecules(t_index, x0, y0, which_chan, delta_x=[None], appear_in=np.arange(4), n_frame_sep=5,
                    return_paired=True, pix_size_nm=115.):
     """
-    pair_molecules uses pyDeClump functions to group localization clumps into molecules for registration.
+    pair_molecules groups localization clumps from all channels into molecules for registration.
 
     Parameters
     ----------
@@ -273,42 +302,44 @@ def pair_molecules(t_index, x0, y0, which_chan, delta_x=[None], appear_in=np.ara
     -----
     Outputs are of length #molecules, and the keep vector that is returned needs to be applied as:
     x_kept = x[keep] in order to only look at kept molecules.
+    
+    All channels are clumped in a single pass (see deClump.findClumpsMultiview), with the correlative shifts applied
+    as per-channel offsets within the clumping kernel rather than to copies of the position columns.
 
     """
+    from PYME.Analysis.points.DeClump import deClump
+    
+    which_chan = np.asarray(which_chan)
+    
     # take out any large linear shifts for the sake of easier pairing
-    x, y = correlative_shift(x0, y0, which_chan, pix_size_nm)
+    shifts = correlative_channel_shifts(x0, y0, which_chan, pix_size_nm)
+    n_chan = max(int(which_chan.max()) + 1, 1)
+    chan_dx, chan_dy = np.zeros(n_chan), np.zeros(n_chan)
+    for chan, (dx, dy) in shifts.items():
+        if chan >= 0:
+            chan_dx[chan], chan_dy[chan] = dx, dy
+        
     # group within a certain distance, potentially based on localization uncertainty
     if not delta_x[0]:
-        delta_x = 100.*np.ones_like(x)
-    # group localizations
-    assigned = pyDeClump.findClumps(t_index.astype(np.int32), x, y, delta_x, n_frame_sep)
-    # print assigned.min()
-
-    # only look at clumps with localizations from each channel
-    clumps = np.unique(assigned)
-
-    # Note that this will never be a keep clump if an ignore channel is present...
-    kept_clumps = [np.array_equal(np.unique(which_chan[assigned == clumps[ii]]), appear_in) for ii in range(len(clumps))]
-
-   # don't clump molecules from the wrong channel (done by parsing modified whichChan to this function)
-    ignore_chan = which_chan < 0
-    n_clump = np.max(assigned)
-    ig_vec = np.arange(n_clump + 1, n_clump + 1 + sum(ignore_chan))
-    # give ignored channel localizations unique clump assignments
-    assigned[ignore_chan] = ig_vec
+        delta_x = 100.*np.ones_like(x0)
+        
+    # group localizations. Ignored (negative) channels are given unique clump assignments
+    assigned, chan_masks = deClump.findClumpsMultiview(t_index, x0, y0, delta_x, which_chan,
+                                                       order=np.argsort(t_index, kind='mergesort').astype('i'),
+                                                       nFrames=int(n_frame_sep), chan_dx=chan_dx, chan_dy=chan_dy)
 
     if return_paired:
-        kept_mols = []
-        # TODO: speed up following loop - quite slow for large N
-        for elem in assigned:
-            kept_mols.append(elem in clumps[np.where(kept_clumps)])
-        keep = np.where(kept_mols)
+        # only keep clumps with localizations from (exactly) each of the appear_in channels
+        appear_in = np.asarray(appear_in, dtype='i')
+        target_mask = np.bitwise_or.reduce(np.left_shift(np.uint32(1), appear_in.astype('u4')))
+        keep = np.where(chan_masks[assigned] == target_mask)
         return assigned, keep
     else:
         return assigned
 
 def calc_shifts_for_points(datasource, shiftWallet):
     import importlib
+    from PYME.Analysis.points import twoColour
     model = shiftWallet['shiftModel'].split('.')[-1]
     shiftModule = importlib.import_module(shiftWallet['shiftModel'].split('.' + model)[0])
     shiftModel = getattr(shiftModule, model)
@@ -322,14 +353,12 @@ def calc_shifts_for_points(datasource, shiftWallet):
     #y = y + pipeline.mdh['Camera.ROIY0']*pipeline.mdh['voxelsize.y']*1.0e3
     chan = datasource['multiviewChannel']
 
-    dx = 0
-    dy = 0
-    for ii in range(1, numChan + 1):
-        chanMask = chan == ii
-        dx = dx + chanMask * shiftModel(dict=shiftWallet['Chan0%s.X' % ii]).ev(x, y)
-        dy = dy + chanMask * shiftModel(dict=shiftWallet['Chan0%s.Y' % ii]).ev(x, y)
+    # channel 0 is the reference channel and is not shifted. The models are sampled onto a (cached) lookup grid and
+    # evaluated for all channels in a single pass
+    models = [(None, None)] + [(shiftModel(dict=shiftWallet['Chan0%s.X' % ii]), shiftModel(dict=shiftWallet['Chan0%s.Y' % ii]))
+                               for ii in range(1, numChan + 1)]
 
-    return dx, dy
+    return twoColour.apply_shift_fields(models, x, y, chan=chan)
 
 def apply_shifts_to_points(datasource, shiftWallet):  # FIXME: add metadata for camera roi positions
     """
@@ -358,16 +387,11 @@ def find_clumps(datasource, gap_tolerance, radius_scale, radius_offset, inject=F
     from PYME.Analysis.points.DeClump import deClump
     from PYME.IO import tabular
     t = datasource['t'] #OK as int
-    clumps = np.zeros(len(t), 'i')
-    I = np.argsort(t)
-    t = t[I].astype('i')
-    x = datasource['x'][I].astype('f4')
-    y = datasource['y'][I].astype('f4')
-
-    deltaX = (radius_scale*datasource['error_x'][I] + radius_offset).astype('f4')
+    
+    deltaX = radius_scale*datasource['error_x'] + radius_offset
 
-    assigned = deClump.findClumpsN(t, x, y, deltaX, gap_tolerance)
-    clumps[I] = assigned
+    clumps, _ = deClump.findClumpsMultiview(t, datasource['x'], datasource['y'], deltaX, np.zeros(len(t), 'i'),
+                                            order=np.argsort(t, kind='mergesort').astype('i'), nFrames=gap_tolerance)
 
     if not inject:
         datasource = tabular.MappingFilter(datasource)
@@ -396,31 +420,15 @@ def find_clumps_within_channel(datasource, gap_tolerance, radius_scale, radius_o
     from PYME.Analysis.points.DeClump import deClump
     from PYME.IO import tabular
     t = datasource['t'] #OK as int
-    clumps = np.zeros(len(t), 'i')
-    I = np.argsort(t)
-    t = t[I].astype('i')
-    x = datasource['x'][I].astype('f4')
-    y = datasource['y'][I].astype('f4')
-
-    deltaX = (radius_scale*datasource['error_x'][I] + radius_offset).astype('f4')
-
-    # extract color channel information
-    uprobe = np.unique(datasource['probe'])
-    probe = datasource['probe'][I]
-
-
-    # only clump within color channels
-    assigned = np.zeros_like(clumps)
-    startAt = 0
-    for pi in uprobe:
-        pmask = probe == pi
-        pClumps = deClump.findClumpsN(t[pmask], x[pmask], y[pmask], deltaX, gap_tolerance) + startAt
-        # throw all unclumped into the 0th clumpID, and preserve pClumps[-1] of the last iteration
-        pClumps[pClumps == startAt] = 0
-        # patch in assignments for this color channel
-        assigned[pmask] = pClumps
-        startAt = np.max(assigned)
-    clumps[I] = assigned
+    
+    deltaX = radius_scale*datasource['error_x'] + radius_offset
+
+    # only clump within color channels - all channels are handled in one pass
+    probe = np.asarray(datasource['probe'])
+    _, probe_index = np.unique(probe, return_inverse=True)
+    clumps, _ = deClump.findClumpsMultiview(t, datasource['x'], datasource['y'], deltaX, probe_index.astype('i'),
+                                            order=np.argsort(t, kind='mergesort').astype('i'), nFrames=gap_tolerance,
+                                            within_channel=1)
 
     if not inject:
         datasource = tabular.MappingFilter(datasource)
@@ -73,7 +73,7 @@ measureDType = [('objID', 'i4'),('xPos', 'f4'), ('yPos', 'f4'), ('NEvents', 'i4'
     ('Perimeter', 'f4'), ('majorAxisAngle', 'f4'), ('stdMajor', 'f4'), ('stdMinor', 'f4'),
     ('lengthMajor', 'f4'), ('lengthMinor', 'f4'), ('moments', '25f4'), ('momentErrors', '25f4')]
 
-def measure(object, min_edge_length, output=np.zeros(1, dtype=measureDType)):
+def measure(object, min_edge_length, output=np.zeros(1, dtype=measureDType), calc_moments=True):
     """
     Calculates a number of measurements for a collection of points (as outlined in dtype above).
     
@@ -106,6 +106,9 @@ def measure(object, min_edge_length, output=np.zeros(1, dtype=measureDType)):
     min_edge_length: float
              edge length in nm at which to cull triangles from the point convex hull when estimating cluster areas
     output : [optional] pre-allocated output array
+    calc_moments : bool
+             calculate the `moments` and `momentErrors` (set this to False if they have already been calculated for
+             many objects at once with moments.calcClusterMoments)
 
     Returns
     -------
@@ -137,11 +140,12 @@ def measure(object, min_edge_length, output=np.zeros(1, dtype=measureDType)):
             output['Area'] = 0
             output['Perimeter'] = 0
 
-        ms, sm = moments.calcMCCenteredMoments(object[:,0], object[:,1])
-        #print ms.ravel()[3]
-        #print ms.shape, measurements['moments'].shape
-        output['moments'][:] = ms.ravel()
-        output['momentErrors'][:] = sm.ravel()
+        if calc_moments:
+            ms, sm = moments.calcMCCenteredMoments(object[:,0], object[:,1])
+            #print ms.ravel()[3]
+            #print ms.shape, measurements['moments'].shape
+            output['moments'][:] = ms.ravel()
+            output['momentErrors'][:] = sm.ravel()
 
     if object.shape[0] > 1:
         measureAligned(object, output)
@@ -167,14 +171,32 @@ def measureObjectsByID(filter, min_edge_length, ids, key='objectID'):
 
     measurements = np.zeros(len(ids), dtype=measureDType)
 
+    # calculate the moments for all objects in one pass (if the native code is available). Objects the native code
+    # doesn't handle (ids <= 0) have their moments calculated individually.
+    try:
+        cluster_moments = moments.calcClusterMoments(x, y, id, order=4, nSamples=10)
+        moment_index = dict(zip(cluster_moments['label'], range(len(cluster_moments))))
+    except ImportError:
+        cluster_moments = None
+        moment_index = {}
+
+    # group the points by id with a single sort
+    I = np.argsort(id, kind='mergesort')
+    sorted_id = id[I]
+
     for j,i in enumerate(ids):
         if not i == 0:
-            ind = id == i
+            ind = I[np.searchsorted(sorted_id, i, 'left'):np.searchsorted(sorted_id, i, 'right')]
             obj = np.vstack([x[ind],y[ind]]).T
             #print obj.shape
-            measure(obj, min_edge_length, measurements[j])
+            k = moment_index.get(i, None)
+            measure(obj, min_edge_length, measurements[j], calc_moments=(k is None))
             measurements[j]['objID'] = i
 
+            if (k is not None) and obj.shape[0] > 3:
+                measurements[j]['moments'][:] = cluster_moments['moments'][k].ravel()
+                measurements[j]['momentErrors'][:] = cluster_moments['momentErrors'][k].ravel()
+
     return measurements
 
 def calcEdgeDists(objects, objMeasures):
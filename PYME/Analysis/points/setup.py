@@ -40,6 +40,10 @@ def configuration(parent_package='',top_path=None):
     config.add_subpackage('arcfit')
     config.add_subpackage('astigmatism')
     config.add_subpackage('traveling_salesperson')
+    config.add_subpackage('ShiftField')
+    config.add_subpackage('FiducialTracking')
+    config.add_subpackage('SphericalHarmonics')
+    config.add_subpackage('ClusterMoments')
     #config.add_subpackage('Modules')
     #config.add_subpackage('Tracking')
     
@@ -3,14 +3,32 @@ Estimate spherical harmonics from a point data set
 Initial fitting/conversions ripped 100% from David Baddeley / scipy
 """
 import numpy as np
-from scipy.special import sph_harm
 from scipy import linalg
 from PYME.Analysis.points import coordinate_tools
 from scipy import optimize
+import multiprocessing
 import logging
+from PYME.util.threaded import run_threaded
 
 logger = logging.getLogger(__name__)
 
+try:
+    from scipy.special import sph_harm
+except ImportError:
+    # sph_harm was removed in newer scipy versions in favour of sph_harm_y, which has swapped argument orders
+    from scipy.special import sph_harm_y
+    
+    def sph_harm(m, n, azimuth, zenith):
+        return sph_harm_y(n, m, zenith, azimuth)
+
+try:
+    from PYME.Analysis.points.SphericalHarmonics import sphHarm
+except ImportError:
+    logger.warning('Could not import native spherical harmonics module, falling back to (slower) scipy implementation')
+    sphHarm = None
+
+NUM_PROCS = multiprocessing.cpu_count()
+
 
 def r_sph_harm(m, n, azimuth, zenith):
     """
@@ -41,6 +59,144 @@ def r_sph_harm(m, n, azimuth, zenith):
         return (1. / np.sqrt(2) * (-1) ** m) * sph_harm(m, n, azimuth, zenith).imag
 
 
+def standard_modes(n_max):
+    """
+    The (m, n) modes, in the order used by sphere_expansion and the native routines, for all harmonics up to n_max
+    """
+    return [(m, n) for n in range(n_max + 1) for m in range(-n, n + 1)]
+
+
+def real_sph_harm_basis(azimuth, zenith, n_max=3):
+    """
+    Evaluate all real spherical harmonics up to n_max (see r_sph_harm)
+
+    Parameters
+    ----------
+    azimuth : ndarray
+        the azimuth angle in [0, 2pi]
+    zenith : ndarray
+        the elevation in [0, pi]
+    n_max : int
+        Maximum order to calculate to
+
+    Returns
+    -------
+    modes : list of tuples
+        the (m, n) modes
+    A : ndarray
+        [n_points, n_modes] array of the harmonics evaluated at each point
+
+    """
+    modes = standard_modes(n_max)
+    azimuth, zenith = np.atleast_1d(azimuth).ravel(), np.atleast_1d(zenith).ravel()
+
+    if sphHarm is not None:
+        return modes, sphHarm.realSphHarm(azimuth, zenith, n_max)
+
+    return modes, np.vstack([r_sph_harm(m, n, azimuth, zenith) for m, n in modes]).T
+
+
+def sphere_expansion_batch(azimuth, zenith, r, starts, n_max=3, max_iters=2, tol_init=0.3, n_threads=NUM_PROCS):
+    """
+    Fit spherical harmonic expansions to multiple sets of points (e.g. one per cell), with the same outlier rejection
+    as sphere_expansion_clean.
+
+    Parameters
+    ----------
+    azimuth, zenith, r : ndarray
+        spherical coordinates of the points, with the points for each set contiguous
+    starts : ndarray
+        offsets of each set of points into azimuth, zenith and r, with a final entry of len(r)
+    n_max : int
+        Maximum order to calculate to
+    max_iters: int
+        number of outlier rejection iterations
+    tol_init: float
+        relative outlier tolerance. Used to ignore outliers in subsequent iterations
+    n_threads : int
+        number of threads to use
+
+    Returns
+    -------
+    modes : list of tuples
+        a list of the (m, n) modes projected onto
+    c : ndarray
+        [n_sets, n_modes] array of mode coefficients. Sets which could not be fitted are NaN.
+    summed_residuals : ndarray
+        summed squared residuals for each set
+
+    """
+    modes = standard_modes(n_max)
+    azimuth = np.ascontiguousarray(azimuth, dtype='f8')
+    zenith = np.ascontiguousarray(zenith, dtype='f8')
+    r = np.ascontiguousarray(r, dtype='f8')
+    starts = np.ascontiguousarray(starts, dtype='i4')
+
+    n_sets = len(starts) - 1
+    c = np.zeros([n_sets, len(modes)], 'f8')
+    summed_residuals = np.zeros(n_sets, 'f8')
+
+    if sphHarm is None:
+        for i in range(n_sets):
+            sl = slice(starts[i], starts[i + 1])
+            c[i], summed_residuals[i] = _sphere_expansion_lstsq(azimuth[sl], zenith[sl], r[sl], n_max, max_iters,
+                                                                tol_init)
+        return modes, c, summed_residuals
+
+    bounds = np.linspace(0, n_sets, max(min(n_threads, n_sets), 1) + 1).astype('i')
+
+    def _fit(start, end):
+        sphHarm.fitShells(azimuth, zenith, r, starts, c, summed_residuals, n_max=int(n_max), max_iters=int(max_iters),
+                          tol_init=float(tol_init), startCell=int(start), endCell=int(end))
+
+    run_threaded(_fit, list(zip(bounds[:-1], bounds[1:])))
+
+    # the native fit solves the normal equations, and fails (giving NaN) if they are (close to) singular - e.g. for
+    # small sets of points. Re-fit these with lstsq, which gives the minimum norm solution.
+    for i in np.flatnonzero(np.isnan(c).any(axis=1)):
+        sl = slice(starts[i], starts[i + 1])
+        try:
+            c[i], summed_residuals[i] = _sphere_expansion_lstsq(azimuth[sl], zenith[sl], r[sl], n_max, max_iters,
+                                                                tol_init)
+        except (ValueError, linalg.LinAlgError):
+            # no points, or non-finite input - leave as NaN
+            pass
+
+    return modes, c, summed_residuals
+
+
+def _sphere_expansion_lstsq(azimuth, zenith, r, n_max=3, max_iters=2, tol_init=0.3):
+    """
+    Least squares fit of a single set of points (see sphere_expansion_clean), without the native code.
+
+    Returns
+    -------
+    c : ndarray
+        the mode coefficients
+    summed_residuals : float
+        summed squared residuals of the points used in the final fit
+    """
+    _, A = real_sph_harm_basis(azimuth, zenith, n_max)
+
+    tol = tol_init
+    mask = np.ones(len(r), dtype=bool)
+
+    c = linalg.lstsq(A, r)[0]
+
+    # recompute, discarding outliers
+    for i in range(max_iters):
+        pred = np.dot(A, c)
+        error = abs(r - pred) / r
+        mask = error < tol
+
+        c = linalg.lstsq(A[mask, :], r[mask])[0]
+        tol /= 2
+
+    summed_residuals = np.sum((r[mask] - np.dot(A[mask, :], c)) ** 2)
+
+    return c, summed_residuals
+
+
 def sphere_expansion(x, y, z, n_max=3):
     """
     Project coordinates onto spherical harmonics
@@ -69,20 +225,13 @@ def sphere_expansion(x, y, z, n_max=3):
 
     azimuth, zenith, r = coordinate_tools.cartesian_to_spherical(x, y, z)
 
-    A = []
-    modes = []
-    for n in range(n_max + 1):
-        for m in range(-n, n + 1):
-            sp_mode = r_sph_harm(m, n, azimuth, zenith)
-            A.append(sp_mode)
+    if sphHarm is not None:
+        modes, c, _ = sphere_expansion_batch(azimuth, zenith, r, [0, len(r)], n_max, max_iters=0, n_threads=1)
+        return modes, c[0]
 
-            modes.append((m, n))
+    c, _ = _sphere_expansion_lstsq(azimuth, zenith, r, n_max, max_iters=0)
 
-    A = np.vstack(A)
-
-    c = linalg.lstsq(A.T, r)[0]
-
-    return modes, c
+    return standard_modes(n_max), c
 
 
 def sphere_expansion_clean(x, y, z, n_max=3, max_iters=2, tol_init=0.3):
@@ -117,38 +266,27 @@ def sphere_expansion_clean(x, y, z, n_max=3, max_iters=2, tol_init=0.3):
 
     azimuth, zenith, r = coordinate_tools.cartesian_to_spherical(x, y, z)
 
-    A = []
-    modes = []
-    for n in range(n_max + 1):
-        for m in range(-n, n + 1):
-            sp_mode = r_sph_harm(m, n, azimuth, zenith)
-            A.append(sp_mode)
-
-            modes.append((m, n))
-
-    A = np.vstack(A).T
-
-    tol = tol_init
-
-    c = linalg.lstsq(A, r)[0]
-
-    # recompute, discarding outliers
-    for i in range(max_iters):
-        pred = np.dot(A, c)
-        error = abs(r - pred) / r
-        mask = error < tol
-        # print mask.sum(), len(mask)
+    if sphHarm is not None:
+        modes, c, summed_residuals = sphere_expansion_batch(azimuth, zenith, r, [0, len(r)], n_max, max_iters,
+                                                            tol_init, n_threads=1)
+        return modes, c[0], summed_residuals[0]
 
-        c, summed_residuals, rank, singular_values = linalg.lstsq(A[mask, :], r[mask])
-        tol /= 2
+    c, summed_residuals = _sphere_expansion_lstsq(azimuth, zenith, r, n_max, max_iters, tol_init)
 
-    return modes, c, summed_residuals
+    return standard_modes(n_max), c, summed_residuals
 
 
 AXES = np.stack([[1., 0., 0.], [0., 1., 0.], [0., 0., 1.]], axis=1)
 
 
 def reconstruct_shell(modes, coeffs, azimuth, zenith):
+    if (sphHarm is not None) and (len(modes) > 0):
+        n_max = int(np.max(np.asarray(modes)[:, 1]))
+        if [tuple(m) for m in modes] == standard_modes(n_max):
+            azimuth, zenith = np.broadcast_arrays(azimuth, zenith)
+            r = sphHarm.reconstructShell(azimuth.ravel(), zenith.ravel(), np.asarray(coeffs, dtype='f8'))
+            return r.reshape(azimuth.shape)
+
     r = 0
     for (m, n), c in zip(modes, coeffs):
         r += c * (r_sph_harm(m, n, azimuth, zenith))
@@ -361,6 +499,7 @@ class ScaledShell(object):
         assert len(modes) == len(coefficients)
         self.modes = modes
         self.coefficients = coefficients
+        self._shell_tables = {}
 
     def set_fitting_points(self, x, y, z):
         assert (x.shape == y.shape) and (y.shape == z.shape)
@@ -490,6 +629,10 @@ class ScaledShell(object):
         x, y, z = query_points
         x, y, z = np.atleast_1d(x), np.atleast_1d(y), np.atleast_1d(z)
         n_points = len(x)
+
+        if sphHarm is not None:
+            return self._distance_to_shell_native(x, y, z, d_angles)
+
         zenith, azimuth = np.mgrid[0:(np.pi + d_angles):d_angles, 0:(2 * np.pi + d_angles):d_angles]
 
         x_shell, y_shell, z_shell = self.get_fitted_shell(azimuth, zenith)
@@ -507,6 +650,44 @@ class ScaledShell(object):
                                                   y_shell.reshape(n_shell_coords)[min_ind],
                                                   z_shell.reshape(n_shell_coords)[min_ind])
 
+    def _shell_table(self, d_angles):
+        """
+        Cartesian coordinates of the shell sampled on a regular angular grid, cached for each d_angles (and reset when
+        the coefficients change).
+        """
+        if not hasattr(self, '_shell_tables'):
+            self._shell_tables = {}
+
+        table = self._shell_tables.get(d_angles, None)
+        if table is None:
+            zenith, azimuth = np.mgrid[0:(np.pi + d_angles):d_angles, 0:(2 * np.pi + d_angles):d_angles]
+            x_shell, y_shell, z_shell = self.get_fitted_shell(azimuth, zenith)
+            table = np.ascontiguousarray(np.stack([x_shell.ravel(), y_shell.ravel(), z_shell.ravel()], axis=1),
+                                         dtype='f8')
+            self._shell_tables[d_angles] = table
+
+        return table
+
+    def _distance_to_shell_native(self, x, y, z, d_angles, n_threads=NUM_PROCS):
+        table = self._shell_table(d_angles)
+
+        x = np.ascontiguousarray(x, dtype='f8')
+        y = np.ascontiguousarray(y, dtype='f8')
+        z = np.ascontiguousarray(z, dtype='f8')
+        n_points = len(x)
+
+        distances = np.zeros(n_points, 'f8')
+        indices = np.zeros(n_points, 'i4')
+
+        bounds = np.linspace(0, n_points, max(min(n_threads, n_points // 1000), 1) + 1).astype('i')
+
+        def _closest(start, end):
+            sphHarm.closestShellPoints(x, y, z, table, distances, indices, start=int(start), end=int(end))
+
+        run_threaded(_closest, list(zip(bounds[:-1], bounds[1:])))
+
+        return distances, (table[indices, 0], table[indices, 1], table[indices, 2])
+
     def approximate_normal(self, x, y, z, d_azimuth=1e-6, d_zenith=1e-6, return_orthogonal_vectors=False):
         """
 
@@ -677,3 +858,55 @@ class ScaledShell(object):
 
         return guess_distances[np.argmin(np.abs(errors))]
 
+
+
+def fit_shells(x, y, z, labels, max_n_mode=3, max_iterations=2, tol_init=0.3, sampling_fraction=1.):
+    """
+    Fit a ScaledShell to the points of each label (e.g. one shell per nucleus). The centering and scaling is done per
+    label, and the spherical harmonic fits for all labels are then done in a single (multi-threaded) batch.
+
+    Parameters
+    ----------
+    x, y, z : ndarray
+        point positions
+    labels : ndarray
+        label for each point. Points with label <= 0 are ignored.
+    max_n_mode, max_iterations, tol_init : see ScaledShell.fit_shell
+    sampling_fraction : see ScaledShell
+
+    Returns
+    -------
+    shells : dict
+        ScaledShell for each label
+
+    """
+    x, y, z, labels = np.asarray(x), np.asarray(y), np.asarray(z), np.asarray(labels)
+    I = np.argsort(labels, kind='mergesort')
+    I = I[labels[I] > 0]
+    unique_labels, starts = np.unique(labels[I], return_index=True)
+    starts = np.hstack([starts, len(I)]).astype('i4')
+
+    shells = {}
+    azimuth, zenith, r = [], [], []
+    for label, s0, s1 in zip(unique_labels, starts[:-1], starts[1:]):
+        ind = I[s0:s1]
+        shell = ScaledShell(sampling_fraction=sampling_fraction)
+        shell.set_fitting_points(x[ind], y[ind], z[ind])
+        shells[label] = shell
+
+        az, zen, rad = coordinate_tools.cartesian_to_spherical(shell.x_cs, shell.y_cs, shell.z_cs)
+        azimuth.append(az)
+        zenith.append(zen)
+        r.append(rad)
+
+    if len(shells) == 0:
+        return shells
+
+    modes, c, summed_residuals = sphere_expansion_batch(np.hstack(azimuth), np.hstack(zenith), np.hstack(r), starts,
+                                                        max_n_mode, max_iterations, tol_init)
+
+    for i, label in enumerate(unique_labels):
+        shells[label]._set_coefficients(modes, c[i])
+        shells[label]._summed_residuals = summed_residuals[i]
+
+    return shells
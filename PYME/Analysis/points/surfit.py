@@ -647,43 +647,89 @@ def fit_quad_surfaces_tr(data, kdt, ivals, results, radius=100, fitPos=True):
             res[i]['N'] = 0
             #print 'f', i
 
-def fit_quad_surfaces_P(data, radius, fitPos=False, NFits=0):
-    from scipy.spatial import cKDTree
-    #kdt = kdtree.KDTree(pts)
-    kdt = cKDTree(data)
+def fit_quad_surfaces_P(data, radius, fitPos=True, NFits=0):
+    """
+    Fit quadratic surfaces to each point in data, returning the results as separate (res, pos, nPs) arrays. This is a
+    thin wrapper around fit_quad_surfaces_batch - see fit_quad_surfaces_Pr for details of the parameters.
     
-    if NFits == 0:
-        NFits = data.shape[0]
+    NB - fitPos defaults to True here (unlike the other fit_quad_surfaces_* functions) as this function has always fit
+    the position.
+    """
+    results = fit_quad_surfaces_batch(data, radius, fitPos=fitPos, NFits=NFits)
     
-    #surfs = []
+    res = np.vstack([results[k] for k in ['x', 'y', 'z', 'theta', 'phi', 'psi', 'A', 'B']])
+    pos = np.vstack([results[k] for k in ['x0', 'y0', 'z0']])
+    nPs = results['N']
     
-    #def _task(i):
-    #    return fitPtA(kdt, pts, i)
+    return res, pos, nPs
+
+
+def _build_neighbour_grid(data, radius):
+    """
+    Bin points into a spatial hash of cubic cells of side radius for neighbour searches in arcfit.quad_surf_fit_batch
     
-    nCPUs = multiprocessing.cpu_count()
-    #nCPUs = 1
+    Returns
+    -------
+    order : indices of the points, sorted by cell
+    cell_keys : sorted, unique, cell keys
+    cell_starts : offset into order of the first point in each cell (length len(cell_keys) + 1)
+    grid : [x0, y0, z0, cell_size, nx, ny, nz]
+    """
+    origin = data.min(0)
+    ijk = np.floor((data - origin[None, :]) / radius).astype('i8')
+    nx, ny, nz = ijk.max(0) + 1
     
-    #if fitPos:
-    nParams = 8
-    res = shmarray.zeros((nParams, NFits))
-    pos = shmarray.zeros((3, NFits))
-    nPs = shmarray.zeros(NFits)
-    #rt = shmarray.zeros((2,NFits))
+    keys = (ijk[:, 0] * ny + ijk[:, 1]) * nz + ijk[:, 2]
+    order = np.argsort(keys, kind='mergesort')
+    cell_keys, cell_starts = np.unique(keys[order], return_index=True)
+    cell_starts = np.hstack([cell_starts, len(keys)]).astype('i4')
     
-    fnums = range(NFits)
+    grid = np.array([origin[0], origin[1], origin[2], radius, nx, ny, nz], 'f8')
     
-    processes = [multiprocessing.Process(target=fit_quad_surfaces_t, args=(data, kdt, fnums[i::nCPUs], res, pos, nPs)) for i in
-                 range(nCPUs)]
+    return order.astype('i4'), cell_keys.astype('i8'), cell_starts, grid
+
+
+def fit_quad_surfaces_batch(data, radius, fitPos=False, NFits=0, nThreads=None):
+    """
+    Fit a quadratic surface patch (see fit_quad_surf) to the neighbourhood of each point in data.
     
-    for p in processes:
-        print(p)
-        p.start()
+    This does the neighbour search and the Levenberg-Marquardt fitting (with analytic Jacobians) in c
+    (arcfit.quad_surf_fit_batch), splitting the control points between threads. Rather than using random starting
+    parameters, each fit is initialised with the surface normal aligned to the direction of least variance of the
+    neighbourhood. Parameters are as for fit_quad_surfaces_Pr.
+
+    Returns
+    -------
+
+    a numpy array of results with the dtype surfit.SURF_PATCH_DTYPE_FLAT
+    """
+    from PYME.Analysis.points import arcfit
+    from PYME.util.threaded import run_threaded
     
-    for p in processes:
-        print(p)
-        p.join()
+    data = np.ascontiguousarray(data, dtype='f4')
     
-    return res, pos, nPs
+    if NFits == 0:
+        NFits = data.shape[0]
+        
+    if nThreads is None:
+        nThreads = multiprocessing.cpu_count()
+        
+    results = np.zeros(NFits, SURF_PATCH_DTYPE_FLAT)
+    
+    if NFits == 0:
+        return results
+    
+    order, cell_keys, cell_starts, grid = _build_neighbour_grid(data, float(radius))
+    
+    bounds = np.linspace(0, NFits, min(nThreads, NFits) + 1).astype('i')
+    
+    def _fit(start, end):
+        arcfit.quad_surf_fit_batch(data, order, cell_keys, cell_starts, grid, results, radius=float(radius),
+                                   fitPos=int(fitPos), start=int(start), end=int(end))
+    
+    run_threaded(_fit, list(zip(bounds[:-1], bounds[1:])))
+        
+    return results
 
 
 def fit_quad_surfaces_Pr(data, radius, fitPos=False, NFits=0):
@@ -716,46 +762,14 @@ def fit_quad_surfaces_Pr(data, radius, fitPos=False, NFits=0):
 
     a numpy array of results with the dtype surfit.SURF_PATCH_FLAT
     """
-    from scipy.spatial import cKDTree
-    #generate a kdtree to allow us to rapidly find a points neighbours
-    kdt = cKDTree(data)
-    
     if NFits == 0:
         NFits = data.shape[0]
         
         print('NFits: %d' % NFits)
     
-    nCPUs = multiprocessing.cpu_count()
-    #nCPUs = 1
-    
-    #generate a results array in shared memory. The worker processes will each write their chunk of results into this array
-    #this make the calling semantics of the the actual call below pass by reference for the results
-    #there is a bit of magic going on behind the scenes for this to work - see PYME.util.shmarray
-    results = shmarray.zeros(NFits, SURF_PATCH_DTYPE_FLAT)
-    
-    #calculate a list of points at which to fit a surface
-    fnums = range(NFits)
-    
-    #create a process for each cpu and assign them a chunk of fits
-    #note that the slicing of fnums[i::nCPUs] effectively interleaves the fit allocations - ie one process works on every
-    #nCPUth point. This was done as a simple way of allocating the tasks evenly, but might not be optimal in terms of e.g.
-    #cache coherency. The process creation here will be significantly more efficient on *nix platforms which use copy on
-    #write forking when compared to windows which will end up copying both the data and kdt structures
-    if False: #multiprocessing.current_process().name == 'MainProcess':  # avoid potentially trying to spawn children from daemon
-        processes = [multiprocessing.Process(target=fit_quad_surfaces_tr,
-                                             args=(data, kdt, fnums[i::nCPUs], results, radius, fitPos)) for i in range(nCPUs)]
-        # launch all the processes
-        logger.debug('launching quadratic surface patch fitting processes')
-        for p in processes:
-            p.start()
-        # wait for them to complete
-        for p in processes:
-            p.join()
-    else:
-        logger.debug('fitting quadratic surface patches in main process')
-        fit_quad_surfaces_tr(data, kdt, fnums, results, radius, fitPos)
-    # each process should have written their results into our shared memory array, return this
-    return results
+    #the fitting is done in c, with the control points split between threads (the GIL is released during fitting)
+    logger.debug('fitting quadratic surface patches')
+    return fit_quad_surfaces_batch(data, radius, fitPos=fitPos, NFits=NFits)
 
 def reconstruct_quad_surfaces(fits, radius):
     return np.hstack([reconstruct_quad_surf(*f, radius=radius) for f in fits if not f is None])
@@ -0,0 +1,491 @@
+/*
+##################
+# route_opt.c
+#
+# Copyright David Baddeley, 2019
+# d.baddeley@auckland.ac.nz
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+##################
+ */
+
+/*
+Local search (2-opt and Or-opt) for open paths (the first position in the route is fixed, and optionally also the last).
+
+Rather than the dense distance matrix used by two_opt.py, candidate moves are restricted to each point's k nearest
+neighbours (with distances calculated on the fly), and points whose neighbourhood has not changed since they were last
+examined are skipped (don't-look bits, implemented as a queue of active points). This lets us optimise routes through
+~1e5 points.
+*/
+
+#include "Python.h"
+#include <math.h>
+#include "numpy/arrayobject.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN(a, b) ((a<b) ? a : b)
+#define MAX(a, b) ((a>b) ? a : b)
+
+#define MAX_DIM 3
+#define MAX_SEGMENT 3
+
+//minimum improvement for a move to be accepted (stops us cycling on rounding errors)
+#define TOL 1e-10
+
+typedef struct route_t {
+    const double *x;
+    int dim;
+    int n;
+
+    const int *neighbours;
+    int k;
+
+    int *r; // route (point at each position)
+    int *pos; // position of each point
+
+    int fixed_end;
+
+    // queue of active points (the don't look bit is set for points not in the queue)
+    int *queue;
+    char *in_queue;
+    int q_head;
+    int q_len;
+} route_t;
+
+static double dist(const route_t *rt, int a, int b)
+{
+    int j;
+    double d, s = 0;
+
+    for (j = 0; j < rt->dim; j++)
+    {
+        d = rt->x[a*rt->dim + j] - rt->x[b*rt->dim + j];
+        s += d*d;
+    }
+
+    return sqrt(s);
+}
+
+static void push(route_t *rt, int a)
+{
+    if ((a < 0) || rt->in_queue[a]) return;
+
+    rt->queue[(rt->q_head + rt->q_len) % rt->n] = a;
+    rt->q_len++;
+    rt->in_queue[a] = 1;
+}
+
+static int pop(route_t *rt)
+{
+    int a = rt->queue[rt->q_head];
+
+    rt->q_head = (rt->q_head + 1) % rt->n;
+    rt->q_len--;
+    rt->in_queue[a] = 0;
+
+    return a;
+}
+
+/* reverse the route between positions i and j (inclusive) */
+static void reverse(route_t *rt, int i, int j)
+{
+    int t;
+
+    while (i < j)
+    {
+        t = rt->r[i];
+        rt->r[i] = rt->r[j];
+        rt->r[j] = t;
+
+        rt->pos[rt->r[i]] = i;
+        rt->pos[rt->r[j]] = j;
+
+        i++;
+        j--;
+    }
+
+    if (i == j) rt->pos[rt->r[i]] = i;
+}
+
+/* try 2-opt moves which replace the edge between a and its successor (or predecessor) with an edge to a neighbour */
+static int improve_2opt(route_t *rt, int a)
+{
+    int p = rt->pos[a], n = rt->n;
+    int b, c, d, q, j;
+    double dab, dac, delta;
+
+    //a -> successor
+    if (p < (n - 1))
+    {
+        b = rt->r[p + 1];
+        dab = dist(rt, a, b);
+
+        for (j = 0; j < rt->k; j++)
+        {
+            c = rt->neighbours[a*rt->k + j];
+            dac = dist(rt, a, c);
+            if (dac >= dab) break;
+            if (c == b) continue;
+
+            q = rt->pos[c];
+
+            if (q > p)
+            {
+                //reverse (p, q] - c becomes a's successor and b is joined to c's old successor (if any)
+                if (rt->fixed_end && (q == (n - 1))) continue;
+
+                d = (q < (n - 1)) ? rt->r[q + 1] : -1;
+                delta = dac - dab;
+                if (d >= 0) delta += dist(rt, b, d) - dist(rt, c, d);
+
+                if (delta < -TOL)
+                {
+                    reverse(rt, p + 1, q);
+                    push(rt, a); push(rt, b); push(rt, c); push(rt, d);
+                    return 1;
+                }
+            } else
+            {
+                //reverse (q, p] - a becomes c's successor and b is joined to c's old successor
+                d = rt->r[q + 1];
+                if (d == a) continue;
+
+                delta = dac + dist(rt, b, d) - dab - dist(rt, c, d);
+
+                if (delta < -TOL)
+                {
+                    reverse(rt, q + 1, p);
+                    push(rt, a); push(rt, b); push(rt, c); push(rt, d);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    //a -> predecessor
+    if (p > 0)
+    {
+        b = rt->r[p - 1];
+        dab = dist(rt, a, b);
+
+        for (j = 0; j < rt->k; j++)
+        {
+            c = rt->neighbours[a*rt->k + j];
+            dac = dist(rt, a, c);
+            if (dac >= dab) break;
+            if (c == b) continue;
+
+            q = rt->pos[c];
+
+            if (q < p)
+            {
+                //reverse [q, p) - c becomes a's predecessor. The start point cannot move.
+                if (q == 0) continue;
+
+                d = rt->r[q - 1];
+                delta = dac + dist(rt, b, d) - dab - dist(rt, c, d);
+
+                if (delta < -TOL)
+                {
+                    reverse(rt, q, p - 1);
+                    push(rt, a); push(rt, b); push(rt, c); push(rt, d);
+                    return 1;
+                }
+            } else
+            {
+                //reverse [p, q) - a becomes c's predecessor
+                d = rt->r[q - 1];
+                if (d == a) continue;
+
+                delta = dac + dist(rt, b, d) - dab - dist(rt, c, d);
+
+                if (delta < -TOL)
+                {
+                    reverse(rt, p, q - 1);
+                    push(rt, a); push(rt, b); push(rt, c); push(rt, d);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* move the segment at positions [p, p + L) so that it follows position iu, optionally reversing it */
+static void move_segment(route_t *rt, int p, int L, int iu, int reversed)
+{
+    int seg[MAX_SEGMENT];
+    int i, dest;
+
+    for (i = 0; i < L; i++) seg[i] = rt->r[p + i];
+
+    if (iu > p)
+    {
+        //shift the points between the segment and the target back
+        for (i = p + L; i <= iu; i++)
+        {
+            rt->r[i - L] = rt->r[i];
+            rt->pos[rt->r[i - L]] = i - L;
+        }
+        dest = iu - L + 1;
+    } else
+    {
+        //shift the points between the target and the segment forward
+        for (i = p - 1; i > iu; i--)
+        {
+            rt->r[i + L] = rt->r[i];
+            rt->pos[rt->r[i + L]] = i + L;
+        }
+        dest = iu + 1;
+    }
+
+    for (i = 0; i < L; i++)
+    {
+        rt->r[dest + i] = reversed ? seg[L - 1 - i] : seg[i];
+        rt->pos[rt->r[dest + i]] = dest + i;
+    }
+}
+
+/* try moving segments of 1-3 points starting at a to lie between a neighbour and one of its neighbours on the route */
+static int improve_or_opt(route_t *rt, int a)
+{
+    int p = rt->pos[a], n = rt->n;
+    int L, e, j, s, end, prev, next, u, v, iu, iv, best_iu, best_rev, c;
+    double gain, add, fwd, rev, best;
+
+    if (p == 0) return 0; //the start point is fixed
+
+    for (L = 1; L <= MAX_SEGMENT; L++)
+    {
+        end = p + L - 1;
+        if (end > (n - 1)) break;
+        if (rt->fixed_end && (end == (n - 1))) break;
+
+        prev = rt->r[p - 1];
+        next = (end < (n - 1)) ? rt->r[end + 1] : -1;
+
+        //how much we save by cutting the segment out
+        gain = dist(rt, prev, a);
+        if (next >= 0) gain += dist(rt, rt->r[end], next) - dist(rt, prev, next);
+        if (gain <= TOL) continue;
+
+        best = -TOL;
+        best_iu = -1;
+        best_rev = 0;
+
+        //candidate insertion points next to neighbours of either end of the segment
+        for (e = 0; e < 2; e++)
+        {
+            s = e ? rt->r[end] : a;
+
+            for (j = 0; j < rt->k; j++)
+            {
+                c = rt->neighbours[s*rt->k + j];
+                if (dist(rt, s, c) >= gain) break;
+
+                //edges c -> successor and predecessor -> c
+                for (iv = 0; iv < 2; iv++)
+                {
+                    iu = iv ? rt->pos[c] - 1 : rt->pos[c];
+                    if ((iu < 0) || ((iu >= p - 1) && (iu <= end))) continue; //not in (or next to) the segment
+
+                    u = rt->r[iu];
+                    v = (iu < (n - 1)) ? rt->r[iu + 1] : -1;
+
+                    if (v < 0)
+                    {
+                        //append to the (free) end of the route
+                        if (rt->fixed_end) continue;
+
+                        fwd = dist(rt, u, a);
+                        rev = dist(rt, u, rt->r[end]);
+                        add = MIN(fwd, rev);
+                    } else
+                    {
+                        fwd = dist(rt, u, a) + dist(rt, rt->r[end], v);
+                        rev = dist(rt, u, rt->r[end]) + dist(rt, a, v);
+                        add = MIN(fwd, rev) - dist(rt, u, v);
+                    }
+
+                    if ((add - gain) < best)
+                    {
+                        best = add - gain;
+                        best_iu = iu;
+                        best_rev = rev < fwd;
+                    }
+                }
+            }
+        }
+
+        if (best_iu >= 0)
+        {
+            u = rt->r[best_iu];
+            v = (best_iu < (n - 1)) ? rt->r[best_iu + 1] : -1;
+            c = rt->r[end];
+
+            move_segment(rt, p, L, best_iu, best_rev);
+
+            push(rt, a); push(rt, c); push(rt, prev); push(rt, next); push(rt, u); push(rt, v);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static double route_length(const route_t *rt)
+{
+    int i;
+    double l = 0;
+
+    for (i = 1; i < rt->n; i++) l += dist(rt, rt->r[i - 1], rt->r[i]);
+
+    return l;
+}
+
+static PyObject * optimiseRoute(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oPositions=0, *oRoute=0, *oNeighbours=0;
+    PyArrayObject *aPositions=0, *aRoute=0, *aNeighbours=0;
+    route_t rt;
+    int i, a, improved;
+    int fixedEndpoint = 0, orOpt = 1;
+    double length = 0;
+
+    static char *kwlist[] = {"positions", "route", "neighbours", "fixedEndpoint", "orOpt", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOO|ii", kwlist, &oPositions, &oRoute, &oNeighbours,
+         &fixedEndpoint, &orOpt))
+        return NULL;
+
+    memset(&rt, 0, sizeof(route_t));
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_optimiseRoute;\
+        }
+
+    aPositions = (PyArrayObject *) PyArray_ContiguousFromObject(oPositions, NPY_DOUBLE, 2, 2);
+    if ((aPositions == NULL) || (PyArray_DIM(aPositions, 1) > MAX_DIM)) ABORT("Bad positions - expecting an [N, 2] or [N, 3] array")
+    rt.n = (int) PyArray_DIM(aPositions, 0);
+    rt.dim = (int) PyArray_DIM(aPositions, 1);
+    rt.x = (const double *) PyArray_DATA(aPositions);
+
+    aNeighbours = (PyArrayObject *) PyArray_ContiguousFromObject(oNeighbours, NPY_INT, 2, 2);
+    if ((aNeighbours == NULL) || (PyArray_DIM(aNeighbours, 0) != rt.n)) ABORT("Bad neighbours - expecting an [N, k] array")
+    rt.k = (int) PyArray_DIM(aNeighbours, 1);
+    rt.neighbours = (const int *) PyArray_DATA(aNeighbours);
+
+    //the route is optimised in place
+    if (!PyArray_Check(oRoute)) ABORT("route must be an array")
+    aRoute = (PyArrayObject *) oRoute;
+    if ((PyArray_TYPE(aRoute) != NPY_INT) || !PyArray_ISCARRAY(aRoute) || (PyArray_SIZE(aRoute) != rt.n))
+        ABORT("route must be a contiguous int32 array with one entry per point")
+    rt.r = (int *) PyArray_DATA(aRoute);
+    rt.fixed_end = fixedEndpoint;
+
+    for (i = 0; i < rt.n*rt.k; i++)
+        if ((rt.neighbours[i] < 0) || (rt.neighbours[i] >= rt.n)) ABORT("neighbour index out of range")
+
+    rt.pos = (int *) malloc(rt.n*sizeof(int));
+    rt.queue = (int *) malloc(MAX(rt.n, 1)*sizeof(int));
+    rt.in_queue = (char *) calloc(MAX(rt.n, 1), sizeof(char));
+    if ((rt.pos == NULL) || (rt.queue == NULL) || (rt.in_queue == NULL)) ABORT("Error allocating memory")
+
+    for (i = 0; i < rt.n; i++) rt.pos[i] = -1;
+    for (i = 0; i < rt.n; i++)
+    {
+        if ((rt.r[i] < 0) || (rt.r[i] >= rt.n) || (rt.pos[rt.r[i]] >= 0)) ABORT("route must be a permutation of the points")
+        rt.pos[rt.r[i]] = i;
+    }
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (i = 0; i < rt.n; i++) push(&rt, rt.r[i]);
+
+    while (rt.q_len > 0)
+    {
+        a = pop(&rt);
+
+        do
+        {
+            improved = improve_2opt(&rt, a);
+            if (!improved && orOpt) improved = improve_or_opt(&rt, a);
+        } while (improved);
+    }
+
+    length = route_length(&rt);
+    Py_END_ALLOW_THREADS;
+
+    free(rt.pos);
+    free(rt.queue);
+    free(rt.in_queue);
+
+    Py_XDECREF(aPositions);
+    Py_XDECREF(aNeighbours);
+
+    return Py_BuildValue("d", length);
+
+FINALIZE_optimiseRoute:
+    #undef ABORT
+
+    if (rt.pos) free(rt.pos);
+    if (rt.queue) free(rt.queue);
+    if (rt.in_queue) free(rt.in_queue);
+
+    Py_XDECREF(aPositions);
+    Py_XDECREF(aNeighbours);
+
+    return NULL;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+static PyMethodDef route_optMethods[] = {
+    {"optimiseRoute",  optimiseRoute, METH_VARARGS | METH_KEYWORDS,
+    "Improve an (open) route in place using 2-opt and Or-opt moves restricted to nearest neighbour candidates. The first "
+    "point in the route is fixed.\n Arguments are: 'positions' [N, 2 or 3], 'route' (int32, modified in place), "
+    "'neighbours' (int32 [N, k] - the k nearest neighbours of each point, sorted by distance), 'fixedEndpoint'=0, "
+    "'orOpt'=1\n Returns the length of the optimised route."},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+#pragma GCC diagnostic pop
+
+#if PY_MAJOR_VERSION>=3
+static struct PyModuleDef moduledef = {
+        PyModuleDef_HEAD_INIT,
+        "route_opt",     /* m_name */
+        "k-nearest neighbour 2-opt / Or-opt route optimisation",  /* m_doc */
+        -1,                  /* m_size */
+        route_optMethods,    /* m_methods */
+        NULL,                /* m_reload */
+        NULL,                /* m_traverse */
+        NULL,                /* m_clear */
+        NULL,                /* m_free */
+    };
+
+PyMODINIT_FUNC PyInit_route_opt(void)
+{
+	PyObject *m;
+    m = PyModule_Create(&moduledef);
+    import_array()
+    return m;
+}
+
+#else
+PyMODINIT_FUNC initroute_opt(void)
+{
+    PyObject *m;
+
+    m = Py_InitModule("route_opt", route_optMethods);
+    import_array()
+}
+#endif
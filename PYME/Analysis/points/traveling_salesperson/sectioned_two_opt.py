@@ -231,7 +231,93 @@ def two_opt_section(positions, start_section, counts, n_tasks, epsilon, master_r
         start_pos += counts[ti]
 
 
+def _two_opt_sections_multiproc(positions, counts, tasks, epsilon, route):
+    """
+    Run two_opt_section for each set of tasks in a separate process
+
+    Parameters
+    ----------
+    positions: ndarray
+        positions, shape (n_points, 2), sorted by section
+    counts: ndarray
+        number of positions in each section
+    tasks: ndarray
+        number of sections to process in each process
+    epsilon: float
+        relative improvement exit criteria for sorting
+    route: shmarray
+        output array for the sorted sections
+    """
+    if len(tasks) == 1:
+        two_opt_section(positions, 0, counts, tasks[0], epsilon, route)
+        return
+
+    ind_task_start = 0
+    ind_pos_start = 0
+    processes = []
+
+    cumcount = counts.cumsum()
+    cumtasks = tasks.cumsum()
+    for ci in range(len(tasks)):
+        ind_task_end = cumtasks[ci]
+        ind_pos_end = cumcount[ind_task_end - 1]
+
+        subcounts = counts[ind_task_start: ind_task_end]
+
+        p = multiprocessing.Process(target=two_opt_section,
+                                    args=(positions[ind_pos_start:ind_pos_end, :],
+                                          ind_pos_start,
+                                          subcounts,
+                                          tasks[ci], epsilon, route))
+        p.start()
+        processes.append(p)
+        ind_task_start = ind_task_end
+        ind_pos_start = ind_pos_end
+
+    [p.join() for p in processes]
+
+
+def two_opt_sections_threaded(positions, counts, route, n_threads):
+    """
+    Perform a (native, nearest neighbour) two-opt TSP on each section, sharing the sections between threads. Equivalent
+    to running two_opt_section on all the sections, but without the dense distance matrices.
+
+    Parameters
+    ----------
+    positions: ndarray
+        positions, shape (n_points, 2), sorted by section
+    counts: ndarray
+        number of positions in each section
+    route: ndarray
+        output array for the sorted sections
+    n_threads: int
+        number of threads to use
+
+    Notes
+    -----
+    There is no epsilon - each section is optimised until no improving move is found (see two_opt.knn_two_opt).
+    """
+    from PYME.util.threaded import run_threaded
+
+    starts = np.hstack([[0], np.cumsum(counts)])
+    n_sections = len(counts)
+
+    def _sort_sections(section_inds):
+        for si in section_inds:
+            pos = positions[starts[si]:starts[si + 1]]
+            # start on a corner, rather than center
+            initial_route = np.argsort(pos[:, 0] + pos[:, 1])
+            best_route, best_distance, og_distance = two_opt.knn_two_opt(pos, initial_route, fixed_endpoint=True)
+            route[starts[si]:starts[si + 1]] = starts[si] + best_route
+
+    # interleave the sections between threads for a rough load balance
+    n_threads = max(min(n_threads, n_sections), 1)
+    run_threaded(_sort_sections, [(range(ti, n_sections, n_threads),) for ti in range(n_threads)])
+
+
 def tsp_chunk_two_opt_multiproc(positions, epsilon, points_per_chunk, n_proc=1):
+    # NB - if the native route optimisation is available the sections are optimised to convergence and epsilon is
+    # only used when linking the sections (see two_opt_sections_threaded)
     # divide points spatially
     positions = positions.astype(np.float32)
     section, n_sections = split_points_kmeans(positions, points_per_chunk)
@@ -251,37 +337,18 @@ def tsp_chunk_two_opt_multiproc(positions, epsilon, points_per_chunk, n_proc=1):
 
     uni, counts = np.unique(section, return_counts=True)
     logger.debug('%d points total, section counts: %s' % (counts.sum(), (counts,)))
-    if (counts > 1000).any():
-        logger.warning('%d counts in a bin, traveling salesperson algorithm may be very slow' % counts.max())
-
-    ind_task_start = 0
-    ind_pos_start = 0
-    processes = []
 
-    cumcount = counts.cumsum()
-    cumtasks = tasks.cumsum()
-    print('%d tasks' % cumtasks[-1])
+    print('%d tasks' % tasks.sum())
     t = time.time()
-    if n_cpu == 1:
-        two_opt_section(positions, 0, counts, tasks[0], epsilon, route)
+    try:
+        from PYME.Analysis.points.traveling_salesperson import route_opt
+    except ImportError:
+        # native route optimisation not available, fall back to dense two-opt in multiple processes
+        if (counts > 1000).any():
+            logger.warning('%d counts in a bin, traveling salesperson algorithm may be very slow' % counts.max())
+        _two_opt_sections_multiproc(positions, counts, tasks, epsilon, route)
     else:
-        for ci in range(n_cpu):
-            ind_task_end = cumtasks[ci]
-            ind_pos_end = cumcount[ind_task_end - 1]
-
-            subcounts = counts[ind_task_start: ind_task_end]
-
-            p = multiprocessing.Process(target=two_opt_section,
-                                        args=(positions[ind_pos_start:ind_pos_end, :],
-                                              ind_pos_start,
-                                              subcounts,
-                                              tasks[ci], epsilon, route))
-            p.start()
-            processes.append(p)
-            ind_task_start = ind_task_end
-            ind_pos_start = ind_pos_end
-
-        [p.join() for p in processes]
+        two_opt_sections_threaded(positions, counts, route, n_cpu)
     print('Chunked TSPs finished after ~%.2f s, connecting chunks' % (time.time() - t))
 
     sorted_pos = positions[route, :]
@@ -31,6 +31,12 @@ def configuration(parent_package='', top_path=None):
                     extra_link_args=link_args)
 
     config = Configuration('traveling_salesperson', parent_package, top_path, ext_modules=cythonize([ext]))
+
+    config.add_extension('route_opt',
+                         sources=['route_opt.c'],
+                         include_dirs=get_numpy_include_dirs() + extra_include_dirs,
+                         extra_compile_args=['-O3', '-fno-exceptions', '-ffast-math', '-march=native', '-mtune=native'],
+                         extra_link_args=link_args)
     return config
 
 if __name__ == '__main__':
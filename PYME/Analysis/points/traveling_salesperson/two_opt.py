@@ -187,3 +187,58 @@ def timeout_two_opt(distances, epsilon, timeout, initial_route=None):
         improvement = (last_distance - best_distance) / last_distance
 
     return route, best_distance, og_distance
+
+
+def knn_two_opt(positions, initial_route=None, fixed_endpoint=False, n_neighbours=10, or_opt=True):
+    """
+    Native 2-opt (and Or-opt) route optimisation which considers only moves to each point's nearest neighbours rather
+    than using a dense distance matrix. Suitable for ~1e5 points.
+
+    Parameters
+    ----------
+    positions: ndarray
+        Positions array, size n x 2 (or n x 3)
+    initial_route: ndarray
+        [optional] route to initialize search with. Note that the first position in the route is fixed, but all others
+        may vary. If no route is provided, the initial route is the order of positions. As the search is local, a
+        sensible (e.g. spatially sorted) initial route makes a big difference to the run time for large problems.
+    fixed_endpoint: bool
+        fix the last position in the route as well as the first
+    n_neighbours: int
+        number of nearest neighbours to consider as candidates for each point
+    or_opt: bool
+        also try moving short (1-3 point) segments of the route (Or-opt moves)
+
+    Returns
+    -------
+    route: ndarray
+        "solved" route
+    best_distance: float
+        distance of the route
+    og_distance: float
+        distance of the initial route.
+
+    Notes
+    -----
+    Unlike two_opt, this runs until no improving move is found (there is no epsilon), and releases the GIL, so
+    independent problems can be run in parallel threads.
+    """
+    from scipy.spatial import cKDTree
+    from PYME.Analysis.points.traveling_salesperson import route_opt
+
+    positions = np.ascontiguousarray(positions, dtype='f8')
+    n_points = positions.shape[0]
+    # always copy - the route is optimised in place, and we must not modify the caller's initial_route
+    route = np.array(initial_route if initial_route is not None else np.arange(n_points), dtype='i4', copy=True)
+
+    og_distance = np.sqrt((np.diff(positions[route], axis=0) ** 2).sum(axis=1)).sum()
+    if n_points < 3:
+        return route, og_distance, og_distance
+
+    n_neighbours = min(n_neighbours, n_points - 1)
+    neighbours = cKDTree(positions).query(positions, n_neighbours + 1)[1][:, 1:].astype('i4')
+
+    best_distance = route_opt.optimiseRoute(positions, route, neighbours, fixedEndpoint=int(fixed_endpoint),
+                                            orOpt=int(or_opt))
+
+    return route, best_distance, og_distance
@@ -463,12 +463,13 @@ def genShiftVectorFieldSpline(nx,ny, nsx, nsy, err_sx, err_sy, bbox=None):
         spx = SmoothBivariateSpline(nx[good], ny[good], nsx[good], 1./err_sx[good])
         spy = SmoothBivariateSpline(nx[good], ny[good], nsy[good], 1./err_sy[good])
 
-    X, Y = np.meshgrid(np.arange(0, 512*70, 100), np.arange(0, 256*70, 100))
+    #evaluate directly on the grid (much faster than evaluating at each point of a meshgrid)
+    xg, yg = np.arange(0, 512*70, 100), np.arange(0, 256*70, 100)
 
-    dx = spx.ev(X.ravel(),Y.ravel()).reshape(X.shape)
-    dy = spy.ev(X.ravel(),Y.ravel()).reshape(X.shape)
+    dx = spx(xg, yg)
+    dy = spy(xg, yg)
 
-    return (dx.T, dy.T, spx, spy, good)
+    return (dx, dy, spx, spy, good)
 
 
 def genShiftVectorFieldMC(nx,ny, nsx, nsy, p, Nsamp):
@@ -570,3 +571,215 @@ class sffake(ShiftModel):
 
     def ev(self, x, y):
         return self.val
+
+
+#############
+# Fast evaluation of shift fields over whole localisation tables.
+#
+# Shift models are sampled once on a regular grid covering the data and then evaluated using the bicubic
+# interpolation in ShiftField.shiftField. The sampled grids are cached (keyed on the model JSON) so that repeatedly
+# re-applying the same correction (e.g. when the pipeline re-filters) does not re-evaluate the models.
+try:
+    from PYME.Analysis.points.ShiftField import shiftField
+except ImportError:
+    shiftField = None
+
+import threading
+import multiprocessing
+import collections
+from PYME.util.threaded import run_threaded
+
+NUM_PROCS = multiprocessing.cpu_count()
+
+#grids are extended in blocks of this many samples so that small changes in data extent re-use the cached grid
+_GRID_BLOCK = 64
+_MAX_GRID_SAMPLES = 4096
+_MAX_CACHED_GRIDS = 8
+
+_shift_grid_cache = collections.OrderedDict()
+_shift_grid_lock = threading.Lock()
+
+def _model_key(model):
+    """A string uniquely identifying a shift model (or spline) for caching"""
+    import json
+    if model is None:
+        return 'None'
+    elif hasattr(model, 'to_JSON'):
+        return model.to_JSON()
+    elif hasattr(model, 'get_knots'):
+        #scipy BivariateSpline
+        tx, ty = model.get_knots()
+        return json.dumps({'spline': [list(tx), list(ty), list(model.get_coeffs()), list(model.degrees)]})
+    else:
+        #not serialisable - fall back on identity. The cache entry holds a reference to the model (see
+        #shift_field_grids) so that the id can't be re-used by another model while the entry exists.
+        return 'id:%d' % id(model)
+
+def _sample_model(model, xg, yg):
+    """Sample a model on the grid defined by xg and yg, returning [f(x, y, 0), df/dz] as [ny, nx] arrays"""
+    shape = (len(yg), len(xg))
+    if model is None:
+        return np.zeros(shape), np.zeros(shape)
+
+    if hasattr(model, 'get_knots'):
+        #splines evaluate natively on grids
+        return model(xg, yg).T, np.zeros(shape)
+
+    X, Y = np.meshgrid(xg, yg)
+    X, Y = X.ravel(), Y.ravel()
+
+    if getattr(model, 'ZDEPSHIFT', False):
+        #z models are linear in z
+        f0 = model.ev(X, Y, 0*X)
+        fz = model.ev(X, Y, 1 + 0*X) - f0
+    else:
+        f0 = model.ev(X, Y)
+        fz = 0
+
+    return (f0 + 0*X).reshape(shape), (fz + 0*X).reshape(shape)
+
+def _grid_extent(v, spacing):
+    """
+    The range of v to sample on the lookup grid, rounded out to whole blocks. Non-finite values are ignored, and the
+    grid is limited to _MAX_GRID_SAMPLES samples along each axis - points outside the grid are evaluated directly (see
+    apply_shift_fields) so that a few outliers don't force us to sample an enormous grid.
+    """
+    block = _GRID_BLOCK*spacing
+    v = v[np.isfinite(v)]
+    if len(v) == 0:
+        return 0., block
+
+    v0, v1 = v.min(), v.max()
+    if (v1 - v0) > (_MAX_GRID_SAMPLES - 2*_GRID_BLOCK)*spacing:
+        #cover the bulk of the data (not the outliers)
+        v0, v1 = np.percentile(v, [0.1, 99.9])
+        half_width = 0.5*(_MAX_GRID_SAMPLES - 2*_GRID_BLOCK)*spacing
+        if (v1 - v0) > 2*half_width:
+            vm = np.median(v)
+            v0, v1 = max(v0, vm - half_width), min(v1, vm + half_width)
+
+    #pad by 2 samples so that the bicubic interpolation never needs to clamp at the edges of the data
+    v0 = np.floor(v0/block)*block - 2*spacing
+    v1 = np.ceil(v1/block)*block + 2*spacing
+    return v0, v1
+
+def shift_field_grids(models, x, y, spacing=100.):
+    """
+    Get (cached) lookup grids for a set of shift models, covering the range of x and y.
+
+    Parameters
+    ----------
+    models : list of (spx, spy) tuples, one per channel. Either entry can be None for an unshifted channel.
+    x, y : positions which will be evaluated (used to determine the grid extent)
+    spacing : grid spacing, in the same units as x and y
+
+    Returns
+    -------
+    grids : float32 [nChannels, 4, ny, nx] array (dx, d(dx)/dz, dy, d(dy)/dz)
+    x0, y0 : grid origin
+    """
+    key = ('|'.join(['%s;%s' % (_model_key(spx), _model_key(spy)) for spx, spy in models]), float(spacing))
+
+    x0, x1 = _grid_extent(x, spacing)
+    y0, y1 = _grid_extent(y, spacing)
+
+    with _shift_grid_lock:
+        cached = _shift_grid_cache.get(key, None)
+
+    if cached is not None:
+        grids, gx0, gy0, gx1, gy1, _ = cached
+        if (gx0 <= x0) and (gy0 <= y0) and (gx1 >= x1) and (gy1 >= y1):
+            return grids, gx0, gy0
+
+        #grow the grid to cover both the old and new ranges (unless that would make it too large)
+        mx0, my0, mx1, my1 = min(x0, gx0), min(y0, gy0), max(x1, gx1), max(y1, gy1)
+        if max(mx1 - mx0, my1 - my0) <= _MAX_GRID_SAMPLES*spacing:
+            x0, y0, x1, y1 = mx0, my0, mx1, my1
+
+    xg = np.arange(x0, x1 + spacing/2, spacing)
+    yg = np.arange(y0, y1 + spacing/2, spacing)
+
+    grids = np.zeros([len(models), 4, len(yg), len(xg)], 'f4')
+    for i, (spx, spy) in enumerate(models):
+        grids[i, 0], grids[i, 1] = _sample_model(spx, xg, yg)
+        grids[i, 2], grids[i, 3] = _sample_model(spy, xg, yg)
+
+    with _shift_grid_lock:
+        _shift_grid_cache[key] = (grids, x0, y0, x1, y1, list(models))
+        while len(_shift_grid_cache) > _MAX_CACHED_GRIDS:
+            _shift_grid_cache.popitem(last=False)
+
+    return grids, x0, y0
+
+def apply_shift_fields(models, x, y, z=None, chan=None, spacing=100., nThreads=NUM_PROCS):
+    """
+    Evaluate shift corrections for a whole table of points.
+
+    Parameters
+    ----------
+    models : list of (spx, spy) tuples (shift models or splines), indexed by channel. Either entry can be None.
+    x, y : point positions [nm]
+    z : optional z positions, used for models with a z dependent shift (e.g. lin3zModel)
+    chan : optional channel index for each point. Points with a channel outside range(len(models)) are not shifted.
+        If None, the first set of models is used for all points.
+    spacing : spacing of the lookup grid [nm]
+    nThreads : number of threads to use
+
+    Returns
+    -------
+    dx, dy : shifts for each point
+    """
+    x = np.ascontiguousarray(x, dtype='f8').ravel()
+    y = np.ascontiguousarray(y, dtype='f8').ravel()
+
+    if shiftField is None or len(x) == 0:
+        return _apply_shift_fields_py(models, x, y, z, chan)
+
+    if z is not None:
+        z = np.ascontiguousarray(z, dtype='f8').ravel()
+    if chan is not None:
+        chan = np.ascontiguousarray(chan, dtype='i4').ravel()
+
+    grids, x0, y0 = shift_field_grids(models, x, y, spacing)
+
+    dx = np.zeros(len(x), 'f8')
+    dy = np.zeros(len(x), 'f8')
+
+    bounds = np.linspace(0, len(x), max(min(nThreads, len(x)//10000), 1) + 1).astype('i')
+
+    def _apply(start, end):
+        shiftField.applyShiftField(grids, x, y, dx, dy, z=z, chan=chan, x0=x0, y0=y0, spacing=spacing, start=start,
+                                   end=end)
+
+    run_threaded(_apply, list(zip(bounds[:-1], bounds[1:])))
+
+    #points which fall outside the grid (outliers, or non-finite positions) are evaluated directly
+    ny, nx = grids.shape[2:]
+    outside = ~((x >= x0 + spacing) & (x <= x0 + (nx - 3)*spacing) & (y >= y0 + spacing) & (y <= y0 + (ny - 3)*spacing))
+    if np.any(outside):
+        dx[outside], dy[outside] = _apply_shift_fields_py(models, x[outside], y[outside],
+                                                          None if z is None else z[outside],
+                                                          None if chan is None else chan[outside])
+
+    return dx, dy
+
+def _apply_shift_fields_py(models, x, y, z=None, chan=None):
+    """direct (slow) evaluation of the models, used if the c extension is unavailable"""
+    dx = np.zeros(len(x))
+    dy = np.zeros(len(x))
+
+    if chan is None:
+        #as for the c extension, the first set of models is used for all points
+        models = models[:1]
+
+    for i, (spx, spy) in enumerate(models):
+        mask = np.ones(len(x), 'bool') if chan is None else (chan == i)
+        for m, d in [(spx, dx), (spy, dy)]:
+            if m is None:
+                continue
+            if getattr(m, 'ZDEPSHIFT', False) and z is not None:
+                d[mask] = m.ev(x[mask], y[mask], z[mask])
+            else:
+                d[mask] = m.ev(x[mask], y[mask])
+
+    return dx, dy
@@ -731,8 +731,8 @@ class LMAnalyser2(Plugin):
                 except:
                     pass
             else:
-                self.fitResults = np.concatenate((self.fitResults, newResults))
-                self.ds.setResults(self.fitResults)
+                self.ds.appendResults(newResults)
+                self.fitResults = self.ds.fitResults
                 self.dsviewer.pipeline.recipe.prune_dependencies_from_namespace(['Localizations', ], True)
                 self.dsviewer.pipeline.recipe.invalidate_data()
         
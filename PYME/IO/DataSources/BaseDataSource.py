@@ -95,6 +95,17 @@ class BaseDataSource(object):
         """
         raise NotImplementedError
 
+    def getSlices(self, indices, out=None):
+        """Return a stack of slices (indexed along the first axis). Over-ridden in data sources which can fetch
+        multiple slices more efficiently than one at a time (currently only ClusterPZFDataSource)."""
+        for j, ind in enumerate(indices):
+            sl = self.getSlice(ind)
+            if out is None:
+                out = np.empty((len(indices),) + sl.shape, sl.dtype)
+            out[j] = sl
+        
+        return out
+    
     def getSliceShape(self):
         """Return the 2D shape of a slice"""
         raise NotImplementedError
@@ -73,6 +73,18 @@ class DataSource(BaseDataSource):
         #print sl.shape, sl.dtype
         return sl.squeeze()
 
+    def getSlices(self, indices, out=None):
+        """Get multiple frames, using batched requests to the data servers"""
+        frameNames = ['%s/frame%05d.pzf' % (self.sequenceName, ind) for ind in indices]
+        
+        for j, data in enumerate(clusterIO.get_files(frameNames, self.clusterfilter)):
+            sl = PZFFormat.loads(data)[0].squeeze()
+            if out is None:
+                out = np.empty((len(indices),) + sl.shape, sl.dtype)
+            out[j] = sl
+            
+        return out
+
     def getSliceShape(self):
         if self.fshape is None:
             self.fshape = self.getSlice(0).shape
@@ -89,7 +101,27 @@ class DataSource(BaseDataSource):
     def eventFileName(self):
         return self.sequenceName + '/events.json'
 
+    def _getBinaryEvents(self):
+        """Read the binary event log (see PYME.IO.EventLogFormat), which newer spoolers stream events to"""
+        from PYME.IO import EventLogFormat
+        
+        fn = self.sequenceName + '/events.pev'
+        localpath = clusterIO.get_local_path(fn, self.clusterfilter)
+        if localpath:
+            # memory map the file rather than reading it
+            return EventLogFormat.load_file(localpath)
+        
+        # don't use the file cache or retry, as the log grows during acquisition, and might not exist
+        return EventLogFormat.loads(clusterIO.get_file(fn, self.clusterfilter, numRetries=1, use_file_cache=False,
+                                                       timeout=10))
+
     def getEvents(self):
+        try:
+            return self._getBinaryEvents()
+        except IOError:
+            # no binary event log, fall back to events.json
+            pass
+        
         import pandas as pd #defer pandas import for as long as possible
         try:
             #return json.loads(clusterIO.getFile(eventFileName, self.clusterfilter))
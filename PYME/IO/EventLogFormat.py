@@ -0,0 +1,194 @@
+# -*- coding: utf-8 -*-
+"""
+A compact binary format for acquisition event logs, used as an alternative to serialising all the events of a series
+to JSON once acquisition has finished.
+
+A file consists of a sequence of self-contained chunks, so that events can be streamed to the file as they are logged
+(e.g. by appending chunks to a file on the cluster using `__aggregate_txt`). Each chunk is laid out as follows, with
+all sections padded to a multiple of 8 bytes:
+
+:header: a :const:`CHUNK_HEADER_DTYPE` record
+:names: the (interned) event names used in the chunk, each terminated by a null byte
+:records: `NumRecords` fixed size :const:`RECORD_DTYPE` records, which refer to names by their index in the name table
+:descriptions: the event descriptions, concatenated
+
+As the records are fixed size, they are read straight out of the file (or a memory map of the file) without any
+parsing. Note that there is no guarantee that chunks are written in order, so readers should sort by time.
+
+Most users will just want :func:`dumps` and :func:`loads` (or :func:`load_file`).
+"""
+
+import numpy as np
+import six
+
+FILE_FORMAT_ID = b'EV'
+FORMAT_VERSION = 1
+
+CHUNK_HEADER_DTYPE = np.dtype([('ID', 'S2'), ('Version', 'u1'), ('RESERVED0', 'u1'), ('NumNames', '<u4'),
+                               ('NumRecords', '<u4'), ('NamesLength', '<u4'), ('DescrLength', '<u4'),
+                               ('RESERVED1', 'S12')])
+
+RECORD_DTYPE = np.dtype([('Time', '<f8'), ('NameIdx', '<u2'), ('DescrLength', '<u2'), ('DescrOffset', '<u4')])
+
+#the numpy representation of events used by the data sources (and the Events table in our .h5 files)
+EVENTS_DTYPE = [('EventName', 'S32'), ('Time', 'f8'), ('EventDescr', 'S256')]
+
+MAX_DESCR_LENGTH = 256
+
+#number of records to unpack descriptions for at once (bounds the memory used by load)
+_DESCR_BLOCK_SIZE = 65536
+
+
+def _pad8(n):
+    return (n + 7) & ~7
+
+
+def _to_bytes(s):
+    if isinstance(s, bytes):
+        return s
+    return six.text_type(s).encode('utf8')
+
+
+def dumps(events):
+    """
+    Encode a list of events as a single chunk.
+
+    Parameters
+    ----------
+    events : list
+        events, as (EventName, EventDescr, Time) tuples (the same form that is used for events.json)
+
+    Returns
+    -------
+    bytes : the encoded chunk. Chunks can be concatenated to form a file.
+    """
+    names = {}
+    name_idx = np.zeros(len(events), 'u2')
+    times = np.zeros(len(events), 'f8')
+    descrs = []
+
+    for j, (name, descr, t) in enumerate(events):
+        name = _to_bytes(name)
+        try:
+            name_idx[j] = names[name]
+        except KeyError:
+            name_idx[j] = names[name] = len(names)
+
+        descrs.append(_to_bytes(descr)[:MAX_DESCR_LENGTH])
+        times[j] = t
+
+    if len(names) > 65535:
+        raise RuntimeError('Too many distinct event names in one chunk')
+
+    names_s = b''.join([n + b'\0' for n in sorted(names, key=names.get)])
+    descr_s = b''.join(descrs)
+    descr_lengths = np.array([len(d) for d in descrs], 'u4')
+
+    header = np.zeros(1, CHUNK_HEADER_DTYPE)
+    header['ID'] = FILE_FORMAT_ID
+    header['Version'] = FORMAT_VERSION
+    header['NumNames'] = len(names)
+    header['NumRecords'] = len(events)
+    header['NamesLength'] = len(names_s)
+    header['DescrLength'] = len(descr_s)
+
+    records = np.zeros(len(events), RECORD_DTYPE)
+    records['Time'] = times
+    records['NameIdx'] = name_idx
+    records['DescrLength'] = descr_lengths
+    records['DescrOffset'] = np.cumsum(descr_lengths) - descr_lengths
+
+    return b''.join([header.tobytes(),
+                     names_s, b'\0'*(_pad8(len(names_s)) - len(names_s)),
+                     records.tobytes(),
+                     descr_s, b'\0'*(_pad8(len(descr_s)) - len(descr_s))])
+
+
+def _unpack_descriptions(descr_blob, offsets, lengths, out):
+    """gather variable length descriptions into a fixed width string array, without a python loop over events"""
+    if len(offsets) == 0:
+        return
+
+    width = int(lengths.max())
+    if width == 0:
+        return
+
+    cols = np.arange(width)
+    for i in range(0, len(offsets), _DESCR_BLOCK_SIZE):
+        o = offsets[i:(i + _DESCR_BLOCK_SIZE)].astype('i8')
+        l = lengths[i:(i + _DESCR_BLOCK_SIZE)]
+
+        idx = np.minimum(o[:, None] + cols[None, :], len(descr_blob) - 1)
+        d = np.where(cols[None, :] < l[:, None], descr_blob[idx], 0).astype('u1')
+        out[i:(i + _DESCR_BLOCK_SIZE)] = d.view('S%d' % width).ravel()
+
+
+def iter_chunks(data):
+    """
+    Iterate over the chunks in an event log, yielding (names, records, descriptions) for each chunk. `records` and
+    `descriptions` are views into `data`.
+
+    A truncated chunk at the end of the data (e.g. because the file is still being written) is ignored.
+    """
+    buf = np.frombuffer(data, 'u1')
+    hlen = CHUNK_HEADER_DTYPE.itemsize
+    pos = 0
+
+    while (pos + hlen) <= len(buf):
+        header = buf[pos:(pos + hlen)].view(CHUNK_HEADER_DTYPE)[0]
+        if not header['ID'] == FILE_FORMAT_ID:
+            raise RuntimeError("Invalid format: This doesn't appear to be an event log")
+
+        names_len = _pad8(int(header['NamesLength']))
+        records_len = int(header['NumRecords'])*RECORD_DTYPE.itemsize
+        descr_len = _pad8(int(header['DescrLength']))
+
+        start = pos + hlen
+        end = start + names_len + records_len + descr_len
+        if end > len(buf):
+            break
+
+        names = buf[start:(start + int(header['NamesLength']))].tobytes().split(b'\0')[:int(header['NumNames'])]
+        records = buf[(start + names_len):(start + names_len + records_len)].view(RECORD_DTYPE)
+        descriptions = buf[(start + names_len + records_len):end]
+
+        yield names, records, descriptions
+        pos = end
+
+
+def loads(data):
+    """
+    Load events from an encoded event log.
+
+    Parameters
+    ----------
+    data : bytes, mmap, or uint8 array
+
+    Returns
+    -------
+    events : ndarray
+        The events, sorted by time, as a numpy record array with the :const:`EVENTS_DTYPE` dtype
+    """
+    chunks = list(iter_chunks(data))
+    events = np.zeros(sum([len(records) for names, records, descriptions in chunks]), EVENTS_DTYPE)
+
+    i = 0
+    for names, records, descriptions in chunks:
+        n = len(records)
+        if len(names) > 0:
+            events['EventName'][i:(i + n)] = np.array(names, 'S32')[records['NameIdx']]
+        events['Time'][i:(i + n)] = records['Time']
+        _unpack_descriptions(descriptions, records['DescrOffset'], records['DescrLength'],
+                             events['EventDescr'][i:(i + n)])
+        i += n
+
+    return events[np.argsort(events['Time'], kind='mergesort')]
+
+
+def load_file(filename):
+    """Load events from a file on disk, using a memory map"""
+    import os
+    if os.path.getsize(filename) == 0:
+        return np.zeros(0, EVENTS_DTYPE)
+
+    return loads(np.memmap(filename, 'u1', mode='r'))
@@ -0,0 +1,131 @@
+# -*- coding: utf-8 -*-
+"""
+A simple container for sending many (small) files in a single HTTP request, used for batched gets and puts of frames
+to and from the cluster (see :func:`PYME.IO.clusterIO.get_files` and :func:`PYME.IO.clusterIO.put_files`).
+
+The layout is as follows, with the name table padded to a multiple of 8 bytes:
+
+:header: a :const:`HEADER_DTYPE` record
+:names: the file names, each terminated by a null byte
+:index: `NumFiles` :const:`INDEX_DTYPE` records giving the offset (relative to the start of the data section) and length
+        of each file. A length of -1 indicates a missing file.
+:data: the file contents, concatenated
+
+As the index is known before any of the file data is read, a server can lay out the whole message up front and read
+each file directly into its place in the message buffer.
+"""
+
+import numpy as np
+import six
+
+FILE_FORMAT_ID = b'MF'
+FORMAT_VERSION = 1
+
+HEADER_DTYPE = np.dtype([('ID', 'S2'), ('Version', 'u1'), ('RESERVED0', 'u1'), ('NumFiles', '<u4'),
+                         ('NamesLength', '<u8')])
+
+INDEX_DTYPE = np.dtype([('Offset', '<u8'), ('Length', '<i8')])
+
+
+def _pad8(n):
+    return (n + 7) & ~7
+
+
+def _to_bytes(s):
+    if isinstance(s, bytes):
+        return s
+    return six.text_type(s).encode('utf8')
+
+
+def dumps_header(names, lengths):
+    """
+    Encode the header, name table and index for a set of files
+
+    Parameters
+    ----------
+    names : list of str
+    lengths : list of int
+        the length of each file, or -1 if the file is missing
+
+    Returns
+    -------
+    prefix : bytes
+        the start of the message (the file data should be concatenated onto this)
+    offsets : ndarray
+        offsets of each file within the message
+    """
+    names_s = b''.join([_to_bytes(n) + b'\0' for n in names])
+
+    header = np.zeros(1, HEADER_DTYPE)
+    header['ID'] = FILE_FORMAT_ID
+    header['Version'] = FORMAT_VERSION
+    header['NumFiles'] = len(names)
+    header['NamesLength'] = len(names_s)
+
+    lengths = np.array(lengths, 'i8')
+    sizes = np.maximum(lengths, 0)
+    index = np.zeros(len(names), INDEX_DTYPE)
+    index['Length'] = lengths
+    index['Offset'] = np.cumsum(sizes) - sizes
+
+    prefix = b''.join([header.tobytes(), names_s, b'\0'*(_pad8(len(names_s)) - len(names_s)), index.tobytes()])
+
+    return prefix, index['Offset'] + len(prefix)
+
+
+def dumps(files):
+    """
+    Encode a list of files
+
+    Parameters
+    ----------
+    files : list
+        (name, data) tuples, as passed to :func:`PYME.IO.clusterIO.put_files`
+
+    Returns
+    -------
+    bytes
+    """
+    prefix, offsets = dumps_header([f[0] for f in files], [len(f[1]) for f in files])
+    return b''.join([prefix] + [f[1] for f in files])
+
+
+def loads(data):
+    """
+    Decode a message
+
+    Parameters
+    ----------
+    data : bytes
+
+    Returns
+    -------
+    files : list
+        (name, data) tuples. `data` is a memoryview into the message (or None for missing files).
+    """
+    buf = memoryview(data)
+    hlen = HEADER_DTYPE.itemsize
+    header = np.frombuffer(buf[:hlen], HEADER_DTYPE)[0]
+    if not header['ID'] == FILE_FORMAT_ID:
+        raise RuntimeError("Invalid format: This doesn't appear to be a multi-file message")
+
+    n_files = int(header['NumFiles'])
+    names_len = int(header['NamesLength'])
+    names = buf[hlen:(hlen + names_len)].tobytes().split(b'\0')[:n_files]
+
+    index_start = hlen + _pad8(names_len)
+    data_start = index_start + n_files*INDEX_DTYPE.itemsize
+    index = np.frombuffer(buf[index_start:data_start], INDEX_DTYPE)
+
+    if (data_start + int(np.maximum(index['Length'], 0).sum())) > len(buf):
+        raise RuntimeError('Truncated multi-file message')
+
+    files = []
+    for name, (offset, length) in zip(names, index):
+        if length < 0:
+            files.append((name.decode('utf8'), None))
+        else:
+            start = data_start + int(offset)
+            files.append((name.decode('utf8'), buf[start:(start + int(length))]))
+
+    return files
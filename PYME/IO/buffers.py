@@ -9,7 +9,20 @@ import numpy as np
 #bufferMisses = 0
 
 class dataBuffer: #buffer our io to avoid decompressing multiple times
-    def __init__(self,dataSource, bLen = 12):
+    def __init__(self,dataSource, bLen = 12, frameCache=None, seriesKey=None):
+        """
+        Parameters
+        ----------
+        dataSource : data source
+        bLen : int
+            number of frames to buffer locally
+        frameCache : PYME.IO.frameCache.SharedFrameCache, optional
+            a node-wide cache shared between worker processes, checked before going to the data source. Frames read from
+            the data source are added to the cache. When using the cache, frames are always returned read-only (frames
+            served from the cache are views into shared memory).
+        seriesKey : str, optional
+            the key for this series in the frame cache (required if frameCache is given)
+        """
         self.bLen = bLen
         self.buffer = None #delay creation until we know the dtype
         #self.buffer = np.zeros((bLen,) + dataSource.getSliceShape(), 'uint16')
@@ -17,6 +30,29 @@ class dataBuffer: #buffer our io to avoid decompressing multiple times
         self.bufferedSlices = -1*np.ones((bLen,), 'i')
         self.dataSource = dataSource
         
+        self.frameCache = frameCache if seriesKey else None
+        self.seriesKey = seriesKey
+        
+    def _getFromSource(self, ind):
+        if self.frameCache is not None:
+            sl = self.frameCache.get(self.seriesKey, ind)
+            if sl is not None:
+                return sl
+            
+        sl = self.dataSource.getSlice(ind)
+        
+        if self.frameCache is not None:
+            sl = self._cache_put(ind, sl)
+            
+        return sl
+    
+    def _cache_put(self, ind, sl):
+        """Add a frame to the shared cache, returning it read-only to match frames which came from the cache"""
+        self.frameCache.put(self.seriesKey, ind, sl)
+        sl = np.asarray(sl).view()
+        sl.flags.writeable = False
+        return sl
+        
     def getSlice(self,ind):
         #global bufferMisses
         #print self.bufferedSlices, self.insertAt, ind
@@ -25,7 +61,7 @@ class dataBuffer: #buffer our io to avoid decompressing multiple times
             #print int(np.where(self.bufferedSlices == ind)[0])
             return self.buffer[int(np.where(self.bufferedSlices == ind)[0]),:,:]
         else: #get from our data source and store in buffer
-            sl = self.dataSource.getSlice(ind)
+            sl = self._getFromSource(ind)
             self.bufferedSlices[self.insertAt] = ind
 
             if self.buffer is None: #buffer doesn't exist yet
@@ -42,6 +78,30 @@ class dataBuffer: #buffer our io to avoid decompressing multiple times
 
             return sl
         
+    def getSlices(self, indices):
+        """
+        Get a list of slices, fetching any which are not buffered with a single call to the data source. This is much
+        faster than repeated calls to getSlice when the data source is remote (e.g. when populating a background window).
+        """
+        missing = [ind for ind in indices if not ind in self.bufferedSlices]
+        
+        fetched = {}
+        if self.frameCache is not None:
+            for ind in missing:
+                sl = self.frameCache.get(self.seriesKey, ind)
+                if sl is not None:
+                    fetched[ind] = sl
+            
+            missing = [ind for ind in missing if not ind in fetched]
+        
+        if len(missing) > 1 and hasattr(self.dataSource, 'getSlices'):
+            for ind, sl in zip(missing, self.dataSource.getSlices(missing)):
+                if self.frameCache is not None:
+                    sl = self._cache_put(ind, sl)
+                fetched[ind] = sl
+            
+        return [fetched[ind] if ind in fetched else self.getSlice(ind) for ind in indices]
+        
 class backgroundBuffer:
     def __init__(self, dataBuffer):
         self.dataBuffer = dataBuffer
@@ -52,8 +112,9 @@ class backgroundBuffer:
         bgi = set(bgindices)
 
         #subtract frames we're currently holding but don't need
-        for fi in self.curFrames.difference(bgi):
-            self.curBG[:] = (self.curBG - self.dataBuffer.getSlice(fi))[:]
+        toRemove = list(self.curFrames.difference(bgi))
+        for fi, sl in zip(toRemove, self.dataBuffer.getSlices(toRemove)):
+            self.curBG[:] = (self.curBG - sl)[:]
             self.curFrames.remove(fi) # make sure we also remove the frame from our list of buffered frames in case we crash later
 
         #add frames we don't already have
@@ -62,9 +123,11 @@ class backgroundBuffer:
             if fi >= nSlices:
                 #drop frames which run over the end of our data
                 bgi.remove(fi)
-            else:
-                self.curBG[:] = (self.curBG + self.dataBuffer.getSlice(fi))[:]
-                self.curFrames.add(fi)
+        
+        toAdd = list(bgi.difference(self.curFrames))
+        for fi, sl in zip(toAdd, self.dataBuffer.getSlices(toAdd)):
+            self.curBG[:] = (self.curBG + sl)[:]
+            self.curFrames.add(fi)
 
         #self.curFrames = bgi
 
@@ -222,9 +285,11 @@ class backgroundBufferM:
             if fi >= nSlices:
                 #drop frames which run over the end of our data
                 bgi.remove(fi)
-            else:
-                self.bfb.addFrame(fi, self.dataBuffer.getSlice(fi).squeeze())
-                self.curFrames.add(fi)
+        
+        toAdd = list(bgi.difference(self.curFrames))
+        for fi, sl in zip(toAdd, self.dataBuffer.getSlices(toAdd)):
+            self.bfb.addFrame(fi, sl.squeeze())
+            self.curFrames.add(fi)
 
         #self.curFrames = bgi
         self.curBG = self.bfb.getPercentile(self.pctile).astype('f')
@@ -36,6 +36,7 @@ And finally some functions to facilitate efficient (and data local) operations
     | :func:`get_local_path` which returns a local path if a file is local
     | :func:`locate_file` which returns a list of http urls where the given file can be found
     | :func:`put_files` which implements a streamed, high performance, put of multiple files
+    | :func:`get_files` which gets multiple files using batched requests
     
 There are are also higher level functions in :mod:`PYME.IO.unifiedIO`  which allows files to be accessed in a consistent
 way given either a cluster URI or a local path and :mod:`PYME.IO.clusterResults` which helps with saving tabular data to
@@ -102,6 +103,9 @@ import os
 
 USE_RAW_SOCKETS = True
 
+#maximum number of files to get / put in a single batched (__multiget / __multiput) request
+BATCH_SIZE = 256
+
 from PYME.misc.computerName import GetComputerName
 compName = GetComputerName()
 
@@ -848,6 +852,110 @@ def get_file(filename, serverfilter=local_serverfilter, numRetries=3, use_file_c
     return content
 
 
+def _get_batch(dirurl, names, numRetries=3, timeout=5):
+    """
+    Get a batch of files from a single directory on a single server using a __multiget request.
+    
+    Returns
+    -------
+    list of (name, data) tuples, or None if the server does not support batched gets
+    """
+    from PYME.IO import MultiFileFormat
+    
+    parts = urlparse(dirurl)
+    url = 'http://%s/__multiget%s?names=%s' % (parts.netloc, parts.path, ','.join(names))
+    
+    nTries = 0
+    while True:
+        try:
+            nTries += 1
+            s = _getSession(url)
+            r = s.get(url, timeout=timeout)
+            break
+        except (requests.Timeout, requests.ConnectionError):
+            logger.exception('Timeout on batched get from %s' % dirurl)
+            if nTries >= numRetries:
+                raise
+    
+    if r.status_code == 404:
+        # an older server which doesn't know about __multiget
+        return None
+    
+    if not r.status_code == 200:
+        msg = 'Batched request for %d files from %s failed with error: %d' % (len(names), dirurl, r.status_code)
+        logger.error(msg)
+        raise RuntimeError(msg)
+    
+    return MultiFileFormat.loads(r.content)
+
+
+def get_files(filenames, serverfilter=local_serverfilter, numRetries=3, use_file_cache=True, local_short_circuit=True,
+              timeout=5):
+    """
+    Get multiple files from the cluster. All the requested files which live in the same directory on the same server
+    are fetched with a single (batched) request, which is much faster than calling :func:`get_file` for each file when
+    getting many small files (e.g. the frames for a background estimate).
+    
+    Parameters
+    ----------
+    filenames : list of str
+        filenames relative to cluster root
+    
+    See :func:`get_file` for the other parameters.
+
+    Returns
+    -------
+    list of bytes, in the same order as `filenames`
+
+    """
+    results = [None]*len(filenames)
+    batches = OrderedDict()
+    
+    for j, filename in enumerate(filenames):
+        if use_file_cache:
+            try:
+                results[j] = _fileCache[(filename, serverfilter)]
+                continue
+            except KeyError:
+                pass
+        
+        localpath = get_local_path(filename, serverfilter) if local_short_circuit else None
+        if localpath:
+            with open(localpath, 'rb') as f:
+                results[j] = f.read()
+            continue
+        
+        locs = locate_file(filename, serverfilter, return_first_hit=True)
+        if len(locs) == 0:
+            # let get_file handle retries and error reporting
+            results[j] = get_file(filename, serverfilter, numRetries, use_file_cache, local_short_circuit, timeout)
+            continue
+        
+        dirurl, fn = _chooseLocation(locs).rsplit('/', 1)
+        batches.setdefault(dirurl, []).append((j, fn))
+    
+    for dirurl, entries in batches.items():
+        for i in range(0, len(entries), BATCH_SIZE):
+            batch = entries[i:(i + BATCH_SIZE)]
+            files = _get_batch(dirurl, [fn for j, fn in batch], numRetries, timeout)
+            
+            if files is None:
+                for j, fn in batch:
+                    results[j] = get_file(filenames[j], serverfilter, numRetries, use_file_cache, local_short_circuit,
+                                          timeout)
+                continue
+            
+            for (j, fn), (name, data) in zip(batch, files):
+                if data is None:
+                    raise IOError("Specified file could not be found: %s" % filenames[j])
+                
+                results[j] = data.tobytes()
+                if len(data) < 1000000:
+                    _fileCache[(filenames[j], serverfilter)] = results[j]
+    
+    return results
+
+
 _last_access_time = {}
 _lastwritespeed = {}
 #_diskfreespace = {}
@@ -1029,6 +1137,37 @@ def put_file(filename, data, serverfilter=local_serverfilter, timeout=10):
     
         
 
+def _batch_files(files):
+    """
+    Group files for upload in batched (__multiput) requests, one for each directory (up to BATCH_SIZE files).
+    Directories with a single file are left as a plain put, as are paths to special endpoints (any path component
+    starting with '__', e.g. __aggregate_h5), which need to be handled by the server one file at a time.
+    """
+    from PYME.IO import MultiFileFormat
+    
+    batches = []
+    dirs = OrderedDict()
+    for filename, data in files:
+        unifiedIO.assert_name_ok(filename)
+        if any([c.startswith('__') for c in filename.split('/')]):
+            batches.append((filename, data))
+            continue
+            
+        dirname, fn = filename.rsplit('/', 1) if '/' in filename else ('', filename)
+        dirs.setdefault(dirname, []).append((fn, data))
+    
+    for dirname, dir_files in dirs.items():
+        for i in range(0, len(dir_files), BATCH_SIZE):
+            batch = dir_files[i:(i + BATCH_SIZE)]
+            if len(batch) == 1:
+                fn, data = batch[0]
+                batches.append(('/'.join([dirname, fn]) if dirname else fn, data))
+            else:
+                batches.append(('__multiput/' + dirname, MultiFileFormat.dumps(batch)))
+    
+    return batches
+
+
 if USE_RAW_SOCKETS:
     def _read_status(fp):
         line = fp.readline()
@@ -1111,7 +1250,9 @@ if USE_RAW_SOCKETS:
         
         This uses a long-lived http2 session with keep-alive to avoid the connection overhead in creating a new
         session for each file, and puts files before waiting for a response to the last put. This function exists to
-        facilitate fast streaming
+        facilitate fast streaming. Files which share a directory are sent as batched (__multiput) requests if the
+        'clusterIO-batch-puts' config option is True. This is off by default, as data servers which predate batching
+        would save the batch as a single file - only enable it once all the servers on the cluster support it.
         
         As it reads the replies *after* attempting to put all the files, this is currently not as safe as put_file (in
         handling failures we assume that no attempts were successful after the first failed file).
@@ -1130,7 +1271,10 @@ if USE_RAW_SOCKETS:
         """
         
 
-        files = [(f) for f in files]
+        if config.get('clusterIO-batch-puts', False):
+            files = _batch_files(files)
+        else:
+            files = [(f) for f in files]
         serverfilter = (serverfilter)
         
         nRetries = 0
@@ -1260,7 +1404,10 @@ else:
         -------
 
         """
-        files = [(f) for f in files]
+        if config.get('clusterIO-batch-puts', False):
+            files = _batch_files(files)
+        else:
+            files = [(f) for f in files]
         serverfilter = (serverfilter)
         
         name, info = _chooseServer(serverfilter)
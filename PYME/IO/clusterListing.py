@@ -13,6 +13,7 @@ FILETYPE_NORMAL = 0
 FILETYPE_DIRECTORY = 1 << 0
 FILETYPE_SERIES =  1 << 1 # a directory which is actually a series - treat specially
 FILETYPE_SERIES_COMPLETE = 1 << 2 # a series which has finished spooling
+FILETYPE_SERIES_EVENT_LOG = 1 << 3 # a series with a binary event log (events.pev, see PYME.IO.EventLogFormat)
 
 """ Information about a file in a directory listing.
 
@@ -54,6 +55,9 @@ except ImportError: # coundir module is posix only, fall back to more naive meth
             if os.path.exists(fpath + '/events.json'):
                 #if there is a metadata.json, set the series flag
                 ftype |= FILETYPE_SERIES_COMPLETE
+                
+            if os.path.exists(fpath + '/events.pev'):
+                ftype |= FILETYPE_SERIES_EVENT_LOG
 
             return (fn + '/',  FileInfo(ftype, dirsize(fpath)))
         
@@ -137,6 +141,9 @@ class DirCache(object):
             else:
                 dir_info = (FILETYPE_DIRECTORY, len(dir))
                 
+            if dir.get('events.pev', False) or (fname == 'events.pev'):
+                dir_info = (dir_info[0] | FILETYPE_SERIES_EVENT_LOG, dir_info[1])
+                
             # if this is due to an aggregate call, filesize is the size of the next chunk, add to existing file size
             # FIXME - remove as we don't update on aggregate any more???
             try:
@@ -31,6 +31,7 @@
 #define FILETYPE_DIRECTORY          1 << 0
 #define FILETYPE_SERIES             1 << 1 // a directory which is actually a series - treat specially
 #define FILETYPE_SERIES_COMPLETE    1 << 2 // a series which has finished spooling
+#define FILETYPE_SERIES_EVENT_LOG   1 << 3 // a series with a binary event log (events.pev)
 
 
 
@@ -149,6 +150,12 @@ static PyObject * file_info(PyObject *self, PyObject *args)
 
             if (stat(test_path, &test_stat) == 0) type |= FILETYPE_SERIES_COMPLETE;
 
+            //test for presence of binary event log
+            strncpy(test_path, path, BUF_SIZE - 1);
+            strncat(test_path, "/events.pev", BUF_SIZE - strlen(test_path) -1);
+
+            if (stat(test_path, &test_stat) == 0) type |= FILETYPE_SERIES_EVENT_LOG;
+
             size = count_files(path);
         } else
         {
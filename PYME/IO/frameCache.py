@@ -0,0 +1,368 @@
+"""
+A node-wide cache of decoded frames, held in shared memory so that all the worker processes on a node can read from it.
+
+Fit tasks on a node frequently need the same frames (overlapping background windows, multi-frame fits, and re-running
+tasks after a worker has moved to a different series and back). Each worker process keeps a small buffer of its own (see
+:mod:`PYME.IO.buffers`), but without a shared cache every process fetches and decodes every frame it needs itself.
+
+The cache is a memory-mapped file (in `/dev/shm` where available) divided into fixed size slots. Frames are keyed by
+series and frame number, and occupy one or more contiguous slots. When the cache is full, the least recently used
+entries are evicted. Reads are zero-copy - :meth:`SharedFrameCache.get` returns a read-only view into the shared memory.
+The entry is pinned (and will not be evicted) for as long as the view (or any array derived from it) is alive. Pins
+held by processes which have died are ignored once the slot has gone unused for long enough.
+
+Access to the index is serialised with a lock file (`flock`), so the cache is only available on posix systems.
+"""
+
+import numpy as np
+import mmap
+import os
+import threading
+import tempfile
+import hashlib
+import logging
+
+logger = logging.getLogger(__name__)
+
+try:
+    import fcntl
+except ImportError:
+    # windows
+    fcntl = None
+
+FORMAT_ID = 0x5059434143484531 # 'PYCACHE1'
+
+HEADER_DTYPE = np.dtype([('ID', '<u8'), ('NumSlots', '<i8'), ('SlotBytes', '<i8'), ('Clock', '<u8'),
+                         ('Generation', '<u8'), ('Hits', '<u8'), ('Misses', '<u8'), ('Evictions', '<u8')])
+
+# owner is the index of the first slot of the entry which occupies a slot (-1 if free). Everything other than owner and
+# last_used is only valid in the first slot of an entry.
+INDEX_DTYPE = np.dtype([('owner', '<i4'), ('span', '<i4'), ('pins', '<i4'), ('ndim', '<i4'), ('key', '<u8'),
+                        ('frame', '<i8'), ('last_used', '<u8'), ('pinned_at', '<u8'), ('generation', '<u8'),
+                        ('shape', '<i8', (4,)), ('dtype', 'S8')])
+
+ALIGNMENT = 64
+
+#a pin is considered stale (from a crashed process) if the entry has not been used for STALE_PIN_FACTOR*NumSlots accesses
+STALE_PIN_FACTOR = 16
+
+
+def _align(n):
+    return ALIGNMENT*int(np.ceil(n/float(ALIGNMENT)))
+
+
+class _PinnedFrame(object):
+    """
+    Exposes a cached frame (read-only) via the numpy array interface, and unpins it when garbage collected. Arrays
+    created from this (and any views of them) keep it alive.
+    """
+    def __init__(self, cache, head, generation, view):
+        self._cache = cache
+        self._head = head
+        self._generation = generation
+        self._view = view
+        ai = view.__array_interface__
+        self.__array_interface__ = dict(ai, data=(ai['data'][0], True))
+
+    def __del__(self):
+        try:
+            self._cache._unpin(self._head, self._generation)
+        except Exception:
+            pass
+
+
+def _reserve(fd, size):
+    """
+    Grow the cache file to `size` bytes, allocating the space up front. Growing it with ftruncate alone gives a sparse
+    file - if the filesystem (typically a small /dev/shm) cannot hold the whole cache, we would then get a SIGBUS when
+    touching a slot rather than an error here.
+    """
+    current = os.fstat(fd).st_size
+    if current >= size:
+        return
+
+    st = os.fstatvfs(fd)
+    if st.f_bavail*st.f_frsize < (size - current):
+        raise RuntimeError('Not enough free space for a %d MB frame cache (%d MB available)' % (size/1e6,
+                                                                                              st.f_bavail*st.f_frsize/1e6))
+
+    if hasattr(os, 'posix_fallocate'):
+        os.posix_fallocate(fd, 0, size)
+    else:
+        # no fallocate (e.g. OSX) - rely on the free space check above
+        os.ftruncate(fd, size)
+
+
+def series_key(series):
+    """A (non-zero) 64 bit hash of a series name"""
+    return int(np.frombuffer(hashlib.blake2b(series.encode('utf8'), digest_size=8).digest(), '<u8')[0]) | 1
+
+
+class SharedFrameCache(object):
+    def __init__(self, name='pyme-frame-cache', size=512*1024*1024, slot_bytes=256*1024):
+        """
+        Open (or create) a shared frame cache. All processes opening a cache with the same name share it. The size and
+        slot size are only used when creating the cache - processes opening an existing cache use its geometry.
+
+        Parameters
+        ----------
+        name : str
+            name of the cache (the shared memory file)
+        size : int
+            approximate total size in bytes
+        slot_bytes : int
+            the allocation granularity. Frames larger than this take several slots.
+        """
+        if fcntl is None:
+            raise RuntimeError('SharedFrameCache is not supported on this platform')
+
+        shm_dir = '/dev/shm' if os.path.isdir('/dev/shm') else tempfile.gettempdir()
+        self.filename = os.path.join(shm_dir, name)
+
+        self._thread_lock = threading.Lock()
+        self._fd = os.open(self.filename, os.O_RDWR | os.O_CREAT, 0o600)
+
+        n_slots = max(int(size//slot_bytes), 1)
+        slot_bytes = _align(slot_bytes)
+
+        fcntl.flock(self._fd, fcntl.LOCK_EX)
+        try:
+            header = np.frombuffer(os.pread(self._fd, HEADER_DTYPE.itemsize, 0), HEADER_DTYPE) \
+                if os.fstat(self._fd).st_size >= HEADER_DTYPE.itemsize else None
+
+            if header is not None and header['ID'][0] == FORMAT_ID:
+                # use the existing cache geometry
+                n_slots, slot_bytes = int(header['NumSlots'][0]), int(header['SlotBytes'][0])
+                initialise = False
+            else:
+                initialise = True
+
+            self._data_offset = _align(HEADER_DTYPE.itemsize + n_slots*INDEX_DTYPE.itemsize)
+            total_size = self._data_offset + n_slots*slot_bytes
+            _reserve(self._fd, total_size)
+
+            self._mmap = mmap.mmap(self._fd, total_size)
+            self._header = np.frombuffer(self._mmap, HEADER_DTYPE, 1, 0)
+            self._index = np.frombuffer(self._mmap, INDEX_DTYPE, n_slots, HEADER_DTYPE.itemsize)
+            self._data = np.frombuffer(self._mmap, 'u1', n_slots*slot_bytes, self._data_offset)
+
+            if initialise:
+                self._index[:] = 0
+                self._index['owner'] = -1
+                self._header[0] = (0, n_slots, slot_bytes, 1, 1, 0, 0, 0)
+                # set the ID last, so that a partially initialised cache is re-initialised
+                self._header['ID'] = FORMAT_ID
+        except:
+            fcntl.flock(self._fd, fcntl.LOCK_UN)
+            os.close(self._fd)
+            raise
+        
+        fcntl.flock(self._fd, fcntl.LOCK_UN)
+
+        self.n_slots = n_slots
+        self.slot_bytes = slot_bytes
+        self._slot_ids = np.arange(n_slots)
+
+    def _lock(self):
+        # flock excludes other processes, but not other threads using the same file descriptor
+        self._thread_lock.acquire()
+        fcntl.flock(self._fd, fcntl.LOCK_EX)
+
+    def _unlock(self):
+        fcntl.flock(self._fd, fcntl.LOCK_UN)
+        self._thread_lock.release()
+
+    def _tick(self):
+        c = int(self._header['Clock'][0])
+        self._header['Clock'] = c + 1
+        return c
+
+    def _find(self, key, frame):
+        idx = np.flatnonzero((self._index['key'] == key) & (self._index['frame'] == frame) &
+                             (self._index['owner'] == self._slot_ids))
+        if len(idx) == 0:
+            return -1
+        return int(idx[0])
+
+    def _entry_view(self, head):
+        e = self._index[head]
+        start = head*self.slot_bytes
+        dtype = np.dtype(e['dtype'].decode())
+        shape = tuple(e['shape'][:e['ndim']])
+        return self._data[start:(start + int(np.prod(shape))*dtype.itemsize)].view(dtype).reshape(shape)
+
+    def _unpin(self, head, generation):
+        if self._index is None:
+            # closed
+            return
+        
+        self._lock()
+        try:
+            e = self._index[head:(head + 1)]
+            if e['generation'][0] == generation and e['pins'][0] > 0:
+                e['pins'] -= 1
+        finally:
+            self._unlock()
+
+    def get(self, series, frame):
+        """
+        Get a frame from the cache
+
+        Returns
+        -------
+        frame : ndarray or None
+            a read-only view of the cached frame (the entry stays pinned while the view is alive), or None if the frame
+            is not in the cache.
+        """
+        key = series_key(series)
+        self._lock()
+        try:
+            head = self._find(key, frame)
+            if head < 0:
+                self._header['Misses'] += 1
+                return None
+
+            e = self._index[head:(head + 1)]
+            t = self._tick()
+            self._index['last_used'][head:(head + int(e['span'][0]))] = t
+            e['pins'] += 1
+            e['pinned_at'] = t
+            generation = int(e['generation'][0])
+            self._header['Hits'] += 1
+        finally:
+            self._unlock()
+
+        return np.asarray(_PinnedFrame(self, head, generation, self._entry_view(head)))
+
+    def _free(self, head):
+        span = int(self._index['span'][head])
+        self._index['owner'][head:(head + span)] = -1
+        self._index['key'][head] = 0
+        self._index['pins'][head] = 0
+
+    def _allocate(self, n):
+        """find n contiguous slots, evicting least recently used entries as needed. Called with the lock held."""
+        owner = self._index['owner']
+        clock = int(self._header['Clock'][0])
+
+        pins = self._index['pins'][np.maximum(owner, 0)]
+        stale = (clock - self._index['pinned_at'][np.maximum(owner, 0)]) > STALE_PIN_FACTOR*self.n_slots
+        evictable = (owner < 0) | (pins == 0) | stale
+
+        # free slots count as least recently used
+        last_used = np.where(owner < 0, 0, self._index['last_used']).astype('u8')
+
+        n_starts = self.n_slots - n + 1
+        if n_starts < 1:
+            return -1
+
+        ok = evictable[:n_starts].copy()
+        cost = last_used[:n_starts].copy()
+        for j in range(1, n):
+            ok &= evictable[j:(n_starts + j)]
+            cost = np.maximum(cost, last_used[j:(n_starts + j)])
+
+        if not np.any(ok):
+            return -1
+
+        start = int(np.flatnonzero(ok)[np.argmin(cost[ok])])
+
+        # evict any entries which overlap the slots we want
+        for head in set(owner[start:(start + n)].tolist()):
+            if head >= 0:
+                self._free(head)
+                self._header['Evictions'] += 1
+
+        return start
+
+    def put(self, series, frame, data):
+        """
+        Add a frame to the cache
+
+        Returns
+        -------
+        bool : whether the frame was cached
+        """
+        data = np.ascontiguousarray(data)
+        if data.ndim > 4:
+            return False
+
+        n = int(np.ceil(max(data.nbytes, 1)/float(self.slot_bytes)))
+        key = series_key(series)
+
+        self._lock()
+        try:
+            if self._find(key, frame) >= 0:
+                return True
+
+            head = self._allocate(n)
+            if head < 0:
+                return False
+
+            generation = int(self._header['Generation'][0])
+            self._header['Generation'] = generation + 1
+            t = self._tick()
+
+            start = head*self.slot_bytes
+            self._data[start:(start + data.nbytes)] = data.view('u1').ravel()
+
+            self._index['owner'][head:(head + n)] = head
+            self._index['last_used'][head:(head + n)] = t
+            for field, value in [('span', n), ('pins', 0), ('ndim', data.ndim), ('frame', frame), ('pinned_at', t),
+                                 ('generation', generation), ('shape', list(data.shape) + [0]*(4 - data.ndim)),
+                                 ('dtype', data.dtype.str.encode())]:
+                self._index[field][head] = value
+            # set the key last - the entry is now visible
+            self._index['key'][head] = key
+        finally:
+            self._unlock()
+
+        return True
+
+    def stats(self):
+        h = self._header[0]
+        return {'Hits': int(h['Hits']), 'Misses': int(h['Misses']), 'Evictions': int(h['Evictions']),
+                'SlotsUsed': int((self._index['owner'] >= 0).sum()), 'NumSlots': self.n_slots}
+
+    def close(self):
+        # NB - views returned by get() must not be used after closing
+        self._header = self._index = self._data = None
+        try:
+            self._mmap.close()
+        except BufferError:
+            # there are still views into the cache - leave it to be cleaned up on exit
+            pass
+        os.close(self._fd)
+
+
+_cache = None
+_cache_lock = threading.Lock()
+
+
+def get_cache():
+    """
+    The node-wide frame cache, configured by the 'frame-cache-mb' (default 0, i.e. disabled) and 'frame-cache-slot-kb'
+    (default 256) config options. The cache lives in shared memory, so make sure /dev/shm is large enough before
+    enabling it. If there is not enough space, we continue without a cache.
+
+    Returns
+    -------
+    SharedFrameCache, or None if the cache is disabled or not supported
+    """
+    global _cache
+    from PYME import config
+
+    with _cache_lock:
+        if _cache is None:
+            size_mb = config.get('frame-cache-mb', 0)
+            if size_mb <= 0 or fcntl is None:
+                _cache = False
+            else:
+                try:
+                    _cache = SharedFrameCache('pyme-frame-cache-%d' % os.getuid(), size=int(size_mb*1024*1024),
+                                              slot_bytes=int(config.get('frame-cache-slot-kb', 256)*1024))
+                except Exception as e:
+                    logger.warning('Could not open shared frame cache (%s), continuing without' % e)
+                    _cache = False
+
+        return _cache if _cache else None
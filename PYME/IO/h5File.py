@@ -4,6 +4,8 @@ import ujson as json
 from PYME import config
 import numpy as np
 import traceback
+import collections
+import tables
 from . import h5rFile
 
 EVENTS_DTYPE = np.dtype([('EventDescr', 'S256'), ('EventName', 'S32'), ('Time', '<f8')])
@@ -35,6 +37,16 @@ class H5File(h5rFile.H5RFile):
     PZFCompression = PZFFormat.DATA_COMP_HUFFCODE
     KEEP_ALIVE_TIMEOUT = 120
     
+    def __init__(self, *args, **kwargs):
+        # Incoming frames and metadata updates are queued here and written in batches by the IO thread, so that the
+        # (possibly many concurrent) requests putting them never have to wait on the pytables lock. Appending to a
+        # deque is atomic, so no lock is needed to queue.
+        self._frame_queue = collections.deque()
+        self._metadata_queue = collections.deque()
+        self._metadata_lock = threading.Lock()
+        
+        h5rFile.H5RFile.__init__(self, *args, **kwargs)
+    
     @property
     def image_data(self):
         try:
@@ -103,8 +115,75 @@ class H5File(h5rFile.H5RFile):
         else: #already PZF compressed
             return data
     
+    def _applyMetadata(self):
+        # lock so that updates are applied in order if called from both a request and the IO thread
+        with self._metadata_lock:
+            updates = []
+            try:
+                while True:
+                    updates.append(self._metadata_queue.popleft())
+            except IndexError:
+                pass
+            
+            if len(updates) > 0:
+                with h5rFile.tablesLock:
+                    for md in updates:
+                        self.mdh.update(md)
+                    
+        return len(updates) > 0
+    
+    def _appendFrames(self, frames):
+        """
+        Write a batch of PZF frames in frame number order, along with the index mapping frame numbers to rows, holding
+        the pytables lock once for the whole batch.
+        """
+        frame_nums = np.array([PZFFormat.load_header(f)['FrameNum'][0] for f in frames], 'i4')
+        order = np.argsort(frame_nums, kind='mergesort')
+        
+        with h5rFile.tablesLock:
+            image_data = getattr(self._h5file.root, 'PZFImageData', None)
+            if image_data is None:
+                image_data = self._h5file.create_vlarray(self._h5file.root, 'PZFImageData', tables.VLStringAtom())
+                
+            start = image_data.nrows
+            for j in order:
+                image_data.append(frames[j])
+                
+            idx = np.zeros(len(frames), dtype=[('FrameNum', 'i4'), ('Position', 'i4')])
+            idx['FrameNum'] = frame_nums[order]
+            idx['Position'] = start + np.arange(len(frames))
+            
+            index = getattr(self._h5file.root, 'PZFImageIndex', None)
+            if index is None:
+                self._h5file.create_table(self._h5file.root, 'PZFImageIndex', idx,
+                                          filters=tables.Filters(complevel=5, shuffle=True), expectedrows=50000)
+            else:
+                index.append(idx)
+            
+            self._pzf_index = None
+            
+    def _hasQueued(self):
+        return (len(self._frame_queue) > 0) or (len(self._metadata_queue) > 0) or h5rFile.H5RFile._hasQueued(self)
+    
+    def _writeQueued(self):
+        wrote = self._applyMetadata()
+        
+        frames = []
+        try:
+            while True:
+                frames.append(self._frame_queue.popleft())
+        except IndexError:
+            pass
+        
+        if len(frames) > 0:
+            self._appendFrames(frames)
+            wrote = True
+            
+        return wrote
+    
     def get_file(self, filename):
         if filename == 'metadata.json':
+            self._applyMetadata()
             return self.mdh.to_JSON()
         elif filename == 'events.json':
             try:
@@ -125,7 +204,7 @@ class H5File(h5rFile.H5RFile):
         
     def put_file(self, filename, data):
         if filename in ['metadata.json', 'MetaData']:
-            self.updateMetadata(json.loads(data))
+            self._metadata_queue.append(json.loads(data))
         elif filename == 'events.json':
             events = json.loads(data)
             
@@ -137,9 +216,8 @@ class H5File(h5rFile.H5RFile):
             self.addEvents(events_array)
         
         elif filename.startswith('frame'):
-            #FIXME - this will not preserve ordering
-            frame_num = int(filename[5:10])
-            self.appendToTable('PZFImageData', data)
+            # frames are written in order within each batch, and the index lets us find them in any case
+            self._frame_queue.append(data)
         
         
             
@@ -176,6 +176,21 @@ class H5RFile(object):
                 self._pzf_index = None
                     
 
+    def _hasQueued(self):
+        """Is there anything waiting to be written?"""
+        with self.appendQueueLock:
+            return any([len(v) > 0 for v in self.appendQueues.values()])
+    
+    def _writeQueued(self):
+        """
+        Hook for derived classes to write any data they queue themselves. Called from the IO thread.
+
+        Returns
+        -------
+        True if anything was written
+        """
+        return False
+
     def appendToTable(self, tablename, data):
         #logging.debug('h5rfile - append to table: %s' % tablename)
         with self.appendQueueLock:
@@ -208,13 +223,21 @@ class H5RFile(object):
 
         return res
 
+    def getTableLength(self, tablename):
+        """The number of rows which have been written to a table (0 if the table does not exist)"""
+        with tablesLock:
+            try:
+                return getattr(self._h5file.root, tablename).nrows
+            except AttributeError:
+                return 0
+
     def _pollQueues(self):
         queuesWithData = False
 
         # logging.debug('h5rfile - poll')
 
         try:
-            while self.useCount > 0 or queuesWithData or time.time() < self.keepAliveTimeout or not self._acquired_at_least_once:
+            while self.useCount > 0 or queuesWithData or self._hasQueued() or time.time() < self.keepAliveTimeout or not self._acquired_at_least_once:
                 #logging.debug('poll - %s' % time.time())
                 with self.appendQueueLock:
                     #find queues with stuff to save
@@ -244,6 +267,8 @@ class H5RFile(object):
                         pass
                     
                     self._appendToTable(tablename, np.hstack(recs))
+                    
+                queuesWithData = self._writeQueued() or queuesWithData
 
                 curTime = time.time()
                 if (curTime - self._lastFlushTime) > self.FLUSH_INTERVAL:
@@ -0,0 +1,537 @@
+/*
+##################
+# idFilter.c
+#
+# Copyright David Baddeley, 2019
+# d.baddeley@auckland.ac.nz
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+##################
+ */
+
+/*
+ID membership tests and lookups for tabular data (see tabular.IdFilter and tabular.id_lookup).
+
+The IDs are put into a lookup table - a dense array indexed by (id - min_id) if the IDs are compact enough, or an open
+addressing hash table otherwise - which maps each ID to its position in the ID list. Each row then needs a single
+lookup, rather than a comparison against every ID. For membership tests on compact IDs we use a bitmap instead, which
+is small enough to stay in cache.
+
+Integer and floating point columns are supported (floating point values only match if they are exact integers, as is
+the case for e.g. clumpIndex columns which have been through a float conversion). The GIL is released during the scan
+so that callers can split the rows between threads. To avoid each thread building its own copy of the lookup table,
+build it once with id_table() and pass the result in place of the ids - the table is read-only once built, so it can be
+shared between threads.
+*/
+
+#include "Python.h"
+#include "numpy/arrayobject.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define MIN(a, b) ((a<b) ? a : b)
+#define MAX(a, b) ((a>b) ? a : b)
+
+/*
+Use a dense table if it would be no bigger than a hash table (4 bytes per entry vs. ~24 bytes per ID), or is small
+anyway. Bitmaps (for membership tests) are 32 times smaller again.
+*/
+#define DENSE_RANGE_FACTOR 4
+#define DENSE_MAX_SMALL_RANGE (1ULL << 20)
+#define BITMAP_RANGE_FACTOR 128
+#define BITMAP_MAX_SMALL_RANGE (1ULL << 24)
+
+#define BLOCK_SIZE 4096
+
+typedef struct {
+    int membership_only; /* no positions - can only be used for membership tests */
+    int dense;
+    int64_t min_id;
+    uint64_t range;     /* dense table size */
+    int shift;          /* hash table size is 1 << (64 - shift) */
+    uint64_t mask;
+    int64_t *keys;
+    int32_t *pos;
+    uint64_t *bits;     /* dense membership bitmap (only if we don't need positions) */
+} id_table_t;
+
+static inline uint64_t hash_id(int64_t id)
+{
+    /* fibonacci hashing, after mixing the high bits down */
+    uint64_t x = (uint64_t) id;
+    x ^= x >> 31;
+    return x*0x9E3779B97F4A7C15ULL;
+}
+
+static void free_table(id_table_t *t)
+{
+    if (t->keys) free(t->keys);
+    if (t->pos) free(t->pos);
+    if (t->bits) free(t->bits);
+    t->keys = NULL;
+    t->pos = NULL;
+    t->bits = NULL;
+}
+
+/* build the lookup table. Duplicate IDs map to their first position. Returns 0 on success. */
+static int build_table(id_table_t *t, const int64_t *ids, npy_intp n_ids, int membership_only)
+{
+    npy_intp i;
+    int64_t mn, mx;
+    uint64_t h, size;
+    int bits;
+
+    memset(t, 0, sizeof(id_table_t));
+    t->membership_only = membership_only;
+    if (n_ids == 0) return 0;
+
+    mn = mx = ids[0];
+    for (i = 1; i < n_ids; i++)
+    {
+        mn = MIN(mn, ids[i]);
+        mx = MAX(mx, ids[i]);
+    }
+
+    t->min_id = mn;
+    t->range = (uint64_t) mx - (uint64_t) mn + 1;
+
+    if (membership_only && (t->range > 0) &&
+        ((t->range <= BITMAP_MAX_SMALL_RANGE) || (t->range <= (uint64_t) BITMAP_RANGE_FACTOR*n_ids)))
+    {
+        t->dense = 1;
+        t->bits = (uint64_t *) calloc((t->range + 63)/64, sizeof(uint64_t));
+        if (t->bits == NULL) return -1;
+
+        for (i = 0; i < n_ids; i++)
+        {
+            h = (uint64_t) ids[i] - (uint64_t) mn;
+            t->bits[h >> 6] |= 1ULL << (h & 63);
+        }
+        return 0;
+    }
+
+    if ((t->range > 0) && (t->range < (1ULL << 31)) &&
+        ((t->range <= DENSE_MAX_SMALL_RANGE) || (t->range <= (uint64_t) DENSE_RANGE_FACTOR*n_ids)))
+    {
+        t->dense = 1;
+        t->pos = (int32_t *) malloc(t->range*sizeof(int32_t));
+        if (t->pos == NULL) return -1;
+
+        memset(t->pos, 0xFF, t->range*sizeof(int32_t)); //-1
+        for (i = n_ids - 1; i >= 0; i--) t->pos[ids[i] - mn] = (int32_t) i;
+
+        return 0;
+    }
+
+    //hash table, at most half full
+    bits = 4;
+    while ((1ULL << bits) < (uint64_t) 2*n_ids) bits++;
+    size = 1ULL << bits;
+
+    t->shift = 64 - bits;
+    t->mask = size - 1;
+    t->keys = (int64_t *) malloc(size*sizeof(int64_t));
+    t->pos = (int32_t *) malloc(size*sizeof(int32_t));
+    if ((t->keys == NULL) || (t->pos == NULL)) return -1;
+
+    memset(t->pos, 0xFF, size*sizeof(int32_t));
+
+    for (i = 0; i < n_ids; i++)
+    {
+        h = hash_id(ids[i]) >> t->shift;
+        while ((t->pos[h] >= 0) && (t->keys[h] != ids[i])) h = (h + 1) & t->mask;
+
+        if (t->pos[h] < 0)
+        {
+            t->keys[h] = ids[i];
+            t->pos[h] = (int32_t) i;
+        }
+    }
+
+    return 0;
+}
+
+/* look an id up in the hash table, returning its position in the ID list, or -1 if it's not present */
+static inline int32_t hash_lookup(const id_table_t *t, int64_t id)
+{
+    uint64_t h = hash_id(id) >> t->shift;
+
+    while (t->pos[h] >= 0)
+    {
+        if (t->keys[h] == id) return t->pos[h];
+        h = (h + 1) & t->mask;
+    }
+
+    return -1;
+}
+
+/*
+Convert n rows of a column to int64 keys. Floating point values are only valid keys if they are exact integers (NaNs
+and out of range values are not). The contiguous case is split out so that the compiler can vectorise it.
+*/
+#define LOAD_INT(T) {\
+    if (stride == sizeof(T)) {\
+        const T *d = ((const T *) data) + start;\
+        for (i = 0; i < n; i++) keys[i] = (int64_t) d[i];\
+    } else {\
+        const char *d = data + start*stride;\
+        for (i = 0; i < n; i++, d += stride) keys[i] = (int64_t) *((const T *) d);\
+    }\
+    memset(valid, 1, n);\
+    break;\
+    }
+
+/* unsigned 64 bit values above the int64 range can never match */
+#define LOAD_UINT64(T) {\
+    const char *d = data + start*stride;\
+    for (i = 0; i < n; i++, d += stride) {\
+        keys[i] = (int64_t) *((const T *) d);\
+        valid[i] = (keys[i] >= 0);\
+    }\
+    break;\
+    }
+
+#define LOAD_FLOAT(T) {\
+    const char *d = data + start*stride;\
+    for (i = 0; i < n; i++, d += stride) {\
+        double v = (double) *((const T *) d);\
+        uint8_t ok = (v >= -9.2e18) & (v <= 9.2e18);\
+        keys[i] = (int64_t) (ok ? v : 0);\
+        valid[i] = ok & ((double) keys[i] == v);\
+    }\
+    break;\
+    }
+
+static void load_keys(const char *data, npy_intp stride, int type, npy_intp start, npy_intp n,
+                      int64_t * restrict keys, uint8_t * restrict valid)
+{
+    npy_intp i;
+
+    switch (type)
+    {
+        case NPY_BYTE: LOAD_INT(npy_byte)
+        case NPY_UBYTE: LOAD_INT(npy_ubyte)
+        case NPY_SHORT: LOAD_INT(npy_short)
+        case NPY_USHORT: LOAD_INT(npy_ushort)
+        case NPY_INT: LOAD_INT(npy_int)
+        case NPY_UINT: LOAD_INT(npy_uint)
+        case NPY_LONG: LOAD_INT(npy_long)
+        case NPY_ULONG: LOAD_UINT64(npy_ulong)
+        case NPY_LONGLONG: LOAD_INT(npy_longlong)
+        case NPY_ULONGLONG: LOAD_UINT64(npy_ulonglong)
+        case NPY_FLOAT: LOAD_FLOAT(npy_float)
+        case NPY_DOUBLE: LOAD_FLOAT(npy_double)
+    }
+}
+
+/*
+Find the position of each key in the ID list (or 0 if we only have a bitmap), or -1 if it's not present. The dense
+lookups are branch free (rows which are out of range look up entry 0, and are then masked out).
+*/
+static void lookup_keys(const id_table_t *t, const int64_t * restrict keys, const uint8_t * restrict valid, npy_intp n,
+                        int32_t * restrict p)
+{
+    npy_intp i;
+    uint64_t h, m;
+
+    if (t->bits)
+    {
+        for (i = 0; i < n; i++)
+        {
+            h = (uint64_t) keys[i] - (uint64_t) t->min_id;
+            m = valid[i] & (h < t->range);
+            h = m ? h : 0;
+            p[i] = (int32_t) ((t->bits[h >> 6] >> (h & 63)) & m) - 1;
+        }
+    } else if (t->dense)
+    {
+        for (i = 0; i < n; i++)
+        {
+            h = (uint64_t) keys[i] - (uint64_t) t->min_id;
+            m = valid[i] & (h < t->range);
+            h = m ? h : 0;
+            p[i] = m ? t->pos[h] : -1;
+        }
+    } else if (t->pos)
+    {
+        for (i = 0; i < n; i++) p[i] = valid[i] ? hash_lookup(t, keys[i]) : -1;
+    } else
+    {
+        //no ids
+        for (i = 0; i < n; i++) p[i] = -1;
+    }
+}
+
+/*
+Look up each row of [start, end), a block at a time. If sel is not NULL, the indices of rows which match are written
+to sel and the number of matches returned, otherwise the position of each row's ID (or -1) is written to idx.
+*/
+static npy_intp scan_rows(const id_table_t *t, const char *data, npy_intp stride, int type, npy_intp start,
+                          npy_intp end, npy_intp *sel, int64_t *idx)
+{
+    int64_t keys[BLOCK_SIZE];
+    uint8_t valid[BLOCK_SIZE];
+    int32_t p[BLOCK_SIZE];
+    npy_intp b, i, n, nSel = 0;
+
+    for (b = start; b < end; b += BLOCK_SIZE)
+    {
+        n = MIN(BLOCK_SIZE, end - b);
+
+        load_keys(data, stride, type, b, n, keys, valid);
+        lookup_keys(t, keys, valid, n, p);
+
+        if (sel)
+        {
+            for (i = 0; i < n; i++)
+            {
+                sel[nSel] = b + i;
+                nSel += (p[i] >= 0);
+            }
+        } else
+        {
+            for (i = 0; i < n; i++) idx[b - start + i] = p[i];
+        }
+    }
+
+    return nSel;
+}
+
+static int supported_type(int type)
+{
+    switch (type)
+    {
+        case NPY_FLOAT: case NPY_DOUBLE: case NPY_BYTE: case NPY_UBYTE: case NPY_SHORT: case NPY_USHORT:
+        case NPY_INT: case NPY_UINT: case NPY_LONG: case NPY_ULONG: case NPY_LONGLONG: case NPY_ULONGLONG:
+            return 1;
+    }
+    return 0;
+}
+
+#define TABLE_CAPSULE_NAME "idFilter.id_table"
+
+static void free_table_capsule(PyObject *capsule)
+{
+    id_table_t *t = (id_table_t *) PyCapsule_GetPointer(capsule, TABLE_CAPSULE_NAME);
+
+    if (t)
+    {
+        free_table(t);
+        free(t);
+    }
+}
+
+/* build a lookup table from an array of ids */
+static int table_from_ids(id_table_t *t, PyObject *oIds, int membership_only)
+{
+    PyArrayObject *aIds;
+    int ret;
+
+    aIds = (PyArrayObject *) PyArray_ContiguousFromObject(oIds, NPY_LONGLONG, 1, 1);
+    if (aIds == NULL)
+    {
+        PyErr_Format(PyExc_RuntimeError, "Bad ids - expecting a 1D integer array");
+        return -1;
+    }
+
+    if (PyArray_DIM(aIds, 0) >= 0x7FFFFFFF)
+    {
+        Py_DECREF(aIds);
+        PyErr_Format(PyExc_RuntimeError, "Too many ids");
+        return -1;
+    }
+
+    ret = build_table(t, (int64_t *) PyArray_DATA(aIds), PyArray_DIM(aIds, 0), membership_only);
+    Py_DECREF(aIds);
+
+    if (ret != 0)
+    {
+        free_table(t);
+        PyErr_Format(PyExc_RuntimeError, "Error allocating memory");
+        return -1;
+    }
+
+    return 0;
+}
+
+static PyObject * id_table(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oIds=0, *capsule;
+    id_table_t *t;
+    int membership_only = 0;
+
+    static char *kwlist[] = {"ids", "membership_only", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "O|i", kwlist, &oIds, &membership_only))
+        return NULL;
+
+    t = (id_table_t *) malloc(sizeof(id_table_t));
+    if (t == NULL) return PyErr_NoMemory();
+
+    if (table_from_ids(t, oIds, membership_only) != 0)
+    {
+        free(t);
+        return NULL;
+    }
+
+    capsule = PyCapsule_New(t, TABLE_CAPSULE_NAME, free_table_capsule);
+    if (capsule == NULL)
+    {
+        free_table(t);
+        free(t);
+    }
+
+    return capsule;
+}
+
+static PyObject * id_scan(PyObject *args, PyObject *keywds, int selecting)
+{
+    PyObject *oColumn=0, *oIds=0, *res;
+    PyArrayObject *aColumn=0, *aOut=0;
+    npy_intp start = 0, end = -1, nRows, nSel = 0, dims[1];
+    PyArray_Dims newShape;
+    id_table_t table;
+    const id_table_t *pTable = &table;
+    int err = 0;
+
+    static char *kwlist[] = {"column", "ids", "start", "end", NULL};
+
+    memset(&table, 0, sizeof(table));
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OO|nn", kwlist, &oColumn, &oIds, &start, &end))
+        return NULL;
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_id_scan;\
+        }
+
+    if (PyArray_Check(oColumn) && (PyArray_NDIM((PyArrayObject *) oColumn) == 1) &&
+        supported_type(PyArray_TYPE((PyArrayObject *) oColumn)) && PyArray_ISALIGNED((PyArrayObject *) oColumn) &&
+        PyArray_ISNOTSWAPPED((PyArrayObject *) oColumn))
+    {
+        //use the column as is (including strided views)
+        aColumn = (PyArrayObject *) oColumn;
+        Py_INCREF(aColumn);
+    } else
+    {
+        aColumn = (PyArrayObject *) PyArray_ContiguousFromObject(oColumn, NPY_LONGLONG, 1, 1);
+        if (aColumn == NULL) ABORT("Bad column - expecting a 1D numeric array")
+    }
+
+    if (PyCapsule_IsValid(oIds, TABLE_CAPSULE_NAME))
+    {
+        //a table which has already been built (with id_table)
+        pTable = (const id_table_t *) PyCapsule_GetPointer(oIds, TABLE_CAPSULE_NAME);
+        if (!selecting && pTable->membership_only) ABORT("id_index needs a table built with membership_only=False")
+    } else if (table_from_ids(&table, oIds, selecting) != 0) goto FINALIZE_id_scan;
+
+    nRows = PyArray_DIM(aColumn, 0);
+    if (end < 0) end = nRows;
+    start = MAX(start, 0);
+    end = MIN(end, nRows);
+    dims[0] = MAX(end - start, 0);
+
+    //allocate selections for the worst case (everything selected), and shrink once we know how many rows matched
+    aOut = (PyArrayObject *) PyArray_SimpleNew(1, dims, selecting ? NPY_INTP : NPY_INT64);
+    if (aOut == NULL) goto FINALIZE_id_scan;
+
+    Py_BEGIN_ALLOW_THREADS;
+    nSel = scan_rows(pTable, (const char *) PyArray_DATA(aColumn), PyArray_STRIDE(aColumn, 0), PyArray_TYPE(aColumn),
+                     start, end, selecting ? (npy_intp *) PyArray_DATA(aOut) : NULL,
+                     selecting ? NULL : (int64_t *) PyArray_DATA(aOut));
+    Py_END_ALLOW_THREADS;
+
+    if (selecting && (nSel < dims[0]))
+    {
+        dims[0] = nSel;
+        newShape.ptr = dims;
+        newShape.len = 1;
+        res = PyArray_Resize(aOut, &newShape, 0, NPY_CORDER);
+        if (res == NULL) err = 1;
+        Py_XDECREF(res);
+    }
+
+FINALIZE_id_scan:
+    #undef ABORT
+
+    free_table(&table);
+    Py_XDECREF(aColumn);
+
+    if (err || PyErr_Occurred())
+    {
+        Py_XDECREF(aOut);
+        return NULL;
+    }
+
+    return (PyObject *) aOut;
+}
+
+static PyObject * id_filter(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    return id_scan(args, keywds, 1);
+}
+
+static PyObject * id_index(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    return id_scan(args, keywds, 0);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+static PyMethodDef idFilterMethods[] = {
+    {"id_table",  id_table, METH_VARARGS | METH_KEYWORDS,
+    "Build a lookup table for `ids`, which can be passed in place of the ids to id_filter and id_index (and shared "
+    "between threads).\n"
+    " Arguments are: 'ids' (1D integer array), 'membership_only'=0 (a smaller table, which only supports id_filter)"},
+    {"id_filter",  id_filter, METH_VARARGS | METH_KEYWORDS,
+    "Find the rows in [start, end) whose value is one of `ids`, returning their indices (as an intp array).\n"
+    " Arguments are: 'column' (1D array), 'ids' (1D integer array, or table from id_table), 'start'=0, "
+    "'end'=len(column)"},
+    {"id_index",  id_index, METH_VARARGS | METH_KEYWORDS,
+    "For each row in [start, end), find the position of its value in `ids` (the first, if an id is repeated), or -1 "
+    "if it is not present. Returns an int64 array of length end - start.\n"
+    " Arguments are: 'column' (1D array), 'ids' (1D integer array, or table from id_table), 'start'=0, "
+    "'end'=len(column)"},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+#pragma GCC diagnostic pop
+
+#if PY_MAJOR_VERSION>=3
+static struct PyModuleDef moduledef = {
+        PyModuleDef_HEAD_INIT,
+        "idFilter",     /* m_name */
+        "ID membership tests and lookups for tabular data",  /* m_doc */
+        -1,                  /* m_size */
+        idFilterMethods,    /* m_methods */
+        NULL,                /* m_reload */
+        NULL,                /* m_traverse */
+        NULL,                /* m_clear */
+        NULL,                /* m_free */
+    };
+
+PyMODINIT_FUNC PyInit_idFilter(void)
+{
+	PyObject *m;
+    m = PyModule_Create(&moduledef);
+    import_array()
+    return m;
+}
+
+#else
+PyMODINIT_FUNC initidFilter(void)
+{
+    PyObject *m;
+
+    m = Py_InitModule("idFilter", idFilterMethods);
+    import_array()
+}
+#endif
@@ -0,0 +1,304 @@
+/*
+##################
+# rangeFilter.c
+#
+# Copyright David Baddeley, 2019
+# d.baddeley@auckland.ac.nz
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+##################
+ */
+
+/*
+Range filtering of tabular data (see tabular.ResultsFilter).
+
+All the (lo < column < hi) predicates are evaluated together, a block of rows at a time, into a small block mask
+which is then compacted into a selection vector (the indices of the rows which pass). This avoids allocating full
+length boolean temporaries for each predicate. Blocks where no rows are left are skipped for the remaining columns.
+
+Columns can be any of the common integer or floating point types, and need not be contiguous (e.g. fields of a
+record array). The GIL is released during filtering so that callers can split the rows between threads.
+*/
+
+#include "Python.h"
+#include "numpy/arrayobject.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define MIN(a, b) ((a<b) ? a : b)
+#define MAX(a, b) ((a>b) ? a : b)
+
+#define BLOCK_SIZE 4096
+
+#define ALL_SELECTED 0x0101010101010101ULL
+
+/* maximum number of columns we can filter on at once */
+#define MAX_COLUMNS 64
+
+typedef struct {
+    const char *data;
+    npy_intp stride;
+    int type;
+    double lo;
+    double hi;
+} column_t;
+
+/*
+Evaluate lo < x < hi for n rows, and-ing into the mask. Floating point columns are compared in their own precision
+(matching numpy's behaviour with scalar bounds), integers are compared as doubles so that fractional bounds work.
+The contiguous case is split out so that the compiler can vectorise it.
+*/
+#define AND_RANGE(T, CT) {\
+    const CT lo = (CT) col->lo, hi = (CT) col->hi;\
+    if (col->stride == sizeof(T)) {\
+        const T *d = ((const T *) col->data) + start;\
+        for (i = 0; i < n; i++) mask[i] &= (((CT) d[i] > lo) & ((CT) d[i] < hi));\
+    } else {\
+        const char *d = col->data + start*col->stride;\
+        for (i = 0; i < n; i++, d += col->stride) mask[i] &= (((CT) *((const T *) d) > lo) & ((CT) *((const T *) d) < hi));\
+    }\
+    break;\
+    }
+
+static void and_range(const column_t *col, npy_intp start, npy_intp n, uint8_t * restrict mask)
+{
+    npy_intp i;
+
+    switch (col->type)
+    {
+        case NPY_FLOAT: AND_RANGE(npy_float, npy_float)
+        case NPY_DOUBLE: AND_RANGE(npy_double, npy_double)
+        case NPY_BYTE: AND_RANGE(npy_byte, npy_double)
+        case NPY_UBYTE: AND_RANGE(npy_ubyte, npy_double)
+        case NPY_SHORT: AND_RANGE(npy_short, npy_double)
+        case NPY_USHORT: AND_RANGE(npy_ushort, npy_double)
+        case NPY_INT: AND_RANGE(npy_int, npy_double)
+        case NPY_UINT: AND_RANGE(npy_uint, npy_double)
+        case NPY_LONG: AND_RANGE(npy_long, npy_double)
+        case NPY_ULONG: AND_RANGE(npy_ulong, npy_double)
+        case NPY_LONGLONG: AND_RANGE(npy_longlong, npy_double)
+        case NPY_ULONGLONG: AND_RANGE(npy_ulonglong, npy_double)
+    }
+}
+
+static int supported_type(int type)
+{
+    switch (type)
+    {
+        case NPY_FLOAT: case NPY_DOUBLE: case NPY_BYTE: case NPY_UBYTE: case NPY_SHORT: case NPY_USHORT:
+        case NPY_INT: case NPY_UINT: case NPY_LONG: case NPY_ULONG: case NPY_LONGLONG: case NPY_ULONGLONG:
+            return 1;
+    }
+    return 0;
+}
+
+/*
+Filter rows [start, end), appending the indices of the rows which pass to sel (which has room for end - start
+entries). Returns the number of rows selected.
+*/
+static npy_intp filter_rows(const column_t *cols, int nCols, npy_intp start, npy_intp end, npy_intp *sel)
+{
+    uint8_t mask[BLOCK_SIZE];
+    uint64_t word;
+    npy_intp b, i, j, n, nSel = 0;
+    int c, any;
+
+    for (b = start; b < end; b += BLOCK_SIZE)
+    {
+        n = MIN(BLOCK_SIZE, end - b);
+        memset(mask, 1, n);
+
+        for (c = 0; c < nCols; c++)
+        {
+            and_range(&cols[c], b, n, mask);
+
+            any = 0;
+            for (i = 0; i < n; i++) any |= mask[i];
+            if (!any) break;
+        }
+
+        if (c < nCols) continue; //nothing left in this block
+
+        //compact the mask, 8 rows at a time (skipping runs where nothing or everything is selected)
+        for (i = 0; i < (n & ~7); i += 8)
+        {
+            memcpy(&word, mask + i, 8);
+            if (word == 0) continue;
+
+            if (word == ALL_SELECTED)
+            {
+                for (j = 0; j < 8; j++) sel[nSel + j] = b + i + j;
+                nSel += 8;
+            } else
+            {
+                for (j = 0; j < 8; j++)
+                {
+                    sel[nSel] = b + i + j;
+                    nSel += mask[i + j];
+                }
+            }
+        }
+
+        for (; i < n; i++)
+        {
+            sel[nSel] = b + i;
+            nSel += mask[i];
+        }
+    }
+
+    return nSel;
+}
+
+static PyObject * range_filter(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oColumns=0, *oLo=0, *oHi=0, *oCol, *res;
+    PyArrayObject *aLo=0, *aHi=0, *aOut=0;
+    PyArrayObject *aCols[MAX_COLUMNS];
+    column_t cols[MAX_COLUMNS];
+    npy_intp start = 0, end = -1, nRows = -1, nSel = 0, dims[1];
+    npy_intp *sel;
+    PyArray_Dims newShape;
+    double *lo, *hi;
+    int nCols = 0, c;
+
+    static char *kwlist[] = {"columns", "lo", "hi", "start", "end", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOO|nn", kwlist, &oColumns, &oLo, &oHi, &start, &end))
+        return NULL;
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_range_filter;\
+        }
+
+    memset(aCols, 0, sizeof(aCols));
+
+    if (!PySequence_Check(oColumns)) ABORT("columns must be a sequence of arrays")
+    nCols = (int) PySequence_Size(oColumns);
+    if ((nCols < 1) || (nCols > MAX_COLUMNS)) ABORT("Expecting between 1 and 64 columns")
+
+    aLo = (PyArrayObject *) PyArray_ContiguousFromObject(oLo, NPY_DOUBLE, 1, 1);
+    aHi = (PyArrayObject *) PyArray_ContiguousFromObject(oHi, NPY_DOUBLE, 1, 1);
+    if ((aLo == NULL) || (aHi == NULL) || (PyArray_DIM(aLo, 0) != nCols) || (PyArray_DIM(aHi, 0) != nCols))
+        ABORT("lo and hi must be 1D arrays with one entry per column")
+
+    lo = (double *) PyArray_DATA(aLo);
+    hi = (double *) PyArray_DATA(aHi);
+
+    for (c = 0; c < nCols; c++)
+    {
+        oCol = PySequence_GetItem(oColumns, c);
+        if (oCol == NULL) goto FINALIZE_range_filter;
+
+        if (PyArray_Check(oCol) && (PyArray_NDIM((PyArrayObject *) oCol) == 1) &&
+            supported_type(PyArray_TYPE((PyArrayObject *) oCol)) && PyArray_ISALIGNED((PyArrayObject *) oCol) &&
+            PyArray_ISNOTSWAPPED((PyArrayObject *) oCol))
+        {
+            //use the column as is (including strided views)
+            aCols[c] = (PyArrayObject *) oCol;
+        } else
+        {
+            //convert anything else (lists, bools, big-endian data, etc ...) to double
+            aCols[c] = (PyArrayObject *) PyArray_ContiguousFromObject(oCol, NPY_DOUBLE, 1, 1);
+            Py_DECREF(oCol);
+            if (aCols[c] == NULL) ABORT("Bad column - expecting a 1D array")
+        }
+
+        if (nRows < 0) nRows = PyArray_DIM(aCols[c], 0);
+        if (PyArray_DIM(aCols[c], 0) != nRows) ABORT("All columns must be the same length")
+
+        cols[c].data = (const char *) PyArray_DATA(aCols[c]);
+        cols[c].stride = PyArray_STRIDE(aCols[c], 0);
+        cols[c].type = PyArray_TYPE(aCols[c]);
+        cols[c].lo = lo[c];
+        cols[c].hi = hi[c];
+    }
+
+    if (end < 0) end = nRows;
+    start = MAX(start, 0);
+    end = MIN(end, nRows);
+
+    //allocate for the worst case (everything selected), and shrink once we know how many rows passed
+    dims[0] = MAX(end - start, 0);
+    aOut = (PyArrayObject *) PyArray_SimpleNew(1, dims, NPY_INTP);
+    if (aOut == NULL) goto FINALIZE_range_filter;
+    sel = (npy_intp *) PyArray_DATA(aOut);
+
+    Py_BEGIN_ALLOW_THREADS;
+    nSel = filter_rows(cols, nCols, start, end, sel);
+    Py_END_ALLOW_THREADS;
+
+    if (nSel < dims[0])
+    {
+        dims[0] = nSel;
+        newShape.ptr = dims;
+        newShape.len = 1;
+        res = PyArray_Resize(aOut, &newShape, 0, NPY_CORDER);
+        if (res == NULL)
+        {
+            Py_DECREF(aOut);
+            aOut = NULL;
+        }
+        Py_XDECREF(res);
+    }
+
+FINALIZE_range_filter:
+    #undef ABORT
+
+    for (c = 0; c < nCols; c++) Py_XDECREF(aCols[c]);
+
+    Py_XDECREF(aLo);
+    Py_XDECREF(aHi);
+
+    return (PyObject *) aOut;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+static PyMethodDef rangeFilterMethods[] = {
+    {"range_filter",  range_filter, METH_VARARGS | METH_KEYWORDS,
+    "Find the rows in [start, end) for which lo[i] < columns[i] < hi[i] for all columns, returning their indices "
+    "(as an intp array).\n Arguments are: 'columns' (a sequence of equal length 1D arrays), 'lo', 'hi' (sequences of "
+    "bounds, one per column), 'start'=0, 'end'=len(columns[0])"},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+#pragma GCC diagnostic pop
+
+#if PY_MAJOR_VERSION>=3
+static struct PyModuleDef moduledef = {
+        PyModuleDef_HEAD_INIT,
+        "rangeFilter",     /* m_name */
+        "fused range filtering for tabular data",  /* m_doc */
+        -1,                  /* m_size */
+        rangeFilterMethods,    /* m_methods */
+        NULL,                /* m_reload */
+        NULL,                /* m_traverse */
+        NULL,                /* m_clear */
+        NULL,                /* m_free */
+    };
+
+PyMODINIT_FUNC PyInit_rangeFilter(void)
+{
+	PyObject *m;
+    m = PyModule_Create(&moduledef);
+    import_array()
+    return m;
+}
+
+#else
+PyMODINIT_FUNC initrangeFilter(void)
+{
+    PyObject *m;
+
+    m = Py_InitModule("rangeFilter", rangeFilterMethods);
+    import_array()
+}
+#endif
@@ -39,6 +39,20 @@ def configuration(parent_package='',top_path=None):
                     extra_compile_args=['-O3', '-fno-exceptions', '-ffast-math', '-march=native', '-mtune=native'],
                     extra_link_args=linkArgs)
     config = Configuration('IO',parent_package,top_path, ext_modules=cythonize([ext]))
+    
+    #NB - no -ffast-math, as rows with NaNs must fail the range tests
+    config.add_extension('rangeFilter',
+        sources=['rangeFilter.c'],
+        include_dirs = [get_numpy_include_dirs()],
+        extra_compile_args = ['-O3', '-fno-exceptions'],
+        extra_link_args=linkArgs)
+    
+    config.add_extension('idFilter',
+        sources=['idFilter.c'],
+        include_dirs = [get_numpy_include_dirs()],
+        extra_compile_args = ['-O3', '-fno-exceptions'],
+        extra_link_args=linkArgs)
+    
     config.add_subpackage('FileUtils')
     config.add_subpackage('DataSources')
     config.add_subpackage('countdir')
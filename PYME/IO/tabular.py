@@ -27,6 +27,10 @@ routines expect at least 'x' and 'y' to be defined as keys, and may also
 understand additional values, e.g. 'error_x' 
 """
 import types
+import ast
+import weakref
+import collections
+import itertools
 import six
 import warnings
 import numpy as np
@@ -36,9 +40,31 @@ from PYME.Analysis.piecewise import * #allow piecewise linear mappings
 
 import tables
 import logging
+import threading
+import multiprocessing
+
+from PYME.util.threaded import run_threaded
 
 logger = logging.getLogger(__name__)
 
+try:
+    from PYME.IO import rangeFilter as _rangeFilter
+except ImportError:
+    logger.debug('Could not import native range filter, falling back to numpy')
+    _rangeFilter = None
+
+try:
+    from PYME.IO import idFilter as _idFilter
+except ImportError:
+    logger.debug('Could not import native id filter, falling back to numpy')
+    _idFilter = None
+
+#don't bother splitting the filtering between threads for less than this many rows per thread
+_MIN_ROWS_PER_THREAD = 1 << 18
+
+#block size for the numpy fallback (bounds the size of temporaries)
+_FILTER_BLOCK_SIZE = 1 << 16
+
 #helper function for renaming classes
 
 def deprecated_name(name):
@@ -54,7 +80,39 @@ def deprecated_name(name):
     
     return _dec
 
+# source tokens and versions (see TabularBase._state) are drawn from one counter, so are never re-used
+_state_counter = itertools.count(1)
+
 class TabularBase(object):
+    # set on sources which call mark_changed() whenever they are modified through their own methods. Results derived
+    # from a source are only memoised (see MappingFilter) if it, and every source it is derived from, is versioned.
+    _versioned = False
+    # updated whenever the data changes (see mark_changed)
+    _version = 0
+    
+    def mark_changed(self):
+        """
+        Note that the data in this source has changed, so that memoised results derived from it (see
+        :class:`MappingFilter`) are recalculated. Sources call this themselves when modified through their own methods -
+        call it if you modify a column in place.
+        """
+        self._version = next(_state_counter)
+        
+    def _state(self):
+        """
+        A token for the current state of this source - a (source token, version) tuple, or None if the source is not
+        versioned. Unlike id(), the source token is not re-used once the source is freed.
+        """
+        if not self._versioned:
+            return None
+        
+        # NB - use the instance dict directly, as some sources look up unknown attributes as columns
+        token = self.__dict__.get('_state_token', None)
+        if token is None:
+            token = self.__dict__['_state_token'] = next(_state_counter)
+            
+        return (token, self._version)
+    
     def toDataFrame(self, keys=None):
         import pandas as pd
         if keys is None:
@@ -288,9 +346,77 @@ def unnest_dtype(dtype, parent=''):
         # otherwise just return the description
         return dt
 
+class ZoneMap(object):
+    """
+    Per-block minimum and maximum values ("zone maps") for the columns of a tabular data source. These let range
+    filters skip whole blocks of rows which can't match (or accept blocks which match entirely) without looking at the
+    individual rows, and are most effective for columns which are (roughly) sorted, such as the time index of fit
+    results.
+
+    The summary for a column is calculated the first time it is used, and extended when rows are appended to the
+    source (see :meth:`extend`).
+    """
+    block_size = 4096
+
+    def __init__(self, source):
+        self._source = source
+        self._stats = {}
+        self._n_rows = {}
+
+    def _summarise(self, col):
+        starts = np.arange(0, len(col), self.block_size)
+        if len(starts) == 0:
+            return np.zeros(0, col.dtype), np.zeros(0, col.dtype), np.zeros(0, dtype=bool)
+
+        if col.dtype.kind == 'f':
+            has_nan = np.logical_or.reduceat(np.isnan(col), starts)
+        else:
+            has_nan = np.zeros(len(starts), dtype=bool)
+
+        # fmin/fmax ignore NaNs (unless a block is all NaN)
+        return np.fmin.reduceat(col, starts), np.fmax.reduceat(col, starts), has_nan
+
+    def block_stats(self, key):
+        """
+        Returns
+        -------
+        (mins, maxs, has_nan) : per-block minimum and maximum values, and whether each block contains NaNs, or None if
+                                the column can't be summarised (e.g. it is not numeric)
+        """
+        n = len(self._source)
+        if (not key in self._stats) or self._n_rows[key] != n:
+            col = np.asarray(self._source[key])
+            if col.ndim == 1 and col.dtype.kind in 'fiu':
+                self._stats[key] = self._summarise(col)
+            else:
+                self._stats[key] = None
+
+            self._n_rows[key] = n
+
+        return self._stats[key]
+
+    def extend(self):
+        """Update the summaries after rows have been appended to the source (the existing rows must be unchanged)"""
+        n = len(self._source)
+        for key, stats in list(self._stats.items()):
+            n_old = self._n_rows[key]
+            if stats is None or n_old == n:
+                continue
+
+            # re-summarise from the last (partial) block
+            first = n_old // self.block_size
+            new = self._summarise(np.asarray(self._source[key])[(first*self.block_size):])
+            self._stats[key] = tuple([np.concatenate((s[:first], ns)) for s, ns in zip(stats, new)])
+            self._n_rows[key] = n
+
+
 @deprecated_name('fitResultsSource')
 class FitResultsSource(TabularBase):
     _name = "recarrayfi Source"
+    _versioned = True
+    _sort = True
+    _zone_map = None
+    
     def __init__(self, fitResults, sort=True):
         self.setResults(fitResults, sort=sort)
         
@@ -305,6 +431,8 @@ class FitResultsSource(TabularBase):
         
     def setResults(self, fitResults, sort=True):
         self.fitResults = fitResults
+        self._sort = sort
+        self._zone_map = None
 
         if sort:
             #sort by time
@@ -317,9 +445,37 @@ class FitResultsSource(TabularBase):
         
         #or shorter aliases
         self._set_transkeys()
+        self.mark_changed()
         
 
 
+    def appendResults(self, newResults):
+        """
+        Append fit results. If the new results all come after the existing ones (the usual case when results arrive
+        during analysis), the zone map is updated incrementally rather than rebuilt.
+        """
+        if (self._sort and len(self.fitResults) > 0 and len(newResults) > 0 and
+                newResults['tIndex'].min() < self.fitResults['tIndex'][-1]):
+            # new results are interleaved with the old ones - resort everything
+            self.setResults(np.concatenate((self.fitResults, newResults)), sort=True)
+            return
+
+        if self._sort:
+            newResults = np.sort(newResults, order='tIndex')
+
+        self.fitResults = np.concatenate((self.fitResults, newResults))
+        if self._zone_map is not None:
+            self._zone_map.extend()
+            
+        self.mark_changed()
+
+    @property
+    def zone_map(self):
+        if self._zone_map is None:
+            self._zone_map = ZoneMap(self)
+
+        return self._zone_map
+
     def keys(self):
         return self._keys + list(self.transkeys.keys())
 
@@ -737,9 +893,263 @@ class ColumnSource(DictSource):
 # Filters (which remap existing data sources)
 #############################################
 
+def range_selection(resultsSource, ranges, nThreads=None):
+    """
+    Find the rows of a tabular data source for which lo < value < hi for every key in `ranges`.
+
+    All the ranges are tested together in a single pass over the data (split between threads for large tables), so no
+    full length temporaries are created.
+
+    Parameters
+    ----------
+    resultsSource : TabularBase
+    ranges : dict
+        {key : (lo, hi)} pairs
+    nThreads : int, optional
+        number of threads to use (defaults to the number of CPUs)
+
+    Returns
+    -------
+    ndarray : the (integer) indices of the selected rows
+    """
+    keys = list(ranges.keys())
+    for k in keys:
+        if not k in resultsSource.keys():
+            raise KeyError('Requested key not present: ' + k)
+
+        if not len(ranges[k]) == 2:
+            raise RuntimeError('Expected an iterable of length 2')
+
+    # look through mapping filters if none of our keys are re-mapped (the rows are the same)
+    s = resultsSource
+    while isinstance(s, MappingFilter) and not any([(k in s.mappings or k in s.new_columns) for k in keys]):
+        s = s.resultsSource
+
+    if isinstance(s, ConcatenateFilter):
+        return s._range_selection(ranges, nThreads)
+
+    n = len(resultsSource)
+    if len(keys) == 0:
+        return np.arange(n)
+
+    columns = [np.asarray(_get_column(resultsSource, k)) for k in keys]
+    lo = np.array([ranges[k][0] for k in keys], 'f8')
+    hi = np.array([ranges[k][1] for k in keys], 'f8')
+
+    # use block summaries (if we have them) to skip blocks which can't match, and accept blocks which match entirely
+    segments = _candidate_segments(resultsSource, keys, lo, hi, n)
+
+    n_test = sum([end - start for start, end, test in segments if test])
+    if nThreads is None:
+        nThreads = multiprocessing.cpu_count()
+
+    nThreads = max(min(nThreads, n_test // _MIN_ROWS_PER_THREAD), 1) if _rangeFilter is not None else 1
+
+    # split the rows we need to test into roughly equal pieces, one per thread
+    piece_size = max(int(np.ceil(n_test / float(nThreads))), 1)
+    pieces = []
+    for start, end, test in segments:
+        if test:
+            pieces.extend([(s, min(s + piece_size, end), True) for s in range(start, end, piece_size)])
+        else:
+            pieces.append((start, end, False))
+
+    selections = [np.arange(start, end) if not test else None for start, end, test in pieces]
+    to_test = [i for i, (start, end, test) in enumerate(pieces) if test]
+
+    def _filter(offset):
+        for i in to_test[offset::nThreads]:
+            start, end, test = pieces[i]
+            if _rangeFilter is not None:
+                selections[i] = _rangeFilter.range_filter(columns, lo, hi, start, end)
+            else:
+                selections[i] = _range_filter_numpy(columns, lo, hi, start, end)
+
+    run_threaded(_filter, range(nThreads))
+
+    return np.concatenate([np.zeros(0, np.intp)] + selections).astype(np.intp, copy=False)
+
+
+def _bound(column, value):
+    # compare floating point columns at their own precision (as the native filter does)
+    dtype = np.asarray(column[:0]).dtype
+    return dtype.type(value) if dtype.kind == 'f' else value
+
+
+def _range_filter_numpy(columns, lo, hi, start, end):
+    """numpy fallback for the native range filter - test a block at a time to keep the temporaries small"""
+    selections = [np.zeros(0, np.intp)]
+    for b in range(start, end, _FILTER_BLOCK_SIZE):
+        b_end = min(b + _FILTER_BLOCK_SIZE, end)
+        mask = np.ones(b_end - b, dtype=bool)
+        for c, l, h in zip(columns, lo, hi):
+            cb = np.asarray(c[b:b_end])
+            mask &= (cb > _bound(cb, l)) & (cb < _bound(cb, h))
+
+        selections.append(np.flatnonzero(mask) + b)
+
+    return np.concatenate(selections)
+
+
+def _integral_ids(ids):
+    """the ids as a 1D int64 array, or None if they can't be used with the native id filter"""
+    ids = np.asarray(ids).ravel()
+    if ids.dtype.kind in 'iu':
+        if ids.dtype == np.uint64 and len(ids) > 0 and ids.max() > np.iinfo(np.int64).max:
+            return None
+        return ids.astype(np.int64, copy=False)
+    
+    if ids.dtype.kind == 'f' and np.all(np.isfinite(ids)) and np.all(np.abs(ids) < 2**62) and np.all(ids == np.floor(ids)):
+        return ids.astype(np.int64)
+    
+    return None
+
+
+def _id_scan(column, ids, native_func, numpy_func, nThreads, membership_only=False):
+    """split an id lookup between threads, returning the results for each piece of the column"""
+    column = np.asarray(column)
+    n = len(column)
+    native_ids = _integral_ids(ids) if (_idFilter is not None and column.ndim == 1 and column.dtype.kind in 'iuf') else None
+    
+    if native_ids is None:
+        return [numpy_func(column, np.asarray(ids).ravel())]
+    
+    if nThreads is None:
+        nThreads = multiprocessing.cpu_count()
+
+    nThreads = max(min(nThreads, n // _MIN_ROWS_PER_THREAD), 1)
+    piece_size = max(int(np.ceil(n / float(nThreads))), 1)
+    starts = list(range(0, n, piece_size)) or [0]
+    results = [None]*len(starts)
+    
+    # build the lookup table once, and share it between the threads
+    table = _idFilter.id_table(native_ids, membership_only=int(membership_only))
+    
+    def _scan(i):
+        results[i] = native_func(column, table, starts[i], starts[i] + piece_size)
+    
+    run_threaded(_scan, range(len(starts)))
+            
+    return results
+
+
+def id_selection(column, ids, nThreads=None):
+    """
+    Find the rows of a column whose value is one of `ids`.
+    
+    The ids are put in a lookup table (a dense array if they are compact, otherwise a hash table) so that each row
+    needs a single lookup, rather than a comparison against each id.
+    
+    Parameters
+    ----------
+    column : ndarray
+        the column to test (e.g. clumpIndex or objectID). Floating point values only match if they are integers.
+    ids : array_like
+        the ids to select
+    nThreads : int, optional
+        number of threads to use (defaults to the number of CPUs)
+
+    Returns
+    -------
+    ndarray : the (integer) indices of the selected rows
+    """
+    selections = _id_scan(column, ids, getattr(_idFilter, 'id_filter', None),
+                          lambda c, ids: np.flatnonzero(np.isin(c, ids)), nThreads, membership_only=True)
+    
+    return np.concatenate([np.zeros(0, np.intp)] + selections).astype(np.intp, copy=False)
+
+
+def _id_lookup_numpy(column, ids):
+    if len(ids) == 0:
+        return -np.ones(len(column), np.int64)
+    
+    order = np.argsort(ids, kind='mergesort') #stable, so that we find the first of any repeated ids
+    sorted_ids = ids[order]
+    pos = np.minimum(np.searchsorted(sorted_ids, column), len(ids) - 1)
+    return np.where(sorted_ids[pos] == column, order[pos], -1).astype(np.int64)
+
+
+def id_lookup(column, ids, nThreads=None):
+    """
+    Find the position of each row's value in `ids`, for joining tables on an id column (e.g. looking up per-clump or
+    per-object measurements for each localisation with ``measurements[key][idx]``).
+    
+    Parameters
+    ----------
+    column : ndarray
+        the id column (e.g. clumpIndex or objectID). Floating point values only match if they are integers.
+    ids : array_like
+        the ids of the table being joined to
+    nThreads : int, optional
+        number of threads to use (defaults to the number of CPUs)
+
+    Returns
+    -------
+    ndarray : an int64 array, the same length as column, giving the index of each row's value in ids (the first, if an
+              id is repeated) or -1 if it is not present.
+    """
+    return np.concatenate([np.zeros(0, np.int64)] + _id_scan(column, ids, getattr(_idFilter, 'id_index', None),
+                                                             _id_lookup_numpy, nThreads))
+
+
+def _find_zone_map(source, key):
+    """find the zone map (if any) which covers a given key, looking through mapping filters for keys they pass on
+    unchanged"""
+    while isinstance(source, MappingFilter):
+        if key in source.mappings or key in source.new_columns:
+            return None
+        source = source.resultsSource
+
+    if isinstance(source, FitResultsSource):
+        return source.zone_map
+
+    return None
+
+
+def _candidate_segments(resultsSource, keys, lo, hi, n):
+    """
+    Use zone maps to find the rows which might satisfy a set of range filters.
+
+    Returns
+    -------
+    segments : list of (start, end, test) tuples
+        row ranges which need to be tested (test=True), or which are known to pass (test=False)
+    """
+    stats = []
+    for k in keys:
+        zm = _find_zone_map(resultsSource, k)
+        stats.append(zm.block_stats(k) if zm is not None else None)
+
+    if all([st is None for st in stats]) or n == 0:
+        return [(0, n, True)]
+
+    n_blocks = int(np.ceil(n / float(ZoneMap.block_size)))
+    skip = np.zeros(n_blocks, dtype=bool)
+    accept = np.ones(n_blocks, dtype=bool)
+
+    for st, l, h in zip(stats, lo, hi):
+        if st is None:
+            accept[:] = False
+            continue
+
+        mins, maxs, has_nan = st
+        l, h = _bound(mins, l), _bound(mins, h)
+        # NB - comparisons are written so that blocks which are entirely NaN are skipped
+        skip |= ~(maxs > l) | ~(mins < h)
+        accept &= (mins > l) & (maxs < h) & ~has_nan
+
+    # 0 = skip, 1 = accept, 2 = test
+    status = np.where(skip, 0, np.where(accept, 1, 2))
+    run_starts = np.hstack([[0], np.flatnonzero(np.diff(status)) + 1])
+    run_ends = np.hstack([run_starts[1:], [n_blocks]])
+
+    bs = ZoneMap.block_size
+    return [(int(s*bs), int(min(e*bs, n)), status[s] == 2) for s, e in zip(run_starts, run_ends) if status[s] > 0]
+
 
 class SelectionFilter(TabularBase):
     _name = "Selection Filter"
+    _versioned = True
     
     def __init__(self, resultsSource, index):
         """ A filter which relies on a supplied index (either integer or boolean)"""
@@ -748,9 +1158,46 @@ class SelectionFilter(TabularBase):
         
         self.Index = index
     
+    @property
+    def Index(self):
+        """The index, as supplied. Filters which work from a selection vector create a boolean mask on demand."""
+        if self._index is None:
+            self._index = np.zeros(len(self.resultsSource), dtype=bool)
+            self._index[self._selection] = True
+            
+        return self._index
+    
+    @Index.setter
+    def Index(self, index):
+        self._index = index
+        self._selection = None
+        self.mark_changed()
+    
+    @property
+    def selection(self):
+        """The integer indices of the selected rows"""
+        if self._selection is None:
+            index = np.asarray(self._index)
+            self._selection = np.flatnonzero(index) if index.dtype == bool else index
+            
+        return self._selection
+    
+    def _set_selection(self, selection):
+        self._selection = selection
+        self._index = None
+        self.mark_changed()
+    
     def __getitem__(self, keys):
         key, sl = self._getKeySlice(keys)
-        return self.resultsSource[key][self.Index][sl]
+        #only gather the rows we need
+        col = _get_column(self.resultsSource, key)
+        if not isinstance(col, ChunkedColumn):
+            col = np.asarray(col)
+            
+        return col[self.selection[sl]]
+    
+    def __len__(self):
+        return len(self.selection)
     
     def keys(self):
         return list(self.resultsSource.keys())
@@ -773,19 +1220,7 @@ class ResultsFilter(SelectionFilter):
 
         self.resultsSource = resultsSource
 
-        #by default select everything
-        #self.Index = np.ones(self.resultsSource[list(resultsSource.keys())[0]].shape[0]) >  0.5
-        self.Index = np.ones(len(self.resultsSource), dtype=np.bool)
-
-        for k in kwargs.keys():
-            if not k in self.resultsSource.keys():
-                raise KeyError('Requested key not present: ' + k)
-
-            range = kwargs[k]
-            if not len(range) == 2:
-                raise RuntimeError('Expected an iterable of length 2')
-
-            self.Index *= (self.resultsSource[k] > range[0])*(self.resultsSource[k] < range[1])
+        self._set_selection(range_selection(self.resultsSource, kwargs))
     
 
 @deprecated_name('randomSelectionFilter')
@@ -816,14 +1251,8 @@ class IdFilter(SelectionFilter):
     _name = "Id Filter"
     
     def __init__(self, resultsSource, id_column, valid_ids):
-        """Class to permit filtering of fit results - masquarades
-        as a dictionary. Takes item ranges as keyword arguments, eg:
-        f = resultsFliter(source, x=[0,10], error_x=[0,5]) will return
-        an object that behaves like source, but with only those points with
-        an x value in the range [0, 10] and a x error in the range [0, 5].
-
-        The filter class does not have any explicit knowledge of the keys
-        supported by the underlying data source."""
+        """Filter a tabular data source, keeping only those rows where the value of `id_column` (e.g. clumpIndex or
+        objectID) is one of `valid_ids`. See :func:`id_selection`."""
         
         if not isinstance(resultsSource, TabularBase):
             raise TypeError('Expecting a tabular object for resultsSource')
@@ -832,41 +1261,207 @@ class IdFilter(SelectionFilter):
         self.id_column = id_column
         self.valid_ids = valid_ids
         
-        #self.Index = np.zeros(self.resultsSource[list(resultsSource.keys())[0]].shape)
-        self.Index = np.zeros(len(self.resultsSource))
-        
-        for id in valid_ids:
-            self.Index += (self.resultsSource[id_column] == id)
-            
-            
+        self._set_selection(id_selection(self.resultsSource[id_column], valid_ids))
+
+
+def _read_only(a):
+    """A read-only view of an array"""
+    a = a.view()
+    a.flags.writeable = False
+    return a
+
+
+class ChunkedColumn(object):
+    """
+    A column made up of a list of segments (e.g. the columns of several concatenated tables). The segments are not
+    copied into a single array until one is explicitly asked for (with :meth:`to_array` or `np.asarray`). Indexing with
+    slices or (integer or boolean) index arrays only touches the segments which are needed.
+    
+    Where a result comes from a single segment it is returned as a read-only view of that segment rather than a copy
+    (so that it can't be used to modify the source table).
+    """
+    def __init__(self, segments):
+        self.segments = []
+        for seg in segments:
+            if isinstance(seg, ChunkedColumn):
+                self.segments.extend(seg.segments)
+            else:
+                self.segments.append(np.asarray(seg))
+
+        self.offsets = np.cumsum([0] + [len(seg) for seg in self.segments])
+
+    def __len__(self):
+        return int(self.offsets[-1])
+
+    @property
+    def dtype(self):
+        if len(self.segments) == 0:
+            return np.dtype('f8')
+        return np.result_type(*self.segments)
+
+    @property
+    def shape(self):
+        return (len(self),) + (self.segments[0].shape[1:] if len(self.segments) > 0 else ())
+
+    @property
+    def ndim(self):
+        return len(self.shape)
+
+    def to_array(self):
+        """Copy the segments into a single array (or return a read-only view if there is only one)"""
+        if len(self.segments) == 1:
+            return _read_only(self.segments[0])
+        elif len(self.segments) == 0:
+            return np.zeros(0, self.dtype)
+
+        return np.concatenate(self.segments)
+
+    def __array__(self, dtype=None):
+        a = self.to_array()
+        if dtype is not None:
+            a = a.astype(dtype, copy=False)
+        return a
+
+    def take(self, indices):
+        """Gather rows from the segments"""
+        indices = np.asarray(indices, dtype=np.intp)
+        n = len(self)
+        if len(indices) > 0:
+            # check bounds up front - rows for out of bounds indices would otherwise be left uninitialised
+            lo, hi = indices.min(), indices.max()
+            if lo < -n or hi >= n:
+                raise IndexError('index %d is out of bounds for column of length %d' % (lo if lo < -n else hi, n))
             
-        self.Index = self.Index > 0.5
+            if lo < 0:
+                indices = indices + n*(indices < 0)
+
+        out = np.empty((len(indices),) + self.shape[1:], self.dtype)
+        if len(indices) > 0 and np.all(indices[1:] >= indices[:-1]):
+            # sorted indices (as is usual for selections) - each segment's rows are contiguous in the output
+            bounds = np.searchsorted(indices, self.offsets)
+            for seg, offset, a, b in zip(self.segments, self.offsets, bounds[:-1], bounds[1:]):
+                out[a:b] = seg[indices[a:b] - offset]
+        else:
+            seg_idx = np.searchsorted(self.offsets, indices, 'right') - 1
+            for i, (seg, offset) in enumerate(zip(self.segments, self.offsets)):
+                m = seg_idx == i
+                out[m] = seg[indices[m] - offset]
+
+        return out
+
+    def __getitem__(self, sl):
+        if isinstance(sl, slice):
+            start, stop, step = sl.indices(len(self))
+            if step != 1:
+                return self.take(np.arange(start, stop, step))
+
+            pieces = []
+            for seg, offset in zip(self.segments, self.offsets):
+                a, b = max(start - offset, 0), min(stop - offset, len(seg))
+                if b > a:
+                    pieces.append(seg[a:b])
+
+            if len(pieces) == 1:
+                return _read_only(pieces[0])
+            return ChunkedColumn(pieces).to_array()
+
+        if isinstance(sl, (int, np.integer)):
+            i = int(sl) + (len(self) if sl < 0 else 0)
+            if not 0 <= i < len(self):
+                raise IndexError('index %d is out of bounds for column of length %d' % (sl, len(self)))
+            seg = int(np.searchsorted(self.offsets, i, 'right')) - 1
+            return self.segments[seg][i - self.offsets[seg]]
+
+        indices = np.asarray(sl)
+        if indices.dtype == bool:
+            indices = np.flatnonzero(indices)
+
+        return self.take(indices)
+
+
+def _get_column(source, key):
+    """
+    Get a column, without copying the columns of concatenated sources into a single array (a :class:`ChunkedColumn` is
+    returned instead). Mapping filters are looked through for keys they don't re-map.
+    """
+    s = source
+    while isinstance(s, MappingFilter) and not (key in s.mappings or key in s.new_columns):
+        s = s.resultsSource
+
+    if isinstance(s, ConcatenateFilter):
+        return s.column(key)
+
+    return source[key]
 
 
 @deprecated_name('concatenateFilter')
 class ConcatenateFilter(TabularBase):
     _name = "Concatenation Filter"
+    # has no state of its own, other than its sources
+    _versioned = True
 
-    def __init__(self, source0, source1):
-        """Class which concatenates two tabular data sources. The data sources should have the same keys.
+    def __init__(self, source0, source1, *sources):
+        """Class which concatenates two (or more) tabular data sources. The data sources should have the same keys.
+        An additional 'concatSource' column gives the index of the source each row came from.
+        
+        Columns are held as a list of segments (see :meth:`column`), and are only copied into a single array when
+        accessed with __getitem__. Filters on a concatenation work through the segments directly.
 
         The filter class does not have any explicit knowledge of the keys
         supported by the underlying data source."""
 
-        self.source0 = source0
-        self.source1 = source1
+        self.sources = [source0, source1] + list(sources)
+        self._concat_source = None
 
+    @property
+    def source0(self):
+        return self.sources[0]
+
+    @property
+    def source1(self):
+        return self.sources[1]
+
+    def column(self, key):
+        """Get a column as a ChunkedColumn (without copying)"""
+        if key == 'concatSource':
+            lengths = tuple([len(s) for s in self.sources])
+            if self._concat_source is None or self._concat_source[0] != lengths:
+                self._concat_source = (lengths, ChunkedColumn([np.broadcast_to(np.float64(i), (n,))
+                                                               for i, n in enumerate(lengths)]))
+            return self._concat_source[1]
+
+        return ChunkedColumn([_get_column(s, key) for s in self.sources])
 
     def __getitem__(self, keys):
         key, sl = self._getKeySlice(keys)
-        if key == 'concatSource':
-            return np.hstack((np.zeros(len(self.source0[list(self.source0.keys())[0]])), np.ones(len(self.source1[list(self.source1.keys())[0]]))))
-        else:
-            return np.hstack((self.source0[key], self.source1[key]))[sl]
+        if isinstance(sl, slice) and sl == slice(None):
+            return self.column(key).to_array()
+
+        return self.column(key)[sl]
+
+    def __len__(self):
+        return sum([len(s) for s in self.sources])
+
+    def _range_selection(self, ranges, nThreads=None):
+        """filter each source separately (so that e.g. their zone maps get used)"""
+        ranges = dict(ranges)
+        concat_range = ranges.pop('concatSource', None)
+
+        selections = [np.zeros(0, np.intp)]
+        offset = 0
+        for i, s in enumerate(self.sources):
+            if concat_range is None or (concat_range[0] < i < concat_range[1]):
+                selections.append(range_selection(s, ranges, nThreads) + offset)
+            offset += len(s)
+
+        return np.concatenate(selections)
 
     def keys(self):
-        s1_keys = self.source1.keys()
-        return list(set(['concatSource', ] + [k for k in self.source0.keys() if k in s1_keys]))
+        common = set(self.sources[0].keys())
+        for s in self.sources[1:]:
+            common.intersection_update(s.keys())
+
+        return list(common.union(['concatSource', ]))
 
 @deprecated_name('cachingResultsFilter')
 class CachingResultsFilter(TabularBase):
@@ -887,28 +1482,30 @@ class CachingResultsFilter(TabularBase):
         self.resultsSource = resultsSource
         self.cache = {}
 
-        #by default select everything
-        self.Index = np.ones(len(self.resultsSource), dtype=np.bool)
-
-        for k in kwargs.keys():
-            if not k in self.resultsSource.keys():
-                raise KeyError('Requested key not present: ' + k)
-
-            range = kwargs[k]
-            if not len(range) == 2:
-                raise RuntimeError('Expected an iterable of length 2')
-
-            self.Index *= (self.resultsSource[k] > range[0])*(self.resultsSource[k] < range[1])
-
+        self.selection = range_selection(self.resultsSource, kwargs)
+        
+    @property
+    def Index(self):
+        """boolean mask of the selected rows"""
+        index = np.zeros(len(self.resultsSource), dtype=bool)
+        index[self.selection] = True
+        return index
 
     def __getitem__(self, keys):
         key, sl = self._getKeySlice(keys)
         if key in self.cache.keys():
             return self.cache[key][sl]
         else:
-            res = np.array(self.resultsSource[key])[self.Index]
+            col = _get_column(self.resultsSource, key)
+            if not isinstance(col, ChunkedColumn):
+                col = np.asarray(col)
+            
+            res = col[self.selection]
             self.cache[key] = res
             return res[sl]
+    
+    def __len__(self):
+        return len(self.selection)
 
     def keys(self):
         return list(self.resultsSource.keys())
@@ -917,9 +1514,176 @@ class CachingResultsFilter(TabularBase):
     def mdh(self):
         return self.resultsSource.mdh
 
+# functions which can be safely evaluated a chunk of rows at a time in mappings
+_ELEMENTWISE_FUNCTIONS = {'abs', 'absolute', 'sqrt', 'square', 'exp', 'expm1', 'log', 'log10', 'log2', 'log1p', 'power',
+                          'sin', 'cos', 'tan', 'arcsin', 'arccos', 'arctan', 'arctan2', 'sinh', 'cosh', 'tanh', 'hypot',
+                          'deg2rad', 'rad2deg', 'degrees', 'radians', 'floor', 'ceil', 'rint', 'round', 'sign', 'mod',
+                          'fmod', 'minimum', 'maximum', 'fmin', 'fmax', 'clip', 'where', 'isnan', 'isfinite', 'isinf',
+                          'logical_and', 'logical_or', 'logical_not', 'logical_xor', 'float32', 'float64', 'int32',
+                          'int64', 'float', 'int'}
+
+_ELEMENTWISE_NODES = tuple([getattr(ast, n) for n in ['Expression', 'Name', 'Load', 'Constant', 'Num', 'NameConstant',
+                                                       'BinOp', 'UnaryOp', 'Compare', 'operator', 'unaryop', 'cmpop',
+                                                       'Call', 'Attribute', 'keyword'] if hasattr(ast, n)])
+
+#rows per chunk when evaluating mappings (sized so that the temporaries stay in cache)
+_MAPPING_CHUNK_SIZE = 1 << 16
+
+#which compiled mappings can be evaluated chunk by chunk (keyed by code object)
+_elementwise_mappings = weakref.WeakKeyDictionary()
+
+
+def _is_elementwise(tree):
+    """
+    Check whether an expression only uses arithmetic, comparisons and element-wise numpy functions, and can therefore be
+    evaluated a chunk of rows at a time.
+    """
+    for node in ast.walk(tree):
+        if not isinstance(node, _ELEMENTWISE_NODES):
+            return False
+
+        if isinstance(node, ast.Compare) and len(node.ops) > 1:
+            return False
+
+        if isinstance(node, ast.Attribute) and not (isinstance(node.value, ast.Name) and node.value.id in ['np', 'numpy']):
+            return False
+
+        if isinstance(node, ast.Call):
+            f = node.func
+            name = f.attr if isinstance(f, ast.Attribute) else getattr(f, 'id', None)
+            if not name in _ELEMENTWISE_FUNCTIONS:
+                return False
+
+    return True
+
+
+def compile_mapping(mapping):
+    """
+    Compile a mapping expression to a code object, recording whether it can be evaluated in chunks
+    """
+    code = compile(mapping, '/tmp/test1', 'eval')
+    try:
+        _elementwise_mappings[code] = _is_elementwise(ast.parse(mapping, mode='eval'))
+    except TypeError:
+        # code objects not weak-referenceable on this python - evaluate everything whole
+        pass
+
+    return code
+
+
+def _source_state(source):
+    """
+    A token which changes when a tabular source, or any of the sources it is derived from, changes (as signalled with
+    :meth:`TabularBase.mark_changed`). None if any of these sources is not versioned, in which case results derived
+    from the source should not be memoised.
+    """
+    state = source._state() if isinstance(source, TabularBase) else None
+    if state is None:
+        return None
+    
+    state = [state]
+    
+    # NB - look in the instance dict rather than using getattr, which would try and find a column of the same name
+    attrs = vars(source)
+    parents = list(attrs.get('sources', []))
+    if attrs.get('resultsSource', None) is not None:
+        parents.append(attrs['resultsSource'])
+        
+    for parent in parents:
+        parent_state = _source_state(parent)
+        if parent_state is None:
+            return None
+        
+        state.extend(parent_state)
+        
+    return tuple(state)
+
+
+class _Constant(object):
+    """
+    A constant used by a mapping, as recorded in a memo signature. Scalars compare by value, anything else (e.g.
+    arrays) by identity - the reference held here stops the identity being re-used.
+    """
+    __slots__ = ['value']
+    
+    def __init__(self, value):
+        self.value = value
+        
+    def __eq__(self, other):
+        if np.isscalar(self.value) and np.isscalar(other.value):
+            return (type(self.value) is type(other.value)) and bool(self.value == other.value)
+        
+        return self.value is other.value
+    
+    def __ne__(self, other):
+        return not self.__eq__(other)
+
+
+class _MappingCache(object):
+    """
+    Memoised mapping results, shared by all MappingFilter instances so that the total memory used is bounded (by the
+    'tabular-mapping-cache-mb' config option). The least recently used results are dropped first.
+    """
+    def __init__(self):
+        self._results = collections.OrderedDict()
+        self._nbytes = 0
+        self._max_bytes = None
+        self._lock = threading.Lock()
+        
+    @property
+    def max_bytes(self):
+        if self._max_bytes is None:
+            from PYME import config
+            self._max_bytes = int(config.get('tabular-mapping-cache-mb', 256)*1024*1024)
+            
+        return self._max_bytes
+        
+    def get(self, key, signature):
+        with self._lock:
+            try:
+                cached_signature, res = self._results[key]
+            except KeyError:
+                return None
+            
+            if cached_signature != signature:
+                return None
+            
+            # mark as most recently used
+            self._results[key] = self._results.pop(key)
+            return res
+            
+    def put(self, key, signature, res):
+        nbytes = getattr(res, 'nbytes', 0)
+        with self._lock:
+            self._pop(key)
+            if nbytes > self.max_bytes:
+                return
+            
+            self._results[key] = (signature, res)
+            self._nbytes += nbytes
+            
+            while self._nbytes > self.max_bytes:
+                self._pop(next(iter(self._results)))
+                
+    def _pop(self, key):
+        old = self._results.pop(key, None)
+        if old is not None:
+            self._nbytes -= getattr(old[1], 'nbytes', 0)
+            
+    def drop(self, owner):
+        """drop all results for a given MappingFilter (called when it is garbage collected)"""
+        with self._lock:
+            for key in [k for k in self._results.keys() if k[0] == owner]:
+                self._pop(key)
+                
+_mapping_cache = _MappingCache()
+_mapping_filter_ids = itertools.count()
+
+
 @deprecated_name('mappingFilter')
 class MappingFilter(TabularBase):
     _name = "Mapping Filter"
+    _versioned = True
     def __init__(self, resultsSource, **kwargs):
         """Class to permit transformations (e.g. drift correction) of fit results
         - masquarades as a dictionary. Takes mappings as keyword arguments, eg:
@@ -941,6 +1705,10 @@ class MappingFilter(TabularBase):
         self.new_columns = {}
         self.variables = {}
         self.hidden_columns = []
+        
+        # mapping results are memoised in _mapping_cache, keyed by a unique id for this filter
+        self._cache_id = next(_mapping_filter_ids)
+        weakref.finalize(self, _mapping_cache.drop, self._cache_id)
 
         for k in kwargs.keys():
             v = kwargs[k]
@@ -977,10 +1745,13 @@ class MappingFilter(TabularBase):
         #setattr(self, name, float(value))
 
         self.variables[name] = float(value)
+        self.mark_changed()
         
     def set_variables(self, **kwargs):
         for k, v in kwargs.items():
             self.variables[k] = float(v)
+            
+        self.mark_changed()
 
     def addColumn(self, name, values):
         """
@@ -1005,42 +1776,146 @@ class MappingFilter(TabularBase):
         #setattr(self, name, values)
 
         self.new_columns[name] = values
+        self.mark_changed()
 
 
     def setMapping(self, key, mapping):
         if type(mapping) == types.CodeType:
             self.mappings[key] = mapping
         elif isinstance(mapping, six.string_types):
-            self.mappings[key] = compile(mapping, '/tmp/test1', 'eval')
+            self.mappings[key] = compile_mapping(mapping)
         else:
             warnings.warn('setMapping should not be used to add a variable/data column', DeprecationWarning)
             self.__dict__[key] = mapping
+            
+        self.mark_changed()
 
     def getMappedResults(self, key, sl):
-        map = self.mappings[key]
-
-        #get all the variables needed for evaluation into local namespace
-        varnames = map.co_names
-        for vname in varnames:
-            if vname in globals():
-                pass
-            if vname in self.resultsSource.keys(): #look at original results first
-                locals()[vname] = self.resultsSource[vname][sl]
-            elif vname in self.new_columns.keys():
-                locals()[vname] = self.new_columns[vname][sl]
-            elif vname in self.variables.keys():
-                locals()[vname] = self.variables[vname]
-            elif vname in self.__dict__.keys(): #look for constants
-                #FIXME - do we still need this now we have variables
-                locals()[vname] = self.__dict__[vname]
-            elif vname in self.mappings.keys(): #finally try other mappings
-                #try to prevent infinite recursion here if mappings have circular references
-                if not vname == key and not key in self.mappings[vname].co_names:
-                    locals()[vname] = self.getMappedResults(vname, sl)
-                else:
-                    raise RuntimeError('Circular reference detected in mapping')
+        res = self._evaluate(key, [])
+        if np.ndim(res) == 0:
+            # mapping evaluates to a constant
+            return res
+        
+        return res[sl]
+    
+    def _resolve(self, vname, key, stack):
+        """Find the value of a name used in a mapping. Returns None if the name should be looked up in the globals
+        (e.g. numpy functions)."""
+        if vname in self.resultsSource.keys(): #look at original results first
+            return _get_column(self.resultsSource, vname)
+        elif vname in self.new_columns.keys():
+            return self.new_columns[vname]
+        elif vname in self.variables.keys():
+            return self.variables[vname]
+        elif vname in self.__dict__.keys(): #look for constants
+            #FIXME - do we still need this now we have variables
+            return self.__dict__[vname]
+        elif vname in self.mappings.keys(): #finally try other mappings
+            #prevent infinite recursion if mappings have circular references
+            if vname == key or vname in stack:
+                raise RuntimeError('Circular reference detected in mapping')
+            return self._evaluate(vname, stack + [key])
+        
+        return None
+    
+    def _state(self):
+        if not isinstance(self.resultsSource, TabularBase):
+            return None
+        
+        state = TabularBase._state(self)
+        
+        # constants set directly on the filter (see _resolve) are not versioned, so record their values
+        names = set()
+        for code in self.mappings.values():
+            names.update(code.co_names)
+            
+        source_keys = set(self.resultsSource.keys())
+        constants = tuple((vname, _Constant(self.__dict__[vname])) for vname in sorted(names)
+                          if (vname in self.__dict__) and not ((vname in source_keys) or (vname in self.new_columns)
+                                                               or (vname in self.variables)))
+        
+        return state + (constants,)
+    
+    def _evaluate(self, key, stack):
+        """
+        Evaluate a mapping over all rows. Results are memoised, and only recalculated when the mappings, columns,
+        variables or constants of this filter, or the data in the source, change (see
+        :meth:`TabularBase.mark_changed`). The returned array is shared with the cache, and is read-only. Mappings on
+        sources which are not versioned (e.g. DictSource) are not memoised.
+        """
+        code = self.mappings[key]
+        state = _source_state(self)
+        signature = (code, state)
+        
+        if state is not None:
+            res = _mapping_cache.get((self._cache_id, key), signature)
+            if res is not None:
+                return res
+        
+        names = []
+        inputs = []
+        for vname in code.co_names:
+            v = self._resolve(vname, key, stack)
+            if v is not None:
+                names.append(vname)
+                inputs.append(v)
+        
+        res = self._eval_mapping(code, dict(zip(names, inputs)))
+        if isinstance(res, np.ndarray):
+            # a read-only view, so that the memoised result can't be modified (this also covers mappings which return
+            # an input column as is)
+            res = res.view()
+            res.flags.writeable = False
+            
+        if state is not None:
+            _mapping_cache.put((self._cache_id, key), signature, res)
+            
+        return res
+    
+    def _eval_mapping(self, code, local_vars):
+        """Evaluate a mapping, a chunk of rows at a time if it only uses element-wise operations."""
+        n_rows = None
+        for v in local_vars.values():
+            if np.ndim(v) > 0:
+                n_rows = len(v)
+                break
+        
+        if (n_rows is None) or (n_rows <= _MAPPING_CHUNK_SIZE) or not _elementwise_mappings.get(code, False):
+            return eval(code, globals(), self._as_arrays(local_vars))
+        
+        columns = [k for k, v in local_vars.items() if np.ndim(v) > 0 and len(v) == n_rows]
+        local_vars = dict(local_vars)
+        for k in columns:
+            if not isinstance(local_vars[k], ChunkedColumn):
+                # chunked columns are sliced as is
+                local_vars[k] = np.asarray(local_vars[k])
+            
+        chunk_vars = dict(local_vars)
+        out = None
+        for start in range(0, n_rows, _MAPPING_CHUNK_SIZE):
+            end = min(start + _MAPPING_CHUNK_SIZE, n_rows)
+            for k in columns:
+                chunk_vars[k] = local_vars[k][start:end]
+                
+            res = np.asarray(eval(code, globals(), chunk_vars))
+            
+            if out is None:
+                if res.ndim == 0 or res.shape[0] != (end - start):
+                    # not a row-wise result after all
+                    return eval(code, globals(), self._as_arrays(local_vars))
+                out = np.empty((n_rows,) + res.shape[1:], res.dtype)
+            elif res.dtype != out.dtype:
+                # type promotion differs between chunks (e.g. integer overflow)
+                return eval(code, globals(), self._as_arrays(local_vars))
+            
+            out[start:end] = res
+            
+        return out
+    
+    @staticmethod
+    def _as_arrays(local_vars):
+        return {k : (v.to_array() if isinstance(v, ChunkedColumn) else v) for k, v in local_vars.items()}
 
-        return eval(map)
 
 class _ChannelFilter(TabularBase):
     def __init__(self, colour_filter, channel):
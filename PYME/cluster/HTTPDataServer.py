@@ -140,6 +140,7 @@ def updateStatus():
     total, used, free = disk_usage(os.getcwd())
     status['Disk'] = {'total': total, 'used': used, 'free': free}
     status['Uptime'] = str(datetime.datetime.now() - startTime)
+    status['TabularCache'] = _tabularCache.stats()
 
     try:
         import psutil
@@ -211,12 +212,68 @@ class _LimitedSizeDict(OrderedDict):
 _dirCache = _LimitedSizeDict(size_limit=100)
 _dirCacheTimeout = 1
 
+#serve whole files with sendfile() (so the data never passes through user space) if the platform supports it
+USE_SENDFILE = config.get('dataserver-use-sendfile', True)
+
+
+class _SerialisedPartCache(object):
+    """
+    A least recently used cache of serialised (wire format) table parts, bounded by the total size of the cached data.
+    Fit workers and visualisation clients repeatedly request the same chunks of tabular data, and formatting them (e.g.
+    as json) is much more expensive than sending them.
+    """
+    def __init__(self, max_size):
+        self.max_size = max_size
+        self._size = 0
+        self._entries = OrderedDict()
+        self._lock = threading.Lock()
+        self.hits = 0
+        self.misses = 0
+    
+    def get(self, key):
+        with self._lock:
+            try:
+                entry = self._entries.pop(key)
+            except KeyError:
+                self.misses += 1
+                return None
+            
+            self._entries[key] = entry
+            self.hits += 1
+            return entry
+    
+    def put(self, key, wire_data, output_format):
+        if len(wire_data) > self.max_size/4:
+            #don't let a single huge part flush everything else out of the cache
+            return
+            
+        with self._lock:
+            if key in self._entries:
+                return
+            
+            self._entries[key] = (wire_data, output_format)
+            self._size += len(wire_data)
+            
+            while self._size > self.max_size:
+                k, (d, fmt) = self._entries.popitem(last=False)
+                self._size -= len(d)
+    
+    def stats(self):
+        with self._lock:
+            return {'Size': self._size, 'Entries': len(self._entries), 'Hits': self.hits, 'Misses': self.misses}
+
+
+_tabularCache = _SerialisedPartCache(max_size=config.get('dataserver-tabular-cache-mb', 256)*1024*1024)
+
 #_listDirLock = threading.Lock()
 
 from PYME.IO import clusterListing as cl
 
 class PYMEHTTPRequestHandler(http.server.SimpleHTTPRequestHandler):
-    protocol_version = "HTTP/1.0"
+    protocol_version = "HTTP/1.1"
+    # with persistent connections, headers and body are sent in separate writes. Don't let Nagle's algorithm
+    # hold back the body waiting for a (delayed) ACK.
+    disable_nagle_algorithm = True
     bandwidthTesting = False
     timeoutTesting = 0
     logrequests = False
@@ -428,6 +485,10 @@ class PYMEHTTPRequestHandler(http.server.SimpleHTTPRequestHandler):
             self.end_headers()
             return
 
+        if self.path.lstrip('/').startswith('__multiput'):
+            self._put_multi()
+            return
+
         if self.path.lstrip('/').startswith('__aggregate'):
             #paths starting with __aggregate are special, and trigger appends to an existing file rather than creation
             #of a new file.
@@ -440,6 +501,8 @@ class PYMEHTTPRequestHandler(http.server.SimpleHTTPRequestHandler):
 
         if os.path.exists(path):
             #Do not overwrite - we use write-once semantics
+            #we haven't read the request body, so can't re-use the connection
+            self.close_connection = True
             self.send_error(405, "File already exists %s" % path)
 
             #self.end_headers()
@@ -489,6 +552,96 @@ class PYMEHTTPRequestHandler(http.server.SimpleHTTPRequestHandler):
             self.end_headers()
             return
 
+    def _put_multi(self):
+        """
+        Put a batch of files (encoded using PYME.IO.MultiFileFormat) into a directory, e.g. PUT /__multiput/path/to/dir.
+        The write-once semantics of a normal put apply - if any of the files exist, none of them are written.
+        """
+        from PYME.IO import MultiFileFormat
+        
+        dirname = urlparse.urlparse(self.path).path.lstrip('/')[len('__multiput'):].strip('/')
+        files = MultiFileFormat.loads(self._get_data())
+        
+        if any([c.startswith('__') for c in dirname.split('/') + [name for name, data in files]]):
+            # special paths (e.g. __aggregate_h5) need their own handlers, and can't be batched
+            self.send_error(400, "Can't batch puts to special paths %s" % self.path)
+            return
+        
+        paths = [self.translate_path('/'.join([dirname, name])) for name, data in files]
+        
+        for path in paths:
+            if os.path.exists(path):
+                self.send_error(405, "File already exists %s" % path)
+                return
+        
+        for d in set([os.path.dirname(path) for path in paths]):
+            makedirs_safe(d)
+        
+        for path, (name, data) in zip(paths, files):
+            with open(path, 'wb') as f:
+                f.write(data)
+
+            #set the file to read-only (reflecting our write-once semantics
+            os.chmod(path, 0o440)
+
+            if USE_DIR_CACHE:
+                cl.dir_cache.update_cache(path, len(data))
+        
+        self.send_response(200)
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+    def get_multi(self):
+        """
+        Get a batch of files from a directory in a single request, e.g. GET /__multiget/path/to/dir?names=a.pzf,b.pzf
+        Files are returned encoded using PYME.IO.MultiFileFormat, with missing files flagged in the index.
+        
+        Each file is read straight into its place in a single response buffer, which is then sent in one write.
+        """
+        from PYME.IO import MultiFileFormat
+        
+        parts = urlparse.urlparse(self.path)
+        dirname = parts.path.lstrip('/')[len('__multiget'):].strip('/')
+        names = [n for n in urlparse.parse_qs(parts.query).get('names', [''])[0].split(',') if n]
+        
+        files = []
+        try:
+            lengths = []
+            for name in names:
+                try:
+                    f = open(self.translate_path('/'.join([dirname, name])), 'rb', buffering=0)
+                    files.append(f)
+                    lengths.append(os.fstat(f.fileno()).st_size)
+                except (IOError, OSError):
+                    files.append(None)
+                    lengths.append(-1)
+            
+            prefix, offsets = MultiFileFormat.dumps_header(names, lengths)
+            buf = bytearray(len(prefix) + sum([max(l, 0) for l in lengths]))
+            view = memoryview(buf)
+            view[:len(prefix)] = prefix
+            
+            for f, offset, length in zip(files, offsets, lengths):
+                if f is not None:
+                    offset = int(offset)
+                    n_read = f.readinto(view[offset:(offset + length)])
+                    if n_read != length:
+                        # shouldn't happen given our write once semantics
+                        raise IOError('Short read on file %s' % f.name)
+        finally:
+            for f in files:
+                if f is not None:
+                    f.close()
+        
+        self.send_response(200)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(len(buf)))
+        self.end_headers()
+        if self.command != 'HEAD':
+            self.wfile.write(view)
+        
+        return None
+
     def do_GET(self):
         """Serve a GET request."""
         if self.timeoutTesting:
@@ -497,7 +650,15 @@ class PYMEHTTPRequestHandler(http.server.SimpleHTTPRequestHandler):
         f = self.send_head()
         if f:
             try:
-                self.copyfile(f, self.wfile)
+                if isinstance(f, BytesIO):
+                    # generated content - write it out in one go rather than in chunks
+                    self.wfile.write(f.getvalue())
+                elif USE_SENDFILE:
+                    # a file on disk. The headers have already been written to the (unbuffered) socket, so we can send
+                    # the body straight from the page cache. Falls back to send() if os.sendfile() is not available.
+                    self.connection.sendfile(f)
+                else:
+                    self.copyfile(f, self.wfile)
             finally:
                 f.close()
 
@@ -554,6 +715,9 @@ class PYMEHTTPRequestHandler(http.server.SimpleHTTPRequestHandler):
         if self.path.lstrip('/').startswith('__glob'):
             return self.get_glob()
         
+        if self.path.lstrip('/').startswith('__multiget'):
+            return self.get_multi()
+        
         if os.path.isdir(path):
             parts = urlparse.urlsplit(self.path)
             if not parts.path.endswith('/'):
@@ -608,14 +772,12 @@ class PYMEHTTPRequestHandler(http.server.SimpleHTTPRequestHandler):
             raise
         
     def _string_to_file(self, str):
-        f = BytesIO()
         if not isinstance(str, bytes):
             str = str.encode()
-        f.write(str)
-        length = f.tell()
-        f.seek(0)
         
-        return f, length
+        # NB - initialising the BytesIO with the data (rather than writing to it) shares the underlying buffer, so that
+        # do_GET can send the original bytes without a copy.
+        return BytesIO(str), len(str)
 
     def list_directory(self, path):
         """Helper to produce a directory listing (absent index.html).
@@ -729,7 +891,7 @@ class PYMEHTTPRequestHandler(http.server.SimpleHTTPRequestHandler):
         filename, details = path.split(ext + os.sep)
         filename = filename + ext  # path to file on dataserver disk
         query = urlparse.urlparse(details).query
-        details = details.strip('?' + query)
+        details = details.split('?')[0]
         if '.' in details:
             part, return_type = details.split('.')
         else:
@@ -745,8 +907,21 @@ class PYMEHTTPRequestHandler(http.server.SimpleHTTPRequestHandler):
                     query = urlparse.parse_qs(query)
                     start = int(query.get('from', [0])[0])
                     end = None if 'to' not in query.keys() else int(query['to'][0])
-                    wire_data, output_format = clusterResults.format_results(h5f.getTableData(part, slice(start, end)),
-                                                                             '.' + return_type)
+                    
+                    # Tables are append only, so a slice of the rows which have already been written never changes.
+                    # Clip the slice to the current table length so that we can serve repeated requests for the same
+                    # rows from the cache while the file is still being written.
+                    nrows = h5f.getTableLength(part)
+                    start, end, _ = slice(start, end).indices(nrows)
+                    key = (filename, os.stat(filename).st_ino, part, return_type, start, end)
+                    
+                    cached = _tabularCache.get(key)
+                    if cached is None:
+                        wire_data, output_format = clusterResults.format_results(h5f.getTableData(part, slice(start, end)),
+                                                                                 '.' + return_type)
+                        _tabularCache.put(key, wire_data, output_format)
+                    else:
+                        wire_data, output_format = cached
 
             f, length = self._string_to_file(wire_data)
             self.send_response(200)
@@ -838,6 +1013,9 @@ class PYMEHTTPRequestHandler(http.server.SimpleHTTPRequestHandler):
         self.log_error("code %d, message %s", code, message)
         self.send_response(code, message)
         #self.send_header('Connection', 'close')
+        if self.close_connection:
+            # tell the client not to re-use a connection which we are about to close
+            self.send_header('Connection', 'close')
 
         # Message body is omitted for cases described in:
         #  - RFC7230: 3.3. 1xx, 204(No Content), 304(Not Modified)
@@ -864,7 +1042,7 @@ class ThreadedHTTPServer(ThreadingMixIn, http.server.HTTPServer):
     """Handle requests in a separate thread."""
 
 
-def main(protocol="HTTP/1.0"):
+def main(protocol="HTTP/1.1"):
     global GPU_STATS
     """Test the HTTP request handler class.
 
@@ -63,7 +63,11 @@ def _get_listing(filename):
         file_info = listing[fn]
         if file_info.type & cl.FILETYPE_SERIES:
             complete = (file_info.type & cl.FILETYPE_SERIES_COMPLETE) > 0
-            nFrames = file_info.size - 3 #assume we have metadata.json, events.json, and final_metadata.json - all others are  frames
+            #assume we have metadata.json, events.json, and final_metadata.json (and possibly a binary event log,
+            #events.pev) - all others are frames
+            nFrames = file_info.size - 3
+            if file_info.type & cl.FILETYPE_SERIES_EVENT_LOG:
+                nFrames -= 1
             series.append({'name': fn, 'numFrames': nFrames, 'complete': complete,
                            'cluster_uri': (('pyme-cluster://%s/' % clusterIO.local_serverfilter) + filename + fn).rstrip('/')})
 
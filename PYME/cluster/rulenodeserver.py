@@ -22,11 +22,20 @@ import ujson as json
 
 WORKER_GET_TIMEOUT = config.get('nodeserver-worker-get-timeout', 60)
 
+#how often to re-scan local series and re-advertise locality to the ruleserver (in s)
+LOCALITY_REFRESH = 5
+
+#frame range used to mean "all frames" for series stored as a single file
+MAX_FRAMES = 2**31 - 1
+
 #disable socket timeout to prevent us from generating 408 errors
 #cherrypy.server.socket_timeout = 0
 
 import requests
 import multiprocessing
+import numpy as np
+
+from PYME.cluster.ruleserver import localization_series, in_ranges
 
 #TODO - should be defined in one place
 STATUS_UNAVAILABLE, STATUS_AVAILABLE, STATUS_ASSIGNED, STATUS_COMPLETE, STATUS_FAILED = range(5)
@@ -39,9 +48,43 @@ def template_fill(template, **kwargs):
     
     return s
 
+def local_frame_ranges(series_uri):
+    """
+    Find which frames of a series are stored by the data server on this machine.
+    
+    Returns
+    -------
+    ranges : list
+        a sorted list of [start, end) frame ranges
+    """
+    if os.path.exists(series_uri):
+        # cluster of one special case
+        return [[0, MAX_FRAMES]]
+    
+    filename, serverfilter = clusterIO.parseURL(series_uri)
+    localpath = clusterIO.get_local_path(filename.lstrip('/'), serverfilter)
+    
+    if localpath is None:
+        return []
+    elif os.path.isfile(localpath):
+        # series stored in a single file (e.g. .h5)
+        return [[0, MAX_FRAMES]]
+    
+    frames = np.array(sorted([int(fn[5:-4]) for fn in os.listdir(localpath) if fn.startswith('frame') and fn.endswith('.pzf')]), 'i8')
+    if len(frames) == 0:
+        return []
+    
+    breaks = np.where(np.diff(frames) != 1)[0] + 1
+    starts = frames[np.hstack([[0], breaks])]
+    ends = frames[np.hstack([breaks - 1, [-1]])] + 1
+    
+    return np.vstack([starts, ends]).T.tolist()
+
+
 class Rater(object):
-    def __init__(self, rule):
+    def __init__(self, rule, local_ranges=None):
         self.rule = rule
+        self.local_ranges = local_ranges
         self.taskIDs = rule['availableTaskIDs']
         self.template = rule['taskTemplate']
         inputs = rule.get('inputsByTask', {})
@@ -79,7 +122,10 @@ class Rater(object):
         
         cost = 1.0
         try:
-            if task['type'] == 'localization':
+            if task['type'] == 'localization' and self.local_ranges is not None:
+                if in_ranges([int(task['taskdef']['frameIndex'])], self.local_ranges)[0]:
+                    cost = .01
+            elif task['type'] == 'localization':
                 series_name = task['inputs']['frames']
                 if os.path.exists(series_name):
                     # cluster of one special case
@@ -153,6 +199,11 @@ class NodeServer(object):
         self._update_tasks_lock = threading.Lock()
 
         self._num_connection_fails = 0
+        
+        # {series: (expiry, ranges)} - frames of each series held by our local data server
+        self._local_ranges = {}
+        self._locality_advertised = {}
+        self._locality_expiry = 0
 
         #set up threads to poll the distributor and announce ourselves and get and return tasks
         self.handinSession = requests.Session()
@@ -174,7 +225,50 @@ class NodeServer(object):
     def num_tasks_to_request(self):
         return config.get('nodeserver-chunksize', 50) *multiprocessing.cpu_count()
         #return config.get('nodeserver-chunksize', 50)*len(self.workerIDs)
-              
+    
+    def _update_locality(self, rules):
+        """
+        Find which frames of the series in the current adverts we have locally, and tell the ruleserver (so that it
+        can give us priority on the corresponding tasks).
+        
+        Returns
+        -------
+        dict mapping ruleID to local frame ranges (for localization rules)
+        """
+        t = time.time()
+        local_ranges_by_rule = {}
+        
+        for rule in rules:
+            series = localization_series(rule['taskTemplate'], rule['ruleID'])
+            if series is None:
+                continue
+            
+            try:
+                expiry, ranges = self._local_ranges[series]
+                if expiry < t:
+                    raise KeyError('expired')
+            except KeyError:
+                try:
+                    ranges = local_frame_ranges(series)
+                except Exception:
+                    logger.exception('Error finding local frames for %s' % series)
+                    ranges = []
+                self._local_ranges[series] = (t + LOCALITY_REFRESH, ranges)
+            
+            local_ranges_by_rule[rule['ruleID']] = ranges
+        
+        locality = {series : ranges for series, (expiry, ranges) in self._local_ranges.items() if len(ranges) > 0}
+        
+        if (locality != self._locality_advertised) or (t > self._locality_expiry):
+            self.taskSession.post(self.distributor_url + 'node_locality', params={'nodeID': self.nodeID}, json=locality,
+                                  timeout=120)
+            self._locality_advertised = locality
+            self._locality_expiry = t + LOCALITY_REFRESH
+            
+            # forget about series which are no longer being advertised
+            self._local_ranges = {series: v for series, v in self._local_ranges.items() if v[0] > t}
+        
+        return local_ranges_by_rule
         
 
     def _update_tasks(self):
@@ -199,10 +293,15 @@ class NodeServer(object):
                 r = self.taskSession.get(url, timeout=120)
                 rules = json.loads(r.content) #r.json()
                 
+                #we are idle (and can steal tasks held for other nodes) if we've run out of tasks
+                idle = self._tasks.qsize() == 0
+                
+                local_ranges = self._update_locality(rules)
+                
                 #decide which tasks to bid on
                 n_tasks = 0
                 task_requests = []
-                raters = [Rater(rule) for rule in rules]
+                raters = [Rater(rule, local_ranges.get(rule['ruleID'], None)) for rule in rules]
                 templates_by_ID = {rule['ruleID']: rule['taskTemplate'] for rule in rules}
                 inputs_by_ID = {rule['ruleID']: rule.get('inputsByTask', {}) for rule in rules}
                 
@@ -250,7 +349,8 @@ class NodeServer(object):
                 
                 #place bids and get results
                 url = self.distributor_url +'bid_on_tasks'
-                r = self.taskSession.get(url, json=task_requests, timeout=120)
+                r = self.taskSession.get(url, params={'nodeID': self.nodeID, 'idle': int(idle)}, json=task_requests,
+                                         timeout=120)
                 successful_bids = json.loads(r.content)
                 
                 logging.debug(inputs_by_ID)
@@ -13,6 +13,7 @@ Endpoint                                                      Verb   Brief Descr
 :meth:`/release_rule_tasks <RuleServer.release_rule_tasks>`   POST   Release tasks IDs associated with a rule
 :meth:`/task_advertisments <RuleServer.task_advertisements>`  GET    Retrieve a list of advertisements
 :meth:`/bid_on_tasks <RuleServer.bid_on_tasks>`               POST   Submit bids on advertised tasks
+:meth:`/node_locality <RuleServer.node_locality>`             POST   Advertise which frames a node stores locally
 :meth:`/handin <RuleServer.handin>`                           POST   Advise rule server of task completion
 :meth:`/distributor/queues <Ruleserver.get_queues>`           GET    Get status information
 ============================================================= ====== ========================================
@@ -55,6 +56,40 @@ class Rule(object):
 
 STATUS_UNAVAILABLE, STATUS_AVAILABLE, STATUS_ASSIGNED, STATUS_COMPLETE, STATUS_FAILED = range(5)
 
+# How long (in s) tasks which are stored locally on another node are held for that node, before any node can take them.
+# Idle nodes can always take them (work stealing).
+STEAL_DELAY = config.get('ruleserver-steal-delay', 5.0)
+
+# How long node locality advertisements remain valid (nodes refresh them every few seconds)
+LOCALITY_TIMEOUT = 30
+
+
+def localization_series(template, ruleID=''):
+    """
+    The series (frames URI) a localization rule template operates on, or None if the template is not for localization
+    """
+    try:
+        task = json.loads(template.replace('{{ruleID}}', ruleID).replace('{{taskID}}', '0').replace('{{taskInputs}}', '{}'))
+        if task['type'] == 'localization':
+            return task['inputs']['frames']
+    except (ValueError, KeyError, TypeError):
+        pass
+    
+    return None
+
+
+def in_ranges(ids, ranges):
+    """
+    Which of `ids` fall in any of a sorted list of non-overlapping [start, end) ranges
+    """
+    ranges = np.asarray(ranges, 'i8').reshape(-1, 2)
+    if len(ranges) == 0:
+        return np.zeros(len(ids), 'bool')
+    
+    idx = np.searchsorted(ranges[:, 0], ids, side='right') - 1
+    return (idx >= 0) & (ids < ranges[np.maximum(idx, 0), 1])
+
+
 class IntegerIDRule(Rule):
     """
     A rule which generates tasks based on a template.
@@ -154,7 +189,8 @@ class IntegerIDRule(Rule):
     immediately.
         
     """
-    TASK_INFO_DTYPE = np.dtype([('status', 'uint8'), ('nRetries', 'uint8'), ('expiry', 'f4'), ('cost', 'f4')])
+    TASK_INFO_DTYPE = np.dtype([('status', 'uint8'), ('nRetries', 'uint8'), ('expiry', 'f4'), ('cost', 'f4'),
+                                ('available_at', 'f4')])
     
     
     def __init__(self, ruleID, task_template, inputs_by_task = None,
@@ -204,6 +240,12 @@ class IntegerIDRule(Rule):
         self.avCost = 0
         
         self.expiry = time.time() + self._rule_timeout
+        
+        # for locality aware scheduling (localization rules only)
+        self.series = localization_series(task_template, ruleID)
+        self._t0 = time.time() # reference for available_at (as times don't fit in a float32)
+        self.nLocal = 0
+        self.nStolen = 0
               
         self._info_lock = threading.Lock()
         self._advert_lock = threading.Lock()
@@ -279,6 +321,7 @@ class IntegerIDRule(Rule):
         #TODO - check existing status - it probably makes sense to only apply this to tasks which have STATUS_UNAVAILABLE
         with self._info_lock:
             self._task_info['status'][start:end] = STATUS_AVAILABLE
+            self._task_info['available_at'][start:end] = time.time() - self._t0
             
             self.nTotal = int((self._task_info['status'] >0).sum())
         
@@ -289,17 +332,28 @@ class IntegerIDRule(Rule):
         with self._advert_lock:
             self._cached_advert = None
             
-    def bid(self, bid):
+    def bid(self, bid, nodeID=None, idle=True, locality=None):
         """Bid on tasks (and return any that match). Note the current implementation is very naive and doesn't
         check bid cost - i.e. the first bid gets the task. This works if (and only if) the clients are well behaved
         and preferentially bid on tasks which have a lowest cost for them.
         
+        The one exception is data locality. If `locality` is given, tasks whose data is stored on another node are
+        held for that node (for up to `STEAL_DELAY` seconds after they become available) unless the bidding node
+        stores them too, or is idle.
+        
         Parameters
         ----------
         
         bid : dict
             A dictionary containing the ruleID, the IDs of the tasks to bid on, and their costs
             ``{"ruleID" : str ,"taskIDs" : [list of int],"taskCosts" : [list of float]}``
+        nodeID : str
+            the bidding node
+        idle : bool
+            whether the bidding node has run out of tasks (and can steal tasks from other nodes)
+        locality : dict
+            a dictionary mapping nodeIDs to the ranges of task IDs (frames) they store locally, see
+            :meth:`RuleServer.node_locality`
         
         Returns
         -------
@@ -315,8 +369,32 @@ class IntegerIDRule(Rule):
         
         taskIDs = np.array(bid['taskIDs'], 'i')
         costs = np.array(bid['costs'], 'f4')
+        
+        local = remote = None
+        if locality:
+            local = np.zeros(len(taskIDs), 'bool')
+            remote = np.zeros(len(taskIDs), 'bool')
+            for node, ranges in locality.items():
+                if node == nodeID:
+                    local |= in_ranges(taskIDs, ranges)
+                else:
+                    remote |= in_ranges(taskIDs, ranges)
+            
+            remote &= ~local
+            
         with self._info_lock:
             successful_bid_mask = self._task_info['status'][taskIDs] == STATUS_AVAILABLE
+            
+            if remote is not None:
+                if idle:
+                    self.nStolen += int((successful_bid_mask & remote).sum())
+                else:
+                    held = (time.time() - self._t0 - self._task_info['available_at'][taskIDs]) < STEAL_DELAY
+                    successful_bid_mask &= ~(remote & held)
+                    self.nStolen += int((successful_bid_mask & remote).sum())
+                    
+                self.nLocal += int((successful_bid_mask & local).sum())
+                
             successful_bid_ids = taskIDs[successful_bid_mask]
             self._task_info['status'][successful_bid_ids] = STATUS_ASSIGNED
             self._task_info['cost'][successful_bid_ids] = costs[successful_bid_mask]
@@ -464,6 +542,8 @@ class IntegerIDRule(Rule):
                   'active' : self._active,
                   'tasksTimedOut' : self.n_timed_out,
                   'tasksCompleteAfterTimeout' : self.n_returned_after_timeout,
+                  'tasksAssignedLocal' : self.nLocal,
+                  'tasksStolen' : self.nStolen,
                 }
     
     def poll_timeouts(self):
@@ -476,6 +556,7 @@ class IntegerIDRule(Rule):
             nTimedOut = len(timed_out)
             if nTimedOut > 0:
                 self._task_info['status'][timed_out] = STATUS_AVAILABLE
+                self._task_info['available_at'][timed_out] = t - self._t0
                 self._task_info['nRetries'][timed_out] += 1
                 
                 self.nAssigned -= nTimedOut
@@ -528,6 +609,9 @@ class RuleServer(object):
         
         self._rule_lock = threading.Lock() # lock for when we modify the dictionary of rules
         
+        # {nodeID : (expiry, {series : [[start, end], ...]})} - which frames each node holds locally
+        self._node_locality = {}
+        
         self.rulePollThread = threading.Thread(target=self._poll_rules)
         self.rulePollThread.start()
         
@@ -622,12 +706,18 @@ class RuleServer(object):
         
         
     @webframework.register_endpoint('/bid_on_tasks')
-    def bid_on_tasks(self, body=''):
+    def bid_on_tasks(self, nodeID=None, idle='1', body=''):
         """
         HTTP endpoint (POST) for bidding on tasks.
         
         Parameters
         ----------
+        nodeID : str, optional
+            The ID of the bidding node. Used together with :meth:`node_locality` to give nodes priority on tasks for
+            which they store the data locally.
+        idle : str, optional
+            '1' if the bidding node has run out of tasks, in which case it can take tasks which are being held for other
+            nodes (work stealing). Defaults to '1' so that nodes which don't report locality are unaffected.
         body : json list of bids
             A list of bids, each of which is a dictionary of the form
             ``{"ruleID" : str ,"taskIDs" : [list of int],"taskCosts" : [list of float]}``
@@ -642,18 +732,53 @@ class RuleServer(object):
 
         """
         bids = json.loads(body)
+        idle = idle not in ['0', 'False', 'false']
+        
+        t = time.time()
+        node_locality = [(node, series_ranges) for node, (expiry, series_ranges) in list(self._node_locality.items()) if expiry > t]
         
         succesfull_bids = []
         
         for bid in bids:
             rule = self._rules[bid['ruleID']]
             
-            succesfull_bids.append(rule.bid(bid))
+            locality = None
+            if (nodeID is not None) and (rule.series is not None):
+                locality = {node: series_ranges[rule.series] for node, series_ranges in node_locality if rule.series in series_ranges}
+            
+            succesfull_bids.append(rule.bid(bid, nodeID=nodeID, idle=idle, locality=locality))
             #task_ids = bid['taskIDs']
             #costs = bid['taskCosts']
             
         #print(succesfull_bids)
         return json.dumps(succesfull_bids)
+    
+    @webframework.register_endpoint('/node_locality')
+    def node_locality(self, nodeID, body=''):
+        """
+        HTTP endpoint (POST) for nodes to advertise which frames they store locally (on the data server running on the
+        same machine). Tasks which operate on these frames are given preferentially to the node when it bids (see
+        :meth:`IntegerIDRule.bid`).
+        
+        Advertisements expire after `LOCALITY_TIMEOUT` seconds, so should be refreshed periodically.
+        
+        Parameters
+        ----------
+        nodeID : str
+            The ID of the node (as used when bidding)
+        body : json dict
+            A dictionary mapping series URIs (as used in the "frames" input of localization tasks) to a sorted list of
+            [start, end) frame ranges, ``{"PYME-CLUSTER://cluster/path/to/series" : [[0, 50], [100, 150]]}``.
+
+        Returns
+        -------
+        success : json str
+            ``{"ok" : "True"}`` if successful.
+        """
+        series_ranges = {series: np.array(ranges, 'i8').reshape(-1, 2) for series, ranges in json.loads(body).items()}
+        self._node_locality[nodeID] = (time.time() + LOCALITY_TIMEOUT, series_ranges)
+        
+        return json.dumps({'ok': 'True'})
         
             
         
@@ -700,3 +700,59 @@ class PiecewiseDualMarchingCubes(DualMarchingCubes):
         p[idxs, :] = v0[idxs, :]
         
         return p
+
+
+def march_octree(ot, isolevel, piecewise=True, nThreads=None):
+    """
+    Native (and multi-threaded) equivalent of DualMarchingCubes / PiecewiseDualMarchingCubes which works directly on
+    the octree node array.
+
+    Parameters
+    ----------
+    ot : _octree.Octree
+        The octree (optionally truncated with truncate_at_n_points) to extract the isosurface from
+    isolevel : float
+        The density at which to draw the isosurface
+    piecewise : bool
+        Use the piecewise interpolation of PiecewiseDualMarchingCubes rather than linear interpolation along each edge
+    nThreads : int
+        The number of threads to use (defaults to the number of CPUs)
+
+    Returns
+    -------
+    vertices, faces : np.array
+        [N, 3] vertex positions and [M, 3] vertex indices for each triangle, suitable for passing to
+        _triangle_mesh.TriangleMesh(vertices, faces)
+    """
+    import multiprocessing
+    from PYME.experimental import dual_marching_cubes_utils
+    from PYME.util.threaded import run_threaded
+
+    if nThreads is None:
+        nThreads = multiprocessing.cpu_count()
+
+    nodes = ot._nodes
+    max_depth = nodes['depth'].max() + 1
+    width = np.array(ot.box_size(0), 'f4')
+    density_sc = 1.0/np.prod(ot.box_size(np.arange(max_depth + 1)), axis=0)
+
+    # split the traversal into independent sub-trees / faces / edges, with enough tasks to balance the load
+    tasks = dual_marching_cubes_utils.dualTasks(nodes, width, minTasks=8*nThreads)
+    bounds = np.linspace(0, len(tasks), max(min(nThreads, len(tasks)), 1) + 1).astype('i')
+    results = [None, ]*(len(bounds) - 1)
+
+    def _march(j, start, end):
+        results[j] = dual_marching_cubes_utils.marchTasks(nodes, tasks, width, density_sc, float(isolevel),
+                                                          piecewise=int(piecewise), start=int(start), end=int(end))
+
+    run_threaded(_march, [(j, s, e) for j, (s, e) in enumerate(zip(bounds[:-1], bounds[1:]))])
+
+    # merge vertices shared between tasks, using the octree edge they lie on
+    offsets = np.cumsum([0] + [len(r[0]) for r in results])
+    vertices = np.vstack([r[0] for r in results])
+    keys = np.vstack([r[1] for r in results])
+    faces = np.vstack([r[2] + o for r, o in zip(results, offsets)])
+
+    _, idx, inv = np.unique(keys, axis=0, return_index=True, return_inverse=True)
+
+    return vertices[idx], inv.ravel()[faces].astype('i4')
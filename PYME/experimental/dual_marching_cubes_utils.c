@@ -0,0 +1,839 @@
+/*
+##################
+# dual_marching_cubes_utils.c
+#
+# Copyright David Baddeley, 2019
+# d.baddeley@auckland.ac.nz
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+##################
+ */
+
+/*
+Native dual marching cubes over an octree (see dual_marching_cubes.py for the python reference implementation).
+
+The dual grid is generated using the same node/face/edge/vertex recursion as DualMarchingCubes, but working directly
+on the flat octree node array. Nodes are referred to by id - ids >= 0 index real nodes, whilst the missing children of
+a subdivided node (which the python code fills in with Octree.fix_empty_nodes) get the virtual id
+-(8*parent + octant + 1).
+
+Each dual cell is marched as soon as it is generated, and triangle vertices are shared between cells by hashing the
+(ordered) pair of node ids defining the edge they lie on. The traversal can be split into independent tasks (see
+dualTasks) which are marched in parallel from python, with the per-task meshes then merged on the edge keys.
+*/
+
+#include "Python.h"
+#include <math.h>
+#include "numpy/arrayobject.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dual_marching_cubes_utils.h"
+
+#define MIN(a, b) ((a<b) ? a : b)
+#define MAX(a, b) ((a>b) ? a : b)
+
+#define INITIAL_TABLE_SIZE 4096
+
+/* a node of the dual grid traversal - either a real octree node, or an empty (virtual) child of one */
+typedef struct dnode_t {
+    int64_t id;
+    int32_t depth;
+    int32_t nPoints;
+    int subdivided;
+    float centre[3];
+    const int32_t *children;
+} dnode_t;
+
+/* simple growable array */
+typedef struct buffer_t {
+    char *data;
+    size_t n;
+    size_t capacity;
+    size_t itemsize;
+} buffer_t;
+
+typedef struct hash_entry_t {
+    int64_t k0;
+    int64_t k1;
+    int32_t idx; // -1 for an empty slot
+} hash_entry_t;
+
+typedef struct dmc_t {
+    const octree_node_t *nodes;
+    int64_t n_nodes;
+    float width[3];
+
+    const double *density_sc;
+    int n_depths;
+    double isolevel;
+    int piecewise;
+
+    // edge key -> vertex index
+    hash_entry_t *table;
+    size_t table_size;
+
+    buffer_t vertices; // double[3]
+    buffer_t keys; // int64[2]
+    buffer_t faces; // int32[3]
+    buffer_t tasks; // int64[TASK_SIZE]
+
+    int error;
+} dmc_t;
+
+static void buffer_init(buffer_t *b, size_t itemsize)
+{
+    b->data = NULL;
+    b->n = 0;
+    b->capacity = 0;
+    b->itemsize = itemsize;
+}
+
+static int buffer_append(buffer_t *b, const void *item)
+{
+    char *new_data;
+    size_t new_capacity;
+
+    if (b->n == b->capacity)
+    {
+        // Adjust by 1.5x every time we grow.
+        new_capacity = MAX(1024, (b->capacity*3)/2);
+        new_data = (char *) realloc(b->data, new_capacity*b->itemsize);
+        if (new_data == NULL) return -1;
+
+        b->data = new_data;
+        b->capacity = new_capacity;
+    }
+
+    memcpy(b->data + b->n*b->itemsize, item, b->itemsize);
+    b->n++;
+    return 0;
+}
+
+static void buffer_free(buffer_t *b)
+{
+    if (b->data) free(b->data);
+    b->data = NULL;
+    b->n = 0;
+    b->capacity = 0;
+}
+
+static void dmc_free(dmc_t *d)
+{
+    if (d->table) free(d->table);
+    d->table = NULL;
+
+    buffer_free(&(d->vertices));
+    buffer_free(&(d->keys));
+    buffer_free(&(d->faces));
+    buffer_free(&(d->tasks));
+}
+
+/******************** edge -> vertex hash *********************/
+
+static uint64_t hash_key(int64_t k0, int64_t k1)
+{
+    uint64_t z = ((uint64_t) k0)*0x9E3779B97F4A7C15ULL ^ ((uint64_t) k1);
+    z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27))*0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static int table_alloc(dmc_t *d, size_t size)
+{
+    size_t i;
+
+    d->table = (hash_entry_t *) malloc(size*sizeof(hash_entry_t));
+    if (d->table == NULL) return -1;
+
+    d->table_size = size;
+    for (i = 0; i < size; i++) d->table[i].idx = -1;
+
+    return 0;
+}
+
+/* find the slot for a key (either the slot holding it, or the empty slot where it should go) */
+static hash_entry_t * table_find(dmc_t *d, int64_t k0, int64_t k1)
+{
+    size_t mask = d->table_size - 1;
+    size_t i = hash_key(k0, k1) & mask;
+
+    while ((d->table[i].idx >= 0) && !((d->table[i].k0 == k0) && (d->table[i].k1 == k1)))
+        i = (i + 1) & mask;
+
+    return &(d->table[i]);
+}
+
+/* double the table size, re-inserting all the vertices we have so far */
+static int table_grow(dmc_t *d)
+{
+    size_t i;
+    int64_t *keys = (int64_t *) d->keys.data;
+    hash_entry_t *e;
+
+    free(d->table);
+    if (table_alloc(d, 2*d->table_size)) return -1;
+
+    for (i = 0; i < d->keys.n; i++)
+    {
+        e = table_find(d, keys[2*i], keys[2*i + 1]);
+        e->k0 = keys[2*i];
+        e->k1 = keys[2*i + 1];
+        e->idx = (int32_t) i;
+    }
+
+    return 0;
+}
+
+/******************** octree access *********************/
+
+static int get_node(dmc_t *d, int64_t id, dnode_t *n)
+{
+    const octree_node_t *node;
+    int64_t parent_id;
+    int j, k;
+    float scale;
+
+    n->id = id;
+
+    if (id >= 0)
+    {
+        if (id >= d->n_nodes) {d->error = 1; return -1;}
+        node = &(d->nodes[id]);
+
+        n->depth = node->depth;
+        n->nPoints = node->nPoints;
+        n->children = node->children;
+        for (k = 0; k < 3; k++) n->centre[k] = node->centre[k];
+
+        //NOTE: n_children is not kept up to date when building the tree (or when truncating it) so use the children
+        n->subdivided = 0;
+        for (j = 0; j < 8; j++) n->subdivided |= (node->children[j] > 0);
+    } else
+    {
+        //an empty child of a subdivided node - mirrors Octree.fix_empty_nodes
+        parent_id = (-id - 1) >> 3;
+        j = (int) ((-id - 1) & 7);
+        if (parent_id >= d->n_nodes) {d->error = 1; return -1;}
+        node = &(d->nodes[parent_id]);
+
+        n->depth = node->depth + 1;
+        n->nPoints = 0;
+        n->children = NULL;
+        n->subdivided = 0;
+
+        scale = (float) ldexp(1.0, -(n->depth + 1));
+        n->centre[0] = node->centre[0] + (float) (2*(j & 1) - 1)*(d->width[0]*scale);
+        n->centre[1] = node->centre[1] + (float) ((j & 2) - 1)*(d->width[1]*scale);
+        n->centre[2] = node->centre[2] + ((float) (j & 4)/2.0f - 1)*(d->width[2]*scale);
+    }
+
+    if ((n->depth < 0) || (n->depth >= d->n_depths)) {d->error = 1; return -1;}
+
+    return 0;
+}
+
+static int64_t child_id(const dnode_t *n, int j)
+{
+    if (n->children && (n->children[j] > 0)) return n->children[j];
+    return -(8*n->id + j + 1);
+}
+
+/* the child j of n if n is subdivided, otherwise n itself */
+static void sub_node(dmc_t *d, const dnode_t *n, int j, dnode_t *out)
+{
+    if (n->subdivided)
+        get_node(d, child_id(n, j), out);
+    else
+        *out = *n;
+}
+
+/******************** marching *********************/
+
+static double node_value(dmc_t *d, const dnode_t *n)
+{
+    return n->nPoints*d->density_sc[n->depth];
+}
+
+/* the (interpolated) surface vertex on the dual edge a->b, re-using it if we've seen this edge before */
+static int32_t edge_vertex(dmc_t *d, const dnode_t *a, const dnode_t *b, double v0, double v1)
+{
+    const dnode_t *t;
+    hash_entry_t *e;
+    int64_t key[2];
+    double p0[3], p1[3], p[3], vm[3], tv;
+    double d_depth, r, r2, m, mu, mu2;
+    int32_t idx;
+    int k;
+
+    //order the edge so that we get the same key (and vertex) from every cell which shares it
+    if (a->id > b->id)
+    {
+        t = a; a = b; b = t;
+        tv = v0; v0 = v1; v1 = tv;
+    }
+
+    e = table_find(d, a->id, b->id);
+    if (e->idx >= 0) return e->idx;
+
+    for (k = 0; k < 3; k++)
+    {
+        p0[k] = a->centre[k];
+        p1[k] = b->centre[k];
+    }
+
+    if (fabs(v1 - v0) < 1e-12)
+    {
+        //v0 and v1 are the same vertex (common in dual marching cubes)
+        for (k = 0; k < 3; k++) p[k] = p0[k];
+    } else if (d->piecewise)
+    {
+        //see PiecewiseDualMarchingCubes.interpolate_vertex
+        d_depth = a->depth - b->depth;
+        r = 1.0/(1.0 + pow(8.0, d_depth));
+        r2 = 1.0/(1.0 + pow(2.0, d_depth));
+
+        m = v0*r + v1*(1 - r);
+        for (k = 0; k < 3; k++) vm[k] = p0[k]*(1 - r2) + p1[k]*r2;
+
+        mu = (d->isolevel - v0)/(m - v0);
+        mu2 = (d->isolevel - m)/(v1 - m);
+
+        for (k = 0; k < 3; k++)
+        {
+            if (mu2 > 0)
+                p[k] = vm[k] + mu2*(p1[k] - vm[k]);
+            else
+                p[k] = p0[k] + mu*(vm[k] - p0[k]);
+        }
+    } else
+    {
+        mu = (d->isolevel - v0)/(v1 - v0);
+        for (k = 0; k < 3; k++) p[k] = p0[k] + mu*(p1[k] - p0[k]);
+    }
+
+    idx = (int32_t) d->vertices.n;
+    key[0] = a->id;
+    key[1] = b->id;
+
+    if (buffer_append(&(d->vertices), p) || buffer_append(&(d->keys), key)) {d->error = 2; return -1;}
+
+    e->k0 = a->id;
+    e->k1 = b->id;
+    e->idx = idx;
+
+    if (2*d->vertices.n > d->table_size)
+        if (table_grow(d)) {d->error = 2; return -1;}
+
+    return idx;
+}
+
+static void march_cell(dmc_t *d, const dnode_t *n)
+{
+    double values[8];
+    int32_t vidx[12], face[3];
+    const int8_t *cell_data;
+    const double *v;
+    double a[3], b[3], nx, ny, nz;
+    int cube_index = 0, k, t, e, c0, c1;
+
+    for (k = 0; k < 8; k++)
+    {
+        values[k] = node_value(d, &n[k]);
+        if (values[k] < d->isolevel) cube_index |= (1 << k);
+    }
+
+    if ((cube_index == 0) || (cube_index == 0xFF)) return;
+
+    for (k = 0; k < 12; k++) vidx[k] = -1;
+
+    cell_data = REGULAR_CELL_DATA[REGULAR_CELL_CLASS[cube_index]];
+
+    for (t = 0; (t < 5) && (cell_data[3*t] >= 0); t++)
+    {
+        for (k = 0; k < 3; k++)
+        {
+            e = cell_data[3*t + k];
+            if (vidx[e] < 0)
+            {
+                c0 = (REGULAR_VERTEX_DATA[cube_index][e] >> 4) & 0x0F;
+                c1 = REGULAR_VERTEX_DATA[cube_index][e] & 0x0F;
+                vidx[e] = edge_vertex(d, &n[c0], &n[c1], values[c0], values[c1]);
+                if (vidx[e] < 0) return;
+            }
+            face[k] = vidx[e];
+        }
+
+        if ((face[0] == face[1]) || (face[1] == face[2]) || (face[0] == face[2])) continue;
+
+        //prune 0-area triangles
+        v = (const double *) d->vertices.data;
+        for (k = 0; k < 3; k++)
+        {
+            a[k] = v[3*face[2] + k] - v[3*face[1] + k];
+            b[k] = v[3*face[0] + k] - v[3*face[1] + k];
+        }
+        nx = a[1]*b[2] - a[2]*b[1];
+        ny = a[2]*b[0] - a[0]*b[2];
+        nz = a[0]*b[1] - a[1]*b[0];
+        if ((nx*nx + ny*ny + nz*nz) <= 0) continue;
+
+        if (buffer_append(&(d->faces), face)) {d->error = 2; return;}
+    }
+}
+
+/******************** dual grid traversal *********************/
+
+/*
+In each of the below, the nodes are passed as an array of 8, indexed by their position in the dual cell (bit 0 = x,
+bit 1 = y, bit 2 = z). For faces (edges), positions on either side of the face (along the edge) hold the same node.
+*/
+
+static void vert_proc(dmc_t *d, const dnode_t *n)
+{
+    dnode_t c[8];
+    int k, subdivided = 0;
+
+    if (d->error) return;
+
+    for (k = 0; k < 8; k++) subdivided |= n[k].subdivided;
+
+    if (!subdivided)
+    {
+        march_cell(d, n);
+        return;
+    }
+
+    for (k = 0; k < 8; k++) sub_node(d, &n[k], 7 - k, &c[k]);
+    vert_proc(d, c);
+}
+
+static void edge_proc(dmc_t *d, const dnode_t *n, int dir)
+{
+    dnode_t c[8], e[8];
+    int k, h, subdivided = 0;
+
+    if (d->error) return;
+
+    for (k = 0; k < 8; k++) subdivided |= n[k].subdivided;
+    if (!subdivided) return;
+
+    for (k = 0; k < 8; k++) sub_node(d, &n[k & ~dir], k ^ (7 & ~dir), &c[k]);
+
+    for (h = 0; h <= dir; h += dir)
+    {
+        for (k = 0; k < 8; k++) e[k] = c[(k & ~dir) | h];
+        edge_proc(d, e, dir);
+    }
+
+    vert_proc(d, c);
+}
+
+/* the edges (except those along axis) and vertex shared by 8 nodes which meet at a point */
+static void edge_and_vert_procs(dmc_t *d, const dnode_t *c, int axis)
+{
+    dnode_t f[8];
+    int p, h, dir;
+
+    for (dir = 1; dir < 8; dir <<= 1)
+    {
+        if (dir == axis) continue;
+
+        for (h = 0; h <= dir; h += dir)
+        {
+            for (p = 0; p < 8; p++) f[p] = c[(p & ~dir) | h];
+            edge_proc(d, f, dir);
+        }
+    }
+
+    vert_proc(d, c);
+}
+
+static void face_proc(dmc_t *d, const dnode_t *n, int axis)
+{
+    dnode_t c[8], f[8];
+    int k, p, subdivided = 0;
+
+    if (d->error) return;
+
+    for (k = 0; k < 8; k++) subdivided |= n[k].subdivided;
+    if (!subdivided) return;
+
+    for (k = 0; k < 8; k++) sub_node(d, &n[k], k ^ axis, &c[k]);
+
+    for (k = 0; k < 8; k++)
+    {
+        if (k & axis) continue;
+        for (p = 0; p < 8; p++) f[p] = (p & axis) ? c[k | axis] : c[k];
+        face_proc(d, f, axis);
+    }
+
+    edge_and_vert_procs(d, c, axis);
+}
+
+static void node_proc(dmc_t *d, const dnode_t *n)
+{
+    dnode_t c[8], f[8];
+    int k, p, axis;
+
+    if (d->error || !n->subdivided) return;
+
+    for (k = 0; k < 8; k++) get_node(d, child_id(n, k), &c[k]);
+    if (d->error) return;
+
+    for (k = 0; k < 8; k++) node_proc(d, &c[k]);
+
+    for (axis = 1; axis < 8; axis <<= 1)
+    {
+        for (k = 0; k < 8; k++)
+        {
+            if (k & axis) continue;
+            for (p = 0; p < 8; p++) f[p] = (p & axis) ? c[k | axis] : c[k];
+            face_proc(d, f, axis);
+        }
+    }
+
+    edge_and_vert_procs(d, c, 0);
+}
+
+/******************** tasks *********************/
+
+static int append_task(dmc_t *d, int type, int axis, const dnode_t *n)
+{
+    int64_t task[TASK_SIZE];
+    int k;
+
+    task[0] = type;
+    task[1] = axis;
+
+    //node tasks only have a single node
+    for (k = 0; k < 8; k++) task[k + 2] = (type == TASK_NODE) ? n[0].id : n[k].id;
+
+    return buffer_append(&(d->tasks), task);
+}
+
+/* replace a node task with the tasks making up its node_proc */
+static int expand_node_task(dmc_t *d, const dnode_t *n)
+{
+    dnode_t c[8], f[8];
+    int k, p, h, axis, dir;
+
+    for (k = 0; k < 8; k++) if (get_node(d, child_id(n, k), &c[k])) return -1;
+
+    for (k = 0; k < 8; k++)
+        if (c[k].subdivided && append_task(d, TASK_NODE, 0, &c[k])) return -1;
+
+    for (axis = 1; axis < 8; axis <<= 1)
+    {
+        for (k = 0; k < 8; k++)
+        {
+            if (k & axis) continue;
+            for (p = 0; p < 8; p++) f[p] = (p & axis) ? c[k | axis] : c[k];
+            if (append_task(d, TASK_FACE, axis, f)) return -1;
+        }
+    }
+
+    for (dir = 1; dir < 8; dir <<= 1)
+    {
+        for (h = 0; h <= dir; h += dir)
+        {
+            for (p = 0; p < 8; p++) f[p] = c[(p & ~dir) | h];
+            if (append_task(d, TASK_EDGE, dir, f)) return -1;
+        }
+    }
+
+    return append_task(d, TASK_VERT, 0, c);
+}
+
+static void run_task(dmc_t *d, const int64_t *task)
+{
+    dnode_t n[8];
+    int k;
+
+    for (k = 0; k < 8; k++) if (get_node(d, task[k + 2], &n[k])) return;
+
+    switch (task[0])
+    {
+        case TASK_NODE:
+            node_proc(d, &n[0]);
+            break;
+        case TASK_FACE:
+            face_proc(d, n, (int) task[1]);
+            break;
+        case TASK_EDGE:
+            edge_proc(d, n, (int) task[1]);
+            break;
+        case TASK_VERT:
+            vert_proc(d, n);
+            break;
+        default:
+            d->error = 1;
+    }
+}
+
+/******************** python interface *********************/
+
+static int get_nodes(PyObject *oNodes, dmc_t *d)
+{
+    PyArrayObject *aNodes;
+
+    if (!PyArray_Check(oNodes)) return -1;
+    aNodes = (PyArrayObject *) oNodes;
+
+    if ((PyArray_NDIM(aNodes) != 1) || !PyArray_ISCARRAY_RO(aNodes) ||
+        (PyArray_ITEMSIZE(aNodes) != sizeof(octree_node_t)) || (PyArray_DIM(aNodes, 0) < 1))
+        return -1;
+
+    d->nodes = (const octree_node_t *) PyArray_DATA(aNodes);
+    d->n_nodes = PyArray_DIM(aNodes, 0);
+
+    return 0;
+}
+
+static int get_width(PyObject *oWidth, dmc_t *d)
+{
+    PyArrayObject *aWidth;
+    int k;
+
+    aWidth = (PyArrayObject *) PyArray_ContiguousFromObject(oWidth, NPY_FLOAT, 1, 1);
+    if (aWidth == NULL) return -1;
+
+    if (PyArray_DIM(aWidth, 0) != 3)
+    {
+        Py_DECREF(aWidth);
+        return -1;
+    }
+
+    for (k = 0; k < 3; k++) d->width[k] = ((float *) PyArray_DATA(aWidth))[k];
+
+    Py_DECREF(aWidth);
+    return 0;
+}
+
+static PyObject * dualTasks(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oNodes=0, *oWidth=0;
+    PyArrayObject *aTasks=0;
+    dmc_t d;
+    buffer_t current;
+    dnode_t n;
+    int64_t *task;
+    npy_intp dims[2];
+    size_t i;
+    int minTasks = 1, expanded = 1;
+
+    static char *kwlist[] = {"nodes", "width", "minTasks", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OO|i", kwlist, &oNodes, &oWidth, &minTasks))
+        return NULL;
+
+    memset(&d, 0, sizeof(dmc_t));
+    buffer_init(&(d.tasks), TASK_SIZE*sizeof(int64_t));
+    buffer_init(&current, TASK_SIZE*sizeof(int64_t));
+    d.n_depths = 1 << 30; //depths are not used for task generation
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_dualTasks;\
+        }
+
+    if (get_nodes(oNodes, &d)) ABORT("nodes must be a contiguous octree node array (see _octree.NODE_DTYPE)")
+    if (get_width(oWidth, &d)) ABORT("width must be the (x, y, z) size of the octree")
+
+    //start with the root, and expand node tasks breadth first until we have enough to share between threads
+    get_node(&d, 0, &n);
+    if (append_task(&d, TASK_NODE, 0, &n)) ABORT("Error allocating memory")
+
+    while (((int) d.tasks.n < minTasks) && expanded)
+    {
+        expanded = 0;
+
+        buffer_free(&current);
+        current = d.tasks;
+        buffer_init(&(d.tasks), TASK_SIZE*sizeof(int64_t));
+
+        for (i = 0; i < current.n; i++)
+        {
+            task = ((int64_t *) current.data) + i*TASK_SIZE;
+
+            if ((task[0] == TASK_NODE) && !get_node(&d, task[2], &n) && n.subdivided)
+            {
+                if (expand_node_task(&d, &n)) ABORT("Error allocating memory")
+                expanded = 1;
+            } else
+            {
+                if (buffer_append(&(d.tasks), task)) ABORT("Error allocating memory")
+            }
+        }
+
+        if (d.error) ABORT("Invalid octree - child index out of range")
+    }
+
+    dims[0] = d.tasks.n;
+    dims[1] = TASK_SIZE;
+    aTasks = (PyArrayObject *) PyArray_SimpleNew(2, dims, NPY_INT64);
+    if (aTasks == NULL) ABORT("Error allocating output array")
+    if (d.tasks.n) memcpy(PyArray_DATA(aTasks), d.tasks.data, d.tasks.n*d.tasks.itemsize);
+
+    buffer_free(&current);
+    dmc_free(&d);
+
+    return (PyObject *) aTasks;
+
+FINALIZE_dualTasks:
+    #undef ABORT
+
+    buffer_free(&current);
+    dmc_free(&d);
+
+    return NULL;
+}
+
+static PyObject * marchTasks(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oNodes=0, *oTasks=0, *oWidth=0, *oDensitySc=0;
+    PyArrayObject *aTasks=0, *aDensitySc=0;
+    PyArrayObject *aVertices=0, *aKeys=0, *aFaces=0;
+    dmc_t d;
+    int64_t *tasks;
+    npy_intp dims[2];
+    int nTasks, i;
+    int piecewise = 1, start = 0, end = -1;
+    double isolevel = 0;
+
+    static char *kwlist[] = {"nodes", "tasks", "width", "densityScale", "isolevel", "piecewise", "start", "end", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOOOd|iii", kwlist, &oNodes, &oTasks, &oWidth, &oDensitySc,
+         &isolevel, &piecewise, &start, &end))
+        return NULL;
+
+    memset(&d, 0, sizeof(dmc_t));
+    buffer_init(&(d.vertices), 3*sizeof(double));
+    buffer_init(&(d.keys), 2*sizeof(int64_t));
+    buffer_init(&(d.faces), 3*sizeof(int32_t));
+    buffer_init(&(d.tasks), TASK_SIZE*sizeof(int64_t));
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_marchTasks;\
+        }
+
+    if (get_nodes(oNodes, &d)) ABORT("nodes must be a contiguous octree node array (see _octree.NODE_DTYPE)")
+    if (get_width(oWidth, &d)) ABORT("width must be the (x, y, z) size of the octree")
+
+    aTasks = (PyArrayObject *) PyArray_ContiguousFromObject(oTasks, NPY_INT64, 2, 2);
+    if ((aTasks == NULL) || (PyArray_DIM(aTasks, 1) != TASK_SIZE)) ABORT("Bad tasks - expecting the output of dualTasks")
+    nTasks = (int) PyArray_DIM(aTasks, 0);
+    tasks = (int64_t *) PyArray_DATA(aTasks);
+
+    aDensitySc = (PyArrayObject *) PyArray_ContiguousFromObject(oDensitySc, NPY_DOUBLE, 1, 1);
+    if (aDensitySc == NULL) ABORT("Bad densityScale")
+    d.density_sc = (const double *) PyArray_DATA(aDensitySc);
+    d.n_depths = (int) PyArray_DIM(aDensitySc, 0);
+
+    d.isolevel = isolevel;
+    d.piecewise = piecewise;
+
+    if (table_alloc(&d, INITIAL_TABLE_SIZE)) ABORT("Error allocating memory")
+
+    if (end < 0) end = nTasks;
+    start = MAX(start, 0);
+    end = MIN(end, nTasks);
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (i = start; (i < end) && !d.error; i++)
+        run_task(&d, tasks + (size_t) i*TASK_SIZE);
+    Py_END_ALLOW_THREADS;
+
+    if (d.error == 1) ABORT("Invalid octree - node index or depth out of range (is densityScale long enough?)")
+    if (d.error) ABORT("Error allocating memory")
+
+    dims[0] = d.vertices.n;
+    dims[1] = 3;
+    aVertices = (PyArrayObject *) PyArray_SimpleNew(2, dims, NPY_DOUBLE);
+    dims[1] = 2;
+    aKeys = (PyArrayObject *) PyArray_SimpleNew(2, dims, NPY_INT64);
+    dims[0] = d.faces.n;
+    dims[1] = 3;
+    aFaces = (PyArrayObject *) PyArray_SimpleNew(2, dims, NPY_INT32);
+    if ((aVertices == NULL) || (aKeys == NULL) || (aFaces == NULL)) ABORT("Error allocating output arrays")
+
+    if (d.vertices.n)
+    {
+        memcpy(PyArray_DATA(aVertices), d.vertices.data, d.vertices.n*d.vertices.itemsize);
+        memcpy(PyArray_DATA(aKeys), d.keys.data, d.keys.n*d.keys.itemsize);
+    }
+    if (d.faces.n) memcpy(PyArray_DATA(aFaces), d.faces.data, d.faces.n*d.faces.itemsize);
+
+    dmc_free(&d);
+    Py_XDECREF(aTasks);
+    Py_XDECREF(aDensitySc);
+
+    return Py_BuildValue("(NNN)", aVertices, aKeys, aFaces);
+
+FINALIZE_marchTasks:
+    #undef ABORT
+
+    dmc_free(&d);
+    Py_XDECREF(aTasks);
+    Py_XDECREF(aDensitySc);
+    Py_XDECREF(aVertices);
+    Py_XDECREF(aKeys);
+    Py_XDECREF(aFaces);
+
+    return NULL;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+static PyMethodDef dual_marching_cubes_utils_methods[] = {
+    {"dualTasks",  dualTasks, METH_VARARGS | METH_KEYWORDS,
+    "Split the dual grid traversal of an octree into at least `minTasks` independent tasks (if the tree is deep "
+    "enough).\n Arguments are: 'nodes' (Octree._nodes), 'width' (size of the root node), 'minTasks'=1\n"
+    "Returns an int64 [nTasks, 10] array."},
+    {"marchTasks",  marchTasks, METH_VARARGS | METH_KEYWORDS,
+    "Run dual marching cubes for tasks [start, end).\n Arguments are: 'nodes' (Octree._nodes), 'tasks' (from "
+    "dualTasks), 'width' (size of the root node), 'densityScale' (1/box volume for each depth), 'isolevel', "
+    "'piecewise'=1 (use PiecewiseDualMarchingCubes interpolation), 'start'=0, 'end'=nTasks\n"
+    "Returns (vertices [nVerts, 3], keys [nVerts, 2], faces [nFaces, 3]) where keys are the (ordered) node ids of the "
+    "edge each vertex lies on."},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+#pragma GCC diagnostic pop
+
+#if PY_MAJOR_VERSION >= 3
+static struct PyModuleDef moduledef = {
+        PyModuleDef_HEAD_INIT,
+        "dual_marching_cubes_utils",     /* m_name */
+        "C implementation of dual marching cubes on an octree",  /* m_doc */
+        -1,                  /* m_size */
+        dual_marching_cubes_utils_methods,    /* m_methods */
+        NULL,                /* m_reload */
+        NULL,                /* m_traverse */
+        NULL,                /* m_clear */
+        NULL,                /* m_free */
+    };
+
+PyMODINIT_FUNC PyInit_dual_marching_cubes_utils(void)
+{
+	PyObject *m;
+    m = PyModule_Create(&moduledef);
+    import_array()
+    return m;
+}
+#else
+PyMODINIT_FUNC initdual_marching_cubes_utils(void)
+{
+    PyObject *m;
+
+    m = Py_InitModule("dual_marching_cubes_utils", dual_marching_cubes_utils_methods);
+    import_array()
+}
+#endif
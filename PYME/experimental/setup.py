@@ -74,6 +74,12 @@ def configuration(parent_package='', top_path=None):
                     include_dirs= get_numpy_include_dirs() + extra_include_dirs,
                     extra_compile_args=['-O3', '-fno-exceptions', '-ffast-math', '-march=native', '-mtune=native'],
                     extra_link_args=linkArgs)
+
+    config.add_extension(name='dual_marching_cubes_utils',
+                    sources='dual_marching_cubes_utils.c',
+                    include_dirs= get_numpy_include_dirs() + extra_include_dirs,
+                    extra_compile_args=['-O3', '-fno-exceptions', '-ffast-math', '-march=native', '-mtune=native'],
+                    extra_link_args=linkArgs)
     
     # config = Configuration('pymecompress', parent_package, top_path)
     #
@@ -613,6 +613,366 @@ static PyObject * InterpolateInplaceM(PyObject *self, PyObject *args, PyObject *
 }
 
 
+/*
+Tiled rendering of many emitters into a single image.
+
+InterpolateInplaceM adds each emitter straight into the output, so running it from several threads on the same image
+results in unsynchronised writes to overlapping ROIs. Instead, TileBins sorts the emitters into square tiles of the
+output image (an emitter being listed in every tile its ROI touches) and InterpolateTiles renders a range of tiles,
+only writing to pixels inside those tiles. Different tile ranges can thus safely be rendered in parallel. Within a tile
+emitters are always added in index order, so the result does not depend on how the tiles are split between threads.
+*/
+
+/* ROI of an emitter in output pixels, [xlo, xhi) x [ylo, yhi), as used by InterpolateInplaceM */
+static void emitter_roi(float x0, float y0, int nx, float dx, float dy, int oSizeX, int oSizeY,
+                        int *xlo, int *xhi, int *ylo, int *yhi)
+{
+    int fx = (int)(floorf(x0/dx));
+    int fy = (int)(floorf(y0/dy));
+
+    *xlo = MAX(fx - nx, 0);
+    *xhi = MIN(fx + nx + 1, oSizeX);
+    *ylo = MAX(fy - nx, 0);
+    *yhi = MIN(fy + nx + 1, oSizeY);
+}
+
+/* add a single emitter into the part of its ROI which lies within [xlo, xhi) x [ylo, yhi) */
+static void splat_emitter(const float *mod, int sizeX, int sizeY, int sizeZ, float *out, int outStride,
+                          float x0, float y0, float z0, float A, int nx, float dx, float dy, float dz,
+                          int xlo, int xhi, int ylo, int yhi)
+{
+    float rx, ry, rz;
+    float r000, r100, r010, r110, r001, r101, r011, r111;
+    int fx, fy, fz, cx, cy, xi, yi, xo, yo;
+    const float *m0, *m1;
+    float *res;
+
+    fx = (int)(floorf(x0/dx));
+    fy = (int)(floorf(y0/dy));
+    fz = MIN(sizeZ - 2, MAX(0, (int)(floorf(sizeZ/2.0) + floorf(z0/dz))));
+
+    cx = (int)(floorf(sizeX/2.0)) - fx;
+    cy = (int)(floorf(sizeY/2.0)) - fy;
+
+    ///avoid negatives by adding a chunk before taking the mod
+    rx = 1.0 - fmodf(x0+973*dx,dx)/dx;
+    ry = 1.0 - fmodf(y0+973*dy,dy)/dy;
+    rz = 1.0 - fmodf(z0+973*dz,dz)/dz;
+
+    r000 = A*((1.0-rx)*(1.0-ry)*(1.0-rz));
+    r100 = A*((rx)*(1.0-ry)*(1.0-rz));
+    r010 = A*((1.0-rx)*(ry)*(1.0-rz));
+    r110 = A*((rx)*(ry)*(1.0-rz));
+    r001 = A*((1.0-rx)*(1.0-ry)*(rz));
+    r101 = A*((rx)*(1.0-ry)*(rz));
+    r011 = A*((1.0-rx)*(ry)*(rz));
+    r111 = A*((rx)*(ry)*(rz));
+
+    xlo = MAX(xlo, fx - nx);
+    xhi = MIN(xhi, fx + nx + 1);
+    ylo = MAX(ylo, fy - nx);
+    yhi = MIN(yhi, fy + nx + 1);
+
+    for (xo = xlo; xo < xhi; xo++)
+    {
+        xi = xo + cx;
+        res = out + (size_t) xo*outStride;
+
+        for (yo = ylo; yo < yhi; yo++)
+        {
+            yi = yo + cy;
+
+            m0 = mod + ((size_t) xi*sizeY + yi)*sizeZ + fz;
+            m1 = m0 + (size_t) sizeY*sizeZ;
+
+            res[yo] += r000 * m0[0];
+            res[yo] += r100 * m1[0];
+            res[yo] += r010 * m0[sizeZ];
+            res[yo] += r110 * m1[sizeZ];
+            res[yo] += r001 * m0[1];
+            res[yo] += r101 * m1[1];
+            res[yo] += r011 * m0[sizeZ + 1];
+            res[yo] += r111 * m1[sizeZ + 1];
+        }
+    }
+}
+
+static PyObject * TileBins(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *xv=0, *yv=0, *nv=0, *tileStarts=0, *tileIdx=0;
+    PyArrayObject *ax=0, *ay=0, *an=0;
+    float *x, *y, dx, dy;
+    int *nx, *starts, *idx, *fill=NULL;
+    int sizeX, sizeY, tileSize = 32, nTX, nTY, nTiles, npts;
+    int i, tx, ty, xlo, xhi, ylo, yhi;
+    npy_intp dims[1];
+
+    static char *kwlist[] = {"x0", "y0", "nx", "sizeX", "sizeY", "dx", "dy", "tileSize", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOOiiff|i", kwlist,
+         &xv, &yv, &nv, &sizeX, &sizeY, &dx, &dy, &tileSize))
+        return NULL;
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_TileBins;\
+        }
+
+    if (tileSize < 1) ABORT("tileSize must be positive")
+
+    ax = (PyArrayObject *) PyArray_ContiguousFromObject(xv, NPY_FLOAT, 1, 1);
+    if (ax == NULL) ABORT("Bad x")
+    npts = (int) PyArray_DIM(ax, 0);
+
+    ay = (PyArrayObject *) PyArray_ContiguousFromObject(yv, NPY_FLOAT, 1, 1);
+    if ((ay == NULL) || (PyArray_DIM(ay, 0) != npts)) ABORT("Bad y")
+
+    an = (PyArrayObject *) PyArray_ContiguousFromObject(nv, NPY_INT, 1, 1);
+    if ((an == NULL) || (PyArray_DIM(an, 0) != npts)) ABORT("Bad nx")
+
+    x = (float *) PyArray_DATA(ax);
+    y = (float *) PyArray_DATA(ay);
+    nx = (int *) PyArray_DATA(an);
+
+    nTX = (sizeX + tileSize - 1)/tileSize;
+    nTY = (sizeY + tileSize - 1)/tileSize;
+    nTiles = nTX*nTY;
+
+    dims[0] = nTiles + 1;
+    tileStarts = PyArray_ZEROS(1, dims, NPY_INT, 0);
+    if (tileStarts == NULL) ABORT("Error allocating array")
+    starts = (int *) PyArray_DATA((PyArrayObject *) tileStarts);
+
+    fill = (int *) malloc((nTiles + 1)*sizeof(int));
+    if (fill == NULL) ABORT("Error allocating memory")
+
+    //count the emitters in each tile, using the same (oddly clipped) ROIs as InterpolateInplaceM
+    for (i = 0; i < npts; i++)
+    {
+        emitter_roi(x[i], y[i], nx[i], dx, dy, sizeX - 1, sizeY - 1, &xlo, &xhi, &ylo, &yhi);
+        if ((xlo >= xhi) || (ylo >= yhi)) continue;
+
+        for (tx = xlo/tileSize; tx <= (xhi - 1)/tileSize; tx++)
+            for (ty = ylo/tileSize; ty <= (yhi - 1)/tileSize; ty++)
+                starts[tx*nTY + ty + 1]++;
+    }
+
+    for (i = 0; i < nTiles; i++)
+    {
+        starts[i + 1] += starts[i];
+        fill[i] = starts[i];
+    }
+
+    dims[0] = starts[nTiles];
+    tileIdx = PyArray_SimpleNew(1, dims, NPY_INT);
+    if (tileIdx == NULL) ABORT("Error allocating array")
+    idx = (int *) PyArray_DATA((PyArrayObject *) tileIdx);
+
+    //fill in emitter order, so that each tile lists its emitters in ascending order
+    for (i = 0; i < npts; i++)
+    {
+        emitter_roi(x[i], y[i], nx[i], dx, dy, sizeX - 1, sizeY - 1, &xlo, &xhi, &ylo, &yhi);
+        if ((xlo >= xhi) || (ylo >= yhi)) continue;
+
+        for (tx = xlo/tileSize; tx <= (xhi - 1)/tileSize; tx++)
+            for (ty = ylo/tileSize; ty <= (yhi - 1)/tileSize; ty++)
+                idx[fill[tx*nTY + ty]++] = i;
+    }
+
+    free(fill);
+
+    Py_XDECREF(ax);
+    Py_XDECREF(ay);
+    Py_XDECREF(an);
+
+    return Py_BuildValue("(NN)", tileStarts, tileIdx);
+
+FINALIZE_TileBins:
+    #undef ABORT
+
+    if (fill) free(fill);
+
+    Py_XDECREF(ax);
+    Py_XDECREF(ay);
+    Py_XDECREF(an);
+    Py_XDECREF(tileStarts);
+    Py_XDECREF(tileIdx);
+
+    return NULL;
+}
+
+static PyObject * InterpolateTiles(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *models=0, *out=0, *xv=0, *yv=0, *zv=0, *Av=0, *nv=0, *cv=0, *sv=0, *iv=0;
+    PyObject *fModels=0;
+    PyArrayObject *ax=0, *ay=0, *az=0, *aA=0, *an=0, *ac=0, *as=0, *ai=0;
+    PyArrayObject **amods=NULL;
+    const float **mods=NULL;
+    float *x, *y, *z, *A, *res, dx, dy, dz;
+    int *nx, *chan, *starts, *idx, *sizes=NULL, *sz;
+    int nModels=0, npts, oSizeX, oSizeY, outStride, nTY, nTiles;
+    int tileSize = 32, startTile = 0, endTile = -1;
+    int i, j, k, t, xlo, xhi, ylo, yhi;
+
+    static char *kwlist[] = {"models", "output", "x0", "y0", "z0", "Av", "nx", "chan", "tileStarts", "tileIdx",
+                             "dx", "dy", "dz", "tileSize", "startTile", "endTile", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOOOOOOOOOfff|iii", kwlist, &models, &out, &xv, &yv, &zv, &Av,
+         &nv, &cv, &sv, &iv, &dx, &dy, &dz, &tileSize, &startTile, &endTile))
+        return NULL;
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_InterpolateTiles;\
+        }
+
+    if (tileSize < 1) ABORT("tileSize must be positive")
+
+    //one model per channel - these can be different shapes
+    fModels = PySequence_Fast(models, "models must be a sequence of float32 3D arrays");
+    if (fModels == NULL) goto FINALIZE_InterpolateTiles;
+    nModels = (int) PySequence_Fast_GET_SIZE(fModels);
+    if (nModels < 1) ABORT("Need at least one model")
+
+    amods = (PyArrayObject **) calloc(nModels, sizeof(PyArrayObject *));
+    mods = (const float **) malloc(nModels*sizeof(float *));
+    sizes = (int *) malloc(3*nModels*sizeof(int));
+    if ((amods == NULL) || (mods == NULL) || (sizes == NULL)) ABORT("Error allocating memory")
+
+    for (k = 0; k < nModels; k++)
+    {
+        amods[k] = (PyArrayObject *) PyArray_ContiguousFromObject(PySequence_Fast_GET_ITEM(fModels, k), NPY_FLOAT, 3, 3);
+        if (amods[k] == NULL) ABORT("Bad model")
+        if (PyArray_DIM(amods[k], 2) < 2) ABORT("Models must have at least 2 z slices")
+        mods[k] = (const float *) PyArray_DATA(amods[k]);
+        sizes[3*k] = (int) PyArray_DIM(amods[k], 0);
+        sizes[3*k + 1] = (int) PyArray_DIM(amods[k], 1);
+        sizes[3*k + 2] = (int) PyArray_DIM(amods[k], 2);
+    }
+
+    if (!PyArray_Check(out) || (PyArray_TYPE((PyArrayObject *) out) != NPY_FLOAT) ||
+        !PyArray_ISCARRAY((PyArrayObject *) out) || (PyArray_NDIM((PyArrayObject *) out) != 2))
+        ABORT("output must be a contiguous float32 2D array")
+
+    oSizeX = (int) PyArray_DIM((PyArrayObject *) out, 0);
+    oSizeY = (int) PyArray_DIM((PyArrayObject *) out, 1);
+    outStride = oSizeY;
+    res = (float *) PyArray_DATA((PyArrayObject *) out);
+
+    ax = (PyArrayObject *) PyArray_ContiguousFromObject(xv, NPY_FLOAT, 1, 1);
+    if (ax == NULL) ABORT("Bad x")
+    npts = (int) PyArray_DIM(ax, 0);
+
+    ay = (PyArrayObject *) PyArray_ContiguousFromObject(yv, NPY_FLOAT, 1, 1);
+    if ((ay == NULL) || (PyArray_DIM(ay, 0) != npts)) ABORT("Bad y")
+
+    az = (PyArrayObject *) PyArray_ContiguousFromObject(zv, NPY_FLOAT, 1, 1);
+    if ((az == NULL) || (PyArray_DIM(az, 0) != npts)) ABORT("Bad z")
+
+    aA = (PyArrayObject *) PyArray_ContiguousFromObject(Av, NPY_FLOAT, 1, 1);
+    if ((aA == NULL) || (PyArray_DIM(aA, 0) != npts)) ABORT("Bad A")
+
+    an = (PyArrayObject *) PyArray_ContiguousFromObject(nv, NPY_INT, 1, 1);
+    if ((an == NULL) || (PyArray_DIM(an, 0) != npts)) ABORT("Bad nx")
+
+    ac = (PyArrayObject *) PyArray_ContiguousFromObject(cv, NPY_INT, 1, 1);
+    if ((ac == NULL) || (PyArray_DIM(ac, 0) != npts)) ABORT("Bad chan")
+
+    x = (float *) PyArray_DATA(ax);
+    y = (float *) PyArray_DATA(ay);
+    z = (float *) PyArray_DATA(az);
+    A = (float *) PyArray_DATA(aA);
+    nx = (int *) PyArray_DATA(an);
+    chan = (int *) PyArray_DATA(ac);
+
+    for (i = 0; i < npts; i++)
+    {
+        if ((chan[i] < 0) || (chan[i] >= nModels)) ABORT("chan out of range")
+        //make sure the ROI stays inside the model for this channel
+        sz = sizes + 3*chan[i];
+        if ((nx[i] < 0) || (sz[0]/2 + nx[i] + 1 >= sz[0]) || (sz[1]/2 + nx[i] + 1 >= sz[1])) ABORT("nx too large for model")
+    }
+
+    nTY = (oSizeY + tileSize - 1)/tileSize;
+    nTiles = ((oSizeX + tileSize - 1)/tileSize)*nTY;
+
+    as = (PyArrayObject *) PyArray_ContiguousFromObject(sv, NPY_INT, 1, 1);
+    if ((as == NULL) || (PyArray_DIM(as, 0) != nTiles + 1)) ABORT("Bad tileStarts - does tileSize match TileBins?")
+    starts = (int *) PyArray_DATA(as);
+
+    ai = (PyArrayObject *) PyArray_ContiguousFromObject(iv, NPY_INT, 1, 1);
+    if ((ai == NULL) || (PyArray_DIM(ai, 0) != starts[nTiles])) ABORT("Bad tileIdx")
+    idx = (int *) PyArray_DATA(ai);
+
+    for (j = 0; j < starts[nTiles]; j++)
+        if ((idx[j] < 0) || (idx[j] >= npts)) ABORT("tileIdx out of range")
+
+    if (endTile < 0) endTile = nTiles;
+    startTile = MAX(startTile, 0);
+    endTile = MIN(endTile, nTiles);
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (t = startTile; t < endTile; t++)
+    {
+        //clip to the tile, and to the output size less one as in InterpolateInplaceM
+        xlo = (t/nTY)*tileSize;
+        xhi = MIN(xlo + tileSize, oSizeX - 1);
+        ylo = (t%nTY)*tileSize;
+        yhi = MIN(ylo + tileSize, oSizeY - 1);
+
+        for (j = starts[t]; j < starts[t + 1]; j++)
+        {
+            i = idx[j];
+            sz = sizes + 3*chan[i];
+            splat_emitter(mods[chan[i]], sz[0], sz[1], sz[2], res, outStride, x[i], y[i], z[i], A[i], nx[i],
+                          dx, dy, dz, xlo, xhi, ylo, yhi);
+        }
+    }
+    Py_END_ALLOW_THREADS;
+
+    for (k = 0; k < nModels; k++) Py_XDECREF(amods[k]);
+    free(amods);
+    free(mods);
+    free(sizes);
+    Py_XDECREF(fModels);
+
+    Py_XDECREF(ax);
+    Py_XDECREF(ay);
+    Py_XDECREF(az);
+    Py_XDECREF(aA);
+    Py_XDECREF(an);
+    Py_XDECREF(ac);
+    Py_XDECREF(as);
+    Py_XDECREF(ai);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+
+FINALIZE_InterpolateTiles:
+    #undef ABORT
+
+    if (amods)
+    {
+        for (k = 0; k < nModels; k++) Py_XDECREF(amods[k]);
+        free(amods);
+    }
+    if (mods) free(mods);
+    if (sizes) free(sizes);
+    Py_XDECREF(fModels);
+
+    Py_XDECREF(ax);
+    Py_XDECREF(ay);
+    Py_XDECREF(az);
+    Py_XDECREF(aA);
+    Py_XDECREF(an);
+    Py_XDECREF(ac);
+    Py_XDECREF(as);
+    Py_XDECREF(ai);
+
+    return NULL;
+}
+
+
 static PyMethodDef cInterpMethods[] = {
     {"Interpolate",  (PyCFunction)Interpolate, METH_VARARGS | METH_KEYWORDS,
     "Generate a histogram of pairwise distances between two sets of points.\n. Arguments are: 'x1', 'y1', 'x2', 'y2', 'nBins'= 1e3, 'binSize' = 1"},
@@ -622,6 +982,15 @@ static PyMethodDef cInterpMethods[] = {
     "Generate a histogram of pairwise distances between two sets of points.\n. Arguments are: 'x1', 'y1', 'x2', 'y2', 'nBins'= 1e3, 'binSize' = 1"},
     {"InterpolateInplaceM",  (PyCFunction)InterpolateInplaceM, METH_VARARGS | METH_KEYWORDS,
     "Generate a histogram of pairwise distances between two sets of points.\n. Arguments are: 'x1', 'y1', 'x2', 'y2', 'nBins'= 1e3, 'binSize' = 1"},
+    {"TileBins",  (PyCFunction)TileBins, METH_VARARGS | METH_KEYWORDS,
+    "Sort emitters into square tiles of a [sizeX, sizeY] output image, based on their ROIs. Returns (tileStarts, "
+    "tileIdx) where the emitters touching tile t are tileIdx[tileStarts[t]:tileStarts[t+1]].\n Arguments are: 'x0', "
+    "'y0', 'nx', 'sizeX', 'sizeY', 'dx', 'dy', 'tileSize'=32"},
+    {"InterpolateTiles",  (PyCFunction)InterpolateTiles, METH_VARARGS | METH_KEYWORDS,
+    "Render emitters into tiles [startTile, endTile) of output, as for InterpolateInplaceM but with per-emitter "
+    "models. Tiles can be rendered in parallel.\n Arguments are: 'models' (sequence of float32 3D arrays), 'output', "
+    "'x0', 'y0', 'z0', 'Av', 'nx', 'chan' (model index for each emitter), 'tileStarts', 'tileIdx' (from TileBins), "
+    "'dx', 'dy', 'dz', 'tileSize'=32, 'startTile'=0, 'endTile'=nTiles"},
 
 
     {NULL, NULL, 0, NULL}        /* Sentinel */
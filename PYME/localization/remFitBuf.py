@@ -80,6 +80,19 @@ class BufferManager(object):
         self.bBuffer = None
         self.dataSourceID = None
         
+    def _frameCacheArgs(self, dataSourceID):
+        """Use the node-wide shared frame cache for series on the cluster (which are write-once, so can be safely cached
+        by name)"""
+        if not dataSourceID.upper().startswith('PYME-CLUSTER://'):
+            return {}
+        
+        from PYME.IO import frameCache
+        cache = frameCache.get_cache()
+        if cache is None:
+            return {}
+        
+        return {'frameCache' : cache, 'seriesKey' : dataSourceID}
+        
     def updateBuffers(self, md, dataSourceModule, bufferLen):
         """Update the various buffers. """
         if dataSourceModule is None:
@@ -91,7 +104,8 @@ class BufferManager(object):
 
         #read the data
         if not self.dataSourceID == md.dataSourceID: #avoid unnecessary opening and closing 
-            self.dBuffer = buffers.dataBuffer(DataSource(md.dataSourceID, md.taskQueue), bufferLen)
+            self.dBuffer = buffers.dataBuffer(DataSource(md.dataSourceID, md.taskQueue), bufferLen,
+                                              **self._frameCacheArgs(md.dataSourceID))
             self.bBuffer = None
         
         #fix our background buffers
@@ -148,12 +148,21 @@ class DualMarchingCubes(ModuleBase):
         # from PYME.experimental import triangle_mesh
         from PYME.experimental import _triangle_mesh as triangle_mesh
         
-        dmc = dual_marching_cubes.PiecewiseDualMarchingCubes(self.threshold_density)
-        dmc.set_octree(namespace[self.input].truncate_at_n_points(int(self.n_points_min)))
-        tris = dmc.march(dual_march=False)
-
-        print('Generating TriangularMesh object')
-        surf = triangle_mesh.TriangleMesh.from_np_stl(tris, smooth_curvature=self.smooth_curvature)
+        ot = namespace[self.input].truncate_at_n_points(int(self.n_points_min))
+        
+        try:
+            vertices, faces = dual_marching_cubes.march_octree(ot, self.threshold_density, piecewise=True)
+            
+            print('Generating TriangularMesh object')
+            surf = triangle_mesh.TriangleMesh(vertices, faces, smooth_curvature=self.smooth_curvature)
+        except ImportError:
+            # native module not built - fall back to the python implementation
+            dmc = dual_marching_cubes.PiecewiseDualMarchingCubes(self.threshold_density)
+            dmc.set_octree(ot)
+            tris = dmc.march(dual_march=False)
+    
+            print('Generating TriangularMesh object')
+            surf = triangle_mesh.TriangleMesh.from_np_stl(tris, smooth_curvature=self.smooth_curvature)
         
         print('Generated TriangularMesh object')
         
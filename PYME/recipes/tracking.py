@@ -73,9 +73,7 @@ class TrackFeatures(ModuleBase):
             self._tracker.r0 = self.r0
             self._tracker.linkageCuttoffProb = self.pLinkCutoff
 
-        for i in range(1, (int(objects['t'].max()) + 1)):
-            L = self._tracker.calcLinkages(i,i-1)
-            self._tracker.updateTrack(i, L)
+        self._tracker.track()
             
         clumpSizes = np.zeros_like(self._tracker.clumpIndex)
         
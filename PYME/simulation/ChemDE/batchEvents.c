@@ -0,0 +1,257 @@
+/*
+##################
+# batchEvents.c
+#
+# Copyright David Baddeley, 2019
+# d.baddeley@auckland.ac.nz
+#
+# This file may NOT be distributed without express permision from David Baddeley
+#
+##################
+ */
+
+/*
+Event counting (see countEvents.pyx) and on/off dwell time histograms for many traces and thresholds at once.
+
+countEvents counts an event whenever a trace is on and at least `threshold` frames have passed since the last on
+frame. Rather than re-scanning the trace for each threshold, we find the on/off transitions once, histogram the gaps
+between successive on frames, and read the count for every threshold off the cumulative gap histogram.
+
+Transitions are found 64 frames at a time: the on frames are packed into a bit mask, transitions are the bits which
+differ from their predecessor, and we only visit the (usually few) set bits of the transition mask.
+*/
+
+#include "Python.h"
+#include <math.h>
+#include "numpy/arrayobject.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define MIN(a, b) ((a<b) ? a : b)
+#define MAX(a, b) ((a>b) ? a : b)
+
+/* countEvents starts with the last observation at -100000 - replicate this for the first event */
+#define FIRST_OBS -100000
+
+#ifdef _MSC_VER
+#include <intrin.h>
+static int ctz64(uint64_t x)
+{
+    unsigned long idx;
+    _BitScanForward64(&idx, x);
+    return (int) idx;
+}
+#else
+#define ctz64(x) __builtin_ctzll(x)
+#endif
+
+/*
+Process a single trace, writing the event counts for each threshold into counts and the dwell time histograms into
+onHist and offHist. gaps is scratch space of size maxThreshold + 1.
+
+Runs truncated by the start or end of the trace are not included in the dwell time histograms. Dwell times longer
+than nBins frames are accumulated in the last bin.
+*/
+static void trace_events(const npy_int32 *trace, int nFrames, const npy_int32 *thresholds, int nThresholds,
+                         int maxThreshold, npy_int32 *counts, npy_int32 *onHist, npy_int32 *offHist, int nBins,
+                         npy_int64 *gaps)
+{
+    int i, j, k, nb;
+    int state = 0;          // on/off state before the current frame
+    int runStart = 0;       // start of the current run
+    int lastOn = FIRST_OBS; // last on frame
+    uint64_t mask, trans;
+
+    for (i = 0; i <= maxThreshold; i++) gaps[i] = 0;
+    for (i = 0; i < nBins; i++)
+    {
+        onHist[i] = 0;
+        offHist[i] = 0;
+    }
+
+    for (j = 0; j < nFrames; j += 64)
+    {
+        nb = MIN(64, nFrames - j);
+
+        //pack the on frames into a mask - no branches, so the compiler is free to vectorise this
+        mask = 0;
+        for (i = 0; i < nb; i++) mask |= ((uint64_t) (trace[j + i] != 0)) << i;
+
+        trans = mask ^ ((mask << 1) | (uint64_t) state);
+        if (nb < 64) trans &= (((uint64_t) 1) << nb) - 1;
+
+        while (trans)
+        {
+            k = ctz64(trans);
+            trans &= trans - 1;
+            i = j + k;
+
+            if (!state)
+            {
+                //off -> on: the gap since the last on frame is i - lastOn
+                gaps[(int) MIN((npy_int64) i - lastOn, (npy_int64) maxThreshold)]++;
+                if (runStart > 0) offHist[MIN(i - runStart, nBins) - 1]++;
+            } else
+            {
+                //on -> off: every frame of the run after the first has a gap of 1
+                gaps[1] += i - runStart - 1;
+                lastOn = i - 1;
+                if (runStart > 0) onHist[MIN(i - runStart, nBins) - 1]++;
+            }
+
+            state = !state;
+            runStart = i;
+        }
+    }
+
+    //close a run which is still on at the end of the trace (not counted in the dwell times)
+    if (state) gaps[1] += nFrames - runStart - 1;
+
+    //counts[t] = number of gaps >= thresholds[t]; gaps[maxThreshold] already holds everything >= maxThreshold
+    for (i = maxThreshold - 1; i >= 0; i--) gaps[i] += gaps[i + 1];
+
+    for (i = 0; i < nThresholds; i++) counts[i] = (npy_int32) gaps[MIN(MAX(thresholds[i], 0), maxThreshold)];
+}
+
+static PyObject * countEventsBatch(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *oTraces=0, *oThresholds=0, *oCounts=0, *oOnHist=0, *oOffHist=0;
+    PyArrayObject *aTraces=0, *aThresholds=0, *aCounts, *aOnHist, *aOffHist;
+    npy_int32 *traces, *thresholds, *counts, *onHist, *offHist;
+    npy_int64 *gaps = NULL;
+    int nTraces, nFrames, nThresholds, nBins, maxThreshold, i;
+    int startTrace = 0, endTrace = -1;
+
+    static char *kwlist[] = {"traces", "thresholds", "counts", "onHist", "offHist", "startTrace", "endTrace", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOOOO|ii", kwlist, &oTraces, &oThresholds, &oCounts, &oOnHist,
+         &oOffHist, &startTrace, &endTrace))
+        return NULL;
+
+    #define ABORT(msg) {\
+        PyErr_Format(PyExc_RuntimeError, msg);\
+        goto FINALIZE_countEventsBatch;\
+        }
+
+    aTraces = (PyArrayObject *) PyArray_ContiguousFromObject(oTraces, NPY_INT32, 2, 2);
+    if (aTraces == NULL) ABORT("Bad traces - expecting a 2D int32 array")
+    nTraces = (int) PyArray_DIM(aTraces, 0);
+    nFrames = (int) PyArray_DIM(aTraces, 1);
+
+    aThresholds = (PyArrayObject *) PyArray_ContiguousFromObject(oThresholds, NPY_INT32, 1, 1);
+    if (aThresholds == NULL) ABORT("Bad thresholds")
+    nThresholds = (int) PyArray_DIM(aThresholds, 0);
+
+    //counts and histograms are output arrays and must be written in place
+    if (!PyArray_Check(oCounts) || !PyArray_Check(oOnHist) || !PyArray_Check(oOffHist))
+        ABORT("counts, onHist and offHist must be arrays")
+    aCounts = (PyArrayObject *) oCounts;
+    aOnHist = (PyArrayObject *) oOnHist;
+    aOffHist = (PyArrayObject *) oOffHist;
+
+    if ((PyArray_TYPE(aCounts) != NPY_INT32) || !PyArray_ISCARRAY(aCounts) ||
+        (PyArray_SIZE(aCounts) != (npy_intp) nTraces*nThresholds))
+        ABORT("counts must be a contiguous int32 [nTraces, nThresholds] array")
+
+    if ((PyArray_TYPE(aOnHist) != NPY_INT32) || !PyArray_ISCARRAY(aOnHist) || (PyArray_NDIM(aOnHist) != 2) ||
+        (PyArray_DIM(aOnHist, 0) != nTraces) || (PyArray_DIM(aOnHist, 1) < 1))
+        ABORT("onHist must be a contiguous int32 [nTraces, nBins] array")
+    nBins = (int) PyArray_DIM(aOnHist, 1);
+
+    if ((PyArray_TYPE(aOffHist) != NPY_INT32) || !PyArray_ISCARRAY(aOffHist) || (PyArray_NDIM(aOffHist) != 2) ||
+        (PyArray_DIM(aOffHist, 0) != nTraces) || (PyArray_DIM(aOffHist, 1) != nBins))
+        ABORT("offHist must be a contiguous int32 array the same shape as onHist")
+
+    traces = (npy_int32 *) PyArray_DATA(aTraces);
+    thresholds = (npy_int32 *) PyArray_DATA(aThresholds);
+    counts = (npy_int32 *) PyArray_DATA(aCounts);
+    onHist = (npy_int32 *) PyArray_DATA(aOnHist);
+    offHist = (npy_int32 *) PyArray_DATA(aOffHist);
+
+    //gaps longer than the largest threshold all count the same, so only histogram up to there. No gap can be longer
+    //than nFrames - FIRST_OBS (the first on frame is measured from FIRST_OBS), so larger thresholds are clamped to
+    //that - otherwise a huge threshold would mean a huge allocation.
+    maxThreshold = 1;
+    for (i = 0; i < nThresholds; i++) maxThreshold = MAX(maxThreshold, thresholds[i]);
+    maxThreshold = MIN(maxThreshold, nFrames - FIRST_OBS);
+
+    gaps = (npy_int64 *) malloc(((size_t) maxThreshold + 1)*sizeof(npy_int64));
+    if (gaps == NULL) ABORT("Error allocating memory")
+
+    if (endTrace < 0) endTrace = nTraces;
+    startTrace = MAX(startTrace, 0);
+    endTrace = MIN(endTrace, nTraces);
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (i = startTrace; i < endTrace; i++)
+    {
+        trace_events(traces + (size_t) i*nFrames, nFrames, thresholds, nThresholds, maxThreshold,
+                     counts + (size_t) i*nThresholds, onHist + (size_t) i*nBins, offHist + (size_t) i*nBins, nBins,
+                     gaps);
+    }
+    Py_END_ALLOW_THREADS;
+
+    free(gaps);
+
+    Py_XDECREF(aTraces);
+    Py_XDECREF(aThresholds);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+
+FINALIZE_countEventsBatch:
+    #undef ABORT
+
+    if (gaps) free(gaps);
+
+    Py_XDECREF(aTraces);
+    Py_XDECREF(aThresholds);
+
+    return NULL;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+static PyMethodDef batchEventsMethods[] = {
+    {"countEventsBatch",  countEventsBatch, METH_VARARGS | METH_KEYWORDS,
+    "Count events (as countEvents) for each of traces [startTrace, endTrace) and each threshold, and histogram the "
+    "on and off dwell times, writing the results into `counts`, `onHist` and `offHist`.\n Arguments are: 'traces' "
+    "(int32 [nTraces, nFrames]), 'thresholds' (int32 [nThresholds]), 'counts' (int32 [nTraces, nThresholds]), "
+    "'onHist', 'offHist' (int32 [nTraces, nBins]), 'startTrace'=0, 'endTrace'=nTraces"},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+#pragma GCC diagnostic pop
+
+#if PY_MAJOR_VERSION>=3
+static struct PyModuleDef moduledef = {
+        PyModuleDef_HEAD_INIT,
+        "batchEvents",     /* m_name */
+        "event counting and dwell times for many traces",  /* m_doc */
+        -1,                  /* m_size */
+        batchEventsMethods,    /* m_methods */
+        NULL,                /* m_reload */
+        NULL,                /* m_traverse */
+        NULL,                /* m_clear */
+        NULL,                /* m_free */
+    };
+
+PyMODINIT_FUNC PyInit_batchEvents(void)
+{
+	PyObject *m;
+    m = PyModule_Create(&moduledef);
+    import_array()
+    return m;
+}
+
+#else
+PyMODINIT_FUNC initbatchEvents(void)
+{
+    PyObject *m;
+
+    m = Py_InitModule("batchEvents", batchEventsMethods);
+    import_array()
+}
+#endif
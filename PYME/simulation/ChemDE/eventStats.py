@@ -0,0 +1,71 @@
+#!/usr/bin/python
+##################
+# eventStats.py
+#
+# Copyright David Baddeley, 2019
+# d.baddeley@auckland.ac.nz
+#
+# This file may NOT be distributed without express permision from David Baddeley
+#
+##################
+"""
+Event counts and dwell time statistics for many blinking traces at once.
+"""
+import numpy as np
+import multiprocessing
+from PYME.util.threaded import run_threaded
+
+
+def countEventsBatch(traces, thresholds, nBins=100, nThreads=None):
+    """
+    Count events in each of a set of traces for a range of thresholds, and histogram the on and off dwell times.
+
+    Equivalent to calling `countEvents.countEvents(trace, threshold)` for every trace and threshold, but each trace is
+    only scanned once, and traces are processed in parallel.
+
+    Parameters
+    ----------
+    traces : array_like
+        [nTraces, nFrames] (or [nFrames]) array - a frame is 'on' if it is non-zero
+    thresholds : array_like
+        thresholds, in frames (truncated to integers as in countEvents)
+    nBins : int
+        number of bins in the dwell time histograms. Bin i counts runs of i + 1 frames, with longer runs in the last bin.
+    nThreads : int
+        number of threads to use, defaults to the number of CPUs
+
+    Returns
+    -------
+    counts : ndarray
+        int32 [nTraces, nThresholds] event counts
+    onHist, offHist : ndarray
+        int32 [nTraces, nBins] histograms of on and off dwell times. Runs which are truncated by the start or end of
+        the trace are not included.
+    """
+    from PYME.simulation.ChemDE import batchEvents
+
+    traces = np.ascontiguousarray(traces)
+    squeeze = traces.ndim == 1
+    traces = np.atleast_2d(traces != 0).astype('int32')
+    # clip before converting so that very large thresholds don't wrap around (the native code clamps them further)
+    thresholds = np.clip(np.atleast_1d(thresholds), -1, np.iinfo('int32').max).astype('int32')
+
+    nTraces = traces.shape[0]
+    counts = np.zeros([nTraces, len(thresholds)], 'int32')
+    onHist = np.zeros([nTraces, nBins], 'int32')
+    offHist = np.zeros([nTraces, nBins], 'int32')
+
+    if nThreads is None:
+        nThreads = multiprocessing.cpu_count()
+
+    bounds = np.linspace(0, nTraces, max(min(nThreads, nTraces), 1) + 1).astype('i')
+
+    def _count(start, end):
+        batchEvents.countEventsBatch(traces, thresholds, counts, onHist, offHist, start, end)
+
+    run_threaded(_count, list(zip(bounds[:-1], bounds[1:])))
+
+    if squeeze:
+        return counts[0], onHist[0], offHist[0]
+
+    return counts, onHist, offHist
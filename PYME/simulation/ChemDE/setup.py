@@ -26,6 +26,11 @@ def configuration(parent_package = '', top_path = None):
         include_dirs = [get_numpy_include_dirs()],
 	extra_compile_args = ['-O3', '-fno-exceptions'])
 
+    config.add_extension('batchEvents',
+        sources=['batchEvents.c'],
+        include_dirs = [get_numpy_include_dirs()],
+	extra_compile_args = ['-O3', '-fno-exceptions'])
+
     return config
 
 if __name__ == '__main__':
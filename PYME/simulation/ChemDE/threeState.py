@@ -65,7 +65,7 @@ plt.xlabel('Time [s]')
 #            lastObs = i
 #    return nEvents
 
-from countEvents import countEvents
+from eventStats import countEventsBatch
 
 densities = [1,2,5,10,20,50,100] #molecules/diffraction limited volume
 #densities = [100]
@@ -86,9 +86,8 @@ for j in np.arange(nIters):
         traces.append(dm.DoSteps(NSteps))
 
     for d in densities:
-        for k in range(100/d):
-            tr = ((np.vstack(traces[(k*d):(k*d + d)]) == 1).sum(0) > .5).astype('int32')
-            eventCounts[d] += np.array([countEvents(tr, td) for td in trange])
+        trs = [((np.vstack(traces[(k*d):(k*d + d)]) == 1).sum(0) > .5) for k in range(100//d)]
+        eventCounts[d] += countEventsBatch(np.vstack(trs), trange)[0].sum(0)
 
 plt.figure()
 for d in densities:
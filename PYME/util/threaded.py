@@ -0,0 +1,48 @@
+"""
+Helpers for splitting work between threads.
+
+Most of our native extensions release the GIL, so the heavy lifting can be divided between python threads, each
+working on its own range of the output.
+"""
+import threading
+
+
+def run_threaded(fn, ranges):
+    """
+    Call `fn(*r)` for each `r` in `ranges`, each in its own thread, and wait for all the calls to finish.
+
+    Exceptions don't propagate out of threads, so we keep them and re-raise the first one once all threads are done.
+    If there is only one range, `fn` is called directly in the current thread.
+
+    Parameters
+    ----------
+    fn : callable
+        function to call
+    ranges : sequence
+        arguments for each call, as tuples (typically the (start, end) of the work for that thread). Non-tuple
+        entries are passed as a single argument.
+    """
+    ranges = [r if isinstance(r, tuple) else (r,) for r in ranges]
+
+    if len(ranges) == 1:
+        fn(*ranges[0])
+        return
+
+    errors = []
+
+    def _run(args):
+        try:
+            fn(*args)
+        except Exception as e:
+            errors.append(e)
+
+    threads = [threading.Thread(target=_run, args=(r,)) for r in ranges]
+
+    for t in threads:
+        t.start()
+
+    for t in threads:
+        t.join()
+
+    if errors:
+        raise errors[0]
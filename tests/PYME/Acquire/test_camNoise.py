@@ -0,0 +1,52 @@
+import numpy as np
+import threading
+
+from PYME.Acquire.Hardware.Simulator import camNoise
+
+
+def _noisify(im, offset, read_noise, frame, nThreads=1, shutter_open=1, seed=42):
+    out = np.zeros(im.shape, 'd')
+    bounds = np.linspace(0, im.shape[0], nThreads + 1).astype('i')
+    threads = [threading.Thread(target=camNoise.noisify,
+                                args=(im, out, offset, read_noise, 1.0, 1.0, 1.0, 0.0, shutter_open, seed, frame,
+                                      bounds[i], bounds[i + 1])) for i in range(nThreads)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    return out
+
+
+def test_deterministic_per_frame():
+    im = np.full((64, 80), 5, 'f')
+
+    a = _noisify(im, 100., 2., frame=7)
+    b = _noisify(im, 100., 2., frame=7, nThreads=5)
+    c = _noisify(im, 100., 2., frame=8)
+
+    assert np.all(a == b)
+    assert not np.all(a == c)
+
+
+def test_poisson_statistics():
+    for lam in [0.5, 4., 30., 500.]:
+        im = np.full((500, 500), lam, 'f')
+        k = _noisify(im, 0., 0., frame=0)
+
+        assert np.all(k == np.round(k))
+        assert abs(k.mean() - lam) < 5 * np.sqrt(lam / k.size)
+        assert abs(k.var() / lam - 1) < 0.02
+
+
+def test_read_noise_maps():
+    im = np.zeros((500, 500), 'f')
+    offset = np.linspace(90, 110, im.size).reshape(im.shape)
+    read_noise = np.ones(im.shape)
+    read_noise[:, 250:] = 3
+
+    o = _noisify(im, offset, read_noise, frame=0, shutter_open=0) - offset
+
+    assert abs(o.mean()) < 0.02
+    assert abs(o[:, :250].std() - 1) < 0.01
+    assert abs(o[:, 250:].std() - 3) < 0.03
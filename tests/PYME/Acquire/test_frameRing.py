@@ -0,0 +1,80 @@
+import numpy as np
+
+from PYME.Acquire.frameRing import FrameRing
+
+
+def test_push_get():
+    ring = FrameRing((1, 30, 20), 'uint16', 'F', n_slots=4)
+    frames = [np.asfortranarray(np.random.randint(0, 1000, (1, 30, 20)).astype('uint16')) for i in range(6)]
+
+    for i, f in enumerate(frames):
+        assert ring.push(f) == i
+
+    assert ring.n_written == 6
+    # the first two frames have been overwritten
+    assert ring.get(0) is None
+    assert ring.get(1) is None
+    assert not ring.is_valid(1)
+    assert ring.get(6) is None
+
+    for i in range(2, 6):
+        assert np.all(ring.get(i) == frames[i])
+        assert ring.get(i).ctypes.data % 64 == 0
+
+
+def test_begin_write_publish():
+    ring = FrameRing((1, 16, 16), 'uint16', 'C', n_slots=3)
+
+    f = ring.begin_write()
+    f[:] = 7
+    assert ring.get(0) is None  # not visible until published
+    assert ring.publish() == 0
+    assert np.all(ring.get(0) == 7)
+
+    out = np.zeros((16, 16, 1), 'uint16')
+    assert ring.copy_latest(out) == 0
+    assert np.all(out == 7)
+
+
+def test_consumer_overflow_and_release():
+    ring = FrameRing((1, 8, 8), 'uint16', 'F', n_slots=4, max_consumers=2)
+    c = ring.register_consumer()
+
+    for i in range(3):
+        ring.push(np.full((1, 8, 8), i, 'uint16'))
+
+    assert c.lag == 3
+    fn, f = c.next()
+    assert fn == 0 and np.all(f == 0)
+
+    c.release(2)
+    assert c.lag == 1
+
+    # frames 2..5 fit in the ring, frame 6 pushes out frame 2 which we still hold
+    for i in range(3, 7):
+        ring.push(np.full((1, 8, 8), i, 'uint16'))
+
+    write, read, overflows = c.state
+    assert (write, read, overflows) == (7, 3, 1)
+
+    # frames which were overwritten are skipped
+    fn, f = c.next()
+    assert fn == 3 and np.all(f == 3)
+
+    # releasing never moves the cursor backwards
+    c.release(1)
+    assert c.state[1] == 3
+
+    c2 = ring.register_consumer()
+    try:
+        ring.register_consumer()
+        assert False, 'should only be able to register 2 consumers'
+    except RuntimeError:
+        pass
+
+    # closed consumers no longer count overflows
+    c.close()
+    c3 = ring.register_consumer()
+    for i in range(10):
+        ring.push(np.full((1, 8, 8), i, 'uint16'))
+    assert c2.overflows == 6
@@ -0,0 +1,83 @@
+import json
+import socket
+import threading
+import types
+
+import numpy as np
+
+from PYME.Acquire import HTTPSpooler, eventLog
+from PYME.Acquire.frameRing import FrameRing
+from PYME.contrib import dispatch
+from PYME.IO import PZFFormat, EventLogFormat
+
+
+def _fake_cluster(monkeypatch):
+    """Capture anything the spooler sends to the cluster, rather than needing a running data server"""
+    files = {}
+    events = []
+    lock = threading.Lock()
+
+    def put_file(filename, data, serverfilter='', timeout=None):
+        with lock:
+            files[filename] = data
+
+    def put_files(file_list, serverfilter=''):
+        with lock:
+            files.update(file_list)
+
+    def choose_server(serverfilter=''):
+        return 'test', types.SimpleNamespace(address=socket.inet_aton('127.0.0.1'), port=8080)
+
+    monkeypatch.setattr(HTTPSpooler.clusterIO, 'put_file', put_file)
+    monkeypatch.setattr(HTTPSpooler.clusterIO, 'put_files', put_files)
+    monkeypatch.setattr(HTTPSpooler.clusterIO, '_chooseServer', choose_server)
+    monkeypatch.setattr(HTTPSpooler.Spooler, '_put_events', lambda self, chunk: events.append(chunk))
+
+    return files, events
+
+
+def test_spool_from_frame_ring(monkeypatch):
+    files, events = _fake_cluster(monkeypatch)
+
+    n_frames = 120
+    frames = [np.random.randint(0, 1000, (1, 32, 24)).astype('uint16') for i in range(n_frames)]
+
+    # a small ring, so that the spooler has to copy frames out of it (and wait for compression) to keep up
+    ring = FrameRing((1, 32, 24), 'uint16', 'F', n_slots=8)
+    frame_source = dispatch.Signal()
+
+    spooler = HTTPSpooler.Spooler('_testing/spool_from_ring', frame_source, frameShape=None,
+                                  compressionSettings={'compression': PZFFormat.DATA_COMP_RAW,
+                                                       'quantization': PZFFormat.DATA_QUANT_NONE})
+    try:
+        spooler.StartSpool()
+
+        for i, f in enumerate(frames):
+            slot = ring.begin_write()
+            slot[:] = f
+            frame_num = ring.publish()
+            frame_source.send(None, frameData=slot, frameNum=frame_num, frameRing=ring)
+            if i == 10:
+                eventLog.logEvent('TestEvent', 'foo')
+
+        spooler.StopSpool()
+    finally:
+        spooler.cleanup()
+
+    assert spooler.finished()
+    assert spooler.status()['lost_frames'] == 0
+    assert spooler.status()['frames_compressed'] == n_frames
+
+    series = spooler.seriesName
+    for i, f in enumerate(frames):
+        data, header = PZFFormat.loads(files['%s/frame%05d.pzf' % (series, i)])
+        assert np.all(data.squeeze() == f.squeeze())
+
+    assert '%s/metadata.json' % series in files
+    assert '%s/final_metadata.json' % series in files
+
+    # events are streamed to the binary event log, and also saved as a list in events.json at the end
+    evts = EventLogFormat.loads(b''.join(events))
+    assert b'TestEvent' in list(evts['EventName'])
+    json_evts = json.loads(files['%s/events.json' % series])
+    assert [e[0] for e in json_evts] == [n.decode() for n in evts['EventName']]
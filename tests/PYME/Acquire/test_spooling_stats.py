@@ -0,0 +1,73 @@
+import threading
+
+import pytest
+from six.moves import queue
+
+from PYME.Acquire.HTTPSpooler import SpoolingStats, Spooler
+
+
+def test_spooling_stats():
+    stats = SpoolingStats()
+    stats.record_compression(10, 20e6, 5e6, 0.1)
+    stats.record_compression(10, 20e6, 5e6, 0.1)
+    for dt in [0.001, 0.03, 0.03, 100.]:
+        stats.record_upload(dt)
+
+    d = stats.to_dict()
+    assert d['frames_compressed'] == 20
+    assert abs(d['compression_MBps'] - 200) < 1e-6
+    assert abs(d['compression_ratio'] - 4) < 1e-6
+    assert d['n_uploads'] == 4
+    assert d['upload_latency_hist'] == [1, 0, 0, 2, 0, 0, 0, 0, 0, 0, 1]
+
+
+def test_queue_upload_without_upload_threads():
+    sp = Spooler.__new__(Spooler)
+    sp._uploadQueue = queue.Queue(1)
+    sp._uploadQueue.put([])
+    sp._lock = threading.Lock()
+    sp._n_lost_frames = 0
+    sp._dPoll = True
+
+    # a full queue with no upload threads to empty it should raise rather than block forever
+    sp._n_upload_running = 0
+    with pytest.raises(RuntimeError):
+        sp._queue_upload([('a', b''), ('b', b'')])
+
+    # once we have been cleaned up, the chunk is dropped (and counted as lost)
+    sp._n_upload_running = 1
+    sp._dPoll = False
+    sp._queue_upload([('a', b''), ('b', b'')])
+    assert sp._n_lost_frames == 2
+
+
+def test_wait_for_ring():
+    import numpy as np
+    from PYME.Acquire.frameRing import FrameRing
+
+    ring = FrameRing((1, 8, 8), 'uint16', 'F', n_slots=4)
+    consumer = ring.register_consumer()
+
+    sp = Spooler.__new__(Spooler)
+    sp._ring_lock = threading.Lock()
+    sp._ring_released = threading.Condition(sp._ring_lock)
+    sp._ring_consumer = consumer
+    sp._ring_outstanding = {0}
+    sp._ring_next = 4
+    sp._dPoll = True
+    sp._n_compression_running = 1
+
+    for i in range(4):
+        ring.push(np.zeros((1, 8, 8), 'uint16'))
+
+    # frame 0 is still being compressed, so the camera has to wait before it can write the next frame
+    t = threading.Thread(target=sp._wait_for_ring, args=(consumer, ring))
+    t.start()
+    t.join(0.3)
+    assert t.is_alive()
+
+    sp._release_ring_frames([(ring, 0)])
+    t.join(1)
+    assert not t.is_alive()
+    assert consumer.lag == 0
+    assert consumer.overflows == 0
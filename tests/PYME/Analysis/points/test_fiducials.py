@@ -0,0 +1,39 @@
+import numpy as np
+
+
+def _fake_fiducials(n_frames=2000, n_fid=5, seed=3):
+    np.random.seed(seed)
+    t_f = np.arange(n_frames)
+    drift_x = 200 * np.sin(t_f / 500.)
+    drift_y = 0.1 * t_f
+    
+    x0 = 1e4 * np.random.rand(n_fid)
+    y0 = 1e4 * np.random.rand(n_fid)
+    
+    t = np.repeat(t_f, n_fid)
+    x = np.tile(x0, n_frames) + drift_x[t] + 2 * np.random.randn(t.size)
+    y = np.tile(y0, n_frames) + drift_y[t] + 2 * np.random.randn(t.size)
+    
+    # some missed detections
+    keep = np.random.rand(t.size) > 0.05
+    return t[keep], x[keep], y[keep], drift_x, drift_y
+
+
+def test_streaming_drift_matches_true_drift():
+    from PYME.Analysis.points import fiducials
+    t, x, y, drift_x, drift_y = _fake_fiducials()
+    
+    est = fiducials.StreamingDriftEstimator(filter='Median', filterScale=5, minTrackLength=20)
+    # feed in chunks, as during acquisition
+    for chunk in np.array_split(np.arange(t.size), 37):
+        est.add_points(t[chunk], x[chunk], y[chunk], error_x=2 + 0 * x[chunk])
+    est.flush()
+    
+    t_f, drift = est.trajectory()
+    assert len(t_f) == len(drift_x)
+    assert est.n_dropped == 0
+    
+    # drift is relative to the mean position over the first minTrackLength frames
+    err_x = drift['x'] - drift_x
+    err_y = drift['y'] - drift_y
+    assert np.std(err_x[50:]) < 2 and np.std(err_y[50:]) < 2
@@ -0,0 +1,71 @@
+import numpy as np
+
+
+def test_cluster_moments_match_per_cluster():
+    from PYME.Analysis.points import moments
+    np.random.seed(5)
+    labels = np.random.randint(0, 20, 5000)
+    x = 100 * np.random.randn(5000) + 1000 * labels
+    y = 50 * np.random.randn(5000)
+    
+    res = moments.calcClusterMoments(x, y, labels, order=3)
+    
+    assert list(res['label']) == list(range(1, 20))
+    for r in res:
+        ind = labels == r['label']
+        assert r['NEvents'] == ind.sum()
+        np.testing.assert_allclose(r['moments'], moments.calcCenteredMoments(x[ind], y[ind], 3), rtol=1e-8, atol=1e-8)
+        assert np.all(r['momentErrors'] == 0)
+
+
+def test_cluster_moments_monte_carlo():
+    from PYME.Analysis.points import moments
+    np.random.seed(6)
+    labels = np.repeat([1, 2], 2000)
+    x = 100 * np.random.randn(4000)
+    y = 100 * np.random.randn(4000)
+    
+    res = moments.calcClusterMoments(x, y, labels, order=2, nSamples=20, seed=1)
+    # the same seed gives the same result, regardless of threading
+    res1 = moments.calcClusterMoments(x, y, labels, order=2, nSamples=20, seed=1, nThreads=1)
+    np.testing.assert_array_equal(res['moments'], res1['moments'])
+    
+    ref = moments.calcCenteredMoments(x[:2000], y[:2000], 2)
+    # higher order cross moments are noisy - just check the variances
+    np.testing.assert_allclose(res['moments'][0][[2, 0], [0, 2]], ref[[2, 0], [0, 2]], rtol=0.05)
+    assert res['momentErrors'][0][2, 0] > 0
+
+
+def test_measure_objects_by_id_fallback(monkeypatch):
+    from PYME.Analysis.points import objectMeasure, moments
+    np.random.seed(8)
+    labels = np.random.choice([-2, 1, 3], 600)
+    src = {'x': 100 * np.random.randn(600) + 1000 * labels, 'y': 100 * np.random.randn(600),
+           'objectID': labels.astype('f4')}
+    ids = [1, -2, 3]
+    
+    # negative ids are dropped by the native kernel, and get their moments calculated individually
+    res = objectMeasure.measureObjectsByID(src, 10, ids)
+    assert list(res['objID']) == ids
+    assert np.all(res['NEvents'] == [(labels == i).sum() for i in ids])
+    assert np.all(res['moments'][1] != 0)
+    
+    def _missing(*args, **kwargs):
+        raise ImportError('no native moments')
+    
+    monkeypatch.setattr(moments, 'calcClusterMoments', _missing)
+    res1 = objectMeasure.measureObjectsByID(src, 10, ids)
+    np.testing.assert_array_equal(res1['NEvents'], res['NEvents'])
+    np.testing.assert_allclose(res1['xPos'], res['xPos'])
+    assert np.all(res1['moments'] != 0)
+
+
+def test_cluster_moments_raises_for_bad_order():
+    import pytest
+    from PYME.Analysis.points import moments
+    labels = np.repeat([1, 2, 3, 4], 10)
+    x = np.random.randn(40)
+    
+    # errors in the worker threads must not be swallowed (leaving zeroed moments)
+    with pytest.raises(RuntimeError):
+        moments.calcClusterMoments(x, x, labels, order=50, nThreads=4)
@@ -65,3 +65,95 @@ def test_extract_channel():
 
     np.testing.assert_equal(out.data.getSlice(0).squeeze(), 1)
     np.testing.assert_equal(roi_size, out.data.shape[:2])
+
+def test_find_clumps_multiview_pairs_channels():
+    from PYME.Analysis.points.DeClump import deClump
+    np.random.seed(5)
+    n_mol, n_chan = 1000, 4
+    x_mol, y_mol = 5e4 * np.random.rand(n_mol), 5e4 * np.random.rand(n_mol)
+    t_mol = np.random.randint(0, 500, n_mol)
+    
+    # each channel sees every molecule, with a constant offset which is corrected in the clumping kernel
+    offsets = np.array([[0, 0], [300, -200], [-150, 400], [500, 500]], 'f8')
+    x = np.hstack([x_mol + offsets[c, 0] + 5 * np.random.randn(n_mol) for c in range(n_chan)])
+    y = np.hstack([y_mol + offsets[c, 1] + 5 * np.random.randn(n_mol) for c in range(n_chan)])
+    t = np.tile(t_mol, n_chan).astype('i')
+    chan = np.repeat(np.arange(n_chan), n_mol).astype('i')
+    
+    assigned, chan_masks = deClump.findClumpsMultiview(t, x, y, 25. * np.ones_like(x), chan,
+                                                       order=np.argsort(t, kind='mergesort').astype('i'), nFrames=1,
+                                                       chan_dx=-offsets[:, 0], chan_dy=-offsets[:, 1])
+    
+    assert len(np.unique(assigned)) == n_mol
+    for c in range(1, n_chan):
+        assert np.all(assigned[chan == c] == assigned[chan == 0])
+    assert np.all(chan_masks[assigned] == 0xF)
+
+
+def test_find_clumps_multiview_frame_window():
+    from PYME.Analysis.points.DeClump import deClump
+    nFrames = 5
+    # pairs of points at the same position, with gaps of nFrames - 1 (linked) and exactly nFrames (not linked)
+    t = np.array([10, 10 + nFrames - 1, 100, 100 + nFrames], 'i')
+    x = np.array([0, 0, 1e4, 1e4], 'f4')
+    y = np.zeros_like(x)
+    delta_x = 10*np.ones_like(x)
+    
+    assigned, _ = deClump.findClumpsMultiview(t, x, y, delta_x, np.zeros(len(t), 'i'), nFrames=nFrames)
+    assert assigned[0] == assigned[1]
+    assert assigned[2] != assigned[3]
+    
+    # same gap semantics as findClumpsN
+    ref = deClump.findClumpsN(t, x, y, delta_x, nFrames)
+    assert np.all((ref[:, None] == ref[None, :]) == (assigned[:, None] == assigned[None, :]))
+
+
+def test_find_clumps_multiview_large_error():
+    from PYME.Analysis.points.DeClump import deClump
+    np.random.seed(7)
+    n = 2000
+    t = np.sort(np.random.randint(0, 200, n)).astype('i')
+    x, y = 1e4*np.random.rand(n), 1e4*np.random.rand(n)
+    delta_x = 20*np.ones(n)
+    chan = np.zeros(n, 'i')
+    
+    assigned, _ = deClump.findClumpsMultiview(t, x, y, delta_x, chan, nFrames=3)
+    
+    # a single point with a huge error must neither change the clumping of points it can't reach ...
+    delta_x[n//2] = 1e6
+    assigned2, _ = deClump.findClumpsMultiview(t, x, y, delta_x, chan, nFrames=3)
+    later = t > (t[n//2] + 3)
+    assert np.all((assigned[later][:, None] == assigned[later][None, :]) ==
+                  (assigned2[later][:, None] == assigned2[later][None, :]))
+    
+    # ... nor stop it finding its (distant) nearest neighbour in the frame window
+    cand = np.flatnonzero((t > t[n//2] - 3) & (np.arange(n) < n//2))
+    if len(cand) > 0:
+        nearest = cand[np.argmin((x[cand] - x[n//2])**2 + (y[cand] - y[n//2])**2)]
+        assert assigned2[n//2] == assigned2[nearest]
+
+
+def test_find_clumps_multiview_unsorted_without_order():
+    from PYME.Analysis.points.DeClump import deClump
+    np.random.seed(11)
+    n = 500
+    t = np.random.randint(0, 100, n).astype('i')
+    x, y = 1e4*np.random.rand(n), 1e4*np.random.rand(n)
+    delta_x = 200*np.ones(n)
+    chan = np.zeros(n, 'i')
+    
+    ref, _ = deClump.findClumpsMultiview(t, x, y, delta_x, chan, order=np.argsort(t, kind='mergesort').astype('i'),
+                                         nFrames=3)
+    assigned, _ = deClump.findClumpsMultiview(t, x, y, delta_x, chan, nFrames=3)
+    
+    np.testing.assert_array_equal(assigned, ref)
+
+
+def test_find_clumps_multiview_bad_order():
+    from PYME.Analysis.points.DeClump import deClump
+    import pytest
+    t = np.arange(4, dtype='i')
+    x = np.zeros(4)
+    
+    with pytest.raises(RuntimeError):
+        deClump.findClumpsMultiview(t, x, x, np.ones(4), np.zeros(4, 'i'), order=np.array([0, 1, 2, 7], 'i'))
@@ -116,3 +116,39 @@ def test_distance_to_shell_along_vector_from_points():
     dist = FITTER.distance_to_shell_along_vector_from_point(up, query, guess)
     ground_truth = np.sqrt((R_SPHERE ** 2) - ((xq - FITTER.x0) ** 2))
     np.testing.assert_array_almost_equal(ground_truth, dist, decimal=0)
+
+def test_real_sph_harm_basis():
+    np.random.seed(3)
+    azimuth = 2 * np.pi * np.random.rand(100)
+    zenith = np.pi * np.random.rand(100)
+    modes, A = spherical_harmonics.real_sph_harm_basis(azimuth, zenith, n_max=5)
+    for i, (m, n) in enumerate(modes):
+        np.testing.assert_allclose(A[:, i], spherical_harmonics.r_sph_harm(m, n, azimuth, zenith), atol=1e-10)
+
+def test_fit_shells():
+    # two offset copies of the test sphere with different labels
+    x = np.hstack([X, X + 500])
+    y = np.hstack([Y, Y])
+    z = np.hstack([Z, Z])
+    labels = np.hstack([np.ones_like(X), 2 * np.ones_like(X)])
+    shells = spherical_harmonics.fit_shells(x, y, z, labels)
+    
+    assert sorted(shells.keys()) == [1, 2]
+    np.testing.assert_allclose(shells[1].coefficients, shells[2].coefficients, rtol=1e-6, atol=1e-6)
+    np.testing.assert_allclose(shells[2].x0, FITTER.x0 + 500)
+    
+    x_s, y_s, z_s = shells[1].get_fitted_shell(AZIMUTH, ZENITH)
+    np.testing.assert_allclose(np.sort(x_s), np.sort(X), rtol=0.05, atol=np.sqrt(3))
+
+def test_sphere_expansion_underdetermined():
+    # fewer points than modes - should give the minimum norm lstsq solution, rather than NaN
+    np.random.seed(9)
+    azimuth = 2 * np.pi * np.random.rand(10)
+    zenith = np.pi * np.random.rand(10)
+    r = 100 + np.random.rand(10)
+    
+    modes, c, _ = spherical_harmonics.sphere_expansion_batch(azimuth, zenith, r, [0, 10], n_max=3, max_iters=0)
+    _, A = spherical_harmonics.real_sph_harm_basis(azimuth, zenith, n_max=3)
+    
+    assert not np.any(np.isnan(c))
+    np.testing.assert_allclose(c[0], np.linalg.lstsq(A, r, rcond=None)[0], rtol=1e-6, atol=1e-8)
@@ -0,0 +1,32 @@
+import numpy as np
+
+
+def test_fit_quad_surfaces_batch_sphere():
+    from PYME.Analysis.points import surfit
+    np.random.seed(7)
+    R = 1000.
+    v = np.random.randn(3000, 3)
+    v /= np.linalg.norm(v, axis=1)[:, None]
+    pts = (R * v + 1e4).astype('f4')
+    
+    results = surfit.fit_quad_surfaces_batch(pts, 200., fitPos=False)
+    
+    assert len(results) == len(pts)
+    assert np.all(results['N'] >= 10)
+    # curvature of the quadratic approximation to a sphere is 1/(2R) in both directions
+    assert np.allclose(np.median(np.abs(results['A'])), 1. / (2 * R), rtol=0.1)
+    assert np.allclose(np.median(np.abs(results['B'])), 1. / (2 * R), rtol=0.1)
+
+
+def test_fit_quad_surfaces_P_fits_position_by_default():
+    from PYME.Analysis.points import surfit
+    np.random.seed(7)
+    v = np.random.randn(500, 3)
+    v /= np.linalg.norm(v, axis=1)[:, None]
+    pts = (1000. * v + 1e4).astype('f4')
+    
+    res, pos, nPs = surfit.fit_quad_surfaces_P(pts, 300.)
+    results = surfit.fit_quad_surfaces_batch(pts, 300., fitPos=True)
+    
+    np.testing.assert_array_equal(res[0], results['x'])
+    np.testing.assert_array_equal(nPs, results['N'])
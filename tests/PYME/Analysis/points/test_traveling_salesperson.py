@@ -68,3 +68,46 @@ def test_tsp_queue():
     unsorted_distance = calculate_path_length(distance_matrix(positions, positions), dummy_route)
     sorted_distance = calculate_path_length(distance_matrix(sorted_positions, sorted_positions), dummy_route)
     assert sorted_distance < unsorted_distance / 10
+
+def test_knn_two_opt():
+    from PYME.Analysis.points.traveling_salesperson import two_opt
+    np.random.seed(4)
+    n = 1000
+    positions = np.random.rand(n, 2) * 4e3
+    distances = distance_matrix(positions, positions)
+    initial_route = np.argsort(positions.sum(axis=1))
+
+    route, best_distance, og_distance = two_opt.knn_two_opt(positions, initial_route)
+    np.testing.assert_array_equal(np.sort(route), np.arange(n))
+    assert route[0] == initial_route[0]
+    np.testing.assert_almost_equal(best_distance, two_opt.calculate_path_length(distances, route))
+
+    # should be at least as good as the dense version
+    dense_route, dense_distance, _ = two_opt.two_opt(distances, 0.01, initial_route)
+    assert best_distance <= dense_distance
+
+    route, best_distance, og_distance = two_opt.knn_two_opt(positions, initial_route, fixed_endpoint=True)
+    assert (route[0] == initial_route[0]) and (route[-1] == initial_route[-1])
+    assert best_distance < og_distance / 5
+
+    # the caller's route is left alone, even if it is already int32
+    initial_route = initial_route.astype('i4')
+    initial_copy = initial_route.copy()
+    route, best_distance, og_distance = two_opt.knn_two_opt(positions, initial_route)
+    np.testing.assert_array_equal(initial_route, initial_copy)
+    assert best_distance < og_distance
+
+def test_two_opt_sections_threaded_raises_worker_errors(monkeypatch):
+    import pytest
+    from PYME.Analysis.points.traveling_salesperson import sectioned_two_opt, two_opt
+    
+    def _fail(*args, **kwargs):
+        raise RuntimeError('route optimisation failed')
+    
+    monkeypatch.setattr(two_opt, 'knn_two_opt', _fail)
+    
+    positions = np.random.rand(100, 2).astype('f4')
+    route = np.zeros(100, 'i')
+    # a failed section must raise rather than leave a garbage route
+    with pytest.raises(RuntimeError, match='route optimisation failed'):
+        sectioned_two_opt.two_opt_sections_threaded(positions, [50, 50], route, 2)
@@ -0,0 +1,85 @@
+import numpy as np
+
+
+def _lin3z_model(seed):
+    from PYME.Analysis.points import twoColour
+    np.random.seed(seed)
+    names = ['mx', 'my', 'mx2', 'my2', 'mxy', 'mxy2', 'mx2y', 'mx3', 'x0', 'mz', 'mxz', 'myz', 'mxyz']
+    d = dict(zip(names, 10 * np.random.randn(len(names))))
+    d['my3'] = 0
+    return twoColour.lin3zModel(dict=d)
+
+
+def test_apply_shift_fields_matches_models():
+    from PYME.Analysis.points import twoColour
+    spx, spy = _lin3z_model(1), _lin3z_model(2)
+    
+    x = 30e3 * np.random.rand(100000)
+    y = 20e3 * np.random.rand(100000)
+    z = 500 * np.random.randn(100000)
+    chan = np.random.randint(0, 3, 100000)
+    
+    dx, dy = twoColour.apply_shift_fields([(None, None), (spx, spy)], x, y, z, chan=chan)
+    
+    ref = chan == 1
+    assert np.all(dx[~ref] == 0) and np.all(dy[~ref] == 0)
+    assert np.allclose(dx[ref], spx.ev(x[ref], y[ref], z[ref]), atol=0.05)
+    assert np.allclose(dy[ref], spy.ev(x[ref], y[ref], z[ref]), atol=0.05)
+    
+    # re-applying re-uses the cached grid
+    grids, x0, y0 = twoColour.shift_field_grids([(None, None), (spx, spy)], x[:10], y[:10])
+    assert twoColour.shift_field_grids([(None, None), (spx, spy)], x, y)[0] is grids
+
+
+def test_apply_shift_fields_no_chan():
+    from PYME.Analysis.points import twoColour
+    models = [(_lin3z_model(6), _lin3z_model(7)), (_lin3z_model(8), _lin3z_model(9))]
+    np.random.seed(10)
+    
+    x = 30e3 * np.random.rand(10000)
+    y = 20e3 * np.random.rand(10000)
+    
+    # without channels, both the native and python paths use the first set of models for every point
+    dx, dy = twoColour.apply_shift_fields(models, x, y)
+    dx_py, dy_py = twoColour._apply_shift_fields_py(models, x, y)
+    
+    assert np.allclose(dx_py, models[0][0].ev(x, y)) and np.allclose(dy_py, models[0][1].ev(x, y))
+    assert np.allclose(dx, dx_py, atol=0.05) and np.allclose(dy, dy_py, atol=0.05)
+
+
+def test_apply_shift_fields_outliers():
+    from PYME.Analysis.points import twoColour
+    spx, spy = _lin3z_model(3), _lin3z_model(4)
+    np.random.seed(5)
+    
+    x = 30e3 * np.random.rand(1000)
+    y = 20e3 * np.random.rand(1000)
+    x[0], y[1], x[2] = 1e12, -1e12, np.inf
+    
+    dx, dy = twoColour.apply_shift_fields([(spx, spy)], x, y)
+    
+    # the outliers must not blow up the size of the lookup grid ...
+    grids, x0, y0 = twoColour.shift_field_grids([(spx, spy)], x, y)
+    assert max(grids.shape[2:]) <= twoColour._MAX_GRID_SAMPLES
+    
+    # ... and are evaluated directly
+    finite = np.isfinite(x)
+    assert np.allclose(dx[finite], spx.ev(x[finite], y[finite]), rtol=1e-5, atol=0.05)
+    assert np.allclose(dy[finite], spy.ev(x[finite], y[finite]), rtol=1e-5, atol=0.05)
+
+
+def test_shift_field_grid_cache_keeps_unserialisable_models():
+    from PYME.Analysis.points import twoColour
+    
+    class ConstShift(object):
+        def __init__(self, shift):
+            self.shift = shift
+            
+        def ev(self, x, y):
+            return self.shift + 0*x
+    
+    x, y = 1e3 * np.random.rand(10), 1e3 * np.random.rand(10)
+    for shift in range(5):
+        # without a reference in the cache, the ids of these temporary models would be re-used
+        dx, dy = twoColour.apply_shift_fields([(ConstShift(shift), None)], x, y)
+        assert np.allclose(dx, shift)
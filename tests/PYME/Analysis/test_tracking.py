@@ -0,0 +1,33 @@
+import numpy as np
+
+
+def _random_walks(n_particles=100, n_frames=20, step=50., seed=42):
+    np.random.seed(seed)
+    x0 = np.random.rand(n_particles) * 2e4
+    y0 = np.random.rand(n_particles) * 2e4
+    x, y, t = [], [], []
+    for f in range(n_frames):
+        x0 = x0 + step * np.random.randn(n_particles)
+        y0 = y0 + step * np.random.randn(n_particles)
+        keep = np.random.rand(n_particles) > 0.1  # some particles blink off
+        x.append(x0[keep])
+        y.append(y0[keep])
+        t.append(f * np.ones(keep.sum(), 'i'))
+    
+    x, y, t = np.hstack(x), np.hstack(y), np.hstack(t)
+    I = np.random.permutation(len(t))
+    return t[I], np.vstack([x[I], y[I]])
+
+
+def test_native_track_matches_python_linkage():
+    from PYME.Analysis.Tracking import tracking
+    t, xvs = _random_walks()
+    
+    native = tracking.Tracker(t, xvs).track()
+    
+    reference = tracking.Tracker(t, xvs)
+    for i in range(1, t.max() + 1):
+        lMatch, jIndices = reference.calcLinkageMatrix(i, i - 1)
+        reference.updateTrack(i, reference.getLinkageCandidates(lMatch, jIndices))
+    
+    assert np.all(native == reference.clumpIndex)
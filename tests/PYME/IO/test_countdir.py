@@ -3,4 +3,18 @@ def test_dirsize():
     from PYME.IO import countdir
     import os
 
-    assert countdir.dirsize(os.curdir) == len(os.listdir(os.curdir)) + 2  # os.listdir does not count '.' and '..'
\ No newline at end of file
+    assert countdir.dirsize(os.curdir) == len(os.listdir(os.curdir)) + 2  # os.listdir does not count '.' and '..'
+
+
+def test_file_info_series_flags(tmp_path):
+    from PYME.IO import clusterListing as cl
+
+    series = tmp_path / 'series'
+    series.mkdir()
+    (series / 'metadata.json').write_text(u'{}')
+    assert cl._file_info(str(tmp_path), 'series')[1][0] == (cl.FILETYPE_DIRECTORY | cl.FILETYPE_SERIES)
+
+    (series / 'events.pev').write_bytes(b'')
+    (series / 'events.json').write_text(u'{}')
+    assert cl._file_info(str(tmp_path), 'series')[1][0] == (cl.FILETYPE_DIRECTORY | cl.FILETYPE_SERIES |
+                                                            cl.FILETYPE_SERIES_COMPLETE | cl.FILETYPE_SERIES_EVENT_LOG)
@@ -7,6 +7,9 @@ import signal
 import pytest
 import time
 import sys
+import socket
+from io import BytesIO
+from six.moves import http_client
 
 import logging
 logger = logging.getLogger(__name__)
@@ -103,4 +106,118 @@ def test_dircache_purge():
     
         listing = clusterIO.listdir('_testing/lots_of_folders/test_%d/' % i, 'TES1')
     
-    #assert (len(listing) == 10)
\ No newline at end of file
+    #assert (len(listing) == 10)
+
+
+def _connection():
+    """A raw (persistent) HTTP connection to the test server"""
+    name, info = clusterIO._chooseServer('TES1')
+    return http_client.HTTPConnection(socket.inet_ntoa(info.address), info.port, timeout=10)
+
+
+def _request(conn, method, path, body=None):
+    conn.request(method, '/' + path, body=body)
+    r = conn.getresponse()
+    return r.status, r.read()
+
+
+def test_keep_alive():
+    conn = _connection()
+    assert _request(conn, 'PUT', '_testing/keep_alive/a.txt', b'foo')[0] == 200
+    sock = conn.sock
+    
+    assert _request(conn, 'PUT', '_testing/keep_alive/b.txt', b'bar')[0] == 200
+    assert _request(conn, 'GET', '_testing/keep_alive/a.txt') == (200, b'foo')
+    assert _request(conn, 'GET', '_testing/keep_alive/')[0] == 200
+    assert _request(conn, 'GET', '_testing/keep_alive/b.txt') == (200, b'bar')
+    
+    # all of the above should have been served on the same connection
+    assert conn.sock is sock
+    
+    # a rejected put doesn't read the body, so closes the connection. Subsequent requests should still work
+    assert _request(conn, 'PUT', '_testing/keep_alive/a.txt', b'baz')[0] == 405
+    assert _request(conn, 'GET', '_testing/keep_alive/a.txt') == (200, b'foo')
+    
+
+def test_get_large_file():
+    # whole files are sent with sendfile()
+    testdata = os.urandom(5*1024*1024)
+    clusterIO.put_file('_testing/large_file.bin', testdata, 'TES1')
+    
+    conn = _connection()
+    for i in range(2):
+        assert _request(conn, 'GET', '_testing/large_file.bin') == (200, testdata)
+    
+    assert clusterIO.get_file('_testing/large_file.bin', 'TES1') == testdata
+
+
+def test_tabular_part_after_append():
+    import numpy as np
+    from PYME.IO import clusterResults
+    
+    url = 'pyme-cluster://TES1/__aggregate_h5r/_testing/test_part_cache.h5r/foo'
+    conn = _connection()
+    
+    def _get_rows(query='', n_expected=None):
+        # aggregated rows are written to disk in the background - wait for them to show up
+        for i in range(50):
+            status, data = _request(conn, 'GET', '_testing/test_part_cache.h5r/foo.npy' + query)
+            assert status == 200
+            rows = np.load(BytesIO(data))
+            if n_expected is None or len(rows) == n_expected:
+                return rows['a']
+            time.sleep(0.1)
+            
+        raise AssertionError('Expected %d rows, got %d' % (n_expected, len(rows)))
+    
+    testdata = np.zeros(10, dtype=[('a', '<f4'), ('b', '<f4')])
+    testdata['a'] = np.arange(10)
+    clusterResults.fileResults(url, testdata)
+    
+    assert np.all(_get_rows(n_expected=10) == np.arange(10))
+    # repeated requests for a slice are served from the cache
+    assert np.all(_get_rows('?from=5&to=15') == np.arange(5, 10))
+    assert np.all(_get_rows('?from=5&to=15') == np.arange(5, 10))
+    
+    testdata['a'] = np.arange(10, 20)
+    clusterResults.fileResults(url, testdata)
+    
+    # after appending, we should see the new rows, not a stale cached copy
+    assert np.all(_get_rows(n_expected=20) == np.arange(20))
+    assert np.all(_get_rows('?from=5&to=15') == np.arange(5, 15))
+
+
+def test_multiput_multiget(monkeypatch):
+    from PYME import config
+    monkeypatch.setitem(config.config, 'clusterIO-batch-puts', True)
+    
+    test_files = [('_testing/test_multi/file_%d' % i, os.urandom(100 + i)) for i in range(20)]
+    # a single file in its own directory is sent as a plain put
+    test_files.append(('_testing/test_multi_single/file_0', b'single file\n'))
+    
+    # should go as a single __multiput request (plus the plain put)
+    assert len(clusterIO._batch_files(test_files)) == 2
+    clusterIO.put_files(test_files, 'TES1')
+    
+    # the batch should be unpacked into individual files on the server
+    assert sorted(clusterIO.listdir('_testing/test_multi/', 'TES1')) == sorted(['file_%d' % i for i in range(20)])
+    for fn, data in test_files:
+        assert clusterIO.get_file(fn, 'TES1', use_file_cache=False, local_short_circuit=False) == data
+    
+    # get the files back (in a different order) with __multiget
+    names = [fn for fn, data in test_files][::-1]
+    retrieved = clusterIO.get_files(names, 'TES1', use_file_cache=False, local_short_circuit=False)
+    assert retrieved == [data for fn, data in test_files][::-1]
+    
+    # check that the server actually serviced the batch (rather than get_files falling back to individual gets)
+    locs = clusterIO.locate_file('_testing/test_multi/file_0', 'TES1', return_first_hit=True)
+    dirurl = clusterIO._chooseLocation(locs).rsplit('/', 1)[0]
+    batch = clusterIO._get_batch(dirurl, ['file_3', 'file_1', 'missing'])
+    assert [name for name, data in batch] == ['file_3', 'file_1', 'missing']
+    assert batch[0][1].tobytes() == test_files[3][1]
+    assert batch[1][1].tobytes() == test_files[1][1]
+    assert batch[2][1] is None
+    
+    with pytest.raises(IOError):
+        clusterIO.get_files(['_testing/test_multi/file_0', '_testing/test_multi/missing'], 'TES1',
+                            use_file_cache=False, local_short_circuit=False)
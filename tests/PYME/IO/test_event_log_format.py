@@ -0,0 +1,40 @@
+import numpy as np
+import tempfile
+import os
+
+from PYME.IO import EventLogFormat
+
+
+EVENTS = [('StartAq', '0', 1.0), ('ProtocolFocus', '12, 3.5', 2.0), (u'StartAq', u'x'*300, 0.5), ('Empty', '', 3.0)]
+
+
+def test_round_trip():
+    # chunks can be appended in any order, with empty chunks and a truncated (still being written) chunk at the end
+    data = EventLogFormat.dumps(EVENTS[:2]) + EventLogFormat.dumps([]) + EventLogFormat.dumps(EVENTS[2:])
+    data = data + EventLogFormat.dumps(EVENTS)[:50]
+    assert len(data) % 8 == 2
+
+    ev = EventLogFormat.loads(data)
+
+    assert list(ev['Time']) == [0.5, 1.0, 2.0, 3.0]
+    assert list(ev['EventName']) == [b'StartAq', b'StartAq', b'ProtocolFocus', b'Empty']
+    assert list(ev['EventDescr']) == [b'x'*256, b'0', b'12, 3.5', b'']
+
+
+def test_load_file():
+    events = [('Event%d' % (i % 7), '%d' % i, float(i)) for i in range(100000)]
+
+    fd, fn = tempfile.mkstemp(suffix='.pev')
+    try:
+        with os.fdopen(fd, 'wb') as f:
+            f.write(EventLogFormat.dumps(events[:500]))
+            f.write(EventLogFormat.dumps(events[500:]))
+
+        ev = EventLogFormat.load_file(fn)
+        assert len(ev) == len(events)
+        assert np.all(ev['Time'] == np.arange(len(events)))
+        assert ev['EventName'][99999] == b'Event4'
+        assert ev['EventDescr'][12345] == b'12345'
+        del ev
+    finally:
+        os.remove(fn)
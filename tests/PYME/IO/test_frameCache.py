@@ -0,0 +1,129 @@
+import os
+import uuid
+
+import numpy as np
+import pytest
+
+from PYME.IO import frameCache
+from PYME.IO import buffers
+
+pytestmark = pytest.mark.skipif(frameCache.fcntl is None, reason='shared frame cache needs fcntl')
+
+
+@pytest.fixture
+def cache():
+    c = frameCache.SharedFrameCache('pyme-frame-cache-test-%s' % uuid.uuid4().hex, size=8*1024, slot_bytes=1024)
+    yield c
+    c.close()
+    os.unlink(c.filename)
+
+
+def test_put_get(cache):
+    data = np.arange(100, dtype='uint16').reshape(10, 10)
+    assert cache.put('series', 3, data)
+
+    f = cache.get('series', 3)
+    assert np.all(f == data) and f.dtype == data.dtype
+    assert not f.flags.writeable
+
+    assert cache.get('series', 4) is None
+    assert cache.get('other', 3) is None
+
+    # a second handle on the same cache sees the frame
+    c2 = frameCache.SharedFrameCache(os.path.basename(cache.filename))
+    assert c2.n_slots == 8
+    assert np.all(c2.get('series', 3) == data)
+
+
+def test_lru_eviction(cache):
+    for i in range(8):
+        cache.put('series', i, np.full(256, i, 'f4')) # one slot each
+
+    # touch frame 0 so that frame 1 is the least recently used
+    assert cache.get('series', 0) is not None
+    cache.put('series', 8, np.full(256, 8, 'f4'))
+
+    assert cache.get('series', 1) is None
+    assert np.all(cache.get('series', 0) == 0)
+    assert np.all(cache.get('series', 8) == 8)
+
+    # a frame spanning several slots
+    big = np.random.rand(3*256).astype('f4')
+    assert cache.put('series', 100, big)
+    assert np.all(cache.get('series', 100) == big)
+    assert cache.stats()['SlotsUsed'] == 8
+
+
+def test_pinned_frames_are_not_evicted(cache):
+    cache.put('series', 0, np.full(256, 0, 'f4'))
+    f = cache.get('series', 0)[:10] # views of the returned frame keep it pinned
+
+    for i in range(1, 20):
+        cache.put('series', i, np.full(256, i, 'f4'))
+
+    assert np.all(f == 0)
+    assert cache.get('series', 0) is not None
+
+    # once released, it can be evicted
+    del f
+    for i in range(20, 40):
+        cache.put('series', i, np.full(256, i, 'f4'))
+    assert cache.get('series', 0) is None
+
+    # nothing fits if everything is pinned
+    held = [cache.get('series', i) for i in range(32, 40)]
+    assert not cache.put('series', 1000, np.zeros(256, 'f4'))
+
+
+class _DataSource(object):
+    def __init__(self):
+        self.calls = 0
+        self.data = np.random.rand(10, 4, 4).astype('f4')
+
+    def getSlice(self, ind):
+        self.calls += 1
+        return self.data[ind]
+
+    def getSliceShape(self):
+        return (4, 4)
+
+
+def test_data_buffer_uses_cache(cache):
+    ds = _DataSource()
+    b1 = buffers.dataBuffer(ds, 2, frameCache=cache, seriesKey='series')
+    b2 = buffers.dataBuffer(ds, 2, frameCache=cache, seriesKey='series')
+
+    for i in range(5):
+        assert np.all(b1.getSlice(i) == ds.data[i])
+
+    for i in range(5):
+        assert np.all(b2.getSlice(i) == ds.data[i])
+
+    assert ds.calls == 5
+
+
+def test_data_buffer_frames_are_read_only(cache):
+    ds = _DataSource()
+    b = buffers.dataBuffer(ds, 2, frameCache=cache, seriesKey='series')
+
+    # a miss (from the data source) and a hit (from the shared cache) should behave the same
+    miss = b._getFromSource(0)
+    hit = b._getFromSource(0)
+    assert ds.calls == 1
+    assert not miss.flags.writeable
+    assert not hit.flags.writeable
+    assert np.all(miss == hit)
+
+    # the data source's own copy is untouched
+    assert ds.data.flags.writeable
+
+
+def test_cache_too_large_for_filesystem():
+    name = 'pyme-frame-cache-test-%s' % uuid.uuid4().hex
+    with pytest.raises(RuntimeError):
+        frameCache.SharedFrameCache(name, size=1 << 60, slot_bytes=1024*1024)
+
+    # we should not have allocated anything
+    fn = os.path.join('/dev/shm' if os.path.isdir('/dev/shm') else frameCache.tempfile.gettempdir(), name)
+    assert os.path.getsize(fn) == 0
+    os.unlink(fn)
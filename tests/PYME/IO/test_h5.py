@@ -94,4 +94,66 @@ def test_h5r():
         assert (np.allclose(data['x'], inp['x']))
     finally:
         shutil.rmtree(tempdir)
-    
\ No newline at end of file
+
+
+
+def test_h5r_table_length():
+    from PYME.IO import h5rFile
+    
+    tempdir = tempfile.mkdtemp()
+    filename = os.path.join(tempdir, 'test_length.h5r')
+    data = np.ones(10, dtype=[('a', '<f4'), ('b', '<f4')])
+    
+    try:
+        with h5rFile.openH5R(filename, 'a') as h5f:
+            assert h5f.getTableLength('FitResults') == 0
+            
+            h5f.appendToTable('FitResults', data)
+            h5f.appendToTable('FitResults', data)
+            h5f.flush()
+            
+            assert h5f.getTableLength('FitResults') == 20
+            
+        h5f.wait_close()
+    finally:
+        shutil.rmtree(tempdir)
+    
+
+def test_h5_aggregate_frames():
+    # mimic aggregate spooling - frames and metadata arriving out of order from several threads
+    import threading
+    import json
+    from PYME.IO import h5File, PZFFormat
+    
+    tempdir = tempfile.mkdtemp()
+    filename = os.path.join(tempdir, 'test_aggregate.h5')
+    
+    frames = [(np.random.rand(32, 32)*1000).astype('uint16') for i in range(200)]
+    
+    def put_frames(inds):
+        with h5File.openH5(filename, 'a') as h5f:
+            for i in inds:
+                h5f.put_file('frame%05d.pzf' % i, PZFFormat.dumps(frames[i], frameNum=i))
+    
+    try:
+        with h5File.openH5(filename, 'a') as h5f:
+            h5f.put_file('metadata.json', json.dumps({'Camera.IntegrationTime': 0.1}).encode())
+        
+        order = np.random.permutation(200)
+        threads = [threading.Thread(target=put_frames, args=(order[j::5],)) for j in range(5)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+            
+        h5f.wait_close()
+        
+        with h5File.openH5(filename, 'r') as h5f:
+            assert h5f.n_frames == 200
+            assert json.loads(h5f.get_file('metadata.json'))['Camera.IntegrationTime'] == 0.1
+            for i in range(200):
+                assert np.all(PZFFormat.loads(h5f.get_frame(i))[0].squeeze() == frames[i])
+        
+        h5f.wait_close()
+    finally:
+        shutil.rmtree(tempdir)
@@ -0,0 +1,75 @@
+import numpy as np
+
+from PYME.IO import MultiFileFormat
+from PYME.IO import buffers
+
+
+FILES = [('frame00000.pzf', b'abc'), ('frame00001.pzf', b''), ('frame00002.pzf', b'x'*1000)]
+
+
+def test_round_trip():
+    files = MultiFileFormat.loads(MultiFileFormat.dumps(FILES))
+
+    assert [(name, bytes(data)) for name, data in files] == FILES
+
+
+def test_missing_files():
+    prefix, offsets = MultiFileFormat.dumps_header(['a', 'b', 'c'], [2, -1, 3])
+    assert len(prefix) % 8 == 0
+    assert list(offsets - len(prefix)) == [0, 2, 2]
+
+    files = MultiFileFormat.loads(prefix + b'aaccc')
+    assert files[1] == ('b', None)
+    assert bytes(files[2][1]) == b'ccc'
+
+    try:
+        MultiFileFormat.loads(prefix + b'aac')
+        assert False, 'truncated message should raise'
+    except RuntimeError:
+        pass
+
+
+def test_batch_files():
+    from PYME.IO import clusterIO
+
+    files = [('series/' + name, data) for name, data in FILES] + [('other/single.txt', b'y')]
+    files += [('__aggregate_h5/series/frame%05d.pzf' % i, b'z') for i in range(3)]
+    batches = clusterIO._batch_files(files)
+
+    # files sharing a directory are batched, single files and special (__ prefixed) paths are sent individually
+    assert [name for name, data in batches] == ['__aggregate_h5/series/frame%05d.pzf' % i for i in range(3)] + \
+                                               ['__multiput/series', 'other/single.txt']
+    assert [(name, bytes(data)) for name, data in MultiFileFormat.loads(batches[3][1])] == FILES
+
+
+class _DataSource(object):
+    def __init__(self):
+        self.calls = []
+        self.data = np.arange(20*4*5).reshape(20, 4, 5)
+
+    def getSlice(self, ind):
+        self.calls.append([ind])
+        return self.data[ind]
+
+    def getSliceShape(self):
+        return (4, 5)
+
+    def getNumSlices(self):
+        return 20
+
+    def getSlices(self, indices):
+        self.calls.append(list(indices))
+        return self.data[indices]
+
+
+def test_background_buffer_batches_fetches():
+    ds = _DataSource()
+    bb = buffers.backgroundBuffer(buffers.dataBuffer(ds, 4))
+
+    bg = bb.getBackground(range(0, 10))
+    assert np.allclose(bg, ds.data[:10].mean(0))
+    assert len(ds.calls) == 1 and sorted(ds.calls[0]) == list(range(10))
+
+    # frames past the end of the series are dropped
+    bg = bb.getBackground(range(15, 25))
+    assert np.allclose(bg, ds.data[15:].mean(0))
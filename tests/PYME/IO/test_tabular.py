@@ -0,0 +1,450 @@
+import numpy as np
+import pytest
+
+from PYME.IO import tabular
+
+
+def _source(n=10000):
+    rng = np.random.RandomState(42)
+    rec = np.zeros(n, [('x', 'f4'), ('y', 'f8'), ('t', 'i4'), ('A', 'u2')])
+    for k in rec.dtype.names:
+        rec[k] = rng.uniform(0, 1000, n)
+    rec['y'][::7] = np.nan
+
+    return rec, tabular.RecArraySource(rec)
+
+
+RANGES = {'x': [100, 800.5], 'y': (0, 900), 't': [-0.5, 500.5], 'A': [10, 999]}
+
+
+@pytest.fixture(params=['native', 'numpy'])
+def range_impl(request, monkeypatch):
+    if request.param == 'numpy':
+        monkeypatch.setattr(tabular, '_rangeFilter', None)
+    elif tabular._rangeFilter is None:
+        pytest.skip('native range filter not built')
+
+    # use small blocks/thread chunks so that we exercise the splitting
+    monkeypatch.setattr(tabular, '_MIN_ROWS_PER_THREAD', 1000)
+    monkeypatch.setattr(tabular, '_FILTER_BLOCK_SIZE', 1000)
+
+
+def test_range_selection(range_impl):
+    rec, src = _source()
+
+    expected = np.ones(len(rec), dtype=bool)
+    for k, (lo, hi) in RANGES.items():
+        expected &= (rec[k] > lo) & (rec[k] < hi)
+
+    assert np.array_equal(tabular.range_selection(src, RANGES, nThreads=4), np.flatnonzero(expected))
+    assert np.array_equal(tabular.range_selection(src, {}), np.arange(len(rec)))
+
+    with pytest.raises(KeyError):
+        tabular.range_selection(src, {'z': [0, 1]})
+
+
+def test_range_selection_thread_error(monkeypatch):
+    def _range_filter(columns, lo, hi, start, end):
+        raise RuntimeError('filter failed')
+
+    monkeypatch.setattr(tabular, '_rangeFilter', type('', (), {'range_filter': staticmethod(_range_filter)}))
+    monkeypatch.setattr(tabular, '_MIN_ROWS_PER_THREAD', 1000)
+    rec, src = _source()
+
+    # an error in one of the worker threads should be raised in the caller, not silently dropped
+    with pytest.raises(RuntimeError):
+        tabular.range_selection(src, RANGES, nThreads=4)
+
+
+def test_results_filter(range_impl):
+    rec, src = _source()
+    expected = (rec['x'] > 100) & (rec['x'] < 800.5) & (rec['y'] > 0) & (rec['y'] < 900)
+
+    f = tabular.ResultsFilter(src, x=[100, 800.5], y=[0, 900])
+    assert len(f) == expected.sum()
+    assert np.array_equal(f['t'], rec['t'][expected])
+    assert np.array_equal(f['t', 5:10], rec['t'][expected][5:10])
+    # a boolean index is still available
+    assert np.array_equal(f.Index, expected)
+
+    cf = tabular.CachingResultsFilter(src, x=[100, 800.5], y=[0, 900])
+    assert len(cf) == expected.sum()
+    assert np.array_equal(cf['A'], rec['A'][expected])
+    assert np.array_equal(cf.Index, expected)
+
+
+def test_selection_filter():
+    rec, src = _source(100)
+    mask = rec['x'] > 500
+
+    f = tabular.SelectionFilter(src, mask)
+    assert np.array_equal(f.Index, mask)
+    assert np.array_equal(f.selection, np.flatnonzero(mask))
+    assert np.array_equal(f['x'], rec['x'][mask])
+    assert len(f) == mask.sum()
+
+
+@pytest.fixture
+def mapped(monkeypatch):
+    # small chunks, so that we exercise chunked evaluation
+    monkeypatch.setattr(tabular, '_MAPPING_CHUNK_SIZE', 1000)
+
+    rng = np.random.RandomState(0)
+    data = np.zeros(10000, [('x', 'f8'), ('y', 'f8'), ('t', 'i8')])
+    data['x'] = rng.uniform(0, 100, 10000)
+    data['y'] = rng.uniform(0, 100, 10000)
+    data['t'] = np.arange(10000)
+    # a versioned source, so that mapping results are memoised
+    src = tabular.FitResultsSource(data, sort=False)
+
+    return src, tabular.MappingFilter(src, x='x + a*t', xd='x + a*t', r='sqrt(xd**2 + y**2)', c='cumsum(y)',
+                                      k='2*a')
+
+
+def test_mapping_evaluation(mapped):
+    src, m = mapped
+    m.addVariable('a', 0.5)
+
+    x = src['x'] + 0.5*src['t']
+    assert np.allclose(m['x'], x)
+    assert np.allclose(m['x', 10:20], x[10:20])
+    # columns of the source take precedence over mappings with the same name
+    assert np.allclose(m['xd'], x)
+    assert np.allclose(m['r'], np.sqrt(x**2 + src['y']**2))
+    # non element-wise mappings are evaluated over the whole column
+    assert not tabular._elementwise_mappings[m.mappings['c']]
+    assert np.allclose(m['c'], np.cumsum(src['y']))
+    # constant mappings
+    assert m['k'] == 1.0
+
+
+def _count_evaluations(monkeypatch):
+    calls = []
+    eval_mapping = tabular.MappingFilter._eval_mapping
+
+    def _eval(self, code, local_vars):
+        calls.append(code)
+        return eval_mapping(self, code, local_vars)
+
+    monkeypatch.setattr(tabular.MappingFilter, '_eval_mapping', _eval)
+    return calls
+
+
+def test_mapping_memoisation(mapped, monkeypatch):
+    src, m = mapped
+    m.addVariable('a', 0.5)
+    calls = _count_evaluations(monkeypatch)
+
+    r = m['r']
+    assert len(calls) == 2 # r and xd
+    assert np.allclose(m['r'], r)
+    assert len(calls) == 2
+
+    # memoised results are shared, so are read-only
+    with pytest.raises(ValueError):
+        r[0] = 1
+    # ... including mappings which just return a source column
+    m.setMapping('xs', 'x')
+    with pytest.raises(ValueError):
+        m['xs'][0] = 1
+    assert src['x'].flags.writeable
+
+    # changing a variable invalidates the mappings which depend on it (directly or indirectly)
+    m.addVariable('a', 2)
+    assert np.allclose(m['r'], np.sqrt((src['x'] + 2*src['t'])**2 + src['y']**2))
+
+    # as does changing a mapping
+    m.setMapping('xd', '3*x')
+    assert np.allclose(m['r'], np.sqrt((3*src['x'])**2 + src['y']**2))
+
+    m.setMapping('p', 'q + 1')
+    m.setMapping('q', 'p*2')
+    with pytest.raises(RuntimeError):
+        m['p']
+
+
+def test_mapping_memoisation_through_filters(mapped, monkeypatch):
+    src, m = mapped
+    calls = _count_evaluations(monkeypatch)
+
+    # filters return new arrays each time a column is accessed, but results are still memoised
+    sel = tabular.SelectionFilter(src, np.arange(0, len(src), 2))
+    m2 = tabular.MappingFilter(sel, x2='x*2')
+    assert np.allclose(m2['x2'], 2*src['x'][::2])
+    assert np.allclose(m2['x2'], 2*src['x'][::2])
+    assert len(calls) == 1
+
+    # changing the selection invalidates the result
+    sel.Index = np.arange(1, len(src), 2)
+    assert np.allclose(m2['x2'], 2*src['x'][1::2])
+    assert len(calls) == 2
+
+    # modifying a column in place needs an explicit mark_changed()
+    src['x'][:] += 1
+    src.mark_changed()
+    assert np.allclose(m2['x2'], 2*src['x'][1::2])
+    assert len(calls) == 3
+
+
+def test_mapping_memoisation_replaced_source(mapped, monkeypatch):
+    src, m = mapped
+    calls = _count_evaluations(monkeypatch)
+    
+    # as in the pipeline when the filter settings change - the new filter might re-use the address of the old one
+    m2 = tabular.MappingFilter(tabular.ResultsFilter(src, x=[0, 50]), x2='x*2')
+    assert np.all(m2['x2'] <= 100)
+    
+    for i in range(10):
+        m2.resultsSource = None
+        m2.resultsSource = tabular.ResultsFilter(src, x=[50 + i, 100])
+        assert np.all(m2['x2'] >= 100 + 2*i)
+        
+    assert len(calls) == 11
+    
+
+def test_mapping_memoisation_constants(mapped, monkeypatch):
+    src, m = mapped
+    calls = _count_evaluations(monkeypatch)
+    
+    m.b = 1
+    m.setMapping('xb', 'x + b')
+    assert np.allclose(m['xb'], src['x'] + 1)
+    assert np.allclose(m['xb'], src['x'] + 1)
+    assert len(calls) == 1
+    
+    # constants set by plain assignment (without setMapping) are picked up
+    m.b = 2
+    assert np.allclose(m['xb'], src['x'] + 2)
+    assert len(calls) == 2
+    
+    # ... including arrays
+    m.b = np.ones(len(src))
+    assert np.allclose(m['xb'], src['x'] + 1)
+    m.b = 2*np.ones(len(src))
+    assert np.allclose(m['xb'], src['x'] + 2)
+    assert len(calls) == 4
+
+
+def test_mapping_unversioned_source(monkeypatch):
+    calls = _count_evaluations(monkeypatch)
+    
+    # columns of a DictSource can be changed without it knowing, so mappings on it are not memoised
+    d = {'x': np.arange(10.)}
+    m = tabular.MappingFilter(tabular.DictSource(d), x2='x*2')
+    assert np.allclose(m['x2'], 2*np.arange(10.))
+    d['x'] = np.arange(10.) + 1
+    assert np.allclose(m['x2'], 2*(np.arange(10.) + 1))
+    assert len(calls) == 2
+
+
+def test_mapping_cache_is_bounded(mapped, monkeypatch):
+    src, m = mapped
+    cache = tabular._MappingCache()
+    cache._max_bytes = 3*src['x'].nbytes
+    monkeypatch.setattr(tabular, '_mapping_cache', cache)
+
+    # the budget is shared between filters
+    filters = [tabular.MappingFilter(src, x2='x*2') for i in range(5)]
+    for f in filters:
+        f['x2']
+
+    assert len(cache._results) == 3
+    assert cache._nbytes == 3*src['x'].nbytes
+
+    # results are dropped when their filter goes away
+    del f, filters
+    import gc
+    gc.collect()
+    assert len(cache._results) == 0
+    assert cache._nbytes == 0
+
+
+def _fit_results(n, rng):
+    fr = np.zeros(n, [('tIndex', 'i4'), ('fitResults', [('x0', 'f4'), ('y0', 'f4')]), ('fitError', [('x0', 'f4')])])
+    fr['tIndex'] = np.sort(rng.randint(0, 1000, n))
+    fr['fitResults']['x0'] = rng.uniform(0, 1000, n)
+    fr['fitResults']['y0'] = rng.uniform(0, 1000, n)
+    fr['fitError']['x0'] = rng.uniform(0, 50, n)
+    fr['fitError']['x0'][::13] = np.nan
+    return fr
+
+
+def test_fit_results_source_deprecated_name():
+    fr = _fit_results(100, np.random.RandomState(3))
+
+    with pytest.warns(tabular.VisibleDeprecationWarning):
+        src = tabular.fitResultsSource(fr)
+
+    assert isinstance(src, tabular.FitResultsSource)
+    assert np.array_equal(src['x'], fr['fitResults']['x0'])
+
+
+def test_zone_map_filtering(range_impl, monkeypatch):
+    monkeypatch.setattr(tabular.ZoneMap, 'block_size', 100)
+    fr = _fit_results(10000, np.random.RandomState(1))
+    src = tabular.FitResultsSource(fr)
+    # zone maps are used through mapping filters for keys which aren't re-mapped
+    m = tabular.MappingFilter(src, x2='2*x')
+
+    for ranges in [{'t': (100, 200)}, {'t': (-1, 2000)}, {'t': (100, 200), 'x': (10, 500), 'error_x': (0, 30)},
+                   {'x2': (0, 100), 't': (500, 600)}, {'t': (100.5, 100.7)}]:
+        expected = np.ones(len(fr), dtype=bool)
+        for k, (lo, hi) in ranges.items():
+            expected &= (m[k] > lo) & (m[k] < hi)
+
+        assert np.array_equal(tabular.range_selection(m, ranges), np.flatnonzero(expected))
+
+    # only the blocks which straddle the time window need testing
+    segments = tabular._candidate_segments(m, ['t'], np.array([100.]), np.array([200.]), len(fr))
+    assert sum([end - start for start, end, test in segments if test]) <= 200
+
+
+def test_zone_map_append(monkeypatch):
+    monkeypatch.setattr(tabular.ZoneMap, 'block_size', 100)
+    fr = _fit_results(1000, np.random.RandomState(2))
+
+    src = tabular.FitResultsSource(fr[:550].copy())
+    zm = src.zone_map
+    zm.block_stats('t')
+    zm.block_stats('error_x')
+
+    src.appendResults(fr[550:])
+    assert src.zone_map is zm
+    for k in ['t', 'error_x']:
+        for a, b in zip(zm.block_stats(k), tabular.ZoneMap(src).block_stats(k)):
+            assert np.array_equal(a, b)
+
+    # results which are interleaved with the existing ones force a re-sort
+    src.appendResults(fr[:10])
+    assert src.zone_map is not zm
+    assert np.all(np.diff(src['t']) >= 0)
+
+
+def test_chunked_column():
+    segments = [np.arange(5), np.arange(5, 12), np.arange(12, 20)]
+    col = tabular.ChunkedColumn(segments)
+    a = np.arange(20)
+
+    assert len(col) == 20
+    assert np.array_equal(np.asarray(col), a)
+    # slices within a segment are (read-only) views
+    assert np.shares_memory(col[6:10], segments[1])
+    with pytest.raises(ValueError):
+        col[6:10][0] = 100
+    assert segments[1].flags.writeable
+    # as is the whole column if there is only one segment
+    with pytest.raises(ValueError):
+        tabular.ChunkedColumn(segments[:1]).to_array()[0] = 100
+    assert np.array_equal(segments[0], np.arange(5))
+    assert np.array_equal(col[3:15], a[3:15])
+    assert np.array_equal(col[::3], a[::3])
+    assert col[7] == 7 and col[-1] == 19
+
+    idx = np.array([19, 0, 7, 7, 12])
+    assert np.array_equal(col[idx], a[idx])
+    assert np.array_equal(col[np.sort(idx)], a[np.sort(idx)])
+    assert np.array_equal(col[a % 3 == 0], a[a % 3 == 0])
+
+    assert np.array_equal(col[np.array([-20, -1, 3])], a[[-20, -1, 3]])
+
+    # out of bounds indices, sorted or not, and negative or not
+    for idx in [[20], [-21, 3], [0, 21], [3, -25, 0]]:
+        with pytest.raises(IndexError):
+            col[np.array(idx)]
+
+
+def test_concatenate_filter(range_impl):
+    rng = np.random.RandomState(3)
+    sources = [tabular.FitResultsSource(_fit_results(n, rng)) for n in [1000, 500, 2000]]
+    c = tabular.ConcatenateFilter(*sources)
+
+    x = np.concatenate([s['x'] for s in sources])
+    t = np.concatenate([s['t'] for s in sources])
+    cs = np.repeat([0., 1., 2.], [1000, 500, 2000])
+
+    assert len(c) == 3500
+    assert np.array_equal(c['x'], x)
+    assert np.array_equal(c['concatSource'], cs)
+    assert np.array_equal(c['x', 990:1010], x[990:1010])
+
+    # filtering works through the sources individually, and only gathers the selected rows
+    m = tabular.MappingFilter(c, xs='2*x + concatSource')
+    f = tabular.ResultsFilter(m, t=(100, 500), x=(10, 600), concatSource=(0.5, 3))
+    expected = (t > 100) & (t < 500) & (x > 10) & (x < 600) & (cs > 0.5)
+    assert np.array_equal(f['x'], x[expected])
+    assert np.allclose(f['xs'], (2*x + cs)[expected])
+
+    # nested concatenations are flattened
+    c2 = tabular.ConcatenateFilter(c, sources[0])
+    assert len(c2.column('x').segments) == 4
+    assert np.array_equal(c2['concatSource'], np.repeat([0., 1.], [3500, 1000]))
+
+
+@pytest.fixture(params=['native', 'numpy'])
+def id_impl(request, monkeypatch):
+    if request.param == 'numpy':
+        monkeypatch.setattr(tabular, '_idFilter', None)
+    elif tabular._idFilter is None:
+        pytest.skip('native id filter not built')
+
+    monkeypatch.setattr(tabular, '_MIN_ROWS_PER_THREAD', 1000)
+
+
+# compact ids (dense tables), sparse ids (hashed), and repeated ids
+@pytest.mark.parametrize('ids', [[5, 17, 3, 999], [-2**40, 7, 2**50, 123456789], [3, 3, 8, 3]])
+def test_id_filter(id_impl, ids):
+    rec, src = _source()
+    ids = np.array(ids)
+    clump = np.random.RandomState(1).choice(np.concatenate([ids, np.arange(20)]), len(rec))
+    src = tabular.MappingFilter(src)
+    src.addColumn('clumpIndex', clump)
+    src.addColumn('clumpIndexF', clump.astype('f8') + (np.arange(len(rec)) % 5 == 0)*0.5)
+
+    expected = np.isin(clump, ids)
+    f = tabular.IdFilter(src, id_column='clumpIndex', valid_ids=ids)
+    assert np.array_equal(f.selection, np.flatnonzero(expected))
+    assert np.array_equal(f['x'], rec['x'][expected])
+
+    # floating point ids only match if they are integers
+    f = tabular.IdFilter(src, id_column='clumpIndexF', valid_ids=ids.astype('f8'))
+    assert np.array_equal(f.Index, expected & (np.arange(len(rec)) % 5 != 0))
+
+    # join - the position (first occurrence) of each row's id in ids
+    idx = tabular.id_lookup(clump, ids, nThreads=3)
+    first = {}
+    for j, i in enumerate(ids.tolist()):
+        first.setdefault(i, j)
+    assert np.array_equal(idx, [first.get(c, -1) for c in clump.tolist()])
+
+    assert len(tabular.id_selection(clump, [])) == 0
+
+
+def test_id_selection_thread_error(monkeypatch):
+    def _id_filter(column, ids, start, end):
+        raise RuntimeError('filter failed')
+
+    monkeypatch.setattr(tabular, '_idFilter', type('', (), {'id_filter': staticmethod(_id_filter),
+                                                            'id_table': staticmethod(lambda ids, membership_only=0: ids)}))
+    monkeypatch.setattr(tabular, '_MIN_ROWS_PER_THREAD', 1000)
+
+    with pytest.raises(RuntimeError):
+        tabular.id_selection(np.arange(10000), [5, 17], nThreads=4)
+
+
+def test_id_table():
+    if tabular._idFilter is None:
+        pytest.skip('native id filter not built')
+
+    column = np.arange(100) % 10
+    ids = np.array([3, 7, 3])
+
+    # a table built once can be used in place of the ids
+    table = tabular._idFilter.id_table(ids)
+    assert np.array_equal(tabular._idFilter.id_filter(column, table), np.flatnonzero(np.isin(column, ids)))
+    assert np.array_equal(tabular._idFilter.id_index(column, table, 20, 30), [-1, -1, -1, 0, -1, -1, -1, 1, -1, -1])
+
+    # a membership only table has no positions
+    table = tabular._idFilter.id_table(ids, membership_only=1)
+    assert np.array_equal(tabular._idFilter.id_filter(column, table), np.flatnonzero(np.isin(column, ids)))
+    with pytest.raises(RuntimeError):
+        tabular._idFilter.id_index(column, table)
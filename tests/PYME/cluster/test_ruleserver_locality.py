@@ -0,0 +1,42 @@
+import numpy as np
+import time
+
+from PYME.cluster import ruleserver
+
+TEMPLATE = '''{"id" : "{{ruleID}}~{{taskID}}", "type" : "localization",
+ "taskdef" : {"frameIndex" : {{taskID}}, "metadata" : "PYME-CLUSTER://TEST/series/metadata.json"},
+ "inputs" : {"frames" : "PYME-CLUSTER://TEST/series.pcs"},
+ "outputs" : {"fitResults" : "PYME-CLUSTER://TEST/__aggregate_h5r/analysis.h5r/FitResults"}}'''
+
+
+def _bid(rule, ids, **kwargs):
+    return rule.bid({'ruleID': rule.ruleID, 'taskIDs': ids, 'costs': [1.0]*len(ids)}, **kwargs)['taskIDs']
+
+
+def test_in_ranges():
+    ranges = [[0, 10], [20, 30]]
+    assert list(ruleserver.in_ranges(np.array([-1, 0, 9, 10, 19, 20, 29, 30]), ranges)) == \
+           [False, True, True, False, False, True, True, False]
+    assert not np.any(ruleserver.in_ranges(np.arange(5), []))
+
+
+def test_locality_aware_bids():
+    rule = ruleserver.IntegerIDRule('rule0', TEMPLATE, max_task_ID=100)
+    assert rule.series == 'PYME-CLUSTER://TEST/series.pcs'
+    rule.make_range_available(0, 100)
+
+    locality = {'nodeA': np.array([[0, 50]]), 'nodeB': np.array([[50, 100]])}
+
+    # a busy node only gets tasks which are local to it, or not local to anyone
+    assert _bid(rule, [0, 1, 60, 61], nodeID='nodeA', idle=False, locality=locality) == [0, 1]
+
+    # an idle node can steal
+    assert _bid(rule, [60, 2], nodeID='nodeC', idle=True, locality=locality) == [60, 2]
+    assert rule.nStolen == 2 and rule.nLocal == 2
+
+    # once tasks have been held for a while, anyone can take them
+    rule._task_info['available_at'][70] -= ruleserver.STEAL_DELAY + 1
+    assert _bid(rule, [70, 71], nodeID='nodeA', idle=False, locality=locality) == [70]
+
+    # without locality information, the first bidder wins
+    assert _bid(rule, [71, 72], nodeID='nodeA', idle=False) == [71, 72]
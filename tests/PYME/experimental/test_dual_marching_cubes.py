@@ -0,0 +1,72 @@
+import numpy as np
+
+
+def _shell_octree():
+    from PYME.experimental import _octree as octree
+    
+    np.random.seed(7)
+    v = np.random.randn(5000, 3)
+    v /= np.linalg.norm(v, axis=1)[:, None]
+    pts = (500*v + 20*np.random.randn(5000, 3)).astype('f4')
+    
+    ot = octree.Octree([-1000, 1000, -1000, 1000, -1000, 1000], maxdepth=7)
+    ot.add_points(pts)
+    
+    return ot.truncate_at_n_points(10)
+
+
+def _triangle_keys(tris):
+    return [tuple(sorted(map(tuple, t))) for t in np.round(tris.astype('f4'), 2)]
+
+
+def _triangle_set(tris):
+    return set(_triangle_keys(tris))
+
+
+def test_march_octree_matches_python():
+    from PYME.experimental import dual_marching_cubes
+    
+    ot = _shell_octree()
+    isolevel = 2e-6
+    
+    dmc = dual_marching_cubes.PiecewiseDualMarchingCubes(isolevel)
+    dmc.set_octree(ot)
+    tris = dmc.march(dual_march=False)
+    tris = np.stack([tris['vertex0'], tris['vertex1'], tris['vertex2']], 1)
+    
+    vertices, faces = dual_marching_cubes.march_octree(ot, isolevel, nThreads=4)
+    
+    # vertices should be shared between faces
+    assert len(vertices) == len(np.unique(vertices, axis=0))
+    assert _triangle_set(vertices[faces]) == _triangle_set(tris)
+    
+    # same winding as the python implementation
+    def _normals(t):
+        n = np.cross(t[:, 2] - t[:, 1], t[:, 0] - t[:, 1])
+        return dict(zip(_triangle_keys(t), n))
+    
+    n_native, n_python = _normals(vertices[faces]), _normals(tris.astype('f8'))
+    assert all(np.dot(n_native[k], n_python[k]) > 0 for k in n_native)
+
+def test_march_octree_threads():
+    from PYME.experimental import dual_marching_cubes
+    
+    ot = _shell_octree()
+    v1, f1 = dual_marching_cubes.march_octree(ot, 2e-6, nThreads=1)
+    v4, f4 = dual_marching_cubes.march_octree(ot, 2e-6, nThreads=4)
+    
+    assert v1.shape == v4.shape
+    assert _triangle_set(v1[f1]) == _triangle_set(v4[f4])
+
+
+def test_march_octree_raises_worker_errors(monkeypatch):
+    import pytest
+    from PYME.experimental import dual_marching_cubes, dual_marching_cubes_utils
+    
+    def _fail(*args, **kwargs):
+        raise RuntimeError('march failed')
+    
+    monkeypatch.setattr(dual_marching_cubes_utils, 'marchTasks', _fail)
+    
+    with pytest.raises(RuntimeError, match='march failed'):
+        dual_marching_cubes.march_octree(_shell_octree(), 2e-6, nThreads=4)
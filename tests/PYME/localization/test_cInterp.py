@@ -0,0 +1,76 @@
+import numpy as np
+import threading
+
+from PYME.localization import cInterp
+
+
+def _emitters(n=2000, seed=0):
+    rng = np.random.RandomState(seed)
+    x = (rng.rand(n) * 300 * 70 - 1000).astype('f')
+    y = (rng.rand(n) * 250 * 70).astype('f')
+    z = (rng.rand(n) * 1600 - 800).astype('f')
+    A = (rng.rand(n) * 100).astype('f')
+    nx = np.minimum(8 + np.abs(z) * (2.5 / 70.), 140).astype('i')
+    return x, y, z, A, nx
+
+
+def _render_tiles(models, shape, x, y, z, A, nx, chan, nThreads, tileSize=32):
+    im = np.zeros(shape, 'f')
+    tileStarts, tileIdx = cInterp.TileBins(x, y, nx, shape[0], shape[1], 70., 70., tileSize)
+    bounds = np.linspace(0, len(tileStarts) - 1, nThreads + 1).astype('i')
+    threads = [threading.Thread(target=cInterp.InterpolateTiles,
+                                args=(models, im, x, y, z, A, nx, chan, tileStarts, tileIdx, 70., 70., 50., tileSize,
+                                      bounds[i], bounds[i + 1])) for i in range(nThreads)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    return im
+
+
+def test_InterpolateTiles_matches_InterpolateInplaceM():
+    mod = np.random.RandomState(1).rand(300, 300, 40).astype('f')
+    x, y, z, A, nx = _emitters()
+
+    ref = np.zeros((256, 240), 'f')
+    cInterp.InterpolateInplaceM(mod, ref, x, y, z, A, nx, 70., 70., 50.)
+
+    im = _render_tiles([mod, ], ref.shape, x, y, z, A, nx, np.zeros(len(x), 'i'), 4)
+
+    # emitters are added to each pixel in the same order, so the result should be identical
+    assert np.all(im == ref)
+
+
+def test_InterpolateTiles_reproducible():
+    rng = np.random.RandomState(2)
+    models = [rng.rand(300, 300, 40).astype('f') for i in range(2)]
+    x, y, z, A, nx = _emitters()
+    chan = (rng.rand(len(x)) > .5).astype('i')
+
+    ref = np.zeros((256, 240), 'f')
+    for c, mod in enumerate(models):
+        m = chan == c
+        cInterp.InterpolateInplaceM(mod, ref, x[m], y[m], z[m], A[m], nx[m], 70., 70., 50.)
+
+    ims = [_render_tiles(models, ref.shape, x, y, z, A, nx, chan, nThreads) for nThreads in [1, 3, 8]]
+
+    assert np.allclose(ims[0], ref, rtol=1e-5)
+    for im in ims[1:]:
+        assert np.all(im == ims[0])
+
+
+def test_InterpolateTiles_per_channel_shapes():
+    rng = np.random.RandomState(3)
+    models = [rng.rand(300, 300, 40).astype('f'), rng.rand(320, 310, 30).astype('f')]
+    x, y, z, A, nx = _emitters()
+    chan = (rng.rand(len(x)) > .5).astype('i')
+
+    ref = np.zeros((256, 240), 'f')
+    for c, mod in enumerate(models):
+        m = chan == c
+        cInterp.InterpolateInplaceM(mod, ref, x[m], y[m], z[m], A[m], nx[m], 70., 70., 50.)
+
+    im = _render_tiles(models, ref.shape, x, y, z, A, nx, chan, 3)
+
+    assert np.allclose(im, ref, rtol=1e-5)
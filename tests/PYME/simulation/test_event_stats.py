@@ -0,0 +1,68 @@
+import numpy as np
+
+
+def _count_events(trace, threshold):
+    # the python reference implementation from ChemDE/threeState.py
+    nEvents = 0
+    lastObs = -1e9
+
+    for i in range(len(trace)):
+        if trace[i]:
+            if (i - lastObs) >= threshold:
+                nEvents += 1
+            lastObs = i
+    return nEvents
+
+
+def _dwell_hist(trace, value, nBins):
+    # lengths of the runs of `value`, excluding those truncated by the start or end of the trace
+    hist = np.zeros(nBins, 'i')
+    edges = np.flatnonzero(np.diff(trace)) + 1
+    for start, end in zip(edges[:-1], edges[1:]):
+        if trace[start] == value:
+            hist[min(end - start, nBins) - 1] += 1
+    return hist
+
+
+def _blinking_traces(n_traces, n_frames, seed=42):
+    # two state (on/off) markov chains, with a mix of short and long off times
+    rng = np.random.RandomState(seed)
+    traces = np.zeros([n_traces, n_frames], 'i')
+    for i in range(n_traces):
+        p_on, p_off = rng.uniform(0.001, 0.2), rng.uniform(0.05, 0.8)
+        state = 0
+        for j in range(n_frames):
+            state = int(rng.rand() < p_on) if state == 0 else int(rng.rand() > p_off)
+            traces[i, j] = state
+    return traces
+
+
+def test_count_events_batch_matches_python():
+    from PYME.simulation.ChemDE.eventStats import countEventsBatch
+    traces = _blinking_traces(20, 3000)
+    # include the trace ends (and a trace which is all off)
+    traces[0, :] = 0
+    traces[1, 0] = traces[1, -1] = 1
+    thresholds = np.hstack([np.arange(1, 70), [100, 1000.5, 5000]])
+    
+    counts, onHist, offHist = countEventsBatch(traces, thresholds, nBins=30, nThreads=3)
+    
+    for i, tr in enumerate(traces):
+        assert list(counts[i]) == [_count_events(tr, int(t)) for t in thresholds]
+        np.testing.assert_array_equal(onHist[i], _dwell_hist(tr, 1, 30))
+        np.testing.assert_array_equal(offHist[i], _dwell_hist(tr, 0, 30))
+    
+    # single traces
+    c, on, off = countEventsBatch(traces[5].astype(bool), [1, 10], nBins=30)
+    assert list(c) == [_count_events(traces[5], 1), _count_events(traces[5], 10)]
+
+
+def test_count_events_batch_huge_threshold():
+    from PYME.simulation.ChemDE.eventStats import countEventsBatch
+    traces = _blinking_traces(4, 500)
+    
+    # must neither overflow nor try to allocate a histogram of the gaps up to the threshold
+    counts, _, _ = countEventsBatch(traces, [1, 2**31 - 1, 1e12], nBins=10, nThreads=2)
+    
+    for i, tr in enumerate(traces):
+        assert list(counts[i]) == [_count_events(tr, 1), 0, 0]
@@ -0,0 +1,28 @@
+import numpy as np
+import pytest
+
+from PYME.util.threaded import run_threaded
+
+
+def test_run_threaded_fills_all_ranges():
+    out = np.zeros(100)
+    bounds = np.linspace(0, 100, 5).astype('i')
+
+    def _fill(start, end):
+        out[start:end] = np.arange(start, end)
+
+    run_threaded(_fill, list(zip(bounds[:-1], bounds[1:])))
+
+    np.testing.assert_array_equal(out, np.arange(100))
+
+
+def test_run_threaded_reraises():
+    def _fail(i):
+        if i == 2:
+            raise ValueError('bad range')
+
+    with pytest.raises(ValueError):
+        run_threaded(_fail, range(4))
+
+    with pytest.raises(ValueError):
+        run_threaded(_fail, [2])